@@ -1,21 +1,79 @@
 #ifndef MESSAGEUTILS_H
 #define MESSAGEUTILS_H
 
-/* from http://stackoverflow.com/questions/10394951/parsing-data-into-struct */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* from http://stackoverflow.com/questions/10394951/parsing-data-into-struct,
+ * memcpy'ed as the fields are not aligned.
+ */
 template<typename T>
 void read_and_update_offset (size_t & offset, const char * buffer, T & var)
 {
-	T * pInt = (T*)(buffer + offset);
-	var = *pInt;
+	memcpy(&var, buffer + offset, sizeof(T));
 	offset += sizeof(T);
 }
 
 template<typename T>
 void write_and_update_offset (size_t & offset, char * buffer, const T & var)
 {
-	T * pInt = (T*)(buffer + offset);
-	*pInt = var;
+	memcpy(buffer + offset, &var, sizeof(T));
 	offset += sizeof(T);
 }
 
+/* LEB128 varints: 7 bits per byte, least significant first, up to 10 bytes.
+ * Both return false, leaving offset untouched, if the buffer is too short.
+ */
+#define VARINT_MAX_SIZE 10
+
+static inline bool write_varint_and_update_offset (size_t & offset, char * buffer,
+						   size_t size, uint64_t var)
+{
+	size_t o = offset;
+
+	do {
+		if (o >= size)
+			return false;
+		uint8_t byte = var & 0x7f;
+		var >>= 7;
+		buffer[o++] = byte | (var ? 0x80 : 0);
+	} while (var);
+
+	offset = o;
+	return true;
+}
+
+static inline bool read_varint_and_update_offset (size_t & offset, const char * buffer,
+						  size_t size, uint64_t & var)
+{
+	size_t o = offset;
+	uint64_t v = 0;
+
+	for (int shift = 0; shift < 70; shift += 7) {
+		if (o >= size)
+			return false;
+		uint8_t byte = buffer[o++];
+		v |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			var = v;
+			offset = o;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* signed values as varints, small in magnitude = short */
+static inline uint64_t zigzag_encode (int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t zigzag_decode (uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
 #endif
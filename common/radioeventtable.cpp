@@ -3,6 +3,8 @@
 #include "message_utils.h"
 
 #include <inttypes.h>
+#include <stdlib.h>
+#include <algorithm>
 
 bool RadioEventTable::fuzzyCompare(uint32_t a, uint32_t b, int32_t maxError)
 {
@@ -15,40 +17,122 @@ bool RadioEventTable::fuzzyCompare(uint32_t a, uint32_t b, int32_t maxError)
 	return ret;
 }
 
-RetEntry * RadioEventTable::findMatchInActiveCommunications(uint32_t frequencyStart,
-				      uint32_t frequencyEnd,
-				      int8_t pwr)
+uint32_t RadioEventTable::centralFreq(const RetEntry *entry)
+{
+	uint32_t width = entry->frequencyEnd() - entry->frequencyStart();
+	return entry->frequencyStart() + width / 2;
+}
+
+static bool activeComLess(const RadioEventTable::ActiveCom &com, uint32_t freq)
+{
+	return com.centralFreq < freq;
+}
+
+static bool activeComOrder(const RadioEventTable::ActiveCom &a,
+			   const RadioEventTable::ActiveCom &b)
+{
+	return a.centralFreq < b.centralFreq;
+}
+
+static bool timeEndOrder(const RadioEventTable::ActiveCom &a,
+			 const RadioEventTable::ActiveCom &b)
+{
+	return a.entry->timeEnd() < b.entry->timeEnd();
+}
+
+RadioEventTable::ActiveComs::iterator RadioEventTable::findActive(const RetEntry *entry)
+{
+	ActiveComs::iterator it;
+
+	/* the index still holds the central frequency the entry had */
+	it = std::lower_bound(_activeComs.begin(), _activeComs.end(),
+			      centralFreq(entry), activeComLess);
+	for (; it != _activeComs.end() && it->centralFreq == centralFreq(entry); ++it) {
+		if (it->entry.get() == entry)
+			return it;
+	}
+
+	/* the entry has been modified behind our back */
+	for (it = _activeComs.begin(); it != _activeComs.end(); ++it) {
+		if (it->entry.get() == entry)
+			return it;
+	}
+
+	return _activeComs.end();
+}
+
+void RadioEventTable::insertActive(const std::shared_ptr<RetEntry> &entry)
+{
+	ActiveCom com = { centralFreq(entry.get()), NOT_SENT, entry };
+	ActiveComs::iterator it;
+
+	it = std::lower_bound(_activeComs.begin(), _activeComs.end(),
+			      com.centralFreq, activeComLess);
+	_activeComs.insert(it, com);
+
+	if (_activeComs.size() == 1 || entry->timeEnd() < _oldestTimeEnd)
+		_oldestTimeEnd = entry->timeEnd();
+}
+
+/* the entry at it changed, move it to its new place. O(distance) */
+void RadioEventTable::updateActive(ActiveComs::iterator it)
 {
-	RetEntry * entry;
+	it->centralFreq = centralFreq(it->entry.get());
+
+	while (it + 1 != _activeComs.end() && (it + 1)->centralFreq < it->centralFreq) {
+		std::swap(*it, *(it + 1));
+		++it;
+	}
+	while (it != _activeComs.begin() && (it - 1)->centralFreq > it->centralFreq) {
+		std::swap(*it, *(it - 1));
+		--it;
+	}
+}
 
+RadioEventTable::ActiveComs::iterator
+RadioEventTable::findMatch(uint32_t frequencyStart, uint32_t frequencyEnd)
+{
 	uint32_t comWidth = frequencyEnd - frequencyStart;
 	uint32_t comCentralFreq = frequencyStart + comWidth / 2;
 	int32_t maxError = comWidth * 10 / 100;
 
-	std::list< std::shared_ptr<RetEntry> >::iterator it;
-	for (it = _activeComs.begin(); it != _activeComs.end(); ++it) {
-		entry = (*it).get();
+	if (maxError <= 0)
+		return _activeComs.end();
+
+	/* the candidates are in ]central - maxError, central + maxError[ */
+	uint32_t low = comCentralFreq > (uint32_t)maxError ? comCentralFreq - maxError + 1 : 0;
+	ActiveComs::iterator it, best = _activeComs.end();
+	it = std::lower_bound(_activeComs.begin(), _activeComs.end(), low, activeComLess);
+	for (; it != _activeComs.end() && fuzzyCompare(it->centralFreq, comCentralFreq, maxError); ++it) {
+		if (best == _activeComs.end() ||
+		    abs((int32_t)(it->centralFreq - comCentralFreq)) <
+		    abs((int32_t)(best->centralFreq - comCentralFreq)))
+			best = it;
+	}
 
-		uint32_t width = entry->frequencyEnd() - entry->frequencyStart();
-		uint32_t centralFreq = entry->frequencyStart() + width / 2;
+	return best;
+}
 
-		if (/*fuzzyCompare(comWidth, width, maxError) &&*/
-		    fuzzyCompare(comCentralFreq, centralFreq, maxError)) {
-			return entry;
-		}
-	}
+RetEntry * RadioEventTable::findMatchInActiveCommunications(uint32_t frequencyStart,
+				      uint32_t frequencyEnd,
+				      int8_t pwr)
+{
+	ActiveComs::iterator it = findMatch(frequencyStart, frequencyEnd);
 
 	/*if (frequencyStart == 936000)
 		fprintf(stderr, "Couldn't match com [%u, %u], centralFreq = %u, width = %u\n",
 		frequencyStart, frequencyEnd, comCentralFreq, comWidth);*/
 
-	return NULL;
+	return it != _activeComs.end() ? it->entry.get() : NULL;
 }
 
-RadioEventTable::RadioEventTable(size_t ringSize, uint32_t endOfTransmissionDelay,
+RadioEventTable::RadioEventTable(size_t historySize, uint32_t endOfTransmissionDelay,
 				 uint32_t minimumTransmissionLength) : _currentComID(0),
-	_finishedComs(ringSize), _endOfTransmissionDelay(endOfTransmissionDelay),
-	_minimumTransmissionLength(minimumTransmissionLength)
+	_finishedComs(historySize), _unsentFinishedComs(0), _endOfTransmissionDelay(endOfTransmissionDelay),
+	_minimumTransmissionLength(minimumTransmissionLength), _lastTimeNs(0), _oldestTimeEnd(0),
+	_sentFinishedComs(0), _updateSequence(0),
+	_keyframeInterval(64), _updatesSinceKeyframe(0), _keyframeRequested(true),
+	_updateSynced(false)
 {
 	trueDetection = totalDetections = 0;
 	_toStringBufSize = 1000000; /* 1 MB */
@@ -66,6 +150,7 @@ RadioEventTable::~RadioEventTable()
 void RadioEventTable::startAddingCommunications(uint64_t timeNs)
 {
 	this->_tmp_timeNs = timeNs;
+	_lastTimeNs = std::max(_lastTimeNs, timeNs);
 #if DEBUG_ADD_COMMUNICATION
 	fprintf(stderr, "%llu: Add new coms!\n", timeNs);
 #endif
@@ -90,7 +175,8 @@ void RadioEventTable::addCommunication(uint64_t frequencyStart,
 				       uint64_t frequencyEnd,
 				       int8_t pwr)
 {
-	RetEntry * entry = findMatchInActiveCommunications(frequencyStart, frequencyEnd, pwr);
+	ActiveComs::iterator it = findMatch(frequencyStart, frequencyEnd);
+	RetEntry * entry = it != _activeComs.end() ? it->entry.get() : NULL;
 #if DEBUG_ADD_COMMUNICATION
 	fprintf(stderr, "	%s a match for ", entry?"Found":"Didn't find");
 	entryToStderr(entry);
@@ -98,9 +184,7 @@ void RadioEventTable::addCommunication(uint64_t frequencyStart,
 #endif
 	if (entry == NULL) {
 		/* no corresponding entry found, let's create one! */
-		entry = new RetEntry(_currentComID++, _tmp_timeNs, _tmp_timeNs, frequencyStart,
-					    frequencyEnd, pwr, RetEntry::UNKNOWN, 0);
-		_activeComs.push_back(std::shared_ptr<RetEntry>(entry));
+		entry = addTransmission(frequencyStart, frequencyEnd, pwr).get();
 #if DEBUG_ADD_COMMUNICATION
 		fprintf(stderr, "add new entry: ");
 		entryToStderr(entry);
@@ -116,6 +200,7 @@ void RadioEventTable::addCommunication(uint64_t frequencyStart,
 		if (entry->pwr() < pwr)
 			entry->setPwr(pwr);
 		entry->setDirty(true);
+		updateActive(it);
 #if DEBUG_ADD_COMMUNICATION
 		entryToStderr(entry);
 		fprintf(stderr, "\n");
@@ -123,36 +208,110 @@ void RadioEventTable::addCommunication(uint64_t frequencyStart,
 	}
 }
 
+std::shared_ptr<RetEntry>
+RadioEventTable::addTransmission(uint64_t frequencyStart, uint64_t frequencyEnd,
+				 int8_t pwr)
+{
+	std::shared_ptr<RetEntry> entry(new RetEntry(_currentComID++, _tmp_timeNs,
+						     _tmp_timeNs, frequencyStart,
+						     frequencyEnd, pwr,
+						     RetEntry::UNKNOWN, 0));
+	insertActive(entry);
+	return entry;
+}
+
+void RadioEventTable::updateTransmission(RetEntry *entry, uint64_t frequencyStart,
+					 uint64_t frequencyEnd, int8_t pwr)
+{
+	ActiveComs::iterator it = findActive(entry);
+
+	entry->setTimeEnd(_tmp_timeNs);
+	entry->setFrequencyStart(frequencyStart);
+	entry->setFrequencyEnd(frequencyEnd);
+	entry->setPwr(pwr);
+	entry->setDirty(true);
+
+	if (it != _activeComs.end())
+		updateActive(it);
+}
+
+void RadioEventTable::mergeTransmissions(RetEntry *into, RetEntry *from)
+{
+	ActiveComs::iterator it = findActive(from);
+	if (it != _activeComs.end()) {
+		retire(*it, NOT_FINISHED);
+		_activeComs.erase(it);
+	}
+
+	it = findActive(into);
+	if (into->timeStart() > from->timeStart())
+		into->setTimeStart(from->timeStart());
+	if (into->timeEnd() < from->timeEnd())
+		into->setTimeEnd(from->timeEnd());
+	if (into->frequencyStart() > from->frequencyStart())
+		into->setFrequencyStart(from->frequencyStart());
+	if (into->frequencyEnd() < from->frequencyEnd())
+		into->setFrequencyEnd(from->frequencyEnd());
+	if (into->pwr() < from->pwr())
+		into->setPwr(from->pwr());
+	into->setDirty(true);
+
+	if (it != _activeComs.end())
+		updateActive(it);
+}
+
 void RadioEventTable::stopAddingCommunications()
 {
-	RetEntry * entry;
+	/* nothing can have ended yet, save the scan */
+	if (_activeComs.empty() ||
+	    _tmp_timeNs - _oldestTimeEnd <= _endOfTransmissionDelay) {
+		this->_tmp_timeNs = 0;
+		return;
+	}
 
-	/* transfer non-ongoing communications to _finishedComs */
-	std::list< std::shared_ptr<RetEntry> >::iterator it;
-	for (it = _activeComs.begin(); it != _activeComs.end(); ++it) {
-		entry = (*it).get();
+	/* compact the ongoing communications in a single pass, the ended
+	 * ones end up at the back.
+	 */
+	size_t kept = 0;
+	uint64_t oldestTimeEnd = ~0ULL;
+	for (size_t i = 0; i < _activeComs.size(); i++) {
+		RetEntry *entry = _activeComs[i].entry.get();
+
+		if (_tmp_timeNs - entry->timeEnd() <= _endOfTransmissionDelay) {
+			if (kept != i)
+				std::swap(_activeComs[kept], _activeComs[i]);
+			kept++;
+			oldestTimeEnd = std::min(oldestTimeEnd, entry->timeEnd());
+		}
+	}
 
-		if (_tmp_timeNs - entry->timeEnd() > _endOfTransmissionDelay) {
+	/* transfer them to _finishedComs by end time. The ongoing ones
+	 * end later than them, the history stays sorted.
+	 */
+	std::sort(_activeComs.begin() + kept, _activeComs.end(), timeEndOrder);
+	for (size_t i = kept; i < _activeComs.size(); i++) {
+		RetEntry *entry = _activeComs[i].entry.get();
 
-			if ((entry->timeEnd() - entry->timeStart()) < _minimumTransmissionLength) {
+		if ((entry->timeEnd() - entry->timeStart()) < _minimumTransmissionLength) {
+			retire(_activeComs[i], NOT_FINISHED);
 #if 0
-				fprintf(stderr, "Invalid transmission terminated: ");
-				entryToStderr(entry);
-				fprintf(stderr, "\n");
+			fprintf(stderr, "Invalid transmission terminated: ");
+			entryToStderr(entry);
+			fprintf(stderr, "\n");
 #endif
-			} else {
-				trueDetection++;
-				_finishedComs.push_back((*it));
+		} else {
+			trueDetection++;
+			retire(_activeComs[i], _finishedComs.push_back(*entry));
 #if 0
-				fprintf(stderr, "Transmission terminated: ");
-				entryToStderr(entry);
-				fprintf(stderr, "\n");
+			fprintf(stderr, "Transmission terminated: ");
+			entryToStderr(entry);
+			fprintf(stderr, "\n");
 #endif
-			}
-			totalDetections++;
-			it = _activeComs.erase(it);
 		}
+		totalDetections++;
 	}
+	_activeComs.resize(kept);
+	_oldestTimeEnd = oldestTimeEnd;
 
 	//fprintf(stderr, "false alarm ratio = %f\n", ((float)falseDetection) / totalDetections);
 
@@ -161,7 +320,7 @@ void RadioEventTable::stopAddingCommunications()
 
 bool RadioEventTable::toStringBufferReserve(size_t offset, size_t additional)
 {
-	if (_toStringBufSize - offset < additional) {
+	while (_toStringBufSize - offset < additional) {
 		_toStringBufSize *= 2; /* Yeah, I know, that may be over the top! */
 		char * tmp = (char *) realloc(_toStringBuf, _toStringBufSize);
 		if (tmp == NULL)
@@ -172,7 +331,7 @@ bool RadioEventTable::toStringBufferReserve(size_t offset, size_t additional)
 	return true;
 }
 
-bool RadioEventTable::addCommunicationToString(size_t &offset, RetEntry *entry)
+bool RadioEventTable::addCommunicationToString(size_t &offset, const RetEntry *entry)
 {
 	size_t len = _toStringBufSize - offset;
 	if (!entry->toString(_toStringBuf + offset, &len))
@@ -184,18 +343,20 @@ bool RadioEventTable::addCommunicationToString(size_t &offset, RetEntry *entry)
 bool RadioEventTable::toString(char **buf, size_t *len)
 {
 	size_t offset = 0;
-	char *_b = _toStringBuf;
+	uint64_t firstUnsent = std::max(_unsentFinishedComs, _finishedComs.tail());
+	size_t count = _activeComs.size() + (_finishedComs.head() - firstUnsent);
 
 	*buf = NULL;
 	*len = 0;
 
-	/* add the on-going communications */
-	if (!toStringBufferReserve(offset, (1 + RetEntry::stringSize()) * _activeComs.size()))
+	if (!toStringBufferReserve(offset, (1 + RetEntry::stringSize()) * count))
 		return false;
+	char *_b = _toStringBuf;
 
-	std::list< std::shared_ptr<RetEntry> >::iterator it;
-	for (it = _activeComs.begin(); it != _activeComs.end(); ++it) {
-		RetEntry * entry = (*it).get();
+	/* add the on-going communications */
+
+	for (size_t i = 0; i < _activeComs.size(); i++) {
+		RetEntry * entry = _activeComs[i].entry.get();
 		if (entry->timeEnd() != entry->timeStart()) {
 			write_and_update_offset(offset, _b, (char) ACTIVE_COM);
 			if (!addCommunicationToString(offset, entry))
@@ -203,17 +364,13 @@ bool RadioEventTable::toString(char **buf, size_t *len)
 		}
 	}
 
-	/* add finished communications */
-	for (uint64_t i = _finishedComs.tail(); i < _finishedComs.head(); i++) {
-		RetEntry *entry = _finishedComs.at_unsafe(i);
-
-		if (entry->isDirty()) {
-			write_and_update_offset(offset, _b, (char) FINISHED_COM);
-			if (!addCommunicationToString(offset, entry))
-				return false;
-			entry->setDirty(false);
-		}
+	/* add the finished communications not sent yet, they never change */
+	for (uint64_t i = firstUnsent; i < _finishedComs.head(); i++) {
+		write_and_update_offset(offset, _b, (char) FINISHED_COM);
+		if (!addCommunicationToString(offset, _finishedComs.at(i)))
+			return false;
 	}
+	_unsentFinishedComs = _finishedComs.head();
 
 	*buf = _toStringBuf;
 	*len = offset;
@@ -225,6 +382,7 @@ bool RadioEventTable::updateFromString(const char *buf, size_t len)
 {
 	char comType = ACTIVE_COM;
 	size_t offset = 0;
+	bool ok = true;
 
 	/* empty the active coms list */
 	_activeComs.clear();
@@ -233,40 +391,459 @@ bool RadioEventTable::updateFromString(const char *buf, size_t len)
 		read_and_update_offset(offset, buf, comType);
 		if (comType < PACKET_END) {
 			/* generate the entry */
-			RetEntry *entry = new RetEntry();
+			RetEntry entry;
 			size_t entryLen = len - offset;
-			if (!entry->fromString(buf+offset, &entryLen))
-				return false;
+			if (!entry.fromString(buf+offset, &entryLen)) {
+				ok = false;
+				break;
+			}
 			offset += entryLen;
 
 			/* add it to the right table */
-			if (comType == ACTIVE_COM)
-				_activeComs.push_back(std::shared_ptr<RetEntry>(entry));
-			else if (comType == FINISHED_COM)
-				_finishedComs.push_back(entry); /* this works right now because we never update old entries */
+			if (comType == ACTIVE_COM) {
+				ActiveCom com = { centralFreq(&entry), NOT_SENT,
+						  std::make_shared<RetEntry>(entry) };
+				_activeComs.push_back(com);
+			} else if (comType == FINISHED_COM)
+				_finishedComs.push_back(entry); /* sent by end time, never updated */
 		}
 	}
 
-	return true;
+	/* index all the active coms at once */
+	std::sort(_activeComs.begin(), _activeComs.end(), activeComOrder);
+	_oldestTimeEnd = ~0ULL;
+	for (size_t i = 0; i < _activeComs.size(); i++)
+		_oldestTimeEnd = std::min(_oldestTimeEnd, _activeComs[i].entry->timeEnd());
+
+	return ok;
 }
 
-std::vector< std::shared_ptr<RetEntry> >
-RadioEventTable::fetchEntries(uint64_t timeStart, uint64_t timeEnd)
+size_t RadioEventTable::fetchEntries(uint64_t timeStart, uint64_t timeEnd,
+				     std::vector<RetEntry> &entries) const
 {
-	std::vector< std::shared_ptr<RetEntry> > ret;
-
 	/* copy all the active communications */
-	std::copy(_activeComs.begin(), _activeComs.end(),
-		  std::back_insert_iterator< std::vector< std::shared_ptr<RetEntry> > >(ret));
+	for (size_t i = 0; i < _activeComs.size(); i++)
+		entries.push_back(*_activeComs[i].entry);
 
 	/* now look at the finished communications */
-	for (uint64_t i = _finishedComs.tail(); i < _finishedComs.head(); i++) {
-		RetEntry *entry = _finishedComs.at_unsafe(i);
+	return _activeComs.size() + _finishedComs.fetch(timeStart, timeEnd, entries);
+}
+
+/* Delta updates, version UPDATE_VERSION. The integers are varints (V),
+ * zigzag'ed when signed (Z), see message_utils.h.
+ *
+ * header:  uint8 version, uint8 flags (UPDATE_KEYFRAME), uint64 sequence,
+ *          uint64 timeBase (ns), uint32 number of active communications
+ *          once applied
+ * records, up to the end of the message:
+ *          uint8 op << 6 | fields, V slot + 1,
+ *          Z id - the previous id sent, for an insertion or slot + 1 = 0,
+ *          then the fields present, in this order:
+ *            FIELD_TIME_END    Z timeBase - timeEnd
+ *            FIELD_TIME_START  Z timeEnd - timeStart
+ *            FIELD_FREQ_START  Z frequencyStart - the previous one sent
+ *            FIELD_FREQ_END    Z frequencyEnd - frequencyStart
+ *            FIELD_PWR         int8
+ *            FIELD_ADDRESS     V psu << 56 | address
+ *
+ * An insertion gives the communication a slot, the following records
+ * refer to it by this slot until it finishes or is removed. A finished
+ * communication never sent has no slot. The communications the receivers
+ * do not know carry all their fields, but a null address. A keyframe
+ * replaces all the active communications and frees all the slots.
+ */
+#define UPDATE_KEYFRAME 0x1
+#define UPDATE_HEADER_SIZE 22
+#define UPDATE_RECORD_MAX_SIZE (2 + 7 * VARINT_MAX_SIZE)
+
+enum UpdateField {
+	FIELD_TIME_END = 0x01,
+	FIELD_TIME_START = 0x02,
+	FIELD_FREQ_START = 0x04,
+	FIELD_FREQ_END = 0x08,
+	FIELD_PWR = 0x10,
+	FIELD_ADDRESS = 0x20,
+	FIELD_ALL = 0x3f
+};
+
+static uint64_t rawAddress(const RetEntry &e)
+{
+	return ((uint64_t)e.psu() << 56) | e.address();
+}
+
+/* the fields of e the receivers do not know, all of them if unknown */
+static uint8_t changedFields(const RetEntry &e, const RetEntry *known)
+{
+	if (!known)
+		return rawAddress(e) ? FIELD_ALL : FIELD_ALL & ~FIELD_ADDRESS;
+
+	uint8_t fields = 0;
+	if (e.timeEnd() != known->timeEnd())
+		fields |= FIELD_TIME_END;
+	if (e.timeStart() != known->timeStart())
+		fields |= FIELD_TIME_START;
+	if (e.frequencyStart() != known->frequencyStart())
+		fields |= FIELD_FREQ_START;
+	if (e.frequencyEnd() != known->frequencyEnd())
+		fields |= FIELD_FREQ_END;
+	if (e.pwr() != known->pwr())
+		fields |= FIELD_PWR;
+	if (rawAddress(e) != rawAddress(*known))
+		fields |= FIELD_ADDRESS;
+	return fields;
+}
+
+static bool isVisible(const RetEntry &e)
+{
+	/* seen once only, as with toString() */
+	return e.timeEnd() != e.timeStart();
+}
 
-		if (entry->timeEnd() > timeStart &&
-		    entry->timeStart() < timeEnd)
-		    ret.push_back(_finishedComs.at(i));
+/* the communication left the active ones, tell the receivers if they know it */
+void RadioEventTable::retire(const ActiveCom &com, uint64_t position)
+{
+	if (com.sent != NOT_SENT) {
+		RetiredCom retired = { com.sent, position };
+		_retiredComs.push_back(retired);
 	}
+}
 
-	return ret;
+/* forget what the receivers know, for a keyframe */
+void RadioEventTable::resetSent()
+{
+	for (size_t i = 0; i < _activeComs.size(); i++)
+		_activeComs[i].sent = NOT_SENT;
+	_sentComs.clear();
+	_freeSentSlots.clear();
+	_retiredComs.clear();
+}
+
+bool RadioEventTable::encodeRecord(char *buf, size_t size, size_t &offset,
+				   UpdateOp op, uint32_t slot, const RetEntry &entry,
+				   uint8_t fields, uint64_t timeBase,
+				   uint64_t &prevId, uint32_t &prevFreq)
+{
+	bool ok;
+
+	if (offset >= size)
+		return false;
+	buf[offset++] = (op << 6) | fields;
+
+	/* 0 when not sent */
+	ok = write_varint_and_update_offset(offset, buf, size, (uint32_t)(slot + 1));
+	if (ok && (op == UPDATE_INSERT || slot == NOT_SENT)) {
+		ok = write_varint_and_update_offset(offset, buf, size,
+				zigzag_encode(entry.id() - prevId));
+		prevId = entry.id();
+	}
+
+	if (ok && (fields & FIELD_TIME_END))
+		ok = write_varint_and_update_offset(offset, buf, size,
+				zigzag_encode(timeBase - entry.timeEnd()));
+	if (ok && (fields & FIELD_TIME_START))
+		ok = write_varint_and_update_offset(offset, buf, size,
+				zigzag_encode(entry.timeEnd() - entry.timeStart()));
+	if (ok && (fields & FIELD_FREQ_START)) {
+		ok = write_varint_and_update_offset(offset, buf, size,
+				zigzag_encode((int64_t)entry.frequencyStart() - prevFreq));
+		prevFreq = entry.frequencyStart();
+	}
+	if (ok && (fields & FIELD_FREQ_END))
+		ok = write_varint_and_update_offset(offset, buf, size,
+				zigzag_encode((int64_t)entry.frequencyEnd() - entry.frequencyStart()));
+	if (ok && (fields & FIELD_PWR)) {
+		ok = offset < size;
+		if (ok)
+			buf[offset++] = entry.pwr();
+	}
+	if (ok && (fields & FIELD_ADDRESS))
+		ok = write_varint_and_update_offset(offset, buf, size, rawAddress(entry));
+
+	return ok;
+}
+
+size_t RadioEventTable::maxUpdateSize() const
+{
+	uint64_t firstFinished = std::max(_sentFinishedComs, _finishedComs.tail());
+	size_t records = _activeComs.size() + _retiredComs.size() +
+			 (_finishedComs.head() - firstFinished);
+
+	return UPDATE_HEADER_SIZE + records * UPDATE_RECORD_MAX_SIZE;
+}
+
+bool RadioEventTable::encodeUpdate(char *buf, size_t size, size_t *len)
+{
+	bool keyframe = _keyframeRequested ||
+			(_keyframeInterval > 0 && _updatesSinceKeyframe >= _keyframeInterval);
+
+	*len = 0;
+
+	/* the receivers will only know what this update contains */
+	if (keyframe)
+		resetSent();
+
+	if (!encodeDelta(buf, size, len, keyframe)) {
+		/* what the receivers know is unclear, start over */
+		_keyframeRequested = true;
+		return false;
+	}
+
+	_sentFinishedComs = _finishedComs.head();
+	_updateSequence++;
+	_updatesSinceKeyframe = keyframe ? 1 : _updatesSinceKeyframe + 1;
+	_keyframeRequested = false;
+	return true;
+}
+
+bool RadioEventTable::encodeDelta(char *buf, size_t size, size_t *len, bool keyframe)
+{
+	uint64_t firstFinished = std::max(_sentFinishedComs, _finishedComs.tail());
+	uint64_t timeBase = _lastTimeNs, prevId = 0;
+	uint32_t prevFreq = 0, active = 0;
+	size_t offset = UPDATE_HEADER_SIZE;
+
+	/* the header is written last */
+	if (size < UPDATE_HEADER_SIZE)
+		return false;
+
+	/* the new and modified active communications */
+	for (size_t i = 0; i < _activeComs.size(); i++) {
+		ActiveCom &com = _activeComs[i];
+		RetEntry &e = *com.entry;
+
+		if (!isVisible(e))
+			continue;
+		active++;
+
+		if (com.sent == NOT_SENT) {
+			if (!_freeSentSlots.empty()) {
+				com.sent = _freeSentSlots.back();
+				_freeSentSlots.pop_back();
+			} else {
+				com.sent = _sentComs.size();
+				_sentComs.push_back(e);
+			}
+			if (!encodeRecord(buf, size, offset, UPDATE_INSERT, com.sent, e,
+					  changedFields(e, NULL), timeBase, prevId, prevFreq))
+				return false;
+		} else if (e.isDirty()) {
+			uint8_t fields = changedFields(e, &_sentComs[com.sent]);
+			if (fields != 0 &&
+			    !encodeRecord(buf, size, offset, UPDATE_MODIFY, com.sent, e,
+					  fields, timeBase, prevId, prevFreq))
+				return false;
+		} else
+			continue;
+
+		_sentComs[com.sent] = e;
+		e.setDirty(false);
+	}
+
+	/* the ones gone without finishing: merged or too short */
+	for (size_t r = 0; r < _retiredComs.size(); r++) {
+		const RetiredCom &retired = _retiredComs[r];
+		if (retired.position >= firstFinished && retired.position != NOT_FINISHED)
+			continue;
+		if (!encodeRecord(buf, size, offset, UPDATE_REMOVE, retired.sent,
+				  _sentComs[retired.sent], 0, timeBase, prevId, prevFreq))
+			return false;
+		_freeSentSlots.push_back(retired.sent);
+	}
+
+	/* the finished ones, by end time. The retired ones are in the same order. */
+	size_t r = 0;
+	for (uint64_t i = firstFinished; i < _finishedComs.head(); i++) {
+		while (r < _retiredComs.size() && (_retiredComs[r].position < i ||
+						   _retiredComs[r].position == NOT_FINISHED))
+			r++;
+
+		uint32_t slot = NOT_SENT;
+		if (r < _retiredComs.size() && _retiredComs[r].position == i)
+			slot = _retiredComs[r].sent;
+
+		const RetEntry &e = *_finishedComs.at(i);
+		const RetEntry *known = slot != NOT_SENT ? &_sentComs[slot] : NULL;
+		if (!encodeRecord(buf, size, offset, UPDATE_FINISH, slot, e,
+				  changedFields(e, known), timeBase, prevId, prevFreq))
+			return false;
+		if (slot != NOT_SENT)
+			_freeSentSlots.push_back(slot);
+	}
+	_retiredComs.clear();
+
+	*len = offset;
+	offset = 0;
+	write_and_update_offset(offset, buf, (uint8_t)UPDATE_VERSION);
+	write_and_update_offset(offset, buf, (uint8_t)(keyframe ? UPDATE_KEYFRAME : 0));
+	write_and_update_offset(offset, buf, _updateSequence + 1);
+	write_and_update_offset(offset, buf, timeBase);
+	write_and_update_offset(offset, buf, active);
+
+	return true;
+}
+
+/* read the fields of a record into e */
+static bool decodeFields(const char *buf, size_t len, size_t &offset,
+			 uint8_t fields, RetEntry &e, uint64_t timeBase,
+			 uint32_t &prevFreq)
+{
+	uint64_t v;
+
+	if (fields & FIELD_TIME_END) {
+		if (!read_varint_and_update_offset(offset, buf, len, v))
+			return false;
+		e.setTimeEnd(timeBase - zigzag_decode(v));
+	}
+	if (fields & FIELD_TIME_START) {
+		if (!read_varint_and_update_offset(offset, buf, len, v))
+			return false;
+		e.setTimeStart(e.timeEnd() - zigzag_decode(v));
+	}
+	if (fields & FIELD_FREQ_START) {
+		if (!read_varint_and_update_offset(offset, buf, len, v))
+			return false;
+		prevFreq += zigzag_decode(v);
+		e.setFrequencyStart(prevFreq);
+	}
+	if (fields & FIELD_FREQ_END) {
+		if (!read_varint_and_update_offset(offset, buf, len, v))
+			return false;
+		e.setFrequencyEnd(e.frequencyStart() + zigzag_decode(v));
+	}
+	if (fields & FIELD_PWR) {
+		if (offset >= len)
+			return false;
+		e.setPwr(buf[offset++]);
+	}
+	if (fields & FIELD_ADDRESS) {
+		if (!read_varint_and_update_offset(offset, buf, len, v))
+			return false;
+		e.setAddress(v);
+		e.setPsu((RetEntry::Psu)(v >> 56));
+	}
+
+	return true;
+}
+
+void RadioEventTable::eraseReceived(uint32_t slot)
+{
+	ActiveComs::iterator it = findActive(_receivedComs[slot].get());
+	if (it != _activeComs.end())
+		_activeComs.erase(it);
+	_receivedComs[slot].reset();
+}
+
+bool RadioEventTable::applyRecords(const char *buf, size_t len, size_t offset,
+				   uint64_t timeBase)
+{
+	uint64_t prevId = 0;
+	uint32_t prevFreq = 0;
+
+	while (offset < len) {
+		uint8_t head = buf[offset++];
+		UpdateOp op = (UpdateOp)(head >> 6);
+		uint64_t v;
+
+		/* the slot, NOT_SENT for a finished communication never sent */
+		if (!read_varint_and_update_offset(offset, buf, len, v) || v > NOT_SENT)
+			return false;
+		uint32_t slot = v - 1;
+		uint8_t fields = head & FIELD_ALL;
+		bool known = slot != NOT_SENT && slot < _receivedComs.size() &&
+			     _receivedComs[slot];
+
+		/* in place if its central frequency does not change */
+		if (op == UPDATE_MODIFY && known &&
+		    !(fields & (FIELD_FREQ_START | FIELD_FREQ_END))) {
+			RetEntry *e = _receivedComs[slot].get();
+			if (!decodeFields(buf, len, offset, fields, *e, timeBase, prevFreq))
+				return false;
+			e->setDirty(true);
+			continue;
+		}
+
+		/* start from what we know about it */
+		RetEntry entry(0, 0, 0, 0, 0, 0, RetEntry::UNKNOWN, 0);
+		if (op == UPDATE_INSERT || slot == NOT_SENT) {
+			if (known || !read_varint_and_update_offset(offset, buf, len, v))
+				return false;
+			prevId += zigzag_decode(v);
+			entry.setId(prevId);
+		} else if (known)
+			entry = *_receivedComs[slot];
+		else
+			return false;
+		entry.setDirty(true);
+
+		if (!decodeFields(buf, len, offset, fields, entry, timeBase, prevFreq))
+			return false;
+
+		switch (op) {
+		case UPDATE_INSERT:
+			if (slot == NOT_SENT)
+				return false;
+			if (slot >= _receivedComs.size())
+				_receivedComs.resize(slot + 1);
+			_receivedComs[slot] = std::make_shared<RetEntry>(entry);
+			insertActive(_receivedComs[slot]);
+			break;
+		case UPDATE_MODIFY:
+			{
+				ActiveComs::iterator it = findActive(_receivedComs[slot].get());
+				*_receivedComs[slot] = entry;
+				if (it != _activeComs.end())
+					updateActive(it);
+			}
+			break;
+		case UPDATE_FINISH:
+			if (known)
+				eraseReceived(slot);
+			_finishedComs.push_back(entry);
+			break;
+		case UPDATE_REMOVE:
+			eraseReceived(slot);
+			break;
+		}
+	}
+
+	return true;
+}
+
+bool RadioEventTable::applyUpdate(const char *buf, size_t len)
+{
+	uint8_t version, flags;
+	uint64_t sequence, timeBase;
+	uint32_t active;
+	size_t offset = 0;
+
+	if (len < UPDATE_HEADER_SIZE) {
+		_updateSynced = false;
+		return false;
+	}
+	read_and_update_offset(offset, buf, version);
+	read_and_update_offset(offset, buf, flags);
+	read_and_update_offset(offset, buf, sequence);
+	read_and_update_offset(offset, buf, timeBase);
+	read_and_update_offset(offset, buf, active);
+	if (version != UPDATE_VERSION) {
+		_updateSynced = false;
+		return false;
+	}
+
+	/* a delta needs the previous update */
+	if (!(flags & UPDATE_KEYFRAME)) {
+		if (!_updateSynced || sequence != _updateSequence + 1) {
+			_updateSynced = false;
+			return false;
+		}
+	} else {
+		_activeComs.clear();
+		_receivedComs.clear();
+	}
+
+	_updateSequence = sequence;
+	_updateSynced = applyRecords(buf, len, offset, timeBase) &&
+			_activeComs.size() == active;
+
+	return _updateSynced;
 }
@@ -1,47 +1,112 @@
 #ifndef RADIOEVENTTABLE_H
 #define RADIOEVENTTABLE_H
 
-#include "absoluteringbuffer.h"
 #include "ret_entry.h"
+#include "rethistory.h"
 
-#include <list>
+#include <memory>
+#include <vector>
 
 class RadioEventTable
 {
+public:
+	/* an active communication, indexed by its central frequency */
+	struct ActiveCom
+	{
+		uint32_t centralFreq;
+		uint32_t sent; /* its slot in the delta updates, or NOT_SENT */
+		std::shared_ptr<RetEntry> entry;
+	};
+	static const uint32_t NOT_SENT = ~0U;
+	typedef std::vector<ActiveCom> ActiveComs;
+
+private:
 	uint64_t _currentComID;
 
-	std::list< std::shared_ptr<RetEntry> > _activeComs;
-	AbsoluteRingBuffer< RetEntry > _finishedComs;
+	/* sorted by central frequency, for O(log n) matching */
+	ActiveComs _activeComs;
+	RetHistory _finishedComs;
+	uint64_t _unsentFinishedComs; /* the first one #toString did not send */
 
 	/* detection-related */
 	uint32_t _endOfTransmissionDelay;
 	uint32_t _minimumTransmissionLength;
 	uint64_t _tmp_timeNs;
+	uint64_t _lastTimeNs; /* the latest _tmp_timeNs */
+	uint64_t _oldestTimeEnd; /* no active communication ended before */
 	bool fuzzyCompare(uint32_t a, uint32_t b, int32_t maxError);
 
+	static uint32_t centralFreq(const RetEntry *entry);
+	ActiveComs::iterator findActive(const RetEntry *entry);
+	ActiveComs::iterator findMatch(uint32_t frequencyStart, uint32_t frequencyEnd);
+	void insertActive(const std::shared_ptr<RetEntry> &entry);
+	void updateActive(ActiveComs::iterator it);
+
 	/* Serialization-related */
 	enum RadioEventType { ACTIVE_COM = 0, FINISHED_COM = 1, PACKET_END = 2 };
 	char *_toStringBuf;
 	size_t _toStringBufSize;
 	bool toStringBufferReserve(size_t offset, size_t additional);
-	bool addCommunicationToString(size_t &offset, RetEntry *entry);
+	bool addCommunicationToString(size_t &offset, const RetEntry *entry);
+
+	/* Delta updates, see encodeUpdate(). The receivers know the active
+	 * communications by the slot they were sent in.
+	 */
+	enum UpdateOp { UPDATE_INSERT = 0, UPDATE_MODIFY = 1, UPDATE_FINISH = 2, UPDATE_REMOVE = 3 };
+	struct RetiredCom
+	{
+		uint32_t sent; /* its slot */
+		uint64_t position; /* in _finishedComs, NOT_FINISHED if dropped */
+	};
+	static const uint64_t NOT_FINISHED = ~0ULL;
+	std::vector<RetEntry> _sentComs; /* as the receivers know them, by slot */
+	std::vector<uint32_t> _freeSentSlots;
+	std::vector<RetiredCom> _retiredComs; /* sent, no longer active */
+	uint64_t _sentFinishedComs; /* the first finished one not encoded */
+	uint64_t _updateSequence; /* of the last update encoded or applied */
+	uint32_t _keyframeInterval;
+	uint32_t _updatesSinceKeyframe;
+	bool _keyframeRequested;
+	bool _updateSynced; /* applied a keyframe and all the updates since */
+	std::vector< std::shared_ptr<RetEntry> > _receivedComs; /* by slot, when applying */
+
+	void retire(const ActiveCom &com, uint64_t position);
+	void resetSent();
+	bool encodeRecord(char *buf, size_t size, size_t &offset, UpdateOp op,
+			  uint32_t slot, const RetEntry &entry, uint8_t fields,
+			  uint64_t timeBase, uint64_t &prevId, uint32_t &prevFreq);
+	bool encodeDelta(char *buf, size_t size, size_t *len, bool keyframe);
+	bool applyRecords(const char *buf, size_t len, size_t offset, uint64_t timeBase);
+	void eraseReceived(uint32_t slot);
 public:
 	/* temp, to be moved back to private after the demo */
 	uint64_t trueDetection;
 	uint64_t totalDetections;
 
-	RadioEventTable(size_t ringSize, uint32_t endOfTransmissionDelay = 0,
+	/* keeps up to historySize finished communications */
+	RadioEventTable(size_t historySize, uint32_t endOfTransmissionDelay = 0,
 			uint32_t minimumTransmissionLength = 0);
 	~RadioEventTable();
 
 	void startAddingCommunications(uint64_t timeNs);
 
-	/* Access the current communications */
-	const std::list< std::shared_ptr<RetEntry> > &activeCommunications() const { return _activeComs; }
+	/* Access the current communications, sorted by central frequency */
+	const ActiveComs &activeCommunications() const { return _activeComs; }
+
+	/* Access the finished communications, by end time */
+	const RetHistory &finishedCommunications() const { return _finishedComs; }
 	void updateTransmission(RetEntry *entry, uint64_t frequencyStart,
 				uint64_t frequencyEnd,
 				int8_t pwr);
 
+	/* add a new communication, tracked by the caller */
+	std::shared_ptr<RetEntry> addTransmission(uint64_t frequencyStart,
+						  uint64_t frequencyEnd,
+						  int8_t pwr);
+
+	/* two communications turned out to be one, \a from is dropped */
+	void mergeTransmissions(RetEntry *into, RetEntry *from);
+
 	/* add a new communication */
 	void addCommunication(uint64_t frequencyStart, uint64_t frequencyEnd,
 			      int8_t pwr);
@@ -50,7 +115,40 @@ public:
 	bool toString(char **buf, size_t *len);
 	bool updateFromString(const char *buf, size_t len);
 
-	std::vector< std::shared_ptr<RetEntry> > fetchEntries(uint64_t timeStart, uint64_t timeEnd);
+	/* The version of the delta updates' wire format */
+	static const uint8_t UPDATE_VERSION = 1;
+
+	/* the largest update #encodeUpdate may produce now */
+	size_t maxUpdateSize() const;
+
+	/* Encode what changed since the last update in buf, returns false if
+	 * it does not fit in size bytes. The next update is then a keyframe.
+	 */
+	bool encodeUpdate(char *buf, size_t size, size_t *len);
+
+	/* Apply an update, returns false if it is invalid or if a previous
+	 * one is missing. The updates are then ignored until a keyframe.
+	 */
+	bool applyUpdate(const char *buf, size_t len);
+
+	/* the next update will contain all the active communications */
+	void requestKeyframe() { _keyframeRequested = true; }
+	void setKeyframeInterval(uint32_t interval) { _keyframeInterval = interval; }
+	uint32_t keyframeInterval() const { return _keyframeInterval; }
+
+	uint64_t updateSequence() const { return _updateSequence; }
+	bool isUpdateSynced() const { return _updateSynced; }
+
+	/* append the active communications, then the finished ones
+	 * overlapping ]timeStart, timeEnd[. O(log n + k), see RetHistory.
+	 */
+	size_t fetchEntries(uint64_t timeStart, uint64_t timeEnd,
+			    std::vector<RetEntry> &entries) const;
+
+	/* the active communication whose central frequency is the closest to
+	 * the one of [frequencyStart, frequencyEnd], within 10% of its width.
+	 * O(log n).
+	 */
 	RetEntry *findMatchInActiveCommunications(uint32_t frequencyStart,
 					      uint32_t frequencyEnd,
 					      int8_t pwr);
@@ -32,7 +32,7 @@ bool RetEntry::fromString(const char *buf, size_t *length)
 	return true;
 }
 
-bool RetEntry::toString(char *buf, size_t *length)
+bool RetEntry::toString(char *buf, size_t *length) const
 {
 	if (*length < stringSize())
 		return false;
@@ -51,14 +51,6 @@ bool RetEntry::toString(char *buf, size_t *length)
 	return true;
 }
 
-RetEntry::Psu RetEntry::psu() const {
-	return (Psu)(_address >> 56);
-}
-
-uint64_t RetEntry::address() const{
-	return _address & 0xFFFFFFFFFFFFFF;
-}
-
 const char * RetEntry::psuString() const
 {
 	Psu psu = this->psu();
@@ -32,22 +32,22 @@ public:
 	static size_t stringSize() { return 41; }
 
 	bool fromString(const char *buf, size_t *length);
-	bool toString(char *buf, size_t *length);
+	bool toString(char *buf, size_t *length) const;
 
 	uint64_t id() const { return _id;}
 	uint64_t timeStart() const { return _timeStart;}
 	uint64_t timeEnd() const { return _timeEnd;}
 	uint32_t frequencyStart() const { return _frequencyStart;}
 	uint32_t frequencyEnd() const { return _frequencyEnd;}
-	int8_t pwr() const { return _id;}
-	Psu psu() const;
+	int8_t pwr() const { return _pwr;}
+	Psu psu() const { return (Psu)(_address >> 56); }
 
 	const char * psuString() const;
 
 	bool isDirty() const { return _dirty; }
 
 	/// address is up to 56 bits
-	uint64_t address() const;
+	uint64_t address() const { return _address & 0xFFFFFFFFFFFFFF; }
 
 	void setId(uint64_t id);
 	void setTimeStart(uint64_t timeStart);
@@ -0,0 +1,114 @@
+#include "rethistory.h"
+
+#include <algorithm>
+
+RetHistory::RetHistory(size_t capacity) :
+	_capacity(capacity > 0 ? capacity : 1), _head(0), _tail(0), _maxLateness(0)
+{
+}
+
+int RetHistory::durationClass(const RetEntry &entry)
+{
+	uint64_t duration = 0;
+	if (entry.timeEnd() > entry.timeStart())
+		duration = entry.timeEnd() - entry.timeStart();
+
+	return duration ? 64 - __builtin_clzll(duration) : 0;
+}
+
+uint64_t RetHistory::push_back(const RetEntry &entry)
+{
+	/* make room by dropping the oldest entry, the front of its class */
+	if (size() >= _capacity) {
+		std::deque<uint64_t> &oldest = _classes[durationClass(*at(_tail))];
+		if (!oldest.empty() && oldest.front() == _tail)
+			oldest.pop_front();
+		_tail++;
+	}
+
+	uint64_t key = entry.timeEnd();
+	if (_head > _tail)
+		key = std::max(key, endKey(_head - 1));
+	_maxLateness = std::max(_maxLateness, key - entry.timeEnd());
+
+	if (_ring.size() < _capacity) {
+		_ring.push_back(entry);
+		_endKey.push_back(key);
+	} else {
+		_ring[_head % _capacity] = entry;
+		_endKey[_head % _capacity] = key;
+	}
+	_classes[durationClass(entry)].push_back(_head);
+
+	return _head++;
+}
+
+const RetEntry *RetHistory::at(uint64_t i) const
+{
+	if (isPositionValid(i))
+		return &_ring[i % _capacity];
+	else
+		return NULL;
+}
+
+void RetHistory::clear()
+{
+	for (int c = 0; c < 65; c++)
+		_classes[c].clear();
+	_tail = _head;
+	_maxLateness = 0;
+}
+
+/* a + b, saturated */
+static uint64_t addSat(uint64_t a, uint64_t b)
+{
+	return a + b >= a ? a + b : ~0ULL;
+}
+
+size_t RetHistory::fetchClass(int c, uint64_t timeStart, uint64_t timeEnd,
+			      std::vector<RetEntry> &entries) const
+{
+	const std::deque<uint64_t> &positions = _classes[c];
+	size_t found = 0;
+
+	/* the first entry whose key, hence maybe whose end, is after timeStart */
+	size_t lo = 0, hi = positions.size();
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (endKey(positions[mid]) <= timeStart)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* the entries of this class ending after stop started after timeEnd */
+	uint64_t span = c < 64 ? 1ULL << c : ~0ULL;
+	uint64_t stop = addSat(addSat(timeEnd, span), _maxLateness);
+
+	for (size_t i = lo; i < positions.size(); i++) {
+		uint64_t pos = positions[i];
+		if (endKey(pos) >= stop)
+			break;
+
+		const RetEntry &entry = _ring[pos % _capacity];
+		if (entry.timeEnd() > timeStart && entry.timeStart() < timeEnd) {
+			entries.push_back(entry);
+			found++;
+		}
+	}
+
+	return found;
+}
+
+size_t RetHistory::fetch(uint64_t timeStart, uint64_t timeEnd,
+			 std::vector<RetEntry> &entries) const
+{
+	size_t found = 0;
+
+	for (int c = 0; c < 65; c++) {
+		if (!_classes[c].empty())
+			found += fetchClass(c, timeStart, timeEnd, entries);
+	}
+
+	return found;
+}
@@ -0,0 +1,103 @@
+/**
+ * \file      rethistory.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef RETHISTORY_H
+#define RETHISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "ret_entry.h"
+
+/**
+ * \class     RetHistory
+ * \brief     Keeps the last finished communications, indexed by time.
+ *
+ * \details   The entries are stored by value in a ring of up to
+ *            \a capacity entries, allocated as it fills (64 bytes per
+ *            entry). Like AbsoluteRingBuffer, every entry gets an absolute
+ *            position and the oldest ones are overwritten once full.
+ *
+ *            The entries are expected to be pushed by increasing end time.
+ *            The ring is then sorted by end time and the entries ending
+ *            after a time are found by a binary search. An entry pushed
+ *            late is still found: the search key is the highest end time
+ *            seen so far, and the queries widen by the largest lateness.
+ *
+ *            The entries ending after the window may still overlap it if
+ *            they started early enough. To avoid scanning the whole end of
+ *            the ring for a few long-running entries, the positions are
+ *            also split by duration class, class c holding the durations
+ *            of [2^(c-1), 2^c[. An entry of class c ending after
+ *            timeEnd + 2^c started after the window, the scan of a class
+ *            stops there. #fetch is thus O(log n + k) per non-empty class.
+ *
+ *            **Thread-safety:** Not thread safe.
+ */
+class RetHistory
+{
+	size_t _capacity; ///< The maximum number of entries
+	std::vector<RetEntry> _ring; ///< The entries, at position % _capacity
+	std::vector<uint64_t> _endKey; ///< The highest end time up to the entry
+
+	uint64_t _head; ///< The position of the next entry
+	uint64_t _tail; ///< The position of the oldest entry
+	uint64_t _maxLateness; ///< The largest _endKey - timeEnd pushed
+
+	/// The positions of the entries, by duration class
+	std::deque<uint64_t> _classes[65];
+
+	static int durationClass(const RetEntry &entry);
+	uint64_t endKey(uint64_t pos) const { return _endKey[pos % _capacity]; }
+	size_t fetchClass(int c, uint64_t timeStart, uint64_t timeEnd,
+			  std::vector<RetEntry> &entries) const;
+
+public:
+	/**
+	 * \brief    Create an empty history.
+	 *
+	 * \param    capacity   The maximum number of entries, up to millions
+	 * \return   Nothing.
+	 */
+	RetHistory(size_t capacity);
+
+	size_t capacity() const { return _capacity; }
+	size_t size() const { return _head - _tail; }
+
+	uint64_t head() const { return _head; }
+	uint64_t tail() const { return _tail; }
+
+	bool isPositionValid(uint64_t i) const { return i >= _tail && i < _head; }
+
+	/// Add an entry, overwriting the oldest one if full. Returns its position.
+	uint64_t push_back(const RetEntry &entry);
+
+	/// Returns the entry at the absolute position \a i, or NULL
+	const RetEntry *at(uint64_t i) const;
+
+	/// Forget all the entries, the positions keep growing
+	void clear();
+
+	/**
+	 * \brief    Append the entries overlapping ]timeStart, timeEnd[.
+	 *
+	 * \details  An entry overlaps the window when it ends after
+	 *           \a timeStart and starts before \a timeEnd. The entries
+	 *           are appended by duration class, then by end time.
+	 *
+	 * \param    timeStart   The start of the window, in ns
+	 * \param    timeEnd     The end of the window, in ns
+	 * \param    entries     The vector to append the entries to
+	 * \return   The number of entries appended.
+	 */
+	size_t fetch(uint64_t timeStart, uint64_t timeEnd,
+		     std::vector<RetEntry> &entries) const;
+};
+
+#endif // RETHISTORY_H
@@ -8,11 +8,26 @@
 #ifndef RINGBUFFER_H
 #define RINGBUFFER_H
 
+#include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
 #include <atomic>
 #include <list>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "ringbufferallocator.h"
 
 /**
  * \class     RingBuffer
@@ -36,6 +51,43 @@
  *            staging area is introduced by this class to keep an atomic commit
  *            of both the data and its meta-data.
  *
+ *            Markers are kept in a fixed-capacity ring of their own, sorted
+ *            by position. Looking a marker up is a binary search and never
+ *            takes a lock. A marker is dropped once the tail went past the
+ *            next one, when no valid element refers to it anymore. The
+ *            capacity defaults to one marker per 64 elements of the ring.
+ *            If more markers than that are needed, the oldest one is
+ *            dropped along with the elements it annotates: every valid
+ *            element keeps its marker.
+ *
+ *            The ring buffer can optionally be *mirrored*: the same physical
+ *            pages are mapped twice, back-to-back, in the virtual address
+ *            space. Reading or writing past the end of the ring then lands at
+ *            its beginning, so every request of up to #ringLength elements
+ *            is served in one contiguous chunk. The ring's length is rounded
+ *            up to the page size in this mode. If the mapping cannot be
+ *            created, the ring falls back to the split mode (see #isMirrored).
+ *
+ *            The ring's storage is allocated by a #RingBufferAllocator which
+ *            takes care of the alignment, huge pages and mirroring. The
+ *            elements are not constructed so \a Sample must be trivially
+ *            copyable. Consumers running on a different NUMA node than the
+ *            producer can move the ring next to them with
+ *            #bindToCurrentNode.
+ *
+ *            Consumers that need to wait for new data should use
+ *            #waitForAvailable instead of polling. The producer only
+ *            issues a wake-up system call when a consumer is actually
+ *            sleeping, so the cost for the producer is a single atomic load
+ *            when nobody waits. Consumers with tight latency requirements can
+ *            ask for some busy-waiting before sleeping (see #setWaitSpinCount).
+ *
+ *            Consumers can register a named #Cursor on the ring to track
+ *            their position. A cursor records how late its consumer is and
+ *            how many times and by how many elements it got overrun, which
+ *            makes it easy to spot the consumer that cannot keep up (see
+ *            #cursorsStatistics).
+ *
  *            **Thread-safety:** There can be only one producer without locking.
  *            Multiple consumers are ok.
  *
@@ -93,9 +145,115 @@
 template <class Sample, class Marker>
 class RingBuffer
 {
+public:
+	/// What a #Cursor should do when the data it points to got overridden
+	enum OverrunPolicy {
+		SKIP_TO_OLDEST_VALID = 0, ///< Restart from the tail, lose as few elements as possible
+		SKIP_TO_HEAD = 1 ///< Restart from the head, only process fresh data
+	};
+
+	/// The statistics of a #Cursor, see #cursorsStatistics
+	struct CursorStatistics
+	{
+		std::string name; ///< The name of the consumer
+		uint64_t position; ///< The current position of the consumer
+		uint64_t lag; ///< The number of elements available to the consumer
+		uint64_t overrunCount; ///< The number of overruns
+		uint64_t droppedCount; ///< The number of elements skipped because of overruns
+	};
+
+	/**
+	 * \class     Cursor
+	 * \brief     The read position of a consumer, registered on a #RingBuffer.
+	 *
+	 * \details   Consumers move their cursor forward when they are done
+	 *            with some data and call #recover before reading to
+	 *            handle overruns according to the cursor's #OverrunPolicy.
+	 *
+	 *            **Thread-safety:** Only the consumer owning the cursor
+	 *            should move it. Statistics can be read from any thread.
+	 */
+	class Cursor
+	{
+		const RingBuffer &_rb; ///< The ring the cursor reads from
+		std::string _name; ///< The name of the consumer
+		OverrunPolicy _policy; ///< What to do on overruns
+
+		std::atomic<uint64_t> _pos; ///< The position of the consumer
+		std::atomic<uint64_t> _overruns; ///< The number of overruns
+		std::atomic<uint64_t> _dropped; ///< The number of elements skipped
+
+	public:
+		Cursor(const RingBuffer &rb, const std::string &name,
+		       OverrunPolicy policy, uint64_t pos) : _rb(rb), _name(name),
+			_policy(policy), _pos(pos), _overruns(0), _dropped(0)
+		{
+		}
+
+		const std::string &name() const { return _name; }
+		OverrunPolicy policy() const { return _policy; }
+		void setPolicy(OverrunPolicy policy) { _policy = policy; }
+
+		/// Returns the position of the consumer
+		uint64_t position() const { return _pos.load(); }
+
+		/// Move the consumer to \a pos
+		void setPosition(uint64_t pos) { _pos.store(pos); }
+
+		/// Move the consumer forward by \a n elements
+		void advance(size_t n) { _pos.fetch_add(n); }
+
+		/// Returns the number of elements available to the consumer
+		uint64_t lag() const
+		{
+			uint64_t head = _rb.head(), pos = _pos.load();
+			return head > pos ? head - pos : 0;
+		}
+
+		uint64_t overrunCount() const { return _overruns.load(); }
+		uint64_t droppedCount() const { return _dropped.load(); }
+
+		/**
+		 * \brief    Handle an overrun of the consumer, if any
+		 *
+		 * \details  If the consumer's position has been overridden by
+		 *           the producer, it is moved according to the cursor's
+		 *           policy and the overrun is accounted for.
+		 *
+		 * \return   True if the consumer got overrun, false otherwise.
+		 */
+		bool recover()
+		{
+			uint64_t pos = _pos.load();
+			uint64_t tail = _rb.tail();
+
+			if (pos >= tail)
+				return false;
+
+			uint64_t newPos = (_policy == SKIP_TO_HEAD) ? _rb.head() : tail;
+			_pos.store(newPos);
+			_dropped.fetch_add(newPos - pos);
+			_overruns.fetch_add(1);
+
+			return true;
+		}
+
+		/// Returns the statistics of the cursor
+		CursorStatistics statistics() const
+		{
+			CursorStatistics s = { _name, position(), lag(),
+					       overrunCount(), droppedCount() };
+			return s;
+		}
+	};
+
 protected:
 	size_t _ring_length; ///< The length of the ring buffer
-	std::auto_ptr<Sample> _ring; ///< The ring buffer
+	Sample *_ring; ///< The ring buffer
+	bool _mirrored; ///< Is the ring mapped twice in a row?
+
+	boost::shared_ptr<RingBufferAllocator> _allocator; ///< The allocator of the ring
+	RingBufferAllocation _allocation; ///< The ring's storage
 
 	std::atomic<uint64_t> _newHead; ///< The head of the staging area
 	std::atomic<uint64_t> _head; ///< The head of the public area
@@ -107,8 +265,124 @@ protected:
 		uint64_t pos; ///< Position of the marker
 		Marker m; ///< The marker
 	};
-	boost::mutex _markersMutex; ///< Mutex to protect the markers' list
-	std::list<MarkerInternal> _markers; ///< The markers' list
+	size_t _markers_length; ///< The length of the markers' ring
+	std::vector<MarkerInternal> _markers; ///< The markers' ring, sorted by position
+
+	std::atomic<uint64_t> _markersNewHead; ///< The head of the markers' staging area
+	std::atomic<uint64_t> _markersHead; ///< The head of the public markers
+	std::atomic<uint64_t> _markersTail; ///< The oldest marker, annotating the tail
+
+	std::atomic<uint32_t> _writeSeq; ///< Futex word, incremented when waking consumers up
+	std::atomic<uint32_t> _waiters; ///< The number of consumers sleeping on #_writeSeq
+	uint32_t _spinCount; ///< Polling iterations before sleeping in #waitForAvailable
+
+	mutable boost::mutex _cursorsMutex; ///< Mutex to protect the cursors' list
+	std::list<Cursor> _cursors; ///< The registered consumers
+
+	/// Sleep until #_writeSeq differs from \a seq or \a timeout expires
+	void futexWait(uint32_t seq, const struct timespec *timeout)
+	{
+		syscall(SYS_futex, (uint32_t *)&_writeSeq, FUTEX_WAIT_PRIVATE,
+			seq, timeout, NULL, 0);
+	}
+
+	/// Wake up all the consumers sleeping in #waitForAvailable
+	void futexWakeAll()
+	{
+		_writeSeq.fetch_add(1);
+		syscall(SYS_futex, (uint32_t *)&_writeSeq, FUTEX_WAKE_PRIVATE,
+			INT_MAX, NULL, NULL, 0);
+	}
+
+	static uint64_t monotonicTimeNs()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+
+	/// Drop the markers only annotating elements located before \a pos
+	void dropMarkersBefore(uint64_t pos)
+	{
+		uint64_t tail = _markersTail.load();
+		uint64_t newHead = _markersNewHead.load();
+
+		while (tail + 1 < newHead && _markers[(tail + 1) % _markers_length].pos <= pos)
+			tail++;
+
+		_markersTail.store(tail, std::memory_order_release);
+	}
+
+	/**
+	 * \brief    Binary search of the last marker located at or before \a pos
+	 *
+	 * \details  The search is lock-free. Markers' slots may be recycled by
+	 *           the producer while we are reading them, so the search is
+	 *           restarted when the markers' tail moved past the slots we
+	 *           looked at.
+	 *
+	 * \param[in]  pos         The position from which the marker should be
+	 *                         searched for.
+	 * \param[out] mi          Stores a copy of the marker found.
+	 *
+	 * \return   True if a marker has been found, false otherwise.
+	 */
+	bool searchMarker(uint64_t pos, MarkerInternal *mi) const
+	{
+		uint64_t lo, hi;
+		bool found;
+
+		do {
+			lo = _markersTail.load(std::memory_order_acquire);
+			hi = _markersHead.load(std::memory_order_acquire);
+
+			uint64_t low = lo;
+			found = false;
+			while (low < hi) {
+				uint64_t mid = low + (hi - low) / 2;
+				const MarkerInternal &m = _markers[mid % _markers_length];
+				if (m.pos <= pos) {
+					*mi = m;
+					found = true;
+					low = mid + 1;
+				} else
+					hi = mid;
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+		} while (lo < _markersTail.load());
+
+		return found;
+	}
+
+	/// Same as #searchMarker, for the first marker located after \a pos
+	bool searchNextMarker(uint64_t pos, MarkerInternal *mi) const
+	{
+		uint64_t lo, hi;
+		bool found;
+
+		do {
+			lo = _markersTail.load(std::memory_order_acquire);
+			hi = _markersHead.load(std::memory_order_acquire);
+
+			uint64_t low = lo;
+			found = false;
+			while (low < hi) {
+				uint64_t mid = low + (hi - low) / 2;
+				const MarkerInternal &m = _markers[mid % _markers_length];
+				if (m.pos > pos) {
+					*mi = m;
+					found = true;
+					hi = mid;
+				} else
+					low = mid + 1;
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+		} while (lo < _markersTail.load());
+
+		return found;
+	}
 
 	/// Same as #requestRead, but without boundary checks
 	void requestRead_unsafe(uint64_t pos, size_t *length, Sample **samples)
@@ -116,10 +390,13 @@ protected:
 		size_t packetSize = *length;
 
 		/* check that we won't be wrapping around  */
-		if ((pos % _ring_length) + packetSize >= _ring_length)
+		if (_mirrored) {
+			if (packetSize > _ring_length)
+				packetSize = _ring_length;
+		} else if ((pos % _ring_length) + packetSize >= _ring_length)
 			packetSize = (_ring_length - (pos % _ring_length));
 
-		*samples = (_ring.get() + (pos % _ring_length));
+		*samples = (_ring + (pos % _ring_length));
 		*length = packetSize;
 	}
 
@@ -128,15 +405,69 @@ public:
 	/**
 	 * \brief    Construct a new ring buffer
 	 *
-	 * \param    size The maximum number of elements to be stored in the ring buffer.
+	 * \param    size            The maximum number of elements to be stored in the ring buffer.
+	 * \param    allocator       The allocator of the ring's storage. See
+	 *                           #RingBufferAllocator for the default one.
+	 * \param    markersCapacity The maximum number of markers to be stored,
+	 *                           0 for one per 64 elements (at least 4096).
 	 * \return   Nothing.
 	 */
-	RingBuffer(size_t size) : _ring_length(size),
-		_ring(new Sample[size * sizeof(Sample)]), _newHead(0), _head(0),
-		_tail(0)
+	RingBuffer(size_t size, boost::shared_ptr<RingBufferAllocator> allocator =
+			boost::shared_ptr<RingBufferAllocator>(new RingBufferAllocator()),
+		   size_t markersCapacity = 0)
+		: _ring_length(size), _ring(NULL), _mirrored(false),
+		_allocator(allocator), _newHead(0), _head(0), _tail(0),
+		_markers_length(markersCapacity), _markersNewHead(0), _markersHead(0),
+		_markersTail(0), _writeSeq(0), _waiters(0), _spinCount(0)
+	{
+		if (!_allocator->allocate(sizeof(Sample), size, &_allocation))
+			throw std::bad_alloc();
+
+		_ring = (Sample *)_allocation.ptr;
+		_ring_length = _allocation.length;
+		_mirrored = _allocation.mirrored;
+
+		if (_markers_length == 0)
+			_markers_length = std::max(_ring_length / 64, (size_t)4096);
+		_markers.resize(_markers_length);
+	}
+
+	~RingBuffer()
+	{
+		_allocator->release(_allocation);
+	}
+
+	/**
+	 * \brief    Returns true if the ring is backed by huge pages.
+	 * \return   True if the ring is backed by huge pages.
+	 */
+	bool usesHugePages() const { return _allocation.hugePages; }
+
+	/**
+	 * \brief    Move the ring's storage to the NUMA node of the calling thread
+	 *
+	 * \details  Should be called by the most demanding consumer once it
+	 *           runs on its final CPU.
+	 *
+	 * \return   True on success, false otherwise.
+	 */
+	bool bindToCurrentNode()
 	{
+		return _allocator->bindToNode(_allocation, -1);
 	}
 
+	/**
+	 * \brief    Returns true if the ring is mapped twice in a row.
+	 * \return   True if reads of up to #ringLength elements are never split.
+	 */
+	bool isMirrored() const { return _mirrored; }
+
+	/**
+	 * \brief    Returns the maximum number of markers that can be stored.
+	 * \return   The maximum number of markers that can be stored.
+	 */
+	size_t markersCapacity() const { return _markers_length; }
+
 	/**
 	 * \brief    Returns the maximum number of elements that can be stored in the ring buffer.
 	 * \return   The maximum number of elements that can be stored in the ring buffer.
@@ -170,6 +501,130 @@ public:
 		return (pos + n) < _head.load();
 	}
 
+	/**
+	 * \brief    Wait until there are n entries available starting from pos.
+	 *
+	 * \details  The calling thread first polls the ring #waitSpinCount
+	 *           times then goes to sleep until the producer calls
+	 *           #validateWrite. It is woken up by every write and goes back
+	 *           to sleep until enough elements are available.
+	 *
+	 * \param[in] pos         The position from which the elements are wanted.
+	 * \param[in] n           The number of elements wanted.
+	 * \param[in] timeoutNs   The maximum time to wait, in nanoseconds.
+	 *
+	 * \return   True if the elements are available, false if the timeout
+	 *           expired.
+	 *
+	 * \sa #hasNAvailableFrom, #setWaitSpinCount
+	 */
+	bool waitForAvailable(uint64_t pos, size_t n, uint64_t timeoutNs)
+	{
+		for (uint32_t i = 0; i < _spinCount; i++) {
+			if (hasNAvailableFrom(pos, n))
+				return true;
+#if defined(__i386__) || defined(__x86_64__)
+			__builtin_ia32_pause();
+#endif
+		}
+
+		uint64_t deadline = monotonicTimeNs() + timeoutNs;
+		while (true) {
+			uint32_t seq = _writeSeq.load();
+
+			/* register as a waiter before the last check so as the
+			 * producer cannot miss us
+			 */
+			_waiters.fetch_add(1);
+			if (hasNAvailableFrom(pos, n)) {
+				_waiters.fetch_sub(1);
+				return true;
+			}
+
+			uint64_t now = monotonicTimeNs();
+			if (now >= deadline) {
+				_waiters.fetch_sub(1);
+				return false;
+			}
+
+			struct timespec timeout;
+			timeout.tv_sec = (deadline - now) / 1000000000ULL;
+			timeout.tv_nsec = (deadline - now) % 1000000000ULL;
+			futexWait(seq, &timeout);
+
+			_waiters.fetch_sub(1);
+		}
+	}
+
+	/**
+	 * \brief    Set how many times #waitForAvailable polls before sleeping
+	 *
+	 * \details  Polling burns a core but avoids the wake-up latency of the
+	 *           scheduler. The default is 0, consumers sleep right away.
+	 *
+	 * \param[in] spinCount   The number of polling iterations.
+	 *
+	 * \return   Nothing.
+	 */
+	void setWaitSpinCount(uint32_t spinCount) { _spinCount = spinCount; }
+
+	/// Returns the number of polling iterations done by #waitForAvailable
+	uint32_t waitSpinCount() const { return _spinCount; }
+
+	/**
+	 * \brief    Register a new consumer on the ring buffer
+	 *
+	 * \param[in] name      The name of the consumer, used for statistics.
+	 * \param[in] policy    What to do when the consumer gets overrun.
+	 *
+	 * \return   The consumer's cursor, starting at the current head. It
+	 *           stays valid until #unregisterCursor is called.
+	 *
+	 * \sa #unregisterCursor, #cursorsStatistics
+	 */
+	Cursor *registerCursor(const std::string &name,
+			       OverrunPolicy policy = SKIP_TO_HEAD)
+	{
+		boost::mutex::scoped_lock lock(_cursorsMutex);
+		_cursors.emplace_back(*this, name, policy, head());
+		return &_cursors.back();
+	}
+
+	/**
+	 * \brief    Unregister a consumer and free its cursor
+	 *
+	 * \param[in] cursor    The cursor returned by #registerCursor.
+	 *
+	 * \return   Nothing.
+	 */
+	void unregisterCursor(Cursor *cursor)
+	{
+		boost::mutex::scoped_lock lock(_cursorsMutex);
+		typename std::list<Cursor>::iterator it;
+		for (it = _cursors.begin(); it != _cursors.end(); ++it) {
+			if (&(*it) == cursor) {
+				_cursors.erase(it);
+				return;
+			}
+		}
+	}
+
+	/**
+	 * \brief    Get the statistics of all the registered consumers
+	 * \return   The lag and overrun accounting of every consumer.
+	 */
+	std::vector<CursorStatistics> cursorsStatistics() const
+	{
+		std::vector<CursorStatistics> stats;
+
+		boost::mutex::scoped_lock lock(_cursorsMutex);
+		typename std::list<Cursor>::const_iterator it;
+		for (it = _cursors.begin(); it != _cursors.end(); ++it)
+			stats.push_back((*it).statistics());
+
+		return stats;
+	}
+
 	/**
 	 * \brief    Returns head's position
 	 * \return   Returns the position of the head
@@ -189,21 +644,29 @@ public:
 	}
 
 	/**
-	 * \brief    Empties the ring buffer and markers.
+	 * \brief    Empties the ring buffer and markers, rewinds the cursors.
+	 *
+	 * \warning  The reads and the marker lookups never take a lock, they
+	 *           cannot be protected against this function. Only call it
+	 *           when no consumer is reading the ring.
 	 *
 	 * \return   Nothing.
 	 */
 	void clear()
 	{
-		_markersMutex.lock();
+		boost::mutex::scoped_lock lock(_cursorsMutex);
 
 		_newHead = 0;
-		 _head = 0;
+		_head = 0;
 		_tail = 0;
 
-		_markers.clear();
+		_markersNewHead = 0;
+		_markersHead = 0;
+		_markersTail = 0;
 
-		_markersMutex.unlock();
+		typename std::list<Cursor>::iterator it;
+		for (it = _cursors.begin(); it != _cursors.end(); ++it)
+			(*it).setPosition(0);
 	}
 
 	/**
@@ -229,7 +692,7 @@ public:
 	 * \return   The samples of elements that can be read. The number can be
 	 * lower than what has been requested due to the ring buffer's wrap
 	 * around. In this case, one should call #requestRead with \a restartPos as
-	 * a starting position.
+	 * a starting position. This never happens on a mirrored ring.
 	 *
 	 * \sa #requestRead, #isPositionValid, #addSamples, #requestWrite
 	 */
@@ -249,7 +712,7 @@ public:
 				*samples = NULL;
 		} else {
 			/* check that we won't be wrapping around */
-			if ((wantedPos % _ring_length) + n >= _ring_length)
+			if (!_mirrored && (wantedPos % _ring_length) + n >= _ring_length)
 				packetSize = (_ring_length - (wantedPos % _ring_length));
 
 			if (startPos)
@@ -257,7 +720,7 @@ public:
 			if (restartPos)
 				*restartPos = wantedPos + packetSize;
 			if (samples)
-				*samples = (_ring.get() + (wantedPos % _ring_length));
+				*samples = (_ring + (wantedPos % _ring_length));
 		}
 
 		return packetSize;
@@ -327,7 +790,6 @@ public:
 	 */
 	size_t requestWrite(size_t length, Sample **samples)
 	{
-		uint64_t tail = _tail.load();
 		uint64_t newHead = _newHead.load();
 		size_t packetSize = length;
 		requestRead_unsafe(newHead, &packetSize, samples);
@@ -339,11 +801,7 @@ public:
 			if (wantedTail > _head.load())
 				_head.store(wantedTail);
 			_tail.store(wantedTail);
-
-			/* delete the markers that have been overridden */
-			typename std::list<MarkerInternal>::iterator it =_markers.begin();
-			while (it != _markers.end() && (*it).pos >= tail && (*it).pos < wantedTail)
-				it = _markers.erase(it);
+			dropMarkersBefore(wantedTail);
 		}
 
 		_newHead.store(wantedNewHead);
@@ -357,7 +815,8 @@ public:
 	 * \details  When data is added, it is staged and not made public until
 	 *           #validateWrite is called. This staging area is meant to let
 	 *           developers add both data and markers before making
-	 *           them public.
+	 *           them public. Consumers sleeping in #waitForAvailable are
+	 *           woken up.
 	 *
 	 * \return   Nothing.
 	 *
@@ -365,7 +824,11 @@ public:
 	 */
 	void validateWrite()
 	{
+		_markersHead.store(_markersNewHead.load(), std::memory_order_release);
 		_head.store(_newHead.load());
+
+		if (_waiters.load() > 0)
+			futexWakeAll();
 	}
 
 	/**
@@ -417,6 +880,10 @@ public:
 	 *                        stored in added in the staging area otherwise,
 	 *                        the function will return false.
 	 *
+	 *                        When the markers' ring is full, the oldest
+	 *                        marker is dropped and the tail moves to the
+	 *                        next one.
+	 *
 	 * \return   True if the position was valid and the marker has been
 	 *           added. False if the position was invalid (position not in
 	 *           the staging area).
@@ -428,24 +895,53 @@ public:
 		if (!(pos >= _head.load() && pos < _newHead.load()))
 			return false;
 
-		_markersMutex.lock();
+		uint64_t newHead = _markersNewHead.load();
 
-		MarkerInternal m = {pos, marker};
+		/* the elements of the oldest marker go with it. The marker's
+		 * slot is not recycled before the readers can notice it.
+		 */
+		if (newHead - _markersTail.load() >= _markers_length) {
+			uint64_t tail = _markersTail.load() + 1;
+			uint64_t tailPos = _markers[tail % _markers_length].pos;
+
+			if (tailPos > _tail.load()) {
+				if (tailPos > _head.load())
+					_head.store(tailPos);
+				_tail.store(tailPos);
+			}
+			_markersTail.store(tail, std::memory_order_release);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (pos < _tail.load())
+				return false;
+		}
+
+		uint64_t head = std::max(_markersHead.load(), _markersTail.load());
+		uint64_t i = newHead;
 
-		typename std::list<MarkerInternal>::reverse_iterator rit;
-		for (rit =_markers.rbegin(); rit!=_markers.rend(); ++rit) {
-			if ((*rit).pos == pos) {
-				(*rit).m = marker;
-			} else if ((*rit).pos < pos) {
-				_markers.insert(rit.base(), m);
-				goto exit;
+		/* replace the staged marker at the same position, if any */
+		while (i > head && _markers[(i - 1) % _markers_length].pos >= pos) {
+			MarkerInternal &m = _markers[(i - 1) % _markers_length];
+			if (m.pos == pos) {
+				m.m = marker;
+				return true;
 			}
+			i--;
 		}
 
-		_markers.push_front(m);
+		/* reserve the slot before writing it so as readers can detect the
+		 * wrap around. Staged markers are not visible to the readers so
+		 * we can shift them freely to keep the ring sorted.
+		 */
+		_markersNewHead.store(newHead + 1);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for (uint64_t e = newHead; e > i; e--)
+			_markers[e % _markers_length] = _markers[(e - 1) % _markers_length];
+
+		MarkerInternal m = {pos, marker};
+		_markers[i % _markers_length] = m;
 
-exit:
-		_markersMutex.unlock();
 		return true;
 	}
 
@@ -460,22 +956,15 @@ exit:
 	 *
 	 * \sa #findMarker, #addMarker
 	 */
-	bool getMarker(uint64_t markerPos, Marker *marker)
+	bool getMarker(uint64_t markerPos, Marker *marker) const
 	{
-		typename std::list<MarkerInternal>::reverse_iterator rit;
-		bool ret = false;
+		MarkerInternal mi;
 
-		_markersMutex.lock();
-		for (rit =_markers.rbegin(); rit!=_markers.rend(); ++rit) {
-			if ((*rit).pos == markerPos) {
-				*marker = (*rit).m;
-				ret = true;
-				break;
-			}
-		}
-		_markersMutex.unlock();
+		if (!searchMarker(markerPos, &mi) || mi.pos != markerPos)
+			return false;
 
-		return ret;
+		*marker = mi.m;
+		return true;
 	}
 
 	/**
@@ -490,28 +979,43 @@ exit:
 	 *
 	 * \sa #getMarker, #addMarker
 	 */
-	bool findMarker(uint64_t pos, Marker *marker, uint64_t *markerPos)
+	bool findMarker(uint64_t pos, Marker *marker, uint64_t *markerPos) const
 	{
-		bool ret = false;
+		MarkerInternal mi;
 
 		if (!isPositionValid(pos))
 			return false;
 
-		_markersMutex.lock();
-		typename std::list<MarkerInternal>::reverse_iterator rit = _markers.rbegin();
+		if (!searchMarker(pos, &mi))
+			return false;
 
-		while (rit != _markers.rend() && (*rit).pos > pos)
-			++rit;
+		*marker = mi.m;
+		*markerPos = mi.pos;
+		return true;
+	}
 
-		if (rit != _markers.rend()) {
-			*marker = (*rit).m;
-			*markerPos = (*rit).pos;
-			ret = true;
-		}
+	/**
+	 * \brief    Find the marker right after a position
+	 *
+	 * \param[in] pos         The position after which the marker should be
+	 *                        searched for.
+	 * \param[out] marker     Stores the retrieved marker.
+	 * \param[out] markerPos  Stores the marker's position, greater than \a pos.
+	 *
+	 * \return   True if a public marker has been found, false otherwise.
+	 *
+	 * \sa #findMarker, #addMarker
+	 */
+	bool findNextMarker(uint64_t pos, Marker *marker, uint64_t *markerPos) const
+	{
+		MarkerInternal mi;
 
-		_markersMutex.unlock();
+		if (!searchNextMarker(pos, &mi))
+			return false;
 
-		return ret;
+		*marker = mi.m;
+		*markerPos = mi.pos;
+		return true;
 	}
 };
 
@@ -0,0 +1,266 @@
+/**
+ * \file      ringbufferallocator.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef RINGBUFFERALLOCATOR_H
+#define RINGBUFFERALLOCATOR_H
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+
+/// Describes the memory backing a #RingBuffer, see #RingBufferAllocator
+struct RingBufferAllocation
+{
+	void *ptr; ///< The address of the ring
+	size_t length; ///< The number of elements in the ring (may be rounded up)
+	size_t bytes; ///< The size of the ring, in bytes
+	size_t mappedBytes; ///< The number of bytes mapped, 0 if the ring is on the heap
+	bool mirrored; ///< The ring is mapped twice in a row
+	bool hugePages; ///< The ring is backed by huge pages
+};
+
+/**
+ * \class     RingBufferAllocator
+ * \brief     Allocates the storage of a #RingBuffer.
+ *
+ * \details   The default implementation aligns the ring on \a alignment
+ *            bytes (64 by default, a cache line) and can optionally back it
+ *            with huge pages and/or map it twice in a row (mirrored ring).
+ *
+ *            When explicit huge pages (MAP_HUGETLB) are not available, the
+ *            allocator falls back to normal pages and asks for transparent
+ *            huge pages instead. When the mirrored mapping cannot be
+ *            created, the allocator falls back to a normal allocation. The
+ *            #RingBufferAllocation tells what has actually been done.
+ *
+ *            Inherit from this class and override #allocate, #release and
+ *            #bindToNode to plug another allocation strategy.
+ *
+ *            **Thread-safety:** The default allocator is stateless once
+ *            constructed and thus thread safe.
+ */
+class RingBufferAllocator
+{
+	size_t _alignment; ///< The wanted alignment of the ring, in bytes
+	bool _hugePages; ///< Should the ring be backed by huge pages?
+	bool _mirrored; ///< Should the ring be mapped twice in a row?
+
+	static size_t pageSize() { return sysconf(_SC_PAGESIZE); }
+	static size_t hugePageSize() { return 2 * 1024 * 1024; }
+
+	static size_t gcd(size_t a, size_t b)
+	{
+		while (b) {
+			size_t t = a % b;
+			a = b;
+			b = t;
+		}
+		return a;
+	}
+
+	/// Round \a length up so as \a length * \a elementSize is a multiple of \a page
+	static size_t roundUpLength(size_t length, size_t elementSize, size_t page)
+	{
+		size_t unit = page / gcd(page, elementSize);
+		return (length + unit - 1) / unit * unit;
+	}
+
+	bool mapMirrored(size_t elementSize, size_t length, bool hugePages,
+			 RingBufferAllocation *a) const
+	{
+		size_t page = hugePages ? hugePageSize() : pageSize();
+		size_t len = roundUpLength(length, elementSize, page);
+		size_t bytes = len * elementSize;
+
+		int fd = memfd_create("ringbuffer", MFD_CLOEXEC | (hugePages ? MFD_HUGETLB : 0));
+		if (fd < 0)
+			return false;
+
+		if (ftruncate(fd, bytes) < 0) {
+			close(fd);
+			return false;
+		}
+
+		/* reserve the address space and map the file twice in it */
+		char *addr = (char *)mmap(NULL, 2 * bytes, PROT_NONE,
+					  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (addr == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+
+		if (mmap(addr, bytes, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+		    mmap(addr + bytes, bytes, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			munmap(addr, 2 * bytes);
+			close(fd);
+			return false;
+		}
+		close(fd);
+
+		a->ptr = addr;
+		a->length = len;
+		a->bytes = bytes;
+		a->mappedBytes = 2 * bytes;
+		a->mirrored = true;
+		a->hugePages = hugePages;
+		return true;
+	}
+
+	bool mapAnonymous(size_t elementSize, size_t length, bool hugePages,
+			  RingBufferAllocation *a) const
+	{
+		size_t page = hugePages ? hugePageSize() : pageSize();
+		size_t bytes = (length * elementSize + page - 1) / page * page;
+
+		void *addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+				  MAP_PRIVATE | MAP_ANONYMOUS | (hugePages ? MAP_HUGETLB : 0),
+				  -1, 0);
+		if (addr == MAP_FAILED)
+			return false;
+
+		a->ptr = addr;
+		a->length = length;
+		a->bytes = length * elementSize;
+		a->mappedBytes = bytes;
+		a->mirrored = false;
+		a->hugePages = hugePages;
+		return true;
+	}
+
+public:
+	/**
+	 * \brief    Construct an allocator
+	 *
+	 * \param    alignment   The wanted alignment of the ring, in bytes.
+	 *                       Must be a power of two.
+	 * \param    hugePages   Back the ring with huge pages, when possible.
+	 * \param    mirrored    Map the ring twice in a row, when possible.
+	 * \return   Nothing.
+	 */
+	RingBufferAllocator(size_t alignment = 64, bool hugePages = false,
+			    bool mirrored = false) : _alignment(alignment),
+		_hugePages(hugePages), _mirrored(mirrored)
+	{
+	}
+
+	virtual ~RingBufferAllocator() {}
+
+	size_t alignment() const { return _alignment; }
+	bool hugePages() const { return _hugePages; }
+	bool mirrored() const { return _mirrored; }
+
+	/**
+	 * \brief    Allocate the storage of a ring
+	 *
+	 * \param[in]  elementSize  The size of an element of the ring.
+	 * \param[in]  length       The wanted number of elements.
+	 * \param[out] a            Describes the allocated storage.
+	 *
+	 * \return   True on success, false otherwise.
+	 */
+	virtual bool allocate(size_t elementSize, size_t length,
+			      RingBufferAllocation *a) const
+	{
+		if (_mirrored) {
+			if (_hugePages && mapMirrored(elementSize, length, true, a))
+				return true;
+			if (mapMirrored(elementSize, length, false, a)) {
+				if (_hugePages)
+					madvise(a->ptr, a->mappedBytes, MADV_HUGEPAGE);
+				return true;
+			}
+		}
+
+		/* mappings are page-aligned, which covers any sane alignment */
+		if (_hugePages || _alignment > pageSize()) {
+			if (_hugePages && mapAnonymous(elementSize, length, true, a))
+				return true;
+			if (mapAnonymous(elementSize, length, false, a)) {
+				if (_hugePages)
+					madvise(a->ptr, a->mappedBytes, MADV_HUGEPAGE);
+				return true;
+			}
+			return false;
+		}
+
+		void *ptr;
+		size_t alignment = _alignment < sizeof(void *) ? sizeof(void *) : _alignment;
+		if (posix_memalign(&ptr, alignment, length * elementSize) != 0)
+			return false;
+
+		a->ptr = ptr;
+		a->length = length;
+		a->bytes = length * elementSize;
+		a->mappedBytes = 0;
+		a->mirrored = false;
+		a->hugePages = false;
+		return true;
+	}
+
+	/**
+	 * \brief    Free the storage of a ring
+	 *
+	 * \param[in]  a            The storage returned by #allocate.
+	 *
+	 * \return   Nothing.
+	 */
+	virtual void release(const RingBufferAllocation &a) const
+	{
+		if (a.mappedBytes > 0)
+			munmap(a.ptr, a.mappedBytes);
+		else
+			free(a.ptr);
+	}
+
+	/**
+	 * \brief    Move the storage of a ring to a NUMA node
+	 *
+	 * \details  Already-touched pages are migrated. Only the pages fully
+	 *           contained in the ring are moved. The two views of a
+	 *           mirrored ring share their pages so moving one is enough.
+	 *
+	 * \param[in]  a            The storage returned by #allocate.
+	 * \param[in]  node         The NUMA node, -1 for the node of the
+	 *                          calling thread.
+	 *
+	 * \return   True on success, false otherwise.
+	 */
+	virtual bool bindToNode(const RingBufferAllocation &a, int node) const
+	{
+		if (node < 0) {
+			unsigned cpu, curNode;
+			if (syscall(SYS_getcpu, &cpu, &curNode, NULL) != 0)
+				return false;
+			node = curNode;
+		}
+
+		if (node >= (int)(8 * sizeof(unsigned long)))
+			return false;
+
+		size_t page = pageSize();
+		uintptr_t start = ((uintptr_t)a.ptr + page - 1) / page * page;
+		uintptr_t end = ((uintptr_t)a.ptr + a.bytes) / page * page;
+		if (end <= start)
+			return false;
+
+		unsigned long nodemask = 1UL << node;
+		return syscall(SYS_mbind, start, end - start, MPOL_PREFERRED,
+			       &nodemask, 8 * sizeof(nodemask), MPOL_MF_MOVE) == 0;
+	}
+};
+
+#endif // RINGBUFFERALLOCATOR_H
@@ -0,0 +1,402 @@
+#include "spectrumshm.h"
+#include "radioeventtable.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <mutex>
+#include <set>
+
+/* the readers give up on a RET snapshot overwritten this many times */
+#define RET_READ_ATTEMPTS 4
+
+/* the names published by the writers of this process */
+static std::mutex namesMutex;
+static std::set<std::string> names;
+
+static bool claimName(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(namesMutex);
+	return names.insert(name).second;
+}
+
+static void releaseName(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(namesMutex);
+	names.erase(name);
+}
+
+static uint64_t roundUp(uint64_t v, uint64_t unit)
+{
+	return (v + unit - 1) / unit * unit;
+}
+
+std::string spectrumShmName(unsigned instance)
+{
+	if (instance == 0)
+		return SPECTRUM_SHM_DEFAULT_NAME;
+
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "-%u", instance);
+	return std::string(SPECTRUM_SHM_DEFAULT_NAME) + suffix;
+}
+
+SpectrumShmWriter::Config::Config() :
+	name(SPECTRUM_SHM_DEFAULT_NAME), slotCount(256), maxBins(4096), maxRetEntries(4096)
+{
+}
+
+SpectrumShmWriter::SpectrumShmWriter(const Config &config) :
+	_config(config), _mem(NULL), _size(0), _header(NULL), _dev(0), _ino(0),
+	_frames(0), _rets(0)
+{
+	uint32_t slots = 1;
+	while (slots < _config.slotCount)
+		slots <<= 1;
+	_config.slotCount = slots;
+
+	uint64_t slotsOffset = roundUp(sizeof(SpectrumShmHeader), SPECTRUM_SHM_DATA_OFFSET);
+	uint64_t slotSize = roundUp(SPECTRUM_SHM_DATA_OFFSET + _config.maxBins * sizeof(float),
+				    SPECTRUM_SHM_DATA_OFFSET);
+	uint64_t retOffset = slotsOffset + slots * slotSize;
+	uint64_t retSize = roundUp(SPECTRUM_SHM_DATA_OFFSET +
+				   _config.maxRetEntries * sizeof(SpectrumShmRetEntry),
+				   SPECTRUM_SHM_DATA_OFFSET);
+	_size = retOffset + 2 * retSize;
+
+	if (!claimName(_config.name)) {
+		fprintf(stderr, "SpectrumShmWriter: %s is already published by this process\n",
+			_config.name.c_str());
+		return;
+	}
+
+	/* a dead writer's memory stays mapped by its readers only */
+	int fd = shm_open(_config.name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0 && errno == EEXIST) {
+		int former = shm_open(_config.name.c_str(), O_RDONLY, 0);
+		bool live = former >= 0 && isLive(former);
+		if (former >= 0)
+			close(former);
+		if (live) {
+			fprintf(stderr, "SpectrumShmWriter: %s is published by a running process\n",
+				_config.name.c_str());
+			releaseName(_config.name);
+			return;
+		}
+
+		shm_unlink(_config.name.c_str());
+		fd = shm_open(_config.name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	}
+	if (fd < 0) {
+		perror("SpectrumShmWriter: shm_open");
+		releaseName(_config.name);
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0) {
+		_dev = st.st_dev;
+		_ino = st.st_ino;
+	}
+
+	if (ftruncate(fd, _size) < 0) {
+		perror("SpectrumShmWriter: ftruncate");
+		close(fd);
+		shm_unlink(_config.name.c_str());
+		releaseName(_config.name);
+		return;
+	}
+
+	void *mem = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		perror("SpectrumShmWriter: mmap");
+		shm_unlink(_config.name.c_str());
+		releaseName(_config.name);
+		return;
+	}
+	_mem = (char *)mem;
+
+	/* ftruncate zeroed the memory: all the counters and seqlocks are 0 */
+	_header = (SpectrumShmHeader *)_mem;
+	_header->version = SPECTRUM_SHM_VERSION;
+	_header->slotCount = slots;
+	_header->maxBins = _config.maxBins;
+	_header->maxRetEntries = _config.maxRetEntries;
+	_header->writerPid = getpid();
+	_header->slotsOffset = slotsOffset;
+	_header->slotSize = slotSize;
+	_header->retOffset = retOffset;
+	_header->retSize = retSize;
+	_header->totalSize = _size;
+
+	/* the readers check the magic last */
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(_header->magic, SPECTRUM_SHM_MAGIC, sizeof(_header->magic));
+}
+
+SpectrumShmWriter::~SpectrumShmWriter()
+{
+	if (_mem) {
+		munmap(_mem, _size);
+		if (isOurs())
+			shm_unlink(_config.name.c_str());
+		releaseName(_config.name);
+	}
+}
+
+/* is the memory behind fd published by a running writer? */
+bool SpectrumShmWriter::isLive(int fd) const
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SpectrumShmHeader))
+		return false;
+
+	void *mem = mmap(NULL, sizeof(SpectrumShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED)
+		return false;
+
+	const SpectrumShmHeader *header = (const SpectrumShmHeader *)mem;
+	bool valid = memcmp(header->magic, SPECTRUM_SHM_MAGIC, sizeof(header->magic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	pid_t pid = valid && header->version == SPECTRUM_SHM_VERSION ? header->writerPid : 0;
+	munmap(mem, sizeof(SpectrumShmHeader));
+
+	/* our writers claimed their name, a former process had our pid.
+	 * EPERM: the process exists, but belongs to another user.
+	 */
+	if (pid <= 0 || pid == getpid())
+		return false;
+	return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+/* does our name still refer to our memory? */
+bool SpectrumShmWriter::isOurs() const
+{
+	int fd = shm_open(_config.name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	bool ours = fstat(fd, &st) == 0 && st.st_dev == _dev && st.st_ino == _ino;
+	close(fd);
+	return ours;
+}
+
+SpectrumShmFrame *SpectrumShmWriter::frame(uint64_t n)
+{
+	uint64_t slot = n & (_header->slotCount - 1);
+	return (SpectrumShmFrame *)(_mem + _header->slotsOffset + slot * _header->slotSize);
+}
+
+SpectrumShmRet *SpectrumShmWriter::ret(uint64_t n)
+{
+	return (SpectrumShmRet *)(_mem + _header->retOffset + (n & 1) * _header->retSize);
+}
+
+bool SpectrumShmWriter::publishSpectrum(uint64_t time_ns, uint64_t startFrequency,
+					uint64_t endFrequency, const float *bins,
+					uint32_t fftSize)
+{
+	if (!_header || fftSize > _config.maxBins)
+		return false;
+
+	SpectrumShmFrame *f = frame(_frames);
+
+	/* the readers must see the slot as being written before any change */
+	f->seq.store(2 * _frames + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	f->time_ns = time_ns;
+	f->startFrequency = startFrequency;
+	f->endFrequency = endFrequency;
+	f->fftSize = fftSize;
+	memcpy((char *)f + SPECTRUM_SHM_DATA_OFFSET, bins, fftSize * sizeof(float));
+
+	f->seq.store(2 * _frames + 2, std::memory_order_release);
+	_header->frames.store(++_frames, std::memory_order_release);
+
+	return true;
+}
+
+bool SpectrumShmWriter::publishRet(uint64_t timeNs, const RadioEventTable &table)
+{
+	if (!_header)
+		return false;
+
+	const RadioEventTable::ActiveComs &coms = table.activeCommunications();
+	SpectrumShmRet *r = ret(_rets);
+
+	r->seq.store(2 * _rets + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	SpectrumShmRetEntry *entries = (SpectrumShmRetEntry *)((char *)r + SPECTRUM_SHM_DATA_OFFSET);
+	uint32_t count = 0;
+	for (size_t i = 0; i < coms.size() && count < _config.maxRetEntries; i++) {
+		const RetEntry *entry = coms[i].entry.get();
+		SpectrumShmRetEntry &e = entries[count++];
+
+		e.id = entry->id();
+		e.timeStart = entry->timeStart();
+		e.timeEnd = entry->timeEnd();
+		e.frequencyStart = entry->frequencyStart();
+		e.frequencyEnd = entry->frequencyEnd();
+		e.address = (uint64_t)entry->psu() << 56 | entry->address();
+		e.pwr = entry->pwr();
+		memset(e.reserved, 0, sizeof(e.reserved));
+	}
+	r->timeNs = timeNs;
+	r->count = count;
+	r->activeCount = coms.size();
+
+	r->seq.store(2 * _rets + 2, std::memory_order_release);
+	_header->rets.store(++_rets, std::memory_order_release);
+
+	return count == coms.size();
+}
+
+SpectrumShmReader::SpectrumShmReader(const char *name) :
+	_mem(NULL), _size(0), _header(NULL), _next(0), _lost(0), _rets(0)
+{
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SpectrumShmHeader)) {
+		close(fd);
+		return;
+	}
+
+	void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+		return;
+	_mem = (const char *)mem;
+	_size = st.st_size;
+
+	const SpectrumShmHeader *header = (const SpectrumShmHeader *)_mem;
+	bool valid = memcmp(header->magic, SPECTRUM_SHM_MAGIC, sizeof(header->magic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!valid || header->version != SPECTRUM_SHM_VERSION ||
+	    header->totalSize > _size) {
+		fprintf(stderr, "SpectrumShmReader: %s is not a valid spectrum memory\n", name);
+		return;
+	}
+
+	_header = header;
+	_next = _header->frames.load(std::memory_order_acquire);
+}
+
+SpectrumShmReader::~SpectrumShmReader()
+{
+	if (_mem)
+		munmap((void *)_mem, _size);
+}
+
+const SpectrumShmFrame *SpectrumShmReader::frame(uint64_t n) const
+{
+	uint64_t slot = n & (_header->slotCount - 1);
+	return (const SpectrumShmFrame *)(_mem + _header->slotsOffset + slot * _header->slotSize);
+}
+
+const SpectrumShmRet *SpectrumShmReader::ret(uint64_t n) const
+{
+	return (const SpectrumShmRet *)(_mem + _header->retOffset + (n & 1) * _header->retSize);
+}
+
+uint64_t SpectrumShmReader::framesPublished() const
+{
+	return _header ? _header->frames.load(std::memory_order_acquire) : 0;
+}
+
+void SpectrumShmReader::skipToLatest()
+{
+	uint64_t published = framesPublished();
+	if (published > _next + 1) {
+		_lost += published - 1 - _next;
+		_next = published - 1;
+	}
+}
+
+bool SpectrumShmReader::readFrame(Frame &frame, std::vector<float> &bins)
+{
+	if (!_header)
+		return false;
+
+	uint64_t published = _header->frames.load(std::memory_order_acquire);
+	while (_next < published) {
+		/* the frames older than the ring are gone */
+		if (published - _next > _header->slotCount) {
+			_lost += published - _header->slotCount - _next;
+			_next = published - _header->slotCount;
+		}
+
+		const SpectrumShmFrame *f = this->frame(_next);
+		uint64_t seq = f->seq.load(std::memory_order_acquire);
+		if (seq == 2 * _next + 2) {
+			frame.sequence = _next;
+			frame.time_ns = f->time_ns;
+			frame.startFrequency = f->startFrequency;
+			frame.endFrequency = f->endFrequency;
+			frame.fftSize = f->fftSize;
+			if (frame.fftSize > _header->maxBins)
+				frame.fftSize = _header->maxBins;
+			bins.resize(frame.fftSize);
+			memcpy(bins.data(), (const char *)f + SPECTRUM_SHM_DATA_OFFSET,
+			       frame.fftSize * sizeof(float));
+
+			/* the copy is valid if the slot was not rewritten meanwhile */
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (f->seq.load(std::memory_order_relaxed) == seq) {
+				_next++;
+				return true;
+			}
+		}
+
+		/* overwritten by a later frame */
+		_lost++;
+		_next++;
+		published = _header->frames.load(std::memory_order_acquire);
+	}
+
+	return false;
+}
+
+bool SpectrumShmReader::readRet(uint64_t &timeNs, std::vector<SpectrumShmRetEntry> &entries)
+{
+	if (!_header)
+		return false;
+
+	for (int attempt = 0; attempt < RET_READ_ATTEMPTS; attempt++) {
+		uint64_t published = _header->rets.load(std::memory_order_acquire);
+		if (published == _rets)
+			return false;
+
+		const SpectrumShmRet *r = ret(published - 1);
+		uint64_t seq = r->seq.load(std::memory_order_acquire);
+		if (seq != 2 * published)
+			continue;
+
+		uint32_t count = r->count;
+		if (count > _header->maxRetEntries)
+			count = _header->maxRetEntries;
+		timeNs = r->timeNs;
+		entries.resize(count);
+		memcpy(entries.data(), (const char *)r + SPECTRUM_SHM_DATA_OFFSET,
+		       count * sizeof(SpectrumShmRetEntry));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (r->seq.load(std::memory_order_relaxed) == seq) {
+			_rets = published;
+			return true;
+		}
+	}
+
+	return false;
+}
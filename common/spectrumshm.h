@@ -0,0 +1,253 @@
+/**
+ * \file      spectrumshm.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef SPECTRUMSHM_H
+#define SPECTRUMSHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+class RadioEventTable;
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#error "the shared memory needs lock-free 64 bits atomics"
+#endif
+
+#define SPECTRUM_SHM_DEFAULT_NAME "/gtsrc-spectrum"
+#define SPECTRUM_SHM_MAGIC "GTSRCSPC"
+#define SPECTRUM_SHM_VERSION 2
+
+/**
+ * The layout of the shared memory, in the native byte order. It starts with
+ * a SpectrumShmHeader, followed at \a slotsOffset by \a slotCount frame
+ * slots of \a slotSize bytes and at \a retOffset by two RET snapshots of
+ * \a retSize bytes.
+ *
+ * Every slot and snapshot is protected by a seqlock: its \a seq is 2n + 1
+ * while the n-th frame (or snapshot) is written into it, 2n + 2 once
+ * written. A reader copies it out then checks \a seq did not change.
+ */
+struct SpectrumShmHeader
+{
+	char magic[8]; ///< SPECTRUM_SHM_MAGIC, not nul-terminated
+	uint32_t version; ///< SPECTRUM_SHM_VERSION
+	uint32_t slotCount; ///< The number of frame slots, a power of 2
+	uint32_t maxBins; ///< The largest spectrum a slot can hold
+	uint32_t maxRetEntries; ///< The most entries a RET snapshot can hold
+	uint32_t writerPid; ///< The process publishing in the memory
+	uint32_t reserved;
+	uint64_t slotsOffset; ///< The offset of the first frame slot
+	uint64_t slotSize; ///< The size of a frame slot, in bytes
+	uint64_t retOffset; ///< The offset of the first RET snapshot
+	uint64_t retSize; ///< The size of a RET snapshot, in bytes
+	uint64_t totalSize; ///< The size of the shared memory, in bytes
+	std::atomic<uint64_t> frames; ///< The frames published, frame n is in slot n % slotCount
+	std::atomic<uint64_t> rets; ///< The RET snapshots published, snapshot n is in n % 2
+};
+
+/// A frame slot, followed by the bins at offset SPECTRUM_SHM_DATA_OFFSET
+struct SpectrumShmFrame
+{
+	std::atomic<uint64_t> seq; ///< The seqlock of the slot
+	uint64_t time_ns; ///< The time of the first sample of the FFT
+	uint64_t startFrequency; ///< The frequency of the first bin, in Hz
+	uint64_t endFrequency; ///< The frequency of the last bin, in Hz
+	uint32_t fftSize; ///< The number of bins, in dBm, following the slot
+	uint32_t reserved;
+};
+
+/// An active communication of a RET snapshot
+struct SpectrumShmRetEntry
+{
+	uint64_t id;
+	uint64_t timeStart; ///< In ns
+	uint64_t timeEnd; ///< In ns
+	uint32_t frequencyStart; ///< In kHz
+	uint32_t frequencyEnd; ///< In kHz
+	uint64_t address; ///< psu << 56 | address, as in RetEntry
+	int8_t pwr;
+	uint8_t reserved[7];
+};
+
+/// A RET snapshot, followed by the entries at offset SPECTRUM_SHM_DATA_OFFSET
+struct SpectrumShmRet
+{
+	std::atomic<uint64_t> seq; ///< The seqlock of the snapshot
+	uint64_t timeNs; ///< The time of the last frame added to the RET
+	uint32_t count; ///< The entries of the snapshot
+	uint32_t activeCount; ///< The active communications, more if truncated
+};
+
+/// The offset of the data of a slot or a snapshot, a cache line
+#define SPECTRUM_SHM_DATA_OFFSET 64
+
+/**
+ * \brief    The name of the memory published by the \a instance -th writer
+ *           of a process.
+ *
+ * \return   SPECTRUM_SHM_DEFAULT_NAME for the instance 0, followed by
+ *           "-<instance>" for the others.
+ */
+std::string spectrumShmName(unsigned instance);
+
+/**
+ * \class     SpectrumShmWriter
+ * \brief     Publishes the spectra and the RET in a shared memory, for the
+ *            consumers running on the same host.
+ *
+ * \details   The shared memory is created by shm_open() with the name
+ *            given. A former memory of the same name is only replaced if
+ *            the process which wrote it is gone: the writer does not open
+ *            if another one still publishes under this name. The destructor
+ *            removes the name, unless it was given to another memory since.
+ *            See SpectrumShmHeader for its layout.
+ *
+ *            Publishing a frame copies its bins in the next slot of the
+ *            ring, without any syscall nor lock: the writer never waits for
+ *            the readers. A reader lagging by more than \a slotCount frames
+ *            loses the oldest ones.
+ *
+ *            **Thread-safety:** Not thread safe, one thread publishes.
+ */
+class SpectrumShmWriter
+{
+public:
+	/// The parameters of the shared memory
+	struct Config
+	{
+		std::string name; ///< The name given to shm_open()
+		uint32_t slotCount; ///< The frames kept, rounded up to a power of 2
+		uint32_t maxBins; ///< The largest spectrum
+		uint32_t maxRetEntries; ///< The most active communications published
+
+		/// SPECTRUM_SHM_DEFAULT_NAME, 256 slots of 4096 bins, 4096 entries
+		Config();
+	};
+
+private:
+	Config _config;
+	char *_mem;
+	size_t _size;
+	SpectrumShmHeader *_header;
+	dev_t _dev; ///< The device of the memory, to recognize it at removal
+	ino_t _ino; ///< The inode of the memory
+	uint64_t _frames; ///< The frames published, only the writer updates them
+	uint64_t _rets; ///< The RET snapshots published
+
+	SpectrumShmFrame *frame(uint64_t n);
+	SpectrumShmRet *ret(uint64_t n);
+
+	bool isLive(int fd) const;
+	bool isOurs() const;
+
+public:
+	SpectrumShmWriter(const Config &config = Config());
+	~SpectrumShmWriter();
+
+	/// Was the shared memory created?
+	bool isOpen() const { return _header != NULL; }
+	const Config &config() const { return _config; }
+
+	/**
+	 * \brief    Publish a spectrum.
+	 *
+	 * \param    time_ns          The time of the first sample of the FFT
+	 * \param    startFrequency   The frequency of the first bin, in Hz
+	 * \param    endFrequency     The frequency of the last bin, in Hz
+	 * \param    bins             The power of the bins, in dBm
+	 * \param    fftSize          The number of bins, up to \a maxBins
+	 * \return   False if the memory is not open or the spectrum too large.
+	 */
+	bool publishSpectrum(uint64_t time_ns, uint64_t startFrequency,
+			     uint64_t endFrequency, const float *bins,
+			     uint32_t fftSize);
+
+	/// Publish the active communications of \a ret, up to \a maxRetEntries
+	bool publishRet(uint64_t timeNs, const RadioEventTable &ret);
+
+	uint64_t framesPublished() const { return _frames; }
+	uint64_t retsPublished() const { return _rets; }
+};
+
+/**
+ * \class     SpectrumShmReader
+ * \brief     Reads the spectra and the RET published by a SpectrumShmWriter.
+ *
+ * \details   The shared memory is mapped read-only. Reading does no syscall
+ *            nor lock: #readFrame copies the next frame out of its slot,
+ *            and skips the frames overwritten before or while being copied.
+ *            The frames skipped are counted by #lostFrames.
+ *
+ *            A consumer only needs this header and spectrumshm.cpp, built
+ *            along with the common directory, not GNU Radio.
+ *
+ *            **Thread-safety:** Not thread safe, but any number of readers
+ *            may read the same memory.
+ */
+class SpectrumShmReader
+{
+public:
+	/// The description of a frame read
+	struct Frame
+	{
+		uint64_t sequence; ///< The number of the frame since the writer started
+		uint64_t time_ns; ///< The time of the first sample of the FFT
+		uint64_t startFrequency; ///< The frequency of the first bin, in Hz
+		uint64_t endFrequency; ///< The frequency of the last bin, in Hz
+		uint32_t fftSize; ///< The number of bins
+	};
+
+private:
+	const char *_mem;
+	size_t _size;
+	const SpectrumShmHeader *_header;
+	uint64_t _next; ///< The next frame to read
+	uint64_t _lost; ///< The frames skipped
+	uint64_t _rets; ///< The RET snapshots published at the last #readRet
+
+	const SpectrumShmFrame *frame(uint64_t n) const;
+	const SpectrumShmRet *ret(uint64_t n) const;
+
+public:
+	/// Map the memory published under \a name, see #isOpen
+	SpectrumShmReader(const char *name = SPECTRUM_SHM_DEFAULT_NAME);
+	~SpectrumShmReader();
+
+	bool isOpen() const { return _header != NULL; }
+
+	/// The frames published so far
+	uint64_t framesPublished() const;
+
+	/// Skip to the last frame published
+	void skipToLatest();
+
+	/**
+	 * \brief    Copy the next frame.
+	 *
+	 * \param    frame   Receives the description of the frame
+	 * \param    bins    Receives the bins, resized to \a fftSize
+	 * \return   False if no new frame is available.
+	 */
+	bool readFrame(Frame &frame, std::vector<float> &bins);
+
+	/**
+	 * \brief    Copy the last RET snapshot, if it is new.
+	 *
+	 * \param    timeNs    Receives the time of the snapshot
+	 * \param    entries   Receives the active communications
+	 * \return   False if no snapshot was published since the last call.
+	 */
+	bool readRet(uint64_t &timeNs, std::vector<SpectrumShmRetEntry> &entries);
+
+	uint64_t lostFrames() const { return _lost; }
+};
+
+#endif // SPECTRUMSHM_H
@@ -0,0 +1,32 @@
+# Modified from the CppUnit module to look for the single-precision FFTW
+#
+# Find the FFTW3f includes and library
+#
+# This module defines
+# FFTW3F_INCLUDE_DIRS, where to find fftw3.h.
+# FFTW3F_LIBRARIES, the libraries to link against to use FFTW3f.
+# FFTW3F_FOUND, If false, do not try to use FFTW3f.
+
+INCLUDE(FindPkgConfig)
+PKG_CHECK_MODULES(PC_FFTW3F "fftw3f >= 3.0")
+
+FIND_PATH(FFTW3F_INCLUDE_DIRS
+    NAMES fftw3.h
+    HINTS ${PC_FFTW3F_INCLUDE_DIR}
+    PATHS
+    /usr/local/include
+    /usr/include
+)
+
+FIND_LIBRARY(FFTW3F_LIBRARIES
+    NAMES fftw3f libfftw3f
+    HINTS ${PC_FFTW3F_LIBDIR}
+    PATHS
+    ${FFTW3F_INCLUDE_DIRS}/../lib
+    /usr/local/lib
+    /usr/lib
+)
+
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(FFTW3F DEFAULT_MSG FFTW3F_LIBRARIES FFTW3F_INCLUDE_DIRS)
+MARK_AS_ADVANCED(FFTW3F_LIBRARIES FFTW3F_INCLUDE_DIRS)
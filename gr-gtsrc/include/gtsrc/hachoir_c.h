@@ -24,6 +24,7 @@
 
 #include <gtsrc/api.h>
 #include <gnuradio/block.h>
+#include <string>
 
 namespace gr {
   namespace gtsrc {
@@ -47,6 +48,53 @@ namespace gr {
         * creating new instances.
         */
        static sptr make(double freq, int samplerate, int fft_size, int window_type);
+
+       /*!
+        * \brief The TCP port of the sensing server. The n-th block of a
+        * process, from 0, listens on 21333 + n and publishes its spectra in
+        * the shared memory "/gtsrc-spectrum", followed by "-n" if n > 0.
+        */
+       virtual uint16_t server_port() const = 0;
+
+       virtual uint64_t central_freq() const = 0;
+       virtual uint64_t sample_rate() const = 0;
+       virtual uint16_t fft_size() const = 0;
+       virtual int window_type() const = 0;
+       virtual float fft_overlap() const = 0;
+       virtual size_t fft_workers() const = 0;
+
+       /*!
+        * \brief Retune while running. The samples already received keep
+        * the former tuning, the new one applies to the following ones.
+        */
+       virtual void set_central_freq(double freq) = 0;
+       virtual void set_sample_rate(int samplerate) = 0;
+
+       /*!
+        * \brief Change the FFTs while running, picked up between two
+        * batches of FFTs.
+        */
+       virtual void set_FFT_size(int fft_size) = 0;
+       virtual void set_window_type(int window_type) = 0;
+       virtual void set_fft_overlap(float overlap) = 0;
+       /*! \brief The FFT threads, up to 8, 0 to use all the cores but two. */
+       virtual void set_fft_workers(int workers) = 0;
+
+       /*!
+        * \brief Learn the thermal noise of the receiver, the antenna being
+        * disconnected.
+        *
+        * Records \p duration seconds of the stream, so the flowgraph must
+        * be running: call it from another thread. Blocks until done, or
+        * until the stream stopped for a few seconds. The file written is
+        * loaded at the next start when GTSRC_CALIBRATION_FILE names it.
+        *
+        * \param output_file The calibration file to write, empty for none
+        * \param duration The duration of the recording, in seconds
+        * \return True on success, false otherwise.
+        */
+       virtual bool calc_thermal_noise(const std::string &output_file,
+                                       double duration = 1.0) = 0;
     };
 
   } // namespace gtsrc
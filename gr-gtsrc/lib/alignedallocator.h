@@ -0,0 +1,65 @@
+/**
+ * \file      alignedallocator.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef ALIGNEDALLOCATOR_H
+#define ALIGNEDALLOCATOR_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+
+/**
+ * \class     AlignedAllocator
+ * \brief     STL allocator aligning its storage on \a Alignment bytes.
+ *
+ * \details   Used for the buffers processed by the vectorized kernels so
+ *            as their first element never straddles a cache line.
+ *
+ *            **Thread-safety:** Stateless, thus thread safe.
+ */
+template <typename T, size_t Alignment = 64>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template <typename U>
+	struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() {}
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+	pointer allocate(size_type n, const void * = 0)
+	{
+		void *ptr;
+		if (posix_memalign(&ptr, Alignment, n * sizeof(T)) != 0)
+			throw std::bad_alloc();
+		return (pointer)ptr;
+	}
+
+	void deallocate(pointer p, size_type) { free(p); }
+
+	size_type max_size() const { return (size_type)-1 / sizeof(T); }
+
+	template <typename U, typename... Args>
+	void construct(U *p, Args&&... args) { new((void *)p) U(static_cast<Args&&>(args)...); }
+
+	template <typename U>
+	void destroy(U *p) { p->~U(); }
+
+	bool operator==(const AlignedAllocator &) const { return true; }
+	bool operator!=(const AlignedAllocator &) const { return false; }
+};
+
+#endif // ALIGNEDALLOCATOR_H
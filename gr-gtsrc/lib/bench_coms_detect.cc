@@ -0,0 +1,132 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "bench_gtsrc.h"
+#include "comsdetect.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/* the array-of-structures loop ComsDetect::addFFT used to run */
+struct ReferenceBin
+{
+	uint32_t inactiveCnt;
+	uint32_t avgCnt;
+	float avg;
+	float avgSquared;
+	bool active;
+};
+
+static void referenceAddSpectrum(NoiseCalibration &calibration,
+				 std::vector<ReferenceBin> &bins,
+				 const float *pwr, uint32_t maxTimeout)
+{
+	calibration.update(pwr, bins.size());
+	if (!calibration.isReady())
+		return;
+
+	for (size_t i = 0; i < bins.size(); i++) {
+		ReferenceBin *lt = &bins[i];
+		float threshold = calibration.threshold(i);
+
+		if (pwr[i] > threshold) {
+			lt->inactiveCnt = 0;
+			lt->active = true;
+		}
+
+		if (lt->active) {
+			lt->avg += pwr[i];
+			lt->avgSquared += pwr[i] * pwr[i];
+			lt->avgCnt++;
+			if (lt->avgCnt > 1000) {
+				lt->avgCnt /= 2;
+				lt->avg /= 2;
+			}
+
+			if (pwr[i] < threshold) {
+				lt->inactiveCnt++;
+				if (lt->inactiveCnt >= maxTimeout) {
+					lt->avg = 0;
+					lt->avgCnt = 0;
+					lt->active = false;
+				}
+			}
+		}
+	}
+}
+
+/* noise with a few transmissions, some frames apart */
+static void fillFrames(std::vector< std::vector<float> > &frames, size_t bins)
+{
+	for (size_t f = 0; f < frames.size(); f++) {
+		frames[f].resize(bins);
+		for (size_t i = 0; i < bins; i++) {
+			float u = (rand() + 1.0) / (RAND_MAX + 2.0);
+			frames[f][i] = -100.0 - 2.0 * logf(-logf(u));
+		}
+		for (size_t b = 0; b < 16; b++) {
+			size_t start = b * bins / 16;
+			if ((f / (4 + b)) % 2 == 0)
+				for (size_t i = start; i < start + bins / 64; i++)
+					frames[f][i] += 20.0;
+		}
+	}
+}
+
+void bench_coms_detect()
+{
+	const size_t frameCount = 64;
+	const size_t iterations = 16;
+	std::vector< std::vector<float> > frames(frameCount);
+
+	fprintf(stdout, "bins, per-bin loop Mbins/s, vectorized Mbins/s, speedup\n");
+
+	/* the FFT size is a uint16_t, 32768 is the largest power of 2 */
+	for (size_t bins = 1024; bins <= 32768; bins *= 2) {
+		fillFrames(frames, bins);
+
+		NoiseCalibration calibration;
+		std::vector<ReferenceBin> ref(bins);
+		memset(&ref[0], 0, bins * sizeof(ReferenceBin));
+		calibration.reset(bins);
+
+		uint64_t start = bench_time_ns();
+		for (size_t it = 0; it < iterations; it++)
+			for (size_t f = 0; f < frameCount; f++)
+				referenceAddSpectrum(calibration, ref, frames[f].data(), 14);
+		uint64_t refNs = bench_time_ns() - start;
+
+		ComsDetect detect;
+		detect.setFftSize(bins);
+		start = bench_time_ns();
+		for (size_t it = 0; it < iterations; it++)
+			for (size_t f = 0; f < frameCount; f++)
+				detect.addSpectrum(frames[f].data(), bins);
+		uint64_t ns = bench_time_ns() - start;
+
+		double total = (double)bins * frameCount * iterations;
+		fprintf(stdout, "%zu, %.1f, %.1f, %.2f\n", bins,
+			total * 1e3 / refNs, total * 1e3 / ns, (double)refNs / ns);
+	}
+}
@@ -0,0 +1,135 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "bench_gtsrc.h"
+#include "fftaverage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+#include <vector>
+
+/* the variance FftAverage::varianceAt used to compute: the 10-FFT average
+ * replayed over the whole window, for every bin
+ */
+static float formerVarianceAt(const std::deque< std::vector<float> > &ffts,
+			      size_t i, float average)
+{
+	size_t bins = ffts[0].size();
+	std::deque< std::vector<float> > small;
+	std::vector<float> sum(bins, 0.0);
+
+	float variance = 0;
+	for (size_t e = 0; e < ffts.size(); e++) {
+		if (small.size() == 10) {
+			for (size_t b = 0; b < bins; b++)
+				sum[b] -= small[0][b];
+			small.pop_front();
+		}
+		for (size_t b = 0; b < bins; b++)
+			sum[b] += ffts[e][b];
+		small.push_back(ffts[e]);
+
+		float diff = sum[i] / small.size() - average;
+		variance += diff * diff;
+	}
+
+	return variance / ffts.size();
+}
+
+static void fillFrames(std::vector< std::vector<float> > &frames, size_t bins)
+{
+	for (size_t f = 0; f < frames.size(); f++) {
+		frames[f].resize(bins);
+		for (size_t i = 0; i < bins; i++)
+			frames[f][i] = -100.0 + 6.0 * rand() / RAND_MAX;
+	}
+}
+
+void bench_fft_average()
+{
+	const size_t bins = 8192;
+	std::vector< std::vector<float> > frames(64);
+	volatile float sink = 0;
+
+	fillFrames(frames, bins);
+
+	fprintf(stdout, "mode, window, block size, memory MB, add ns/FFT, "
+		"variance of all bins ns\n");
+
+	struct
+	{
+		FftAverage::Mode mode;
+		size_t average;
+		size_t budget;
+	} runs[] = {
+		{ FftAverage::SLIDING, 1000, 64 << 20 },
+		{ FftAverage::SLIDING, 500000, 64 << 20 },
+		{ FftAverage::SLIDING, 500000, 8 << 20 },
+		{ FftAverage::EXPONENTIAL, 500000, 0 },
+	};
+
+	for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+		FftAverage::Config config;
+		config.mode = runs[r].mode;
+		config.average = runs[r].average;
+		config.memoryBudget = runs[r].budget;
+		FftAverage avr(bins, 940000000, 8000000, config);
+
+		/* fill the window, then measure while it slides */
+		size_t fill = runs[r].average < 20000 ? runs[r].average : 20000;
+		for (size_t f = 0; f < fill; f++)
+			avr.addFft(frames[f % frames.size()].data(), f);
+
+		const size_t adds = 4000;
+		uint64_t start = bench_time_ns();
+		for (size_t f = 0; f < adds; f++)
+			avr.addFft(frames[f % frames.size()].data(), f);
+		uint64_t addNs = bench_time_ns() - start;
+
+		start = bench_time_ns();
+		for (size_t i = 0; i < bins; i++)
+			sink = sink + avr.varianceAt(i);
+		uint64_t varianceNs = bench_time_ns() - start;
+
+		fprintf(stdout, "%s, %zu, %zu, %.1f, %.0f, %llu\n",
+			runs[r].mode == FftAverage::SLIDING ? "sliding" : "exponential",
+			runs[r].average, avr.blockSize(),
+			avr.memoryUsage() / 1048576.0, (double)addNs / adds,
+			(unsigned long long)varianceNs);
+	}
+
+	/* the former deque of FFTs, measured on a few bins */
+	const size_t window = 1000;
+	const size_t measured = 8;
+	std::deque< std::vector<float> > ffts;
+	for (size_t f = 0; f < window; f++)
+		ffts.push_back(frames[f % frames.size()]);
+
+	uint64_t start = bench_time_ns();
+	for (size_t i = 0; i < measured; i++)
+		sink = sink + formerVarianceAt(ffts, i, -97.0);
+	uint64_t ns = bench_time_ns() - start;
+
+	fprintf(stdout, "former deque, %zu, -, %.1f, -, %.0f (extrapolated from %zu bins)\n",
+		window, window * bins * sizeof(float) / 1048576.0,
+		(double)ns * bins / measured, measured);
+}
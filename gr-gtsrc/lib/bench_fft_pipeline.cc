@@ -0,0 +1,94 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "bench_gtsrc.h"
+#include "fftpipeline.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+/* all the samples are in the ring before the pipeline starts, so as the
+ * benchmark measures how fast the workers go through them.
+ */
+static double benchWorkers(SamplesRingBuffer &ring, boost::shared_ptr<const FftWindow> win,
+			   size_t batchCount, size_t workers)
+{
+	SamplesRingBuffer::Cursor *cursor = ring.registerCursor("bench");
+	size_t batchSpan = batchCount * win->fftSize();
+	size_t batches = (ring.head() - ring.tail()) / batchSpan - 1;
+	size_t fftCount = 0;
+	std::vector<FftPtr> ffts;
+
+	cursor->setPosition(ring.tail());
+
+	uint64_t start = bench_time_ns();
+	{
+		FftPipeline pipeline(ring, *cursor, win, batchCount, 0.0, workers);
+
+		for (size_t i = 0; i < batches && pipeline.next(ffts); i++)
+			fftCount += ffts.size();
+		ffts.clear();
+	}
+	uint64_t ns = bench_time_ns() - start;
+
+	ring.unregisterCursor(cursor);
+
+	return fftCount * 1e9 / ns;
+}
+
+void bench_fft_pipeline()
+{
+	const uint16_t fftSize = 1024;
+	const size_t batchCount = 8;
+
+	SamplesRingBuffer ring(1 << 23);
+	boost::shared_ptr<const FftWindow> win = boost::make_shared<FftWindow>(fftSize,
+								gr::filter::firdes::WIN_BLACKMAN_HARRIS);
+
+	std::vector<gr_complex> chunk(1 << 16);
+	for (size_t i = 0; i < chunk.size(); i++)
+		chunk[i] = gr_complex(rand() / (float)RAND_MAX - 0.5,
+				      rand() / (float)RAND_MAX - 0.5);
+	while (ring.head() + chunk.size() < ring.ringLength()) {
+		uint64_t pos = ring.addSamples(chunk.data(), chunk.size());
+		RBMarker m = { 940000000, 8000000, pos * 125 };
+		ring.addMarker(m, pos);
+		ring.validateWrite();
+	}
+
+	fprintf(stdout, "cores = %u, fftSize = %u, batch = %zu\n",
+		boost::thread::hardware_concurrency(), fftSize, batchCount);
+	fprintf(stdout, "workers, FFTs/s, MS/s covered, speedup\n");
+
+	double single = 0;
+	for (size_t workers = 1; workers <= 8; workers *= 2) {
+		double rate = benchWorkers(ring, win, batchCount, workers);
+		if (workers == 1)
+			single = rate;
+
+		fprintf(stdout, "%zu, %.0f, %.1f, %.2f\n", workers, rate,
+			rate * fftSize / 1e6, rate / single);
+	}
+}
@@ -0,0 +1,80 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Micro-benchmarks of the sensing block's hot paths. Run without
+ * parameters to execute all of them or give the names of the benchmarks
+ * that should be run.
+ */
+
+#include "bench_gtsrc.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const struct
+{
+	const char *name;
+	void (*run)();
+} benchmarks[] = {
+	{ "ringbuffer_mirrored", bench_ringbuffer_mirrored },
+	{ "ringbuffer_wait", bench_ringbuffer_wait },
+	{ "spectrum_kernels", bench_spectrum_kernels },
+	{ "fft_pipeline", bench_fft_pipeline },
+	{ "noise_floor", bench_noise_floor },
+	{ "coms_detect", bench_coms_detect },
+	{ "transmission_extractor", bench_transmission_extractor },
+	{ "ret_matching", bench_ret_matching },
+	{ "ret_update", bench_ret_update },
+	{ "spectrum_shm", bench_spectrum_shm },
+	{ "fft_average", bench_fft_average },
+};
+
+int
+main (int argc, char **argv)
+{
+	size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+	bool found = false;
+
+	for (size_t i = 0; i < count; i++) {
+		bool wanted = (argc < 2);
+		for (int a = 1; a < argc; a++) {
+			if (strcmp(argv[a], benchmarks[i].name) == 0)
+				wanted = true;
+		}
+
+		if (!wanted)
+			continue;
+
+		fprintf(stdout, "### %s ###\n", benchmarks[i].name);
+		benchmarks[i].run();
+		fprintf(stdout, "\n");
+		found = true;
+	}
+
+	if (!found) {
+		fprintf(stderr, "Usage: %s [benchmark...]\nAvailable benchmarks:\n", argv[0]);
+		for (size_t i = 0; i < count; i++)
+			fprintf(stderr, "	%s\n", benchmarks[i].name);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+/**
+ * \file      bench_gtsrc.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef BENCH_GTSRC_H
+#define BENCH_GTSRC_H
+
+#include <stdint.h>
+#include <time.h>
+
+/// Returns a monotonic time in nanoseconds, for benchmarking purposes
+static inline uint64_t bench_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/// Compares the split and the mirrored reads of a SamplesRingBuffer
+void bench_ringbuffer_mirrored();
+
+/// Measures the producer to FFT thread latency when polling or waiting
+void bench_ringbuffer_wait();
+
+/// Compares the windowing and power conversion kernels to the scalar code
+void bench_spectrum_kernels();
+
+/// Measures how the FFT pipeline scales with its number of workers
+void bench_fft_pipeline();
+
+/// Compares the noise floor estimators to sorting the whole spectrum
+void bench_noise_floor();
+
+/// Compares the vectorized detection to the former per-bin loop
+void bench_coms_detect();
+
+/// Measures the detection rate of OOK and FSK bursts, from spectra to RET
+void bench_transmission_extractor();
+
+/// Compares matching detections to the active communications, list vs index
+void bench_ret_matching();
+
+/// Compares the delta RET updates to the former full ones, 1000 active communications
+void bench_ret_update();
+
+/// Compares publishing the spectra in shared memory to sending them over TCP
+void bench_spectrum_shm();
+
+/// Compares the contiguous FFT average and its O(1) variance to the former deque
+void bench_fft_average();
+
+#endif // BENCH_GTSRC_H
@@ -0,0 +1,95 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "bench_gtsrc.h"
+#include "noisefloor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+/* the implementation Fft::noiseFloor used to have */
+static float sortedNoiseFloor(const std::vector<float> &pwr)
+{
+	std::vector<float> sortedPwr(pwr);
+	size_t keptCount = pwr.size() * 10 / 100;
+
+	std::sort(sortedPwr.begin(), sortedPwr.end());
+
+	float keptSum = 0;
+	for (size_t i = 0; i < keptCount; i++)
+		keptSum += sortedPwr[i];
+
+	return keptSum / keptCount;
+}
+
+static void fillFrames(std::vector< std::vector<float> > &frames, size_t bins)
+{
+	for (size_t f = 0; f < frames.size(); f++) {
+		frames[f].resize(bins);
+		for (size_t i = 0; i < bins; i++)
+			frames[f][i] = -100.0 + 0.001 * f + 6.0 * rand() / RAND_MAX;
+		for (size_t i = bins / 3; i < bins / 3 + bins / 40; i++)
+			frames[f][i] += 30;
+	}
+}
+
+void bench_noise_floor()
+{
+	const size_t frameCount = 256;
+	const size_t iterations = 4;
+	std::vector< std::vector<float> > frames(frameCount);
+	volatile float sink = 0;
+
+	fprintf(stdout, "bins, sort ns/frame, incremental ns/frame (lowest 10%%), "
+		"percentile 50%%, trimmed mean 10/10, fallbacks\n");
+
+	for (size_t bins = 1024; bins <= 65536; bins *= 4) {
+		fillFrames(frames, bins);
+
+		uint64_t start = bench_time_ns();
+		for (size_t it = 0; it < iterations; it++)
+			for (size_t f = 0; f < frameCount; f++)
+				sink = sink + sortedNoiseFloor(frames[f]);
+		uint64_t sortNs = bench_time_ns() - start;
+
+		NoiseFloorEstimator estimators[] = {
+			NoiseFloorEstimator(),
+			NoiseFloorEstimator::percentile(0.5),
+			NoiseFloorEstimator::trimmedMean(0.1, 0.1),
+		};
+		uint64_t ns[3];
+		for (size_t e = 0; e < 3; e++) {
+			start = bench_time_ns();
+			for (size_t it = 0; it < iterations; it++)
+				for (size_t f = 0; f < frameCount; f++)
+					sink = sink + estimators[e].estimate(frames[f].data(), bins);
+			ns[e] = bench_time_ns() - start;
+		}
+
+		size_t frames = iterations * frameCount;
+		fprintf(stdout, "%zu, %.0f, %.0f, %.0f, %.0f, %llu\n", bins,
+			(double)sortNs / frames, (double)ns[0] / frames,
+			(double)ns[1] / frames, (double)ns[2] / frames,
+			(unsigned long long)estimators[0].fallbacks());
+	}
+}
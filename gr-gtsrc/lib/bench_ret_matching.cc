@@ -0,0 +1,163 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "bench_gtsrc.h"
+#include "radioeventtable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <list>
+#include <vector>
+
+/* the list the RadioEventTable used to scan for every detection */
+struct ListTable
+{
+	std::list< std::shared_ptr<RetEntry> > coms;
+	uint64_t id;
+	uint32_t delay;
+
+	ListTable(uint32_t delay) : id(0), delay(delay) {}
+
+	RetEntry *find(uint32_t start, uint32_t end)
+	{
+		uint32_t width = end - start;
+		uint32_t central = start + width / 2;
+		int32_t maxError = width * 10 / 100;
+
+		std::list< std::shared_ptr<RetEntry> >::iterator it;
+		for (it = coms.begin(); it != coms.end(); ++it) {
+			RetEntry *e = (*it).get();
+			int32_t sub = (e->frequencyStart() + (e->frequencyEnd() - e->frequencyStart()) / 2) - central;
+			if (-sub < maxError && sub < maxError)
+				return e;
+		}
+		return NULL;
+	}
+
+	void add(uint64_t timeNs, uint32_t start, uint32_t end, int8_t pwr)
+	{
+		RetEntry *e = find(start, end);
+		if (!e) {
+			coms.push_back(std::shared_ptr<RetEntry>(new RetEntry(id++, timeNs, timeNs, start,
+									      end, pwr, RetEntry::UNKNOWN, 0)));
+			return;
+		}
+		e->setTimeEnd(timeNs);
+		if (e->frequencyStart() > start)
+			e->setFrequencyStart(start);
+		if (e->frequencyEnd() < end)
+			e->setFrequencyEnd(end);
+	}
+
+	void stop(uint64_t timeNs)
+	{
+		std::list< std::shared_ptr<RetEntry> >::iterator it = coms.begin();
+		while (it != coms.end()) {
+			if (timeNs - (*it)->timeEnd() > delay)
+				it = coms.erase(it);
+			else
+				++it;
+		}
+	}
+};
+
+/* the emitters are 40 kHz wide, on a 50 kHz grid, each of them silent for
+ * 20 frames every 2000 frames. The detections jitter by 1 kHz, well within
+ * the 4 kHz tolerance of the matching.
+ */
+struct Emitter
+{
+	uint32_t start;
+	uint32_t end;
+};
+
+static bool emitterSilent(size_t e, size_t frame)
+{
+	return ((frame + e) / 20) % 100 == 0;
+}
+
+void bench_ret_matching()
+{
+	const uint64_t frameNs = 100000;
+	const uint32_t delay = 1000000;
+
+	fprintf(stdout, "emitters, list ns/detection, index ns/detection, speedup\n");
+
+	for (size_t n = 10; n <= 10000; n *= 10) {
+		std::vector<uint32_t> slots(10000);
+		for (size_t s = 0; s < slots.size(); s++)
+			slots[s] = 2400000 + s * 50;
+		srand(n);
+		std::random_shuffle(slots.begin(), slots.end());
+
+		std::vector<Emitter> emitters(n);
+		for (size_t e = 0; e < n; e++) {
+			emitters[e].start = slots[e];
+			emitters[e].end = slots[e] + 40;
+		}
+
+		/* the same detections for both tables */
+		size_t frames = std::max((size_t)10, 100000 / n);
+		std::vector<int> jitter(2 * n * frames);
+		for (size_t j = 0; j < jitter.size(); j++)
+			jitter[j] = rand() % 3 - 1;
+
+		ListTable list(delay);
+		uint64_t detections = 0;
+		uint64_t start = bench_time_ns();
+		for (size_t f = 0; f < frames; f++) {
+			for (size_t e = 0; e < n; e++) {
+				if (emitterSilent(e, f))
+					continue;
+				const int *j = &jitter[2 * (f * n + e)];
+				list.add(f * frameNs, emitters[e].start + j[0],
+					 emitters[e].end + j[1], -50);
+				detections++;
+			}
+			list.stop(f * frameNs);
+		}
+		uint64_t listNs = bench_time_ns() - start;
+
+		RadioEventTable ret(10000, delay, 0);
+		start = bench_time_ns();
+		for (size_t f = 0; f < frames; f++) {
+			ret.startAddingCommunications(f * frameNs);
+			for (size_t e = 0; e < n; e++) {
+				if (emitterSilent(e, f))
+					continue;
+				const int *j = &jitter[2 * (f * n + e)];
+				ret.addCommunication(emitters[e].start + j[0],
+						     emitters[e].end + j[1], -50);
+			}
+			ret.stopAddingCommunications();
+		}
+		uint64_t indexNs = bench_time_ns() - start;
+
+		if (ret.activeCommunications().size() != list.coms.size())
+			fprintf(stderr, "bench_ret_matching: %zu active communications instead of %zu\n",
+				ret.activeCommunications().size(), list.coms.size());
+
+		fprintf(stdout, "%zu, %.1f, %.1f, %.1f\n", n,
+			(double)listNs / detections, (double)indexNs / detections,
+			(double)listNs / indexNs);
+	}
+}
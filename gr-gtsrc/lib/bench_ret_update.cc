@@ -0,0 +1,113 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "bench_gtsrc.h"
+#include "radioeventtable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+/* emitter e transmits 30 frames out of 40, and pauses for 2000 frames
+ * every 20000 frames, long enough for its communication to end.
+ */
+static bool emitterActive(size_t e, size_t frame)
+{
+	size_t f = frame + e * 37;
+	return (f % 40) < 30 && (f % 20000) >= 2000;
+}
+
+void bench_ret_update()
+{
+	const size_t emitters = 1000;
+	const size_t frames = 40000;
+	const size_t framesPerUpdate = 10;
+	const uint64_t frameNs = 100000;
+	const uint32_t delay = 10000000;
+
+	RadioEventTable sender(100000, delay, 0);
+	RadioEventTable legacyReceiver(100000), deltaReceiver(100000);
+	std::vector<char> buf;
+
+	uint64_t updates = 0, legacyBytes = 0, deltaBytes = 0;
+	uint64_t legacyEncodeNs = 0, legacyDecodeNs = 0;
+	uint64_t deltaEncodeNs = 0, deltaDecodeNs = 0;
+	uint64_t activeSum = 0;
+
+	srand(17);
+	for (size_t f = 0; f < frames; f++) {
+		sender.startAddingCommunications(f * frameNs);
+		for (size_t e = 0; e < emitters; e++) {
+			if (!emitterActive(e, f))
+				continue;
+			uint32_t start = 2400000 + e * 50 + rand() % 3 - 1;
+			sender.addCommunication(start, start + 40 + rand() % 3 - 1,
+						-50 - rand() % 3);
+		}
+		sender.stopAddingCommunications();
+
+		if (f % framesPerUpdate != framesPerUpdate - 1)
+			continue;
+
+		char *legacy;
+		size_t len;
+		uint64_t start = bench_time_ns();
+		sender.toString(&legacy, &len);
+		legacyEncodeNs += bench_time_ns() - start;
+		legacyBytes += len;
+
+		start = bench_time_ns();
+		legacyReceiver.updateFromString(legacy, len);
+		legacyDecodeNs += bench_time_ns() - start;
+
+		if (buf.size() < sender.maxUpdateSize())
+			buf.resize(sender.maxUpdateSize());
+		start = bench_time_ns();
+		if (!sender.encodeUpdate(buf.data(), buf.size(), &len))
+			fprintf(stderr, "bench_ret_update: the update does not fit\n");
+		deltaEncodeNs += bench_time_ns() - start;
+		deltaBytes += len;
+
+		start = bench_time_ns();
+		if (!deltaReceiver.applyUpdate(buf.data(), len))
+			fprintf(stderr, "bench_ret_update: update %llu not applied\n",
+				(unsigned long long)sender.updateSequence());
+		deltaDecodeNs += bench_time_ns() - start;
+
+		if (deltaReceiver.activeCommunications().size() !=
+		    legacyReceiver.activeCommunications().size())
+			fprintf(stderr, "bench_ret_update: %zu active communications instead of %zu\n",
+				deltaReceiver.activeCommunications().size(),
+				legacyReceiver.activeCommunications().size());
+
+		activeSum += sender.activeCommunications().size();
+		updates++;
+	}
+
+	fprintf(stdout, "%.0f active communications, %llu updates, %llu finished\n",
+		(double)activeSum / updates, (unsigned long long)updates,
+		(unsigned long long)sender.finishedCommunications().head());
+	fprintf(stdout, "format, bytes/update, encode us/update, decode us/update\n");
+	fprintf(stdout, "toString, %.0f, %.1f, %.1f\n", (double)legacyBytes / updates,
+		legacyEncodeNs / 1000.0 / updates, legacyDecodeNs / 1000.0 / updates);
+	fprintf(stdout, "delta, %.0f, %.1f, %.1f\n", (double)deltaBytes / updates,
+		deltaEncodeNs / 1000.0 / updates, deltaDecodeNs / 1000.0 / updates);
+}
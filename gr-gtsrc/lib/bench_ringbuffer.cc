@@ -0,0 +1,178 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "bench_gtsrc.h"
+#include "samplesringbuffer.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+/* read fftSize samples at pos and window them into dst, like Fft::FftFromRing */
+static bool readWindowed(SamplesRingBuffer &ring, uint64_t pos, size_t fftSize,
+			 const std::vector<float> &win, gr_complex *dst)
+{
+	size_t currentPos = 0;
+
+	while (currentPos < fftSize) {
+		gr_complex *samples;
+		size_t length = fftSize - currentPos;
+
+		if (!ring.requestRead(pos + currentPos, &length, &samples))
+			return false;
+
+		for (size_t i = 0; i < length; i++)
+			dst[currentPos + i] = samples[i] * win[currentPos + i];
+		currentPos += length;
+	}
+
+	return ring.isPositionValid(pos);
+}
+
+static uint64_t benchRing(SamplesRingBuffer &ring, size_t fftSize, size_t iterations)
+{
+	std::vector<gr_complex> chunk(4000, gr_complex(0.5, -0.5));
+	std::vector<gr_complex> dst(fftSize);
+	std::vector<float> win(fftSize, 1.0);
+
+	/* fill the ring twice so as the reads wrap around regularly */
+	ring.clear();
+	while (ring.head() < 2 * ring.ringLength()) {
+		ring.addSamples(chunk.data(), chunk.size());
+		ring.validateWrite();
+	}
+
+	uint64_t pos = ring.tail();
+	uint64_t start = bench_time_ns();
+	for (size_t i = 0; i < iterations; i++) {
+		if (!readWindowed(ring, pos, fftSize, win, dst.data()))
+			fprintf(stderr, "bench_ringbuffer: invalid read at %llu\n",
+				(unsigned long long)pos);
+
+		/* stay away from the tail and the head */
+		pos += fftSize;
+		if (pos + fftSize >= ring.head())
+			pos = ring.tail() + 1;
+	}
+
+	return bench_time_ns() - start;
+}
+
+void bench_ringbuffer_mirrored()
+{
+	const size_t ringLength = 1000000;
+	const size_t iterations = 20000;
+
+	SamplesRingBuffer split(ringLength);
+	SamplesRingBuffer mirrored(ringLength,
+		boost::make_shared<RingBufferAllocator>(64, false, true));
+
+	if (!mirrored.isMirrored())
+		fprintf(stdout, "warning: the mirrored mapping failed, both rings split\n");
+
+	fprintf(stdout, "fftSize, split ns/FFT, mirrored ns/FFT, speedup\n");
+	for (size_t fftSize = 256; fftSize <= 8192; fftSize *= 2) {
+		uint64_t splitNs = benchRing(split, fftSize, iterations);
+		uint64_t mirroredNs = benchRing(mirrored, fftSize, iterations);
+
+		fprintf(stdout, "%zu, %.1f, %.1f, %.2f\n", fftSize,
+			(double)splitNs / iterations,
+			(double)mirroredNs / iterations,
+			(double)splitNs / mirroredNs);
+	}
+}
+
+enum WaitMode { WAIT_POLL, WAIT_SLEEP, WAIT_SPIN };
+
+/* the producer writes chunks at a fixed pace, the consumer waits for each
+ * FFT to be complete and measures how long after its last sample got
+ * published it noticed it.
+ */
+static void benchWaitMode(WaitMode mode, const char *name)
+{
+	const size_t fftSize = 1024;
+	const size_t chunkSize = 256;
+	const size_t fftCount = 2000;
+	const uint64_t chunkPeriodNs = 50000; /* ~5 MS/s */
+
+	SamplesRingBuffer ring(1000000,
+		boost::make_shared<RingBufferAllocator>(64, false, true));
+	std::vector<uint64_t> latencies;
+	latencies.reserve(fftCount);
+
+	if (mode == WAIT_SPIN)
+		ring.setWaitSpinCount(100000);
+
+	boost::thread producer([&ring, chunkSize, chunkPeriodNs]() {
+		std::vector<gr_complex> chunk(chunkSize);
+		uint64_t next = bench_time_ns();
+		while (!boost::this_thread::interruption_requested()) {
+			uint64_t now = bench_time_ns();
+			if (now < next)
+				boost::this_thread::sleep_for(boost::chrono::nanoseconds(next - now));
+			next += chunkPeriodNs;
+
+			uint64_t pos = ring.addSamples(chunk.data(), chunk.size());
+			RBMarker m = { 0, 1, bench_time_ns() };
+			ring.addMarker(m, pos);
+			ring.validateWrite();
+		}
+	});
+
+	uint64_t pos = 0;
+	for (size_t i = 0; i < fftCount; i++) {
+		if (mode == WAIT_POLL) {
+			while (!ring.hasNAvailableFrom(pos, fftSize))
+				boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+		} else
+			ring.waitForAvailable(pos, fftSize, 1000000000);
+		uint64_t now = bench_time_ns();
+
+		/* the marker of the write that completed the FFT */
+		RBMarker m;
+		uint64_t markerPos;
+		if (ring.findMarker(pos + fftSize, &m, &markerPos))
+			latencies.push_back(now - m.time);
+
+		pos += fftSize;
+	}
+
+	producer.interrupt();
+	producer.join();
+
+	std::sort(latencies.begin(), latencies.end());
+	size_t n = latencies.size();
+	fprintf(stdout, "%s, %.1f, %.1f, %.1f\n", name,
+		latencies[n / 2] / 1000.0, latencies[n * 99 / 100] / 1000.0,
+		latencies[n - 1] / 1000.0);
+}
+
+void bench_ringbuffer_wait()
+{
+	/* spinning only makes sense when the producer has its own core */
+	fprintf(stdout, "cores = %u\n", boost::thread::hardware_concurrency());
+	fprintf(stdout, "mode, median us, p99 us, max us\n");
+	benchWaitMode(WAIT_POLL, "sleep(100us) polling");
+	benchWaitMode(WAIT_SLEEP, "waitForAvailable");
+	benchWaitMode(WAIT_SPIN, "waitForAvailable + spinning");
+}
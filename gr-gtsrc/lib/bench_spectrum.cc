@@ -0,0 +1,133 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "bench_gtsrc.h"
+#include "fftwindow.h"
+#include "spectrumkernels.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+/* the conversion done by Fft before the kernels got vectorized */
+static void referenceWindow(gr_complex *dst, const gr_complex *src,
+			    const FftWindow &win, size_t fftSize)
+{
+	for (size_t i = 0; i < fftSize; i++)
+		dst[i] = src[i] * win[i];
+}
+
+static void referencePower(float *pwr, const gr_complex *out,
+			   const FftWindow &win, size_t fftSize)
+{
+	float logFftSize = log10f(fftSize);
+	float logWindowPower = log10f(win.windowPower()/fftSize);
+	for (size_t i = 0; i < fftSize; i++) {
+		int n = (i + fftSize/2 ) % fftSize;
+
+		float real = out[n].real();
+		float imag = out[n].imag();
+		float mag = sqrtf(real*real + imag*imag);
+
+		pwr[i] = 20 * log10f(fabsf(mag))
+			- 20 * logFftSize
+			- 10 * logWindowPower
+			+ 3;
+	}
+}
+
+static void printResult(const char *name, size_t fftSize, size_t iterations,
+			uint64_t ns, uint64_t referenceNs, float maxError)
+{
+	fprintf(stdout, "%zu, %s, %.0f, %.3f, %.2f, %g\n", fftSize, name,
+		iterations * 1e9 / ns, (double)ns / iterations / fftSize,
+		(double)referenceNs / ns, maxError);
+}
+
+void bench_spectrum_kernels()
+{
+	const size_t binsPerSize = 20000000;
+
+	fprintf(stdout, "selected kernels: %s\n",
+		SpectrumKernels::name(SpectrumKernels::selected()));
+	fprintf(stdout, "fftSize, kernels, FFTs/s, ns/bin, speedup, max error dB\n");
+
+	for (size_t fftSize = 256; fftSize <= 8192; fftSize *= 2) {
+		size_t iterations = binsPerSize / fftSize;
+		FftWindow win(fftSize, gr::filter::firdes::WIN_BLACKMAN_HARRIS);
+		std::vector<gr_complex> src(fftSize), dst(fftSize);
+		std::vector<float> reference(fftSize), pwr(fftSize);
+
+		/* samples spanning a large dynamic range, with a few zeros */
+		srand(42);
+		for (size_t i = 0; i < fftSize; i++) {
+			float scale = powf(10, (rand() % 120) / 20.0 - 3);
+			src[i] = gr_complex(scale * (rand() / (float)RAND_MAX - 0.5),
+					    scale * (rand() / (float)RAND_MAX - 0.5));
+		}
+		src[fftSize / 3] = 0;
+
+		/* the output of the FFT is replaced by the windowed samples,
+		 * only the conversion is benchmarked here.
+		 */
+		uint64_t start = bench_time_ns();
+		for (size_t it = 0; it < iterations; it++) {
+			referenceWindow(&dst[0], &src[0], win, fftSize);
+			referencePower(&reference[0], &dst[0], win, fftSize);
+		}
+		uint64_t referenceNs = bench_time_ns() - start;
+		printResult("reference", fftSize, iterations, referenceNs, referenceNs, 0);
+
+		float offset = -20 * log10f(fftSize)
+			- 10 * log10f(win.windowPower()/fftSize)
+			+ 3;
+		for (int isa = 0; isa < SpectrumKernels::ISA_COUNT; isa++) {
+			SpectrumKernels::Isa i = (SpectrumKernels::Isa)isa;
+			SpectrumKernels::ApplyWindowFn applyWindow = SpectrumKernels::applyWindowFor(i);
+			SpectrumKernels::PowerDbFn powerDb = SpectrumKernels::powerDbFor(i);
+			size_t half = fftSize / 2;
+
+			if (!applyWindow || !powerDb)
+				continue;
+
+			start = bench_time_ns();
+			for (size_t it = 0; it < iterations; it++) {
+				applyWindow(&dst[0], &src[0], win.data(), fftSize);
+				powerDb(&pwr[0], &dst[half], fftSize - half, offset);
+				powerDb(&pwr[fftSize - half], &dst[0], half, offset);
+			}
+			uint64_t ns = bench_time_ns() - start;
+
+			/* the zero bin is -inf in the reference, skip it */
+			float maxError = 0;
+			for (size_t b = 0; b < fftSize; b++) {
+				if (isinf(reference[b]))
+					continue;
+				maxError = std::max(maxError, fabsf(pwr[b] - reference[b]));
+			}
+
+			printResult(SpectrumKernels::name(i), fftSize, iterations,
+				    ns, referenceNs, maxError);
+		}
+	}
+}
@@ -0,0 +1,162 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "bench_gtsrc.h"
+#include "sensingserver.h"
+#include "spectrumshm.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+static const uint32_t FFT_SIZE = 4096;
+
+static uint64_t processCpuNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* calls publish(n) for the frames, one every periodNs, 0 for no pause */
+template<typename Publish>
+static void publishFrames(size_t frames, uint64_t periodNs, Publish publish)
+{
+	uint64_t start = bench_time_ns();
+	for (size_t n = 0; n < frames; n++) {
+		uint64_t deadline = start + n * periodNs;
+		uint64_t now = bench_time_ns();
+		if (now < deadline)
+			boost::this_thread::sleep_for(boost::chrono::nanoseconds(deadline - now));
+		publish(n);
+	}
+}
+
+static void printResult(const char *name, uint64_t periodNs, size_t frames,
+			size_t received, uint64_t wallNs, uint64_t cpuNs)
+{
+	char rate[32] = "max";
+	if (periodNs)
+		snprintf(rate, sizeof(rate), "%llu", 1000000000ULL / periodNs);
+
+	fprintf(stdout, "%s, %s, %.0f, %.1f, %.2f\n", name, rate,
+		received * 1e9 / wallNs, 100.0 * (frames - received) / frames,
+		cpuNs / 1000.0 / received);
+}
+
+/* the reader polls, sleeping 1 ms when no frame is ready, a quarter of the ring */
+static void benchShm(size_t frames, uint64_t periodNs)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "/gtsrc-bench-%d", (int)getpid());
+	SpectrumShmWriter::Config config;
+	config.name = name;
+	SpectrumShmWriter writer(config);
+	SpectrumShmReader reader(name);
+	if (!writer.isOpen() || !reader.isOpen()) {
+		fprintf(stderr, "bench_spectrum_shm: cannot open %s\n", name);
+		return;
+	}
+
+	std::atomic<bool> done(false);
+	size_t received = 0;
+	boost::thread consumer([&reader, &done, &received]() {
+		SpectrumShmReader::Frame frame;
+		std::vector<float> bins;
+		while (true) {
+			bool last = done.load();
+			if (reader.readFrame(frame, bins))
+				received++;
+			else if (last)
+				break;
+			else
+				boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+		}
+	});
+
+	std::vector<float> pwr(FFT_SIZE, -100.0);
+	uint64_t start = bench_time_ns(), cpuStart = processCpuNs();
+	publishFrames(frames, periodNs, [&writer, &pwr](size_t n) {
+		writer.publishSpectrum(n, 868000000, 878000000, pwr.data(), FFT_SIZE);
+	});
+	done.store(true);
+	consumer.join();
+
+	printResult("shm", periodNs, frames, received,
+		    bench_time_ns() - start, processCpuNs() - cpuStart);
+}
+
+/* the frames sent as by hachoir_c, a byte per bin, read by a blocking client */
+static void benchTcp(size_t frames, uint64_t periodNs)
+{
+	SensingServer server(0);
+
+	boost::asio::io_service ios;
+	boost::asio::ip::tcp::socket socket(ios);
+	socket.connect(boost::asio::ip::tcp::endpoint(
+		boost::asio::ip::address_v4::loopback(), server.port()));
+	const char requests[] = { 0x1, 0x0 };
+	boost::asio::write(socket, boost::asio::buffer(requests, 2));
+	while (server.statistics().clients == 0)
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+
+	size_t received = 0;
+	boost::thread consumer([&socket, &received]() {
+		std::vector<char> payload;
+		while (true) {
+			char header[5];
+			uint32_t len;
+			boost::asio::read(socket, boost::asio::buffer(header, 5));
+			memcpy(&len, header + 1, sizeof(len));
+			payload.resize(len);
+			boost::asio::read(socket, boost::asio::buffer(payload));
+			if (header[0] != MSG_FFT)
+				break;
+			received++;
+		}
+	});
+
+	std::vector<char> packet(26 + FFT_SIZE, 0);
+	uint64_t start = bench_time_ns(), cpuStart = processCpuNs();
+	publishFrames(frames, periodNs, [&server, &packet](size_t n) {
+		memcpy(packet.data() + 18, &n, sizeof(n));
+		server.sendToAll(MSG_FFT, packet.data(), packet.size());
+	});
+	/* the end, never dropped */
+	server.sendToAll(MSG_RET_UPDATE, packet.data(), 1);
+	consumer.join();
+
+	printResult("tcp", periodNs, frames, received,
+		    bench_time_ns() - start, processCpuNs() - cpuStart);
+}
+
+void bench_spectrum_shm()
+{
+	fprintf(stdout, "transport, frames/s sent, frames/s received, lost %%, cpu us/frame received\n");
+	benchShm(200000, 0);
+	benchTcp(200000, 0);
+	benchShm(50000, 40000);
+	benchTcp(50000, 40000);
+}
@@ -0,0 +1,174 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "bench_gtsrc.h"
+#include "transmissionextractor.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+static const uint16_t FFT_SIZE = 1024;
+static const uint64_t CENTRAL_FREQ = 868000000;
+static const uint64_t SAMPLE_RATE = 10240000;
+static const uint64_t FRAME_NS = 100000; /* FFT_SIZE / SAMPLE_RATE */
+
+enum Modulation { OOK, FSK };
+
+/* a burst of a band, [start, end) in frames */
+struct Burst
+{
+	uint16_t bin;
+	size_t start;
+	size_t end;
+	std::vector<bool> bits;
+};
+
+/* OOK: 8 bins, Manchester coded, 5 frames per half bit.
+ * FSK: two tones of 4 bins, 2 bins apart, 10 frames per bit.
+ */
+static void addBurst(std::vector<float> &lin, const Burst &b, Modulation mod,
+		     size_t frame, float snrLin)
+{
+	size_t t = frame - b.start;
+
+	if (mod == OOK) {
+		bool bit = b.bits[(t / 10) % b.bits.size()];
+		bool on = ((t / 5) % 2 == 0) == bit;
+		if (on)
+			for (size_t i = b.bin; i < b.bin + 8u; i++)
+				lin[i] += snrLin;
+	} else {
+		bool bit = b.bits[(t / 10) % b.bits.size()];
+		size_t tone = b.bin + (bit ? 6 : 0);
+		for (size_t i = tone; i < tone + 4; i++)
+			lin[i] += snrLin;
+	}
+}
+
+static uint32_t kHzAtBin(uint16_t i)
+{
+	return (CENTRAL_FREQ - SAMPLE_RATE / 2 + i * SAMPLE_RATE / FFT_SIZE) / 1000;
+}
+
+static void runScenario(Modulation mod, float snr)
+{
+	const size_t warmup = 3000, frameCount = 30000;
+	const uint16_t bands[4] = { 100, 350, 600, 850 };
+
+	ComsDetect::Config config;
+	config.fftSize = FFT_SIZE;
+	ComsDetect detect(config);
+	RadioEventTable ret(1000, detect.comEndOfTransmissionDelay(),
+			    detect.comMinDurationNs());
+	TransmissionExtractor::Config extractorConfig;
+	extractorConfig.endOfTransmissionDelayNs = detect.comEndOfTransmissionDelay();
+	TransmissionExtractor extractor(ret, extractorConfig);
+
+	/* 150 to 400 ms long bursts, 50 to 200 ms apart, on every band */
+	std::vector<Burst> bursts;
+	for (size_t b = 0; b < 4; b++) {
+		size_t f = warmup + rand() % 2000;
+		while (true) {
+			Burst burst;
+			burst.bin = bands[b];
+			burst.start = f;
+			burst.end = f + 1500 + rand() % 2500;
+			if (burst.end > warmup + frameCount)
+				break;
+			for (size_t i = 0; i < 64; i++)
+				burst.bits.push_back(rand() & 1);
+			bursts.push_back(burst);
+			f = burst.end + 500 + rand() % 1500;
+		}
+	}
+
+	std::vector<float> pwr(FFT_SIZE), lin(FFT_SIZE);
+	float snrLin = powf(10.0, snr / 10);
+	uint64_t extractNs = 0;
+	for (size_t f = 0; f < warmup + frameCount; f++) {
+		std::fill(lin.begin(), lin.end(), 0.0);
+		for (size_t b = 0; b < bursts.size(); b++)
+			if (f >= bursts[b].start && f < bursts[b].end)
+				addBurst(lin, bursts[b], mod, f, snrLin);
+
+		/* |noise + signal|², noise at -100 dB */
+		for (size_t i = 0; i < FFT_SIZE; i++) {
+			float u = (rand() + 1.0) / (RAND_MAX + 2.0);
+			pwr[i] = -100.0 + 10 * log10f(-logf(u) + lin[i]);
+		}
+
+		detect.addSpectrum(pwr.data(), FFT_SIZE);
+		uint64_t start = bench_time_ns();
+		extractor.addFrame(detect, f * FRAME_NS, CENTRAL_FREQ, SAMPLE_RATE);
+		extractNs += bench_time_ns() - start;
+	}
+
+	/* a burst is detected when an entry overlaps it, in time and frequency */
+	std::vector<RetEntry> entries;
+	ret.fetchEntries(0, ~0ULL, entries);
+	std::vector<bool> matched(entries.size(), false);
+	size_t detected = 0, fragments = 0;
+	for (size_t b = 0; b < bursts.size(); b++) {
+		uint32_t fStart = kHzAtBin(bursts[b].bin);
+		uint32_t fEnd = kHzAtBin(bursts[b].bin + 9);
+		uint64_t tStart = bursts[b].start * FRAME_NS;
+		uint64_t tEnd = bursts[b].end * FRAME_NS + detect.comEndOfTransmissionDelay();
+		size_t count = 0;
+
+		for (size_t e = 0; e < entries.size(); e++) {
+			const RetEntry *entry = &entries[e];
+			if (entry->frequencyStart() <= fEnd && entry->frequencyEnd() >= fStart &&
+			    entry->timeStart() <= tEnd && entry->timeEnd() >= tStart) {
+				matched[e] = true;
+				count++;
+			}
+		}
+		detected += count > 0;
+		fragments += count;
+	}
+
+	size_t falseAlarms = 0;
+	for (size_t e = 0; e < entries.size(); e++)
+		falseAlarms += !matched[e];
+
+	fprintf(stdout, "%s, %.0f, %zu, %.1f, %.2f, %zu, %.0f\n",
+		mod == OOK ? "OOK" : "FSK", snr, bursts.size(),
+		100.0 * detected / bursts.size(),
+		detected > 0 ? (double)fragments / detected : 0.0,
+		falseAlarms, (double)extractNs / (warmup + frameCount));
+}
+
+void bench_transmission_extractor()
+{
+	const float snrs[] = { 10, 14, 17, 20, 25 };
+
+	fprintf(stdout, "modulation, SNR dB, bursts, detected %%, entries per detection, "
+		"false alarms, extraction ns/frame\n");
+
+	srand(1);
+	for (size_t s = 0; s < sizeof(snrs) / sizeof(snrs[0]); s++)
+		runScenario(OOK, snrs[s]);
+	for (size_t s = 0; s < sizeof(snrs) / sizeof(snrs[0]); s++)
+		runScenario(FSK, snrs[s]);
+}
@@ -0,0 +1,405 @@
+#include "calibrationstore.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <boost/crc.hpp>
+
+#define CALIBRATION_STORE_MAGIC "GTSRCNCS"
+#define CALIBRATION_STORE_VERSION 1
+
+/* the index starts on the second page, the snapshots after the index */
+#define CALIBRATION_STORE_PAGE 4096
+
+/* the first bytes of a store */
+struct CalibrationStoreHeader
+{
+	char magic[8]; ///< CALIBRATION_STORE_MAGIC
+	uint32_t version; ///< CALIBRATION_STORE_VERSION
+	uint32_t maxKeys; ///< The entries of the index, a power of two
+	uint64_t dataOffset; ///< The first byte of the snapshots
+	uint64_t dataSize; ///< The bytes reserved for the snapshots
+	uint32_t reserved;
+	uint32_t checksum; ///< CRC-32 of the header, this field being 0
+};
+
+/* an entry of the index, the keys colliding are probed linearly */
+struct CalibrationStoreEntry
+{
+	uint64_t centralFrequency;
+	uint64_t sampleRate;
+	float gain;
+	uint16_t fftSize;
+	uint16_t firstBin;
+	uint32_t used; ///< 0 for a free entry
+	uint32_t recordSize; ///< The bytes of each of the two snapshots
+	uint64_t offset; ///< The first snapshot, from the start of the file
+	uint32_t reserved;
+	uint32_t checksum; ///< CRC-32 of the entry, this field being 0
+};
+
+/* a snapshot, followed by the mean, the mode and the high quantile of
+ * every group, groups floats each
+ */
+struct CalibrationStoreRecord
+{
+	uint64_t generation; ///< The newest of the two snapshots is the highest, 0 if never written
+	uint64_t updates;
+	uint32_t bins;
+	uint32_t groupSize;
+	uint32_t groups;
+	float quantile;
+	uint32_t reserved;
+	uint32_t checksum; ///< CRC-32 of the snapshot and its floats, this field being 0
+};
+
+template<typename T>
+static uint32_t checksum(const T &t, const void *data = NULL, size_t size = 0)
+{
+	T copy = t;
+	copy.checksum = 0;
+
+	boost::crc_32_type crc;
+	crc.process_bytes(&copy, sizeof(copy));
+	if (data)
+		crc.process_bytes(data, size);
+
+	return crc.checksum();
+}
+
+/* FNV-1a, the same on every run */
+static uint64_t hashKey(const CalibrationStore::Key &key)
+{
+	uint64_t fields[] = { key.centralFrequency, key.sampleRate, key.fftSize,
+			      key.firstBin, 0 };
+	memcpy(&fields[4], &key.gain, sizeof(key.gain));
+
+	const uint8_t *bytes = (const uint8_t *)fields;
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < sizeof(fields); i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static bool entryMatches(const CalibrationStoreEntry *entry,
+			 const CalibrationStore::Key &key)
+{
+	return entry->centralFrequency == key.centralFrequency &&
+	       entry->sampleRate == key.sampleRate && entry->gain == key.gain &&
+	       entry->fftSize == key.fftSize && entry->firstBin == key.firstBin;
+}
+
+static bool isEntryValid(const CalibrationStoreEntry *entry)
+{
+	return entry->used && entry->checksum == checksum(*entry);
+}
+
+CalibrationStore::Key::Key(uint64_t centralFrequency, uint64_t sampleRate,
+			   float gain, uint16_t fftSize, uint16_t firstBin) :
+	centralFrequency(centralFrequency), sampleRate(sampleRate), gain(gain),
+	fftSize(fftSize), firstBin(firstBin)
+{
+}
+
+bool CalibrationStore::Key::operator==(const Key &other) const
+{
+	return centralFrequency == other.centralFrequency &&
+	       sampleRate == other.sampleRate && gain == other.gain &&
+	       fftSize == other.fftSize && firstBin == other.firstBin;
+}
+
+CalibrationStore::Config::Config() :
+	maxKeys(1024), dataSize(256 << 20)
+{
+}
+
+CalibrationStore::CalibrationStore(const std::string &filepath, const Config &config) :
+	_config(config), _filepath(filepath), _map(NULL), _size(0), _header(NULL),
+	_entries(NULL), _dataEnd(0), _keyCount(0)
+{
+	size_t maxKeys = 1;
+	while (maxKeys < _config.maxKeys)
+		maxKeys *= 2;
+	_config.maxKeys = maxKeys;
+
+	int fd = open(filepath.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		perror("CalibrationStore: open");
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		perror("CalibrationStore: fstat");
+	} else if (st.st_size == 0 || !openExisting(fd, st.st_size)) {
+		if (st.st_size > 0)
+			fprintf(stderr, "CalibrationStore: '%s' is not a store of version %u, "
+				"starting over\n", filepath.c_str(), CALIBRATION_STORE_VERSION);
+		create(fd);
+	}
+
+	/* the mapping stays valid without the descriptor */
+	close(fd);
+}
+
+CalibrationStore::~CalibrationStore()
+{
+	unmap();
+}
+
+bool CalibrationStore::mapFile(int fd, size_t size)
+{
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("CalibrationStore: mmap");
+		return false;
+	}
+
+	_map = (char *)map;
+	_size = size;
+	_header = (CalibrationStoreHeader *)_map;
+	_entries = (CalibrationStoreEntry *)(_map + CALIBRATION_STORE_PAGE);
+
+	return true;
+}
+
+void CalibrationStore::unmap()
+{
+	if (_map)
+		munmap(_map, _size);
+	_map = NULL;
+	_size = 0;
+	_header = NULL;
+	_entries = NULL;
+}
+
+bool CalibrationStore::openExisting(int fd, size_t size)
+{
+	CalibrationStoreHeader header;
+	if (size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header))
+		return false;
+
+	size_t indexEnd = CALIBRATION_STORE_PAGE + (size_t)header.maxKeys * sizeof(CalibrationStoreEntry);
+	if (memcmp(header.magic, CALIBRATION_STORE_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.version != CALIBRATION_STORE_VERSION ||
+	    header.checksum != checksum(header) ||
+	    header.maxKeys == 0 || (header.maxKeys & (header.maxKeys - 1)) != 0 ||
+	    header.dataOffset < indexEnd || header.dataOffset + header.dataSize != size)
+		return false;
+
+	if (!mapFile(fd, size))
+		return false;
+
+	/* the allocations are recovered from the index, the valid entries only */
+	_dataEnd = header.dataOffset;
+	_keyCount = 0;
+	for (size_t i = 0; i < header.maxKeys; i++) {
+		const CalibrationStoreEntry *entry = &_entries[i];
+		if (!isEntryValid(entry))
+			continue;
+
+		uint64_t end = entry->offset + 2 * (uint64_t)entry->recordSize;
+		if (entry->offset < header.dataOffset || end > size)
+			continue;
+
+		_dataEnd = std::max(_dataEnd, end);
+		_keyCount++;
+	}
+
+	return true;
+}
+
+bool CalibrationStore::create(int fd)
+{
+	size_t indexEnd = CALIBRATION_STORE_PAGE + _config.maxKeys * sizeof(CalibrationStoreEntry);
+	size_t dataOffset = (indexEnd + CALIBRATION_STORE_PAGE - 1) /
+			    CALIBRATION_STORE_PAGE * CALIBRATION_STORE_PAGE;
+	size_t size = dataOffset + _config.dataSize;
+
+	/* zero everything, the file is sparse */
+	if (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0) {
+		perror("CalibrationStore: ftruncate");
+		return false;
+	}
+
+	if (!mapFile(fd, size))
+		return false;
+
+	CalibrationStoreHeader *header = _header;
+	memcpy(header->magic, CALIBRATION_STORE_MAGIC, sizeof(header->magic));
+	header->version = CALIBRATION_STORE_VERSION;
+	header->maxKeys = _config.maxKeys;
+	header->dataOffset = dataOffset;
+	header->dataSize = _config.dataSize;
+	header->checksum = checksum(*header);
+
+	_dataEnd = dataOffset;
+	_keyCount = 0;
+
+	return true;
+}
+
+size_t CalibrationStore::keyCount() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _keyCount;
+}
+
+/* the entry of key, or the free entry where it would go, NULL if the index is full */
+CalibrationStoreEntry *CalibrationStore::findEntry(const Key &key) const
+{
+	size_t mask = _header->maxKeys - 1;
+	size_t i = hashKey(key) & mask;
+
+	for (size_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+		CalibrationStoreEntry *entry = &_entries[i];
+		if (!entry->used)
+			return entry;
+
+		/* an entry torn by a crash is skipped, never reused */
+		if (isEntryValid(entry) && entryMatches(entry, key))
+			return entry;
+	}
+
+	return NULL;
+}
+
+bool CalibrationStore::isRecordValid(const CalibrationStoreRecord *record,
+				     uint32_t recordSize) const
+{
+	if (record->generation == 0 || record->bins == 0 || record->groupSize == 0 ||
+	    record->groups != (record->bins + record->groupSize - 1) / record->groupSize ||
+	    sizeof(*record) + 3 * (uint64_t)record->groups * sizeof(float) > recordSize)
+		return false;
+
+	return record->checksum == checksum(*record, record + 1,
+					    3 * record->groups * sizeof(float));
+}
+
+const CalibrationStoreRecord *CalibrationStore::newestRecord(const CalibrationStoreEntry *entry) const
+{
+	const CalibrationStoreRecord *newest = NULL;
+
+	for (size_t r = 0; r < 2; r++) {
+		const CalibrationStoreRecord *record = (const CalibrationStoreRecord *)
+			(_map + entry->offset + r * entry->recordSize);
+		if (isRecordValid(record, entry->recordSize) &&
+		    (!newest || record->generation > newest->generation))
+			newest = record;
+	}
+
+	return newest;
+}
+
+bool CalibrationStore::save(const Key &key, const NoiseCalibration::Snapshot &snapshot)
+{
+	size_t groups = snapshot.mean.size();
+	if (groups == 0 || snapshot.mode.size() != groups ||
+	    snapshot.highQuantile.size() != groups)
+		return false;
+
+	size_t floatsSize = groups * sizeof(float);
+	uint32_t recordSize = (sizeof(CalibrationStoreRecord) + 3 * floatsSize + 63) / 64 * 64;
+
+	boost::mutex::scoped_lock lock(_mutex);
+	if (!_map)
+		return false;
+
+	CalibrationStoreEntry *entry = findEntry(key);
+	if (!entry) {
+		fprintf(stderr, "CalibrationStore: the index of '%s' is full\n", _filepath.c_str());
+		return false;
+	}
+
+	/* allocate the two snapshots of a new key, or of bigger ones */
+	if (!entry->used || entry->recordSize < recordSize) {
+		if (_dataEnd + 2 * (uint64_t)recordSize > _header->dataOffset + _header->dataSize) {
+			fprintf(stderr, "CalibrationStore: '%s' is full\n", _filepath.c_str());
+			return false;
+		}
+
+		if (!entry->used)
+			_keyCount++;
+
+		entry->centralFrequency = key.centralFrequency;
+		entry->sampleRate = key.sampleRate;
+		entry->gain = key.gain;
+		entry->fftSize = key.fftSize;
+		entry->firstBin = key.firstBin;
+		entry->used = 1;
+		entry->recordSize = recordSize;
+		entry->offset = _dataEnd;
+		entry->reserved = 0;
+		entry->checksum = checksum(*entry);
+
+		_dataEnd += 2 * (uint64_t)recordSize;
+	}
+
+	/* overwrite the oldest snapshot, the newest one survives a crash */
+	const CalibrationStoreRecord *newest = newestRecord(entry);
+	char *first = _map + entry->offset;
+	CalibrationStoreRecord *record = (CalibrationStoreRecord *)first;
+	if (newest == record)
+		record = (CalibrationStoreRecord *)(first + entry->recordSize);
+
+	float *floats = (float *)(record + 1);
+	memcpy(floats, snapshot.mean.data(), floatsSize);
+	memcpy(floats + groups, snapshot.mode.data(), floatsSize);
+	memcpy(floats + 2 * groups, snapshot.highQuantile.data(), floatsSize);
+
+	CalibrationStoreRecord header;
+	memset(&header, 0, sizeof(header));
+	header.generation = newest ? newest->generation + 1 : 1;
+	header.updates = snapshot.updates;
+	header.bins = snapshot.bins;
+	header.groupSize = snapshot.groupSize;
+	header.groups = groups;
+	header.quantile = snapshot.quantile;
+	header.checksum = checksum(header, floats, 3 * floatsSize);
+	*record = header;
+
+	/* msync wants a page-aligned address */
+	size_t begin = ((char *)record - _map) / CALIBRATION_STORE_PAGE * CALIBRATION_STORE_PAGE;
+	size_t end = ((char *)record - _map) + recordSize;
+	msync(_map + begin, end - begin, MS_ASYNC);
+
+	return true;
+}
+
+bool CalibrationStore::load(const Key &key, NoiseCalibration::Snapshot &snapshot) const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	if (!_map)
+		return false;
+
+	const CalibrationStoreEntry *entry = findEntry(key);
+	if (!entry || !entry->used)
+		return false;
+
+	const CalibrationStoreRecord *record = newestRecord(entry);
+	if (!record)
+		return false;
+
+	const float *floats = (const float *)(record + 1);
+	size_t groups = record->groups;
+
+	snapshot.bins = record->bins;
+	snapshot.groupSize = record->groupSize;
+	snapshot.updates = record->updates;
+	snapshot.quantile = record->quantile;
+	snapshot.ready = false;
+	snapshot.mean.assign(floats, floats + groups);
+	snapshot.mode.assign(floats + groups, floats + 2 * groups);
+	snapshot.highQuantile.assign(floats + 2 * groups, floats + 3 * groups);
+	snapshot.threshold.clear();
+
+	return true;
+}
@@ -0,0 +1,139 @@
+/**
+ * \file      calibrationstore.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef CALIBRATIONSTORE_H
+#define CALIBRATIONSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+
+#include "noisecalibration.h"
+
+struct CalibrationStoreHeader;
+struct CalibrationStoreEntry;
+struct CalibrationStoreRecord;
+
+/**
+ * \class     CalibrationStore
+ * \brief     Keeps the noise models of every tuning in a memory-mapped file.
+ *
+ * \details   A node restarting, or hopping back to a band it already
+ *            learnt, restores the noise models of the tuning instead of
+ *            warming up again, see ComsDetect::setCalibrationStore.
+ *
+ *            The file starts with a versioned header and an index of
+ *            \a maxKeys entries, an open addressing hash table of the
+ *            keys: finding the models of a key is O(1). The snapshots
+ *            follow, two per key, written alternately. Every entry and
+ *            every snapshot carries a CRC-32: a snapshot torn by a crash
+ *            is ignored and the other one is used.
+ *
+ *            The space of a key is allocated by its first #save and never
+ *            freed. The file is sparse, only the index and the snapshots
+ *            written take disk space: 48 kB per key for 2048 groups.
+ *            A file which is not a store of this version is started over.
+ *
+ *            **Thread-safety:** Thread safe, the slices of a spectrum can
+ *            share a store. A file must only be opened by one process.
+ */
+class CalibrationStore
+{
+public:
+	/// The tuning the noise models were learnt at
+	struct Key
+	{
+		uint64_t centralFrequency; ///< In Hz
+		uint64_t sampleRate; ///< In S/s
+		float gain; ///< The gain of the front-end, in dB, 0 when unknown as in hachoir_c
+		uint16_t fftSize; ///< The size of the spectra
+		uint16_t firstBin; ///< The first bin of the slice
+
+		Key(uint64_t centralFrequency = 0, uint64_t sampleRate = 0,
+		    float gain = 0, uint16_t fftSize = 0, uint16_t firstBin = 0);
+
+		bool operator==(const Key &other) const;
+		bool operator!=(const Key &other) const { return !(*this == other); }
+	};
+
+	/// The layout of a new store, an existing one keeps its own
+	struct Config
+	{
+		size_t maxKeys; ///< The entries of the index, rounded up to a power of two
+		size_t dataSize; ///< The bytes reserved for the snapshots
+
+		/// 1024 keys, 256 MB of snapshots
+		Config();
+	};
+
+private:
+	Config _config;
+	std::string _filepath;
+
+	char *_map; ///< The whole file
+	size_t _size; ///< The size of the file
+	CalibrationStoreHeader *_header;
+	CalibrationStoreEntry *_entries; ///< The index, maxKeys entries
+	uint64_t _dataEnd; ///< The first free byte of the snapshots
+	size_t _keyCount; ///< The keys stored
+
+	mutable boost::mutex _mutex;
+
+	bool mapFile(int fd, size_t size);
+	bool openExisting(int fd, size_t size);
+	bool create(int fd);
+	void unmap();
+
+	CalibrationStoreEntry *findEntry(const Key &key) const;
+	const CalibrationStoreRecord *newestRecord(const CalibrationStoreEntry *entry) const;
+	bool isRecordValid(const CalibrationStoreRecord *record, uint32_t recordSize) const;
+
+public:
+	/**
+	 * \brief    Open the store at \a filepath, create it if needed.
+	 *
+	 * \param    filepath   The path of the store
+	 * \param    config     The layout, if the store is created
+	 * \return   Nothing, see #isOpen.
+	 */
+	CalibrationStore(const std::string &filepath, const Config &config = Config());
+	~CalibrationStore();
+
+	bool isOpen() const { return _map != NULL; }
+	const std::string &filepath() const { return _filepath; }
+
+	/// The keys having an entry in the index
+	size_t keyCount() const;
+
+	/**
+	 * \brief    Save the noise models of a tuning, O(groups).
+	 *
+	 * \details  The oldest of the two snapshots of \a key is overwritten,
+	 *           the file is then flushed asynchronously.
+	 *
+	 * \param    key        The tuning of the models
+	 * \param    snapshot   The models, see NoiseCalibration::snapshot
+	 * \return   False if the index or the snapshots are full, true otherwise.
+	 */
+	bool save(const Key &key, const NoiseCalibration::Snapshot &snapshot);
+
+	/**
+	 * \brief    Read the newest valid noise models of a tuning, O(groups).
+	 *
+	 * \details  The thresholds of \a snapshot are left empty and it is
+	 *           not #ready, NoiseCalibration::restore recomputes them.
+	 *
+	 * \param    key        The tuning of the models
+	 * \param    snapshot   Receives the models
+	 * \return   False if no valid models are stored for \a key.
+	 */
+	bool load(const Key &key, NoiseCalibration::Snapshot &snapshot) const;
+};
+
+#endif // CALIBRATIONSTORE_H
@@ -2,9 +2,14 @@
 #include <assert.h>
 #include <string.h>
 #include <math.h>
+#include <algorithm>
+#include "spectrumkernels.h"
 #include "sw_radio_params.h"
 
-#define CALIBRATION_POINT_COUNT 5
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 #define WANTED_PRECISION 0.9999
 
 float ComsDetect::probaPwrUnder(float pwr)
@@ -41,60 +46,145 @@ uint32_t ComsDetect::calcInactiveTimeout(float pwr, float confidence)
 	return res;
 }
 
-ComsDetect &comsDetect()
+ComsDetect::Config::Config() :
+	comMinFreqWidth(500000), comMinSNR(0), comMinDurationNs(100000000),
+	comEndOfTransmissionDelay(1000000), fftSize(0), firstBin(0), binCount(0),
+	calibrationGroupSize(1), calibrationForgetting(1.0 / 8192),
+	calibrationSaveInterval(8192)
 {
-	static ComsDetect detect(500000, 0, 100000000, 1000000);
-	return detect;
 }
 
-size_t ComsDetect::calibPointIndexAt(size_t i) const
+ComsDetect::ComsDetect(const Config &config) :
+	_config(config), _fftSize(0), _begin(0), _end(0),
+	_calibration(config.calibrationGroupSize, config.calibrationForgetting),
+	_spectraToSave(config.calibrationSaveInterval)
 {
-	return i * CALIBRATION_POINT_COUNT / _fftSize;
+	_maxTimeout = calcInactiveTimeout(0.0 - config.comMinSNR, WANTED_PRECISION);
+	setFftSize(config.fftSize);
 }
 
-ComsDetect::ComsDetect(uint32_t comMinFreqWidth,
-    uint32_t comMinSNR, uint64_t comMinDurationNs,
-    uint64_t comEndOfTransmissionDelay) :
-	_comMinFreqWidth(comMinFreqWidth), _comMinSNR(comMinSNR),
-	_comMinDurationNs(comMinDurationNs),
-	_comEndOfTransmissionDelay(comEndOfTransmissionDelay),
-	_lastDetectedTransmission(nullptr)
+std::vector<ComsDetect::Config> ComsDetect::partition(const Config &config,
+						      size_t parts)
 {
-	_maxTimeout = calcInactiveTimeout(0.0 - comMinSNR, WANTED_PRECISION);
+	std::vector<Config> slices;
+
+	size_t begin = config.firstBin;
+	size_t end = config.binCount > 0 ? begin + config.binCount : config.fftSize;
+	end = std::min(end, (size_t)config.fftSize);
+	if (parts == 0 || begin >= end)
+		return slices;
+
+	/* a calibration group must not straddle two slices */
+	size_t align = std::max(config.calibrationGroupSize, (size_t)16);
+	size_t step = (end - begin) / parts;
+	step = std::max((step + align / 2) / align, (size_t)1) * align;
+
+	for (size_t b = begin; b < end; b += step) {
+		Config slice = config;
+		slice.firstBin = b;
+		slice.binCount = slices.size() + 1 == parts ? end - b : std::min(step, end - b);
+		slices.push_back(slice);
+		if (slices.size() == parts)
+			break;
+	}
+
+	return slices;
 }
 
 void ComsDetect::setFftSize(uint16_t fftSize)
 {
-	if (_lastDetectedTransmission != nullptr)
-		delete[] _lastDetectedTransmission;
-	if (_calibs != nullptr) {
-		delete[] _calibs;
-	}
+	/* keep what was learnt since the last save, at the former size */
+	if (_store && fftSize != _fftSize)
+		saveCalibration();
 
 	_fftSize = fftSize;
+	_begin = std::min(_config.firstBin, fftSize);
+	_end = fftSize;
+	if (_config.binCount > 0 && _begin + _config.binCount < fftSize)
+		_end = _begin + _config.binCount;
 
-	_lastDetectedTransmission = new struct lastDetectedTransmission[_fftSize];
-	assert(_lastDetectedTransmission != nullptr);
-	memset(_lastDetectedTransmission, 0,
-	       _fftSize * sizeof(struct lastDetectedTransmission));
+	size_t bins = _end - _begin;
+	_avg.assign(bins, 0.0);
+	_avgSquared.assign(bins, 0.0);
+	_inactiveCnt.assign(bins, 0);
+	_avgCnt.assign(bins, 0);
+	_active.assign(bins, 0);
 
-	_calibs = new CalibrationPoint[CALIBRATION_POINT_COUNT];
-	assert(_calibs != nullptr);
+	_calibration.reset(bins);
 
-	/* assign every calibrationValue */
-	for (uint16_t i = 0; i < fftSize; i++) {
-		int offset = calibPointIndexAt(i);
+	_storeKey.fftSize = fftSize;
+	_storeKey.firstBin = _begin;
+	restoreCalibration();
+}
 
-		_lastDetectedTransmission[i].calib =
-				&_calibs[offset];
+void ComsDetect::setCalibrationParams(size_t groupSize, float forgetting)
+{
+	_config.calibrationGroupSize = groupSize;
+	_config.calibrationForgetting = forgetting;
+	_calibration.setParams(groupSize, forgetting);
+}
 
-#if 0
-		// debug density
-		std::ostringstream filename;
-		filename << "/tmp/density_" << offset << ".csv";
-		_lastDetectedTransmission[i].calib->dumpToCsvFile(filename.str());
-#endif
-	}
+void ComsDetect::calibrationSnapshot(NoiseCalibration::Snapshot &snapshot) const
+{
+	_calibration.snapshot(snapshot);
+}
+
+bool ComsDetect::loadCalibration(const ThermalCalibration::Result &calibration)
+{
+	if (calibration.fftSize != _fftSize || calibration.mean.size() != _fftSize)
+		return false;
+
+	return _calibration.seed(calibration.mean.data() + _begin,
+				 calibration.median.data() + _begin,
+				 calibration.highQuantile.data() + _begin,
+				 calibration.quantile, _end - _begin, calibration.ffts);
+}
+
+bool ComsDetect::restoreCalibration()
+{
+	_spectraToSave = _config.calibrationSaveInterval;
+
+	if (!_store || !_store->load(_storeKey, _storeSnapshot))
+		return false;
+
+	return _calibration.restore(_storeSnapshot);
+}
+
+bool ComsDetect::setCalibrationStore(const boost::shared_ptr<CalibrationStore> &store,
+				     const CalibrationStore::Key &key)
+{
+	CalibrationStore::Key tuning = key;
+	tuning.fftSize = _fftSize;
+	tuning.firstBin = _begin;
+
+	if (store == _store && tuning == _storeKey)
+		return _calibration.isReady();
+
+	/* the models learnt at another tuning do not hold at this one */
+	bool retune = _store && tuning != _storeKey;
+	if (retune)
+		saveCalibration();
+
+	_store = store;
+	_storeKey = tuning;
+
+	if (retune)
+		setFftSize(_fftSize);
+	else
+		restoreCalibration();
+
+	return _calibration.isReady();
+}
+
+bool ComsDetect::saveCalibration()
+{
+	_spectraToSave = _config.calibrationSaveInterval;
+
+	if (!_store || !_calibration.isReady())
+		return false;
+
+	_calibration.snapshot(_storeSnapshot);
+	return _store->save(_storeKey, _storeSnapshot);
 }
 
 uint64_t getTimeNs()
@@ -104,78 +194,164 @@ uint64_t getTimeNs()
 	return (time.tv_sec * 1000000 + time.tv_usec) * 1000;
 }
 
-void ComsDetect::addFFT(boost::shared_ptr<Fft> fft)
+/* The state machine of a bin, for the bins [begin, end). Written without
+ * branches so as every bin goes through the same instructions:
+ *
+ *	if (pwr > threshold) {
+ *		inactiveCnt = 0;
+ *		active = true;
+ *	}
+ *	if (active) {
+ *		avg += pwr, avgSquared += pwr²
+ *		if (++avgCnt > 1000) halve avg and avgCnt
+ *		if (pwr < threshold && ++inactiveCnt >= maxTimeout)
+ *			avg = avgCnt = active = 0
+ *	}
+ */
+struct BinsState
+{
+	float *avg;
+	float *avgSquared;
+	uint32_t *inactiveCnt;
+	uint32_t *avgCnt;
+	uint32_t *active;
+};
+
+static void detectScalar(const BinsState &s, const float *pwr,
+			 const float *threshold, size_t begin, size_t end,
+			 uint32_t maxTimeout)
+{
+	for (size_t i = begin; i < end; i++) {
+		float p = pwr[i];
+		uint32_t above = -(uint32_t)(p > threshold[i]);
+		uint32_t below = -(uint32_t)(p < threshold[i]);
+
+		uint32_t active = s.active[i] | above;
+		uint32_t inactiveCnt = s.inactiveCnt[i] & ~above;
+		float avg = active ? s.avg[i] + p : s.avg[i];
+		float avgSquared = active ? s.avgSquared[i] + p * p : s.avgSquared[i];
+		uint32_t avgCnt = s.avgCnt[i] - active;
+
+		uint32_t halve = active & -(uint32_t)(avgCnt > 1000);
+		avgCnt = halve ? avgCnt / 2 : avgCnt;
+		avg = halve ? avg / 2 : avg;
+
+		uint32_t inc = active & below;
+		inactiveCnt -= inc;
+		uint32_t expire = inc & -(uint32_t)(inactiveCnt >= maxTimeout);
+
+		s.avg[i] = expire ? 0.0f : avg;
+		s.avgSquared[i] = avgSquared;
+		s.avgCnt[i] = avgCnt & ~expire;
+		s.inactiveCnt[i] = inactiveCnt;
+		s.active[i] = active & ~expire;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* no fma, a fused pwr² + avgSquared would not match the scalar version */
+__attribute__((target("avx2")))
+static void detectAvx2(const BinsState &s, const float *pwr,
+		       const float *threshold, size_t begin, size_t end,
+		       uint32_t maxTimeout)
+{
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256i maxCnt = _mm256_set1_epi32(1000);
+	const __m256i timeout = _mm256_set1_epi32((int32_t)maxTimeout - 1);
+	size_t i = begin;
+
+	for (; i + 8 <= end; i += 8) {
+		__m256 p = _mm256_loadu_ps(pwr + i);
+		__m256 t = _mm256_loadu_ps(threshold + i);
+		__m256i above = _mm256_castps_si256(_mm256_cmp_ps(p, t, _CMP_GT_OQ));
+		__m256i below = _mm256_castps_si256(_mm256_cmp_ps(p, t, _CMP_LT_OQ));
+
+		__m256i active = _mm256_or_si256(_mm256_loadu_si256((__m256i *)(s.active + i)), above);
+		__m256i inactiveCnt = _mm256_andnot_si256(above, _mm256_loadu_si256((__m256i *)(s.inactiveCnt + i)));
+		__m256 activeMask = _mm256_castsi256_ps(active);
+
+		__m256 avg = _mm256_loadu_ps(s.avg + i);
+		avg = _mm256_blendv_ps(avg, _mm256_add_ps(avg, p), activeMask);
+		__m256 avgSquared = _mm256_loadu_ps(s.avgSquared + i);
+		avgSquared = _mm256_blendv_ps(avgSquared,
+					      _mm256_add_ps(avgSquared, _mm256_mul_ps(p, p)),
+					      activeMask);
+		__m256i avgCnt = _mm256_sub_epi32(_mm256_loadu_si256((__m256i *)(s.avgCnt + i)), active);
+
+		__m256i halve = _mm256_and_si256(active, _mm256_cmpgt_epi32(avgCnt, maxCnt));
+		avgCnt = _mm256_blendv_epi8(avgCnt, _mm256_srli_epi32(avgCnt, 1), halve);
+		avg = _mm256_blendv_ps(avg, _mm256_mul_ps(avg, half), _mm256_castsi256_ps(halve));
+
+		__m256i inc = _mm256_and_si256(active, below);
+		inactiveCnt = _mm256_sub_epi32(inactiveCnt, inc);
+		__m256i expire = _mm256_and_si256(inc, _mm256_cmpgt_epi32(inactiveCnt, timeout));
+
+		_mm256_storeu_ps(s.avg + i, _mm256_andnot_ps(_mm256_castsi256_ps(expire), avg));
+		_mm256_storeu_ps(s.avgSquared + i, avgSquared);
+		_mm256_storeu_si256((__m256i *)(s.avgCnt + i), _mm256_andnot_si256(expire, avgCnt));
+		_mm256_storeu_si256((__m256i *)(s.inactiveCnt + i), inactiveCnt);
+		_mm256_storeu_si256((__m256i *)(s.active + i), _mm256_andnot_si256(expire, active));
+	}
+
+	_mm256_zeroupper();
+	detectScalar(s, pwr, threshold, i, end, maxTimeout);
+}
+#endif
+
+void ComsDetect::detect(const float *pwr, const float *threshold)
+{
+	static const bool avx2 = SpectrumKernels::isSupported(SpectrumKernels::AVX2);
+	BinsState s = { _avg.data(), _avgSquared.data(), _inactiveCnt.data(),
+			_avgCnt.data(), _active.data() };
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (avx2) {
+		detectAvx2(s, pwr, threshold, 0, _end - _begin, _maxTimeout);
+		return;
+	}
+#endif
+	detectScalar(s, pwr, threshold, 0, _end - _begin, _maxTimeout);
+}
+
+void ComsDetect::addFFT(FftPtr fft)
 {
 	if (fft->fftSize() != fftSize())
 		return;
 
-	for (int i = 0; i < fftSize(); i++) {
-		float pwr = (fft->operator [](i));
-		struct lastDetectedTransmission *lt = &_lastDetectedTransmission[i];
-
-		lt->calib->addData(fft->operator [](i));
-		if (!lt->calib->isReady())
-			continue;
-
-		if (pwr > lt->calib->modelMax()) {
-			lt->inactiveCnt = 0;
-			lt->active = true;
-		}
-
-		if (lt->active) {
-			lt->avg += pwr;
-			lt->avgSquared += pwr * pwr;
-			lt->avgCnt++;
-			if (lt->avgCnt > 1000) {
-				lt->avgCnt /= 2;
-				lt->avg /= 2;
-			}
-
-			if (pwr < lt->calib->modelMax()) {
-				lt->inactiveCnt++;
-				//float avg = lt->avg / lt->avgCnt;
-				uint32_t timeout = _maxTimeout; //calcInactiveTimeout(lt->calib->modelMax() - avg, WANTED_PRECISION);
-				if (lt->inactiveCnt >= timeout /*||
-					avg < (lt->calib->modelMax() + comMinSNR())*/) {
-					/*fprintf(stderr,
-						"inactiveCnt = %u, avg = %f, avgCnt = %u\n",
-						lt->inactiveCnt, avg, lt->avgCnt);*/
-					lt->avg = 0;
-					lt->avgCnt = 0;
-					lt->active = false;
-				}
-			}
-		}
+	const float *pwr = fft->bins();
+	if (!pwr) {
+		_pwr.resize(fftSize());
+		for (int i = _begin; i < _end; i++)
+			_pwr[i] = fft->operator [](i);
+		pwr = _pwr.data();
 	}
+
+	addSpectrum(pwr, fft->fftSize());
 }
 
-/*float ComsDetect::noiseFloor(size_t i) const
+void ComsDetect::addSpectrum(const float *pwr, uint16_t fftSize)
 {
-	int offset = calibPointIndexAt(i);
-	int offsetb = (offset - 1) % CALIBRATION_POINT_COUNT;
-	int offseta = (offset + 1) % CALIBRATION_POINT_COUNT;
+	if (fftSize != this->fftSize())
+		return;
 
-	if (offsetb < 0) offsetb = CALIBRATION_POINT_COUNT - 1;
-	float model[3] = {
-		_calibs[offsetb].modelMax(),
-		_calibs[offset].modelMax(),
-		_calibs[offseta].modelMax()
-	};
+	if (_begin == _end)
+		return;
 
-	float avg = (model[0] + model[2]) / 2;
+	/* a bin is compared to a model which already learnt its power */
+	_calibration.update(pwr + _begin, _end - _begin);
+	detect(pwr + _begin, _calibration.thresholds());
 
-	if (fabs(model[1] - avg) > 4)
-		return avg + 4;
-	else
-		return model[1];
-}*/
+	if (_store && _config.calibrationSaveInterval > 0 && --_spectraToSave == 0)
+		saveCalibration();
+}
 
 float ComsDetect::avgPowerAtBin(size_t i) const
 {
-	struct lastDetectedTransmission *lt = &_lastDetectedTransmission[i];
-	if (lt->avgCnt > 0) {
+	size_t b = i - _begin;
+
+	if (_avgCnt[b] > 0) {
 		float nf = noiseFloor(i);
-		float avg = lt->avg / lt->avgCnt;
+		float avg = _avg[b] / _avgCnt[b];
 		return avg < nf ? nf : avg;
 	} else
 		return noiseFloor(i);
@@ -183,6 +359,7 @@ float ComsDetect::avgPowerAtBin(size_t i) const
 
 float ComsDetect::varianceAtBin(size_t i) const
 {
-	struct lastDetectedTransmission *lt = &_lastDetectedTransmission[i];
-	return (lt->avgSquared - (lt->avg * lt->avg)) / lt->avgCnt;
+	size_t b = i - _begin;
+
+	return (_avgSquared[b] - (_avg[b] * _avg[b])) / _avgCnt[b];
 }
@@ -3,61 +3,162 @@
 
 #include <stdint.h>
 #include <boost/shared_ptr.hpp>
+#include "alignedallocator.h"
+#include "calibrationstore.h"
 #include "fft.h"
-#include "calibrationpoint.h"
+#include "noisecalibration.h"
+#include "thermalcalibration.h"
 #include <vector>
 
+/**
+ * \class     ComsDetect
+ * \brief     Detects the bins carrying a transmission, FFT after FFT.
+ *
+ * \details   A detector is built from a #Config and owned by its user, a
+ *            hachoir_c block for instance. It handles the bins
+ *            [firstBin(), endBin()) of the spectra: a wide spectrum can be
+ *            split in slices, see #partition, each slice being detected
+ *            by its own instance and thread. The bins keep their index in
+ *            the spectrum.
+ *
+ *            **Thread-safety:** Not thread safe. The instances share no
+ *            state, each of them can be used by a different thread.
+ */
 class ComsDetect
 {
+public:
+	/// The parameters of a detector
+	struct Config
+	{
+		uint32_t comMinFreqWidth; ///< The narrowest transmission, in Hz
+		uint32_t comMinSNR; ///< The weakest transmission, in dB
+		uint64_t comMinDurationNs; ///< The shortest transmission, in ns
+		uint64_t comEndOfTransmissionDelay; ///< Silence ending a transmission, in ns
+
+		uint16_t fftSize; ///< The size of the spectra, 0 until #setFftSize
+		uint16_t firstBin; ///< The first bin of the slice
+		uint16_t binCount; ///< The bins of the slice, 0 for all the remaining ones
+
+		size_t calibrationGroupSize; ///< See NoiseCalibration
+		float calibrationForgetting; ///< See NoiseCalibration
+		uint32_t calibrationSaveInterval; ///< The spectra between two saves, see #setCalibrationStore
+
+		/// The parameters the detection historically used, whole spectrum
+		Config();
+	};
+
+private:
+	Config _config;
+
 	uint16_t _fftSize;
-	uint32_t _comMinFreqWidth;
-	uint32_t _comMinSNR;
-	uint64_t _comMinDurationNs;
-	uint64_t _comEndOfTransmissionDelay;
+	uint16_t _begin; ///< The first bin of the slice
+	uint16_t _end; ///< The bin following the slice
 	uint16_t _maxTimeout;
 
-	CalibrationPoint calib;
+	NoiseCalibration _calibration; ///< The noise model of every bin of the slice
 
-	CalibrationPoint *_calibs;
-
-	struct lastDetectedTransmission
-	{
-		CalibrationPoint *calib;
+	boost::shared_ptr<CalibrationStore> _store; ///< Where the noise models are saved, if any
+	CalibrationStore::Key _storeKey; ///< The tuning of the spectra
+	uint32_t _spectraToSave; ///< Before the next save
+	NoiseCalibration::Snapshot _storeSnapshot; ///< Reused by every save
 
-		uint32_t inactiveCnt;
-		uint32_t avgCnt;
+	/* the state of every bin of the slice, one array per field so as the
+	 * bins can be processed by vector instructions. _active is 0 or ~0.
+	 */
+	std::vector<float, AlignedAllocator<float> > _avg;
+	std::vector<float, AlignedAllocator<float> > _avgSquared;
+	std::vector<uint32_t, AlignedAllocator<uint32_t> > _inactiveCnt;
+	std::vector<uint32_t, AlignedAllocator<uint32_t> > _avgCnt;
+	std::vector<uint32_t, AlignedAllocator<uint32_t> > _active;
 
-		float avg;
-		float avgSquared;
-		bool active;
-	} * _lastDetectedTransmission;
+	std::vector<float> _pwr; ///< Copy of the bins of the FFTs lacking Fft::bins()
 
 	float probaPwrUnder(float pwr);
 	uint32_t calcInactiveTimeout(float pwr, float confidence);
-	size_t calibPointIndexAt(size_t i) const;
+	void detect(const float *pwr, const float *threshold);
+	bool restoreCalibration();
 
-	friend ComsDetect &comsDetect();
-	ComsDetect(uint32_t comMinFreqWidth,
-		uint32_t comMinSNR, uint64_t comMinDurationNs,
-		uint64_t comEndOfTransmissionDelay);
 public:
+	ComsDetect(const Config &config = Config());
 
+	/**
+	 * \brief    Split the spectrum of \a config in \a parts slices.
+	 *
+	 * \details  The slices are multiples of the calibration groups and of
+	 *           16 bins, the last one gets the remainder. Fewer slices are
+	 *           returned when the spectrum is too small.
+	 *
+	 * \param    config   The detection of the whole spectrum, its fftSize
+	 *                    must be set
+	 * \param    parts    The number of slices wanted
+	 * \return   The configuration of every slice, in the order of the bins.
+	 */
+	static std::vector<Config> partition(const Config &config, size_t parts);
+
+	const Config &config() const { return _config; }
+
+	/// Forget everything and detect on spectra of \a fftSize bins
 	void setFftSize(uint16_t fftSize);
 	uint16_t fftSize() const { return _fftSize; }
-	uint32_t comMinFreqWidth() const { return _comMinFreqWidth; }
-	uint32_t comMinSNR() const { return _comMinSNR; }
-	uint64_t comMinDurationNs() const { return _comMinDurationNs; }
-	uint64_t comEndOfTransmissionDelay() const { return _comEndOfTransmissionDelay; }
+	uint16_t firstBin() const { return _begin; }
+	uint16_t endBin() const { return _end; }
+	bool hasBin(size_t i) const { return i >= _begin && i < _end; }
 
-	void addFFT(boost::shared_ptr<Fft> fft);
+	uint32_t comMinFreqWidth() const { return _config.comMinFreqWidth; }
+	uint32_t comMinSNR() const { return _config.comMinSNR; }
+	uint64_t comMinDurationNs() const { return _config.comMinDurationNs; }
+	uint64_t comEndOfTransmissionDelay() const { return _config.comEndOfTransmissionDelay; }
 
-	bool isBinActive(size_t i) const { return _lastDetectedTransmission[i].active; }
-	float noiseFloor(size_t i) const { return _lastDetectedTransmission[i].calib->modelMean(); }
-	float noiseMax(size_t i) const { return _lastDetectedTransmission[i].calib->modelMax(); }
+	/// Add a spectrum, only the bins of the slice are read
+	void addFFT(FftPtr fft);
+	void addSpectrum(const float *pwr, uint16_t fftSize);
+
+	/* the bins are indexed in the spectrum, i must be in the slice */
+	bool isBinActive(size_t i) const { return _active[i - _begin] != 0; }
+	/// 0 or ~0 for every bin of the slice, indexed from firstBin()
+	const uint32_t *activeBins() const { return _active.data(); }
+	float noiseFloor(size_t i) const { return _calibration.modelMean(i - _begin); }
+	float noiseMax(size_t i) const { return _calibration.threshold(i - _begin); }
 	float avgPowerAtBin(size_t i) const;
 	float varianceAtBin(size_t i) const;
-};
 
-ComsDetect &comsDetect();
+	/// The noise models, indexed from firstBin()
+	const NoiseCalibration &calibration() const { return _calibration; }
+	void setCalibrationParams(size_t groupSize, float forgetting);
+	void calibrationSnapshot(NoiseCalibration::Snapshot &snapshot) const;
+
+	/**
+	 * \brief    Start the noise models of the slice from a calibration.
+	 *
+	 * \details  The detection is ready at once, see NoiseCalibration::seed.
+	 *
+	 * \param    calibration   The thermal noise of the whole spectrum
+	 * \return   False if the calibration is not of #fftSize bins.
+	 */
+	bool loadCalibration(const ThermalCalibration::Result &calibration);
+
+	/**
+	 * \brief    Keep the noise models of the slice in a store.
+	 *
+	 * \details  The models stored for \a key are restored at once, so as
+	 *           a restarted node, or a node hopping back to a band, does
+	 *           not need to warm up. The models are then saved every
+	 *           \a calibrationSaveInterval spectra once ready. When \a key
+	 *           changes, the models are saved under the former key, then
+	 *           the detection starts over from the models of the new one.
+	 *
+	 *           The fftSize and firstBin of the key are the detector's.
+	 *
+	 * \param    store   The store, it can be shared by the slices, NULL to stop saving
+	 * \param    key     The tuning of the next spectra
+	 * \return   True if the detection is ready, restored or already learnt.
+	 */
+	bool setCalibrationStore(const boost::shared_ptr<CalibrationStore> &store,
+				 const CalibrationStore::Key &key);
+	const CalibrationStore::Key &calibrationKey() const { return _storeKey; }
+
+	/// Save the noise models now, see #setCalibrationStore
+	bool saveCalibration();
+};
 
 #endif // COMSDETECT_H
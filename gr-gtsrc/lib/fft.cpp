@@ -1,105 +1,132 @@
 #include "fft.h"
+#include "spectrumkernels.h"
 
+#include <algorithm>
 #include <iostream>
 
 void Fft::doFFt(uint16_t fftSize, FftWindow &win, gr::fft::fft_complex *fft)
 {
-	int i;
-
 	fft->execute();
 
-	/* process the output */
-	gr_complex *out = fft->get_outbuf();
-	float logFftSize = log10f(fftSize);
-	float logWindowPower = log10f(win.windowPower()/fftSize);
-	for (i = 0; i < fftSize; i++) {
-		int n = (i + fftSize/2 ) % fftSize;
-
-		float real = out[n].real();
-		float imag = out[n].imag();
-		float mag = sqrtf(real*real + imag*imag);
-
-		_pwr[i] = 20 * log10f(fabsf(mag))
-			- 20 * logFftSize
-			- 10 * logWindowPower
-			+ 3;
-	}
+	computePower(fftSize, win, fft->get_outbuf());
+}
+
+void Fft::computePower(uint16_t fftSize, const FftWindow &win, const gr_complex *out)
+{
+	/* 20*log10(|X|/N) - 10*log10(windowPower/N) + 3, computed without sqrt */
+	float offset = -20 * log10f(fftSize)
+		- 10 * log10f(win.windowPower()/fftSize)
+		+ 3;
+
+	SpectrumKernels::powerDbShifted(&_pwr[0], out, fftSize, offset);
 }
 
-void Fft::FftFromRing(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate,
+bool Fft::FftFromRing(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate,
     gr::fft::fft_complex *fft, FftWindow &win, SamplesRingBuffer &ringBuffer,
-    uint64_t &fromPos)
+    uint64_t &fromPos, SamplesRingBuffer::Cursor *cursor)
 {
 	gr_complex *dst = fft->get_inbuf();
 	gr_complex *samples;
+	uint64_t restartPos;
+	size_t length;
+
+	do {
+		if (cursor) {
+			cursor->recover();
+			fromPos = cursor->position();
+		}
 
-	/* wait until we have enough samples */
-	while (!ringBuffer.hasNAvailableFrom(fromPos, fftSize))
-		boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+		/* wait until we have enough samples */
+		while (!ringBuffer.waitForAvailable(fromPos, fftSize, 1000000000));
 
-	uint64_t restartPos;
-	size_t length = fftSize;
-	if (fromPos != (uint64_t)-1) {
-		if (!ringBuffer.requestRead(fromPos, &length, &samples)) {
+		/* on a mirrored ring, the whole FFT is read in one go */
+		length = fftSize;
+		if (fromPos == (uint64_t)-1) {
+			length = ringBuffer.requestReadLastN(fftSize, &fromPos, &restartPos, &samples);
+		} else if (ringBuffer.requestRead(fromPos, &length, &samples)) {
+			restartPos = fromPos + length;
+		} else if (!cursor) {
 			fprintf(stderr, "Fft::FftFromRing: We lost samples!\n");
 			length = ringBuffer.requestReadLastN(fftSize, &fromPos, &restartPos, &samples);
-		} else
-			restartPos += length;
-	} else
-		length = ringBuffer.requestReadLastN(fftSize, &fromPos, &restartPos, &samples);
+		}
+	} while (length == 0);
 	_ringBufferStartPos = fromPos;
 
 	_time_ns = ringBuffer.timeAt(fromPos);
 
 	size_t currentPos = 0;
 	do {
-		size_t i;
-
 		/* apply the window and copy to the input buffer */
-		for (i = 0; i < length; i++) {
-			dst[i] = samples[i] * win[i];
-		}
+		SpectrumKernels::applyWindow(dst + currentPos, samples,
+					     win.data() + currentPos, length);
 		currentPos += length;
 
-		if (length == 0)
-			boost::this_thread::yield();
-
 		if (currentPos < fftSize) {
-			size_t len = fftSize - currentPos;
-			ringBuffer.requestRead(restartPos, &len, &samples);
+			/* the samples are available, a failure means we got overridden */
+			length = fftSize - currentPos;
+			if (!ringBuffer.requestRead(restartPos, &length, &samples))
+				break;
+			restartPos += length;
 		}
 	} while(currentPos < fftSize);
 
 	/* check that the data has not been overriden while we were reading it! */
 	if (!ringBuffer.isPositionValid(fromPos)) {
-		fprintf(stderr, "Fft::FftFromRing: Invalid FFT, we potentially lost samples!\n");
-		return;
+		if (cursor)
+			cursor->recover();
+		else
+			fprintf(stderr, "Fft::FftFromRing: Invalid FFT, we potentially lost samples!\n");
+		return false;
 	}
 
 	doFFt(fftSize, win, fft);
+	return true;
 }
 
 Fft::Fft(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate) :
 	_fft_size(fftSize), _central_frequency(centralFrequency),
-	_sample_rate(sampleRate), _ringBufferStartPos(0), _pwr(fftSize)
+	_sample_rate(sampleRate), _ringBufferStartPos(0), _pwr(fftSize),
+	_refCount(0), _pool(NULL)
+{
+
+}
+
+Fft::Fft(const Fft &other) : _fft_size(other._fft_size),
+	_central_frequency(other._central_frequency),
+	_sample_rate(other._sample_rate), _time_ns(other._time_ns),
+	_ringBufferStartPos(other._ringBufferStartPos), _pwr(other._pwr),
+	_refCount(0), _pool(NULL)
 {
 
 }
 
+Fft &Fft::operator=(const Fft &other)
+{
+	/* the reference count and the pool belong to the object, not its value */
+	_fft_size = other._fft_size;
+	_central_frequency = other._central_frequency;
+	_sample_rate = other._sample_rate;
+	_time_ns = other._time_ns;
+	_ringBufferStartPos = other._ringBufferStartPos;
+	_pwr = other._pwr;
+
+	return *this;
+}
+
 Fft::Fft(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate,
 	 gr::fft::fft_complex *fft, FftWindow &win, const gr_complex *src, size_t length,
 	 uint64_t time_ns) : _fft_size(fftSize),
 	_central_frequency(centralFrequency), _sample_rate(sampleRate),
-	_time_ns(time_ns), _ringBufferStartPos(0), _pwr(fftSize)
+	_time_ns(time_ns), _ringBufferStartPos(0), _pwr(fftSize),
+	_refCount(0), _pool(NULL)
 {
 	size_t i;
 
 	gr_complex *dst = fft->get_inbuf();
 
 	/* apply the window and copy to input buffer */
-	for (i = 0; i < length && i < fftSize; i++) {
-		dst[i] = src[i] * win[i];
-	}
+	i = length < fftSize ? length : fftSize;
+	SpectrumKernels::applyWindow(dst, src, win.data(), i);
 
 	/* add padding samples when length < fft_size */
 	for (i = i; i < fftSize; i++)
@@ -111,7 +138,7 @@ Fft::Fft(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate,
 Fft::Fft(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate,
     gr::fft::fft_complex *fft, FftWindow &win, SamplesRingBuffer &ringBuffer)
 	: _fft_size(fftSize), _central_frequency(centralFrequency),
-	  _sample_rate(sampleRate), _pwr(fftSize)
+	  _sample_rate(sampleRate), _pwr(fftSize), _refCount(0), _pool(NULL)
 {
 	uint64_t fromPos = (uint64_t)-1;
 	FftFromRing(fftSize, centralFrequency, sampleRate, fft, win, ringBuffer, fromPos);
@@ -121,26 +148,108 @@ Fft::Fft(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate,
     gr::fft::fft_complex *fft, FftWindow &win, SamplesRingBuffer &ringBuffer,
     uint64_t &fromPos)
 	: _fft_size(fftSize), _central_frequency(centralFrequency),
-	  _sample_rate(sampleRate), _pwr(fftSize)
+	  _sample_rate(sampleRate), _pwr(fftSize), _refCount(0), _pool(NULL)
 {
 	FftFromRing(fftSize, centralFrequency, sampleRate, fft, win, ringBuffer, fromPos);
 }
 
-float Fft::noiseFloor() const
+Fft::Fft(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate,
+    gr::fft::fft_complex *fft, FftWindow &win, SamplesRingBuffer &ringBuffer,
+    SamplesRingBuffer::Cursor &cursor)
+	: _fft_size(fftSize), _central_frequency(centralFrequency),
+	  _sample_rate(sampleRate), _pwr(fftSize), _refCount(0), _pool(NULL)
+{
+	uint64_t fromPos;
+	FftFromRing(fftSize, centralFrequency, sampleRate, fft, win, ringBuffer, fromPos, &cursor);
+}
+
+size_t Fft::hopSize(uint16_t fftSize, float overlap)
+{
+	if (overlap < 0.0)
+		overlap = 0.0;
+	else if (overlap > 0.75)
+		overlap = 0.75;
+
+	size_t hop = fftSize - (size_t)(fftSize * overlap);
+	return hop > 0 ? hop : 1;
+}
+
+bool Fft::fromRingBatch(FftBatch &batch, FftPool &pool, const FftWindow &win,
+			SamplesRingBuffer &ringBuffer, uint64_t &fromPos,
+			float overlap, std::vector<FftPtr> &ffts)
 {
-	std::vector<float> sortedPwr(_pwr.size());
-	size_t keptPercentage = 10;
+	uint16_t fftSize = batch.fftSize();
+	size_t count = batch.count();
+	size_t hop = hopSize(fftSize, overlap);
+	size_t span = (count - 1) * hop + fftSize;
+	gr_complex *in = batch.inbuf();
+
+	ffts.clear();
+
+	/* wait until we have enough samples for all the frames */
+	while (!ringBuffer.waitForAvailable(fromPos, span, 1000000000));
+
+	/* apply the window on every frame. On a mirrored ring, every frame is
+	 * read in one go.
+	 */
+	for (size_t k = 0; k < count; k++) {
+		gr_complex *dst = in + k * fftSize;
+		uint64_t pos = fromPos + k * hop;
+		size_t currentPos = 0;
+
+		while (currentPos < fftSize) {
+			gr_complex *samples;
+			size_t length = fftSize - currentPos;
+
+			if (!ringBuffer.requestRead(pos + currentPos, &length, &samples))
+				return false;
+
+			SpectrumKernels::applyWindow(dst + currentPos, samples,
+						     win.data() + currentPos, length);
+			currentPos += length;
+		}
+	}
+
+	/* check that the data has not been overriden while we were reading it! */
+	if (!ringBuffer.isPositionValid(fromPos))
+		return false;
+
+	batch.execute();
 
-	std::copy(_pwr.begin(), _pwr.end(), sortedPwr.begin());
-	std::sort(sortedPwr.begin(), sortedPwr.end());
+	gr_complex *out = batch.outbuf();
+	for (size_t k = 0; k < count; k++) {
+		uint64_t pos = fromPos + k * hop;
+		RBMarker marker;
+		uint64_t markerPos, changePos;
 
-	size_t keptCount = fftSize() * keptPercentage / 100;
-	float keptSum = 0;
-	std::vector<float>::iterator rit;
-	for (rit = sortedPwr.begin(); rit != sortedPwr.begin() + keptCount; ++rit)
-		keptSum += *rit;
+		if (!ringBuffer.findMarker(pos, &marker, &markerPos) ||
+		    ringBuffer.findTuningChange(pos, fftSize, marker, &changePos))
+			continue;
 
-	return keptSum / keptCount;
+		FftPtr fft = pool.get(marker.freq, marker.sampleRate);
+		fft->_time_ns = ringBuffer.timeAtWithMarker(marker, pos - markerPos);
+		fft->_ringBufferStartPos = pos;
+		fft->computePower(fftSize, win, out + k * fftSize);
+
+		ffts.push_back(fft);
+	}
+
+	fromPos += count * hop;
+
+	return true;
+}
+
+float Fft::noiseFloor() const
+{
+	/* one estimator per thread, consecutive FFTs are usually related */
+	static thread_local NoiseFloorEstimator estimator;
+
+	return noiseFloor(estimator);
+}
+
+float Fft::noiseFloor(NoiseFloorEstimator &estimator) const
+{
+	return estimator.estimate(_pwr.data(), fftSize());
 }
 
 Fft & Fft::operator+=(const Fft &rhs)
@@ -191,3 +300,76 @@ const Fft Fft::operator-(const Fft &other) const
 {
 	return Fft(*this) -= other;
 }
+
+FftPool::FftPool(uint16_t fftSize, size_t capacity) : _fft_size(fftSize)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	grow(capacity);
+}
+
+FftPool::~FftPool()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	for (size_t i = 0; i < _frames.size(); i++) {
+		Fft *fft = _frames[i];
+
+		if (fft->_refCount.load(std::memory_order_acquire) == 0)
+			delete fft;
+		else
+			fft->_pool = NULL;
+	}
+}
+
+void FftPool::grow(size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		Fft *fft = new Fft(_fft_size, 0, 0);
+		fft->_pool = this;
+		_frames.push_back(fft);
+		_free.push_back(fft);
+	}
+
+	/* recycle() never has to reallocate the free list */
+	_free.reserve(_frames.size());
+}
+
+void FftPool::recycle(Fft *fft)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	_free.push_back(fft);
+}
+
+size_t FftPool::capacity() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _frames.size();
+}
+
+size_t FftPool::available() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _free.size();
+}
+
+FftPtr FftPool::get(uint64_t centralFrequency, uint64_t sampleRate)
+{
+	Fft *fft;
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		if (_free.empty())
+			grow(_frames.size() > 0 ? _frames.size() : 1);
+
+		fft = _free.back();
+		_free.pop_back();
+	}
+
+	fft->_central_frequency = centralFrequency;
+	fft->_sample_rate = sampleRate;
+	fft->_time_ns = 0;
+	fft->_ringBufferStartPos = 0;
+
+	return FftPtr(fft);
+}
@@ -13,9 +13,23 @@
 
 #include <gnuradio/fft/fft.h>
 
+#include <boost/intrusive_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <vector>
+
+#include "alignedallocator.h"
+#include "fftbatch.h"
 #include "fftwindow.h"
+#include "noisefloor.h"
 #include "samplesringbuffer.h"
 
+class Fft;
+class FftPool;
+
+/// A reference to an Fft, see Fft's thread-safety notes
+typedef boost::intrusive_ptr<Fft> FftPtr;
+
 /**
  * \class     Fft
  * \brief     Generates a Fast Fourier Transform (FFT).
@@ -36,7 +50,12 @@
  *
  *            The output of the FFT is stored as dBM.
  *
+ *            FFTs are reference-counted through #FftPtr. When the last
+ *            reference is dropped, an FFT coming from an #FftPool goes back
+ *            to it instead of being deleted.
+ *
  *            **Thread-safety:** Once constructed, the object should be thread safe.
+ *            The reference count is atomic.
  */
 class Fft
 {
@@ -47,7 +66,14 @@ protected:
 	uint64_t _time_ns; ///< The time in ns at which the first sample has been received (relative to 01/01/1970)
 	uint64_t _ringBufferStartPos; ///< Position of the first sample in the Ringbuffer used in the FFT
 
-	std::vector<float> _pwr; ///< The buffer that stores the FFT bins, converted to dBM
+	std::vector<float, AlignedAllocator<float> > _pwr; ///< The buffer that stores the FFT bins, converted to dBM
+
+	mutable std::atomic<uint32_t> _refCount; ///< The number of FftPtr referencing this FFT
+	FftPool *_pool; ///< The pool the FFT returns to when unreferenced, NULL if none
+
+	friend class FftPool;
+	friend void intrusive_ptr_add_ref(const Fft *fft);
+	friend void intrusive_ptr_release(const Fft *fft);
 
 	/**
 	 * \brief    Generate the FFT
@@ -62,13 +88,27 @@ protected:
 	 */
 	void doFFt(uint16_t fftSize, FftWindow &win, gr::fft::fft_complex *fft);
 
-	void FftFromRing(uint16_t fftSize, uint64_t centralFrequency,
+	/**
+	 * \brief    Convert the output of an FFT to dBm and store it in _pwr
+	 *
+	 * \param    fftSize   The size of the FFT
+	 * \param    win       The window that has been applied to the sample stream
+	 * \param    out       The output of the FFT, \a fftSize bins
+	 * \return   Nothing.
+	 */
+	void computePower(uint16_t fftSize, const FftWindow &win, const gr_complex *out);
+
+	bool FftFromRing(uint16_t fftSize, uint64_t centralFrequency,
 			 uint64_t sampleRate, gr::fft::fft_complex *fft,
 			 FftWindow &win, SamplesRingBuffer &ringBuffer,
-			 uint64_t &fromPos);
+			 uint64_t &fromPos, SamplesRingBuffer::Cursor *cursor = NULL);
 
 	Fft(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate);
 public:
+	Fft(const Fft &other);
+	Fft &operator=(const Fft &other);
+	virtual ~Fft() {}
+
 	/**
 	 * \brief    Create the FFT from a generic sample source.
 	 *
@@ -123,6 +163,62 @@ public:
 	    gr::fft::fft_complex *fft, FftWindow &win, SamplesRingBuffer &ringBuffer,
 	    uint64_t &fromPos);
 
+	/**
+	 * \brief    Create the FFT from a SampleRingBuffer, reading $fftSize samples
+	 *           from a consumer's cursor.
+	 *
+	 * \details  Overruns are accounted for in \a cursor and handled
+	 *           according to its policy. The cursor is not moved forward,
+	 *           this is left to the caller.
+	 *
+	 * \param  fftSize           The size of the FFT
+	 * \param  centralFrequency  The central frequency at which the samples were taken
+	 * \param  sampleRate        The samples' sampling rate
+	 * \param  fft               A gri_fft_complex that will perform the FFT
+	 * \param  win               The window to apply on the samples
+	 * \param  ringBuffer        The samples' source.
+	 * \param  cursor            The consumer's cursor, registered on \a ringBuffer
+	 * \return Nothing.
+	 */
+	Fft(uint16_t fftSize, uint64_t centralFrequency, uint64_t sampleRate,
+	    gr::fft::fft_complex *fft, FftWindow &win, SamplesRingBuffer &ringBuffer,
+	    SamplesRingBuffer::Cursor &cursor);
+
+
+	/**
+	 * \brief    Create \a count consecutive FFTs from a SampleRingBuffer in one go.
+	 *
+	 * \details  Frame k starts at \a fromPos + k * hop where
+	 *           hop = fftSize * (1 - \a overlap). All the frames are read
+	 *           at once, windowed into \a batch's input matrix and
+	 *           transformed by a single FFTW call.
+	 *
+	 *           The frequency, the sample rate and the time of a frame come
+	 *           from the marker covering its first sample. A frame
+	 *           straddling a change of tuning is dropped: its power is
+	 *           of neither tuning. So is a frame without a marker, it
+	 *           could not be dated.
+	 *
+	 * \param  batch             The FFT plan, sets the FFT size and the number of frames
+	 * \param  pool              The pool the FFTs are taken from, of the size of \a batch
+	 * \param  win               The window to apply on the samples
+	 * \param  ringBuffer        The samples' source.
+	 * \param  fromPos           The position of the first sample. Updated to
+	 *                           the position of the frame following the batch.
+	 * \param  overlap           The overlap between two frames, from 0 to 0.75
+	 * \param  ffts              Stores the FFTs, in time order, up to
+	 *                           batch.count(). Keep it between calls to
+	 *                           avoid reallocating it.
+	 * \return True on success, false if the samples got overridden while
+	 *         reading them. \a fromPos is left untouched in this case.
+	 */
+	static bool fromRingBatch(FftBatch &batch, FftPool &pool,
+				  const FftWindow &win,
+				  SamplesRingBuffer &ringBuffer, uint64_t &fromPos,
+				  float overlap, std::vector<FftPtr> &ffts);
+
+	/// Returns the number of samples between two frames overlapping by \a overlap
+	static size_t hopSize(uint16_t fftSize, float overlap);
 
 	uint16_t fftSize() const { return _fft_size; }
 	uint64_t centralFrequency() const { return _central_frequency; }
@@ -178,9 +274,26 @@ public:
 		return i;
 	}
 
-	/// Returns the noise floor in dBM
+	/**
+	 * \brief    Get the noise floor, the mean of the lowest 10% of the bins.
+	 *
+	 * \details  Uses an estimator local to the calling thread, so as
+	 *           consecutive FFTs of the same stream get estimated
+	 *           incrementally.
+	 *
+	 * \return   The noise floor in dBM.
+	 */
 	virtual float noiseFloor() const;
 
+	/**
+	 * \brief    Get the noise floor with a caller-provided estimator.
+	 *
+	 * \param    estimator   The estimator, defining the percentile or
+	 *                       trimmed mean to use.
+	 * \return   The noise floor in dBM.
+	 */
+	virtual float noiseFloor(NoiseFloorEstimator &estimator) const;
+
 	/**
 	 * \brief    Get the power at bin \a i
 	 *
@@ -189,10 +302,99 @@ public:
 	 */
 	virtual float operator[](size_t i) const { return _pwr[i]; }
 
+	/**
+	 * \brief    Get all the bins at once, for the vectorized consumers
+	 *
+	 * \return   The \a fftSize powers, as returned by operator[], or NULL
+	 *           if the FFT does not store them as such.
+	 */
+	virtual const float *bins() const { return _pwr.data(); }
+
 	virtual Fft & operator+=(const Fft &other); ///< Add two FFTs
 	virtual Fft &  operator-=(const Fft &other); ///< Substract two FFTs
 	virtual const Fft operator+(const Fft &other) const; ///< Add two FFTs
 	virtual const Fft operator-(const Fft &other) const; ///< Substract two FFTs
 };
 
+/**
+ * \class     FftPool
+ * \brief     Recycles Fft objects and their power buffers.
+ *
+ * \details   The pool preallocates \a capacity FFTs of a given size. #get
+ *            hands them out as #FftPtr and they come back to the pool when
+ *            their last reference is dropped. No heap allocation happens
+ *            as long as no more than \a capacity FFTs are in use; when the
+ *            pool runs dry, it grows.
+ *
+ *            The pool must outlive the threads dropping its FFTs. FFTs
+ *            still referenced when the pool is destroyed are detached from
+ *            it and deleted on their last release.
+ *
+ *            **Thread-safety:** Thread safe.
+ */
+class FftPool
+{
+private:
+	uint16_t _fft_size; ///< The size of the FFTs
+	std::vector<Fft *> _frames; ///< All the FFTs allocated by the pool
+	std::vector<Fft *> _free; ///< The FFTs ready to be handed out
+	mutable boost::mutex _mutex; ///< Protects _frames and _free
+
+	FftPool(const FftPool &);
+	FftPool &operator=(const FftPool &);
+
+	void grow(size_t count);
+	void recycle(Fft *fft);
+
+	friend void intrusive_ptr_release(const Fft *fft);
+
+public:
+	/**
+	 * \brief    Preallocate \a capacity FFTs of size \a fftSize.
+	 *
+	 * \param    fftSize   The size of the FFTs
+	 * \param    capacity  The number of FFTs to preallocate
+	 * \return   Nothing.
+	 */
+	FftPool(uint16_t fftSize, size_t capacity);
+	~FftPool();
+
+	uint16_t fftSize() const { return _fft_size; }
+
+	/// Returns the number of FFTs allocated by the pool
+	size_t capacity() const;
+
+	/// Returns the number of FFTs ready to be handed out
+	size_t available() const;
+
+	/**
+	 * \brief    Get an FFT from the pool.
+	 *
+	 * \details  The power buffer is left as is, the caller is expected
+	 *           to overwrite it.
+	 *
+	 * \param  centralFrequency  The central frequency at which the samples were taken
+	 * \param  sampleRate        The samples' sampling rate
+	 * \return An FFT of size #fftSize.
+	 */
+	FftPtr get(uint64_t centralFrequency, uint64_t sampleRate);
+};
+
+inline void intrusive_ptr_add_ref(const Fft *fft)
+{
+	fft->_refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void intrusive_ptr_release(const Fft *fft)
+{
+	if (fft->_refCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	Fft *f = const_cast<Fft *>(fft);
+	if (f->_pool)
+		f->_pool->recycle(f);
+	else
+		delete f;
+}
+
 #endif // FFT_H
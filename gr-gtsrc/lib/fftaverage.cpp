@@ -3,14 +3,62 @@
 #include <iostream>
 #include <algorithm>
 
+FftAverage::Config::Config() :
+	mode(SLIDING), average(10), memoryBudget(64 << 20)
+{
+}
+
 FftAverage::FftAverage(uint16_t fftSize, uint64_t centralFrequency,
 		       uint64_t sampleRate, size_t average) :
-	Fft(fftSize, centralFrequency, sampleRate), _average(average)
+	Fft(fftSize, centralFrequency, sampleRate)
+{
+	_config.average = average;
+	init();
+}
+
+FftAverage::FftAverage(uint16_t fftSize, uint64_t centralFrequency,
+		       uint64_t sampleRate, const Config &config) :
+	Fft(fftSize, centralFrequency, sampleRate), _config(config)
 {
+	init();
+}
+
+void FftAverage::init()
+{
+	size_t bins = fftSize();
+	size_t rowBytes = bins * sizeof(float);
+
+	if (_config.average == 0)
+		_config.average = 1;
+
+	_blockSize = 1;
+	_rowStride = bins;
+	_rowCount = 0;
+
+	if (_config.mode == SLIDING) {
+		if (_config.average <= _config.memoryBudget / rowBytes) {
+			_rowCount = _config.average;
+		} else {
+			/* a row holds the sums and the sums of squares of a block */
+			size_t maxRows = _config.memoryBudget / (2 * rowBytes);
+			if (maxRows < 2)
+				maxRows = 2;
+
+			_rowStride = 2 * bins;
+			_blockSize = (_config.average + maxRows - 1) / maxRows;
+			_rowCount = (_config.average + _blockSize - 1) / _blockSize;
+		}
+	}
+
+	_window.resize(_rowCount * _rowStride);
+	_rowTime.resize(_rowCount);
+	_sum.resize(bins);
+	_sumSq.resize(bins);
+
 	reset();
 }
 
-void FftAverage::addFft(boost::shared_ptr<Fft> fft)
+void FftAverage::addFft(FftPtr fft)
 {
 	/* check that we are adding an fft of the same type */
 	if (fft->fftSize() != fftSize() ||
@@ -21,87 +69,168 @@ void FftAverage::addFft(boost::shared_ptr<Fft> fft)
 		return;
 	}
 
+	addFft(fft->bins(), fft->time_ns());
+}
+
+void FftAverage::addFft(const float *pwr, uint64_t time_ns)
+{
+	if (_config.mode == SLIDING)
+		addSliding(pwr, time_ns);
+	else
+		addExponential(pwr, time_ns);
+
+	_lastTime = time_ns;
+}
+
+void FftAverage::removeOldestRow()
+{
+	size_t bins = fftSize();
+	const float *row = &_window[_head * _rowStride];
+
+	if (_blockSize == 1) {
+		for (size_t i = 0; i < bins; i++) {
+			_sum[i] -= row[i];
+			_sumSq[i] -= (double)row[i] * row[i];
+		}
+	} else {
+		const float *rowSq = row + bins;
+		for (size_t i = 0; i < bins; i++) {
+			_sum[i] -= row[i];
+			_sumSq[i] -= rowSq[i];
+		}
+	}
+
+	_head = (_head + 1) % _rowCount;
+	_rows--;
+	_count -= _blockSize;
+}
+
+void FftAverage::addSliding(const float *pwr, uint64_t time_ns)
+{
 	/* delete the oldest entry if the average buffer is full */
-	if (ffts.size() == _average) {
-		boost::shared_ptr<Fft> oldFft = ffts.at(0);
+	if (_count == _config.average)
+		removeOldestRow();
+
+	size_t bins = fftSize();
+	size_t slot = (_head + _rows) % _rowCount;
+	float *row = &_window[slot * _rowStride];
+	double count = _count + 1;
+
+	if (_blockSize == 1) {
+		for (size_t i = 0; i < bins; i++) {
+			float p = pwr[i];
+			row[i] = p;
+			_sum[i] += p;
+			_sumSq[i] += (double)p * p;
+			_pwr[i] = _sum[i] / count;
+		}
+		_rowTime[slot] = time_ns;
+		_rows++;
+		_count++;
+		return;
+	}
 
-		for (size_t i = 0; i < fftSize(); i++)
-			_pwr[i] -= oldFft->operator [](i);
-		ffts.pop_front();
+	/* the block being filled is only added to the sums once complete, so
+	 * as the same values are added and later subtracted.
+	 */
+	float *rowSq = row + bins;
+	if (_blockCount == 0) {
+		for (size_t i = 0; i < bins; i++) {
+			row[i] = pwr[i];
+			rowSq[i] = pwr[i] * pwr[i];
+			_pwr[i] = (_sum[i] + row[i]) / count;
+		}
+		_rowTime[slot] = time_ns;
+	} else {
+		for (size_t i = 0; i < bins; i++) {
+			row[i] += pwr[i];
+			rowSq[i] += pwr[i] * pwr[i];
+			_pwr[i] = (_sum[i] + row[i]) / count;
+		}
 	}
+	_count++;
+
+	if (++_blockCount < _blockSize)
+		return;
 
-	/* add the new fft */
-	for (size_t i = 0; i < fftSize(); i++) {
-		_pwr[i] += fft->operator [](i);
+	for (size_t i = 0; i < bins; i++) {
+		_sum[i] += row[i];
+		_sumSq[i] += rowSq[i];
 	}
-	ffts.push_back(fft);
+	_rows++;
+	_blockCount = 0;
 }
 
-void FftAverage::reset()
+void FftAverage::addExponential(const float *pwr, uint64_t time_ns)
 {
-	ffts.clear();
-	for (int i = 0; i < fftSize(); i++)
-		_pwr[i] = 0.0;
+	size_t bins = fftSize();
+
+	if (_count++ == 0)
+		_firstTime = time_ns;
+
+	/* Welford's update, then an exponential one once the window is full */
+	double w = 1.0 / currentAverageCount();
+	for (size_t i = 0; i < bins; i++) {
+		double diff = pwr[i] - _sum[i];
+		_sum[i] += w * diff;
+		_sumSq[i] = (1 - w) * (_sumSq[i] + w * diff * diff);
+		_pwr[i] = _sum[i];
+	}
 }
 
-float FftAverage::noiseFloor() const
+void FftAverage::reset()
 {
-	return Fft::noiseFloor() / currentAverageCount();
+	_head = 0;
+	_rows = 0;
+	_blockCount = 0;
+	_count = 0;
+	_firstTime = 0;
+	_lastTime = 0;
+
+	std::fill(_sum.begin(), _sum.end(), 0.0);
+	std::fill(_sumSq.begin(), _sumSq.end(), 0.0);
+	std::fill(_pwr.begin(), _pwr.end(), 0.0f);
 }
 
-float FftAverage::varianceAt(size_t i, float *avr, size_t *profile,
-			     int profile_length, float steps)
+size_t FftAverage::memoryUsage() const
 {
-	float average = operator [](i);
-	if (avr)
-		*avr = average;
-
-	FftAverage smallAvr(fftSize(), centralFrequency(), sampleRate(), 10);
-	for (size_t e = 0; e < ffts.size() && e < smallAvr.averageCount(); e++) {
-		smallAvr.addFft(ffts.at(e));
-	}
+	return _window.size() * sizeof(float) + _rowTime.size() * sizeof(uint64_t) +
+		(_sum.size() + _sumSq.size()) * sizeof(double) +
+		_pwr.size() * sizeof(float);
+}
 
-	float variance = 0;
-	for (size_t e = 0; e < ffts.size(); e++) {
-		smallAvr.addFft(ffts.at(e));
-
-		float v = smallAvr[i];
-		float diff = v - average;
-		float val = diff * diff;
-		variance += val;
-
-		if (profile) {
-			float pro_diff = v - average;
-			pro_diff *= 1.0 / steps;
-			if (pro_diff > (profile_length / 2))
-				pro_diff = (profile_length / 2) - 1;
-			else if (pro_diff < -(profile_length / 2))
-				pro_diff = -(profile_length / 2);
-
-			pro_diff = pro_diff + (profile_length / 2);
-			int offset = (int) pro_diff;
-			profile[offset]++;
-		}
-	}
+float FftAverage::noiseFloor() const
+{
+	return Fft::noiseFloor(_noiseFloor);
+}
 
-	return variance / ffts.size();
+uint64_t FftAverage::time_ns() const
+{
+	if (_count == 0)
+		return 0;
+	else if (_config.mode == EXPONENTIAL)
+		return _firstTime;
+	else
+		return _rowTime[_head];
 }
 
-float FftAverage::averageOverTime(int i, uint64_t timeNs) const
+float FftAverage::varianceAt(size_t i) const
 {
-	uint64_t start = 0;
-	float sum = 0;
-	size_t count = 0;
-
-	for (auto rit = ffts.rbegin(); rit != ffts.rend(); ++rit) {
-		if (start == 0)
-			start = (*rit)->time_ns();
-		if ((*rit)->time_ns() - start < timeNs) {
-			sum += (*rit)->operator[](i);
-			count++;
-		} else
-			break;
+	if (_count == 0)
+		return 0;
+	else if (_config.mode == EXPONENTIAL)
+		return _sumSq[i];
+
+	double sum = _sum[i];
+	double sumSq = _sumSq[i];
+	if (_blockCount > 0) {
+		const float *row = &_window[((_head + _rows) % _rowCount) * _rowStride];
+		sum += row[i];
+		sumSq += row[fftSize() + i];
 	}
 
-	return (float)sum / count;
+	double mean = sum / _count;
+	double variance = sumSq / _count - mean * mean;
+
+	return variance > 0 ? variance : 0;
 }
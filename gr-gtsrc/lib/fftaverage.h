@@ -9,23 +9,81 @@
 #define FFTAVERAGE_H
 
 #include "fft.h"
-#include <deque>
-#include <boost/shared_ptr.hpp>
+#include <vector>
 
 /**
  * \class     FftAverage
  * \brief     Create an FFT average sliding window of N FFTs.
  *
- * \details   All the operations are in O(1), yeah!
+ * \details   The mean and the variance of every bin are kept up to date,
+ *            reading them is O(1) and adding an FFT is O(fftSize).
+ *
+ *            In SLIDING mode, the powers of the FFTs in the window are
+ *            stored in a single circular matrix, a row per FFT, along with
+ *            the sum and the sum of squares of every bin. The oldest row
+ *            is subtracted when the window is full.
+ *
+ *            When the window does not fit in \a memoryBudget, a row holds
+ *            the sums and the sums of squares of a block of #blockSize
+ *            consecutive FFTs instead, and the window slides a block at a
+ *            time: it then holds from \a average - #blockSize + 1 to
+ *            \a average FFTs.
+ *
+ *            In EXPONENTIAL mode, no FFT is stored. The weight of a new FFT
+ *            is max(1 / \a average, 1 / n), n being the number of FFTs
+ *            added: the first \a average FFTs are averaged evenly, with
+ *            their exact mean and variance, then the past is forgotten
+ *            exponentially.
  *
  *            **Thread-safety:** Not thread safe.
  */
 class FftAverage : public Fft
 {
+public:
+	/// How the FFTs are averaged
+	enum Mode
+	{
+		SLIDING, ///< Over the last \a average FFTs
+		EXPONENTIAL, ///< Exponentially, the weight of a new FFT being 1 / \a average
+	};
+
+	/// The averaging and the memory it may use
+	struct Config
+	{
+		Mode mode; ///< How the FFTs are averaged
+		size_t average; ///< The size of the FFT window
+		size_t memoryBudget; ///< The bytes the window may use, in SLIDING mode
+
+		/// A sliding window of 10 FFTs, at most 64 MB
+		Config();
+	};
+
 private:
-	std::deque< boost::shared_ptr<Fft> > ffts; ///< Stores up to \a _average FFTs
+	typedef std::vector<float, AlignedAllocator<float> > FloatArray;
+
+	Config _config;
+
+	size_t _blockSize; ///< The FFTs per row of the window
+	size_t _rowStride; ///< The floats per row: the sums, then the sums of squares if _blockSize > 1
+	size_t _rowCount; ///< The rows of the window
+	FloatArray _window; ///< The circular matrix of the FFTs, _rowCount rows
+	std::vector<uint64_t> _rowTime; ///< The time of the first FFT of every row
+	size_t _head; ///< The oldest row
+	size_t _rows; ///< The complete rows, the block being filled follows them
+	size_t _blockCount; ///< The FFTs in the block being filled
+
+	std::vector<double> _sum; ///< Of the complete rows, or the mean in EXPONENTIAL mode
+	std::vector<double> _sumSq; ///< Of the complete rows, or the variance in EXPONENTIAL mode
+	size_t _count; ///< The FFTs in the window, or added in EXPONENTIAL mode
+	uint64_t _firstTime; ///< The time of the first FFT, in EXPONENTIAL mode
+	uint64_t _lastTime; ///< The time of the last FFT
 
-	size_t _average; ///< The size of the FFT window
+	mutable NoiseFloorEstimator _noiseFloor; ///< Follows the noise floor of the average
+
+	void init();
+	void addSliding(const float *pwr, uint64_t time_ns);
+	void addExponential(const float *pwr, uint64_t time_ns);
+	void removeOldestRow();
 
 public:
 	/**
@@ -42,42 +100,71 @@ public:
 	FftAverage(uint16_t fftSize, uint64_t centralFrequency,
 		   uint64_t sampleRate, size_t average);
 
+	/**
+	 * \brief    Create an FFT average.
+	 *
+	 * \details  See the class's description for more details
+	 *
+	 * \param  fftSize           The size of the FFT
+	 * \param  centralFrequency  The central frequency at which the samples were taken
+	 * \param  sampleRate        The samples' sampling rate
+	 * \param  config            The averaging and its memory budget
+	 * \return Nothing.
+	 */
+	FftAverage(uint16_t fftSize, uint64_t centralFrequency,
+		   uint64_t sampleRate, const Config &config);
+
 	/**
 	 * \brief    Add an FFT to the average sliding window.
 	 *
-	 * \details  This operation is done in O(1) and should be considered
-	 *           copy-less.
+	 * \details  This operation is done in O(fftSize), the powers are
+	 *           copied into the window.
 	 *
 	 * \param  fft           The FFT to be added.
 	 * \return Nothing.
 	 */
-	void addFft(boost::shared_ptr<Fft> fft);
+	void addFft(FftPtr fft);
+
+	/**
+	 * \brief    Add the powers of an FFT to the average.
+	 *
+	 * \param  pwr           The fftSize powers, in dBm
+	 * \param  time_ns       The time of the first sample of the FFT
+	 * \return Nothing.
+	 */
+	void addFft(const float *pwr, uint64_t time_ns);
 
 	/// Empty the window
 	void reset();
 
+	const Config &config() const { return _config; }
+
 	/// Returns the size of the FFT window
-	size_t averageCount() const { return _average; }
+	size_t averageCount() const { return _config.average; }
 
 	/// Returns the current number of FFT in the FFT window
-	size_t currentAverageCount() const { return ffts.size(); }
+	size_t currentAverageCount() const { return _count < _config.average ? _count : _config.average; }
 
-	/// Returns the current noise floor
+	/// Returns the number of FFTs per row of the window, 1 when the window fits in the budget
+	size_t blockSize() const { return _blockSize; }
+
+	/// Returns the bytes used by the window and the running sums
+	size_t memoryUsage() const;
+
+	/// Returns the current noise floor, see Fft::noiseFloor()
 	virtual float noiseFloor() const;
 
 	/// Returns the time of the oldest FFT in the FFT window
-	uint64_t time_ns() const { return ffts.at(0)->time_ns(); }
+	uint64_t time_ns() const;
 
 	/// Returns the time difference between the last and the first FFT
-	uint64_t span_ns() const { return ffts.at(ffts.size() - 1)->time_ns() - ffts.at(0)->time_ns(); }
-
-	/// Calculates the variance at bin i
-	float varianceAt(size_t i, float *avr = NULL, size_t *profile = NULL, int profile_length = 0, float steps = 0.1);
+	uint64_t span_ns() const { return _lastTime - time_ns(); }
 
-	float averageOverTime(int i, uint64_t timeNs) const;
+	/// Returns the mean power at bin \a i, in dBm, O(1)
+	float meanAt(size_t i) const { return _pwr[i]; }
 
-	/// Access the average FFT's bins. See Fft::operator[].
-	virtual float operator[](size_t i) const { return _pwr[i] / currentAverageCount(); }
+	/// Returns the variance of the power at bin \a i, in dB², O(1)
+	float varianceAt(size_t i) const;
 };
 
 #endif // FFTAVERAGE_H
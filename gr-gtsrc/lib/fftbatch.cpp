@@ -0,0 +1,33 @@
+#include "fftbatch.h"
+
+#include <new>
+
+#include "fftplancache.h"
+
+FftBatch::FftBatch(uint16_t fftSize, size_t count) : _fft_size(fftSize),
+	_count(count)
+{
+	_in = (fftwf_complex *) fftwf_malloc(sizeof(fftwf_complex) * fftSize * count);
+	_out = (fftwf_complex *) fftwf_malloc(sizeof(fftwf_complex) * fftSize * count);
+	if (!_in || !_out)
+		throw std::bad_alloc();
+
+	_plan = FftPlanCache::instance().plan(fftSize, count);
+	if (!_plan) {
+		fftwf_free(_in);
+		fftwf_free(_out);
+		throw std::bad_alloc();
+	}
+}
+
+FftBatch::~FftBatch()
+{
+	fftwf_free(_in);
+	fftwf_free(_out);
+}
+
+void FftBatch::execute()
+{
+	/* the arrays are aligned as the plan's, both come from fftwf_malloc */
+	fftwf_execute_dft(_plan, _in, _out);
+}
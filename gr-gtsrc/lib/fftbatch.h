@@ -0,0 +1,66 @@
+/**
+ * \file      fftbatch.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef FFTBATCH_H
+#define FFTBATCH_H
+
+#include <stdint.h>
+#include <fftw3.h>
+
+#include <gnuradio/gr_complex.h>
+
+/**
+ * \class     FftBatch
+ * \brief     Computes \a count FFTs of the same size in one FFTW call.
+ *
+ * \details   The input and output buffers are contiguous matrices of
+ *            \a count rows of \a fftSize samples. Frame k is stored at
+ *            inbuf() + k * fftSize. The transforms are done by a single
+ *            FFTW "many" plan which amortizes the call overhead over all
+ *            the frames. The plan comes from the FftPlanCache, it is made
+ *            once per size and count and shared by the batches.
+ *
+ *            **Thread-safety:** Not thread safe, one FftBatch per thread.
+ */
+class FftBatch
+{
+private:
+	uint16_t _fft_size; ///< The size of every FFT
+	size_t _count; ///< The number of FFTs computed at once
+
+	fftwf_complex *_in; ///< The input matrix
+	fftwf_complex *_out; ///< The output matrix
+	fftwf_plan _plan; ///< The FFTW "many" plan, owned by the FftPlanCache
+
+	FftBatch(const FftBatch &);
+	FftBatch &operator=(const FftBatch &);
+
+public:
+	/**
+	 * \brief    Create the buffers for \a count FFTs, get their plan.
+	 *
+	 * \param    fftSize   The size of every FFT
+	 * \param    count     The number of FFTs computed at once
+	 * \return   Nothing.
+	 */
+	FftBatch(uint16_t fftSize, size_t count);
+	~FftBatch();
+
+	uint16_t fftSize() const { return _fft_size; }
+	size_t count() const { return _count; }
+
+	/// Returns the input matrix, \a count rows of \a fftSize samples
+	gr_complex *inbuf() const { return (gr_complex *)_in; }
+
+	/// Returns the output matrix, \a count rows of \a fftSize bins
+	gr_complex *outbuf() const { return (gr_complex *)_out; }
+
+	/// Transform all the frames of the input matrix
+	void execute();
+};
+
+#endif // FFTBATCH_H
@@ -0,0 +1,182 @@
+#include "fftpipeline.h"
+
+#include <time.h>
+
+static uint64_t monotonicNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+FftPipeline::FftPipeline(SamplesRingBuffer &ringBuffer,
+			 SamplesRingBuffer::Cursor &cursor,
+			 boost::shared_ptr<const FftWindow> win, size_t batchCount, float overlap,
+			 size_t workers) :
+	_ringBuffer(ringBuffer), _cursor(cursor), _win(win),
+	_fft_size(win->fftSize()), _batchCount(batchCount), _overlap(overlap),
+	_hop(Fft::hopSize(win->fftSize(), overlap)),
+	_nextSeq(0), _deliverSeq(0), _stop(false)
+{
+	if (workers < 1)
+		workers = 1;
+
+	_slots.resize(2 * workers);
+	for (size_t i = 0; i < _slots.size(); i++) {
+		_slots[i].seq = 0;
+		_slots[i].pos = 0;
+		_slots[i].ready = false;
+		_slots[i].ffts.reserve(batchCount);
+	}
+
+	for (size_t i = 0; i < workers; i++) {
+		boost::shared_ptr<Worker> worker(new Worker(_fft_size, 2 * batchCount));
+		_workers.push_back(worker);
+	}
+
+	for (size_t i = 0; i < _workers.size(); i++)
+		_workers[i]->thread = boost::thread(&FftPipeline::workerLoop, this,
+						     _workers[i].get());
+}
+
+FftPipeline::~FftPipeline()
+{
+	stop();
+}
+
+bool FftPipeline::claim(uint64_t *seq, uint64_t *pos)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	/* do not get more than the reorder buffer can hold ahead of the consumer */
+	while (!_stop && _nextSeq >= _deliverSeq + _slots.size())
+		_slotFreed.wait(lock);
+	if (_stop)
+		return false;
+
+	_cursor.recover();
+	*pos = _cursor.position();
+	_cursor.advance(_batchCount * _hop);
+	*seq = _nextSeq++;
+
+	/* the previous user of the slot has already been consumed */
+	Slot &slot = _slots[*seq % _slots.size()];
+	slot.seq = *seq;
+	slot.pos = *pos;
+	slot.ready = false;
+
+	return true;
+}
+
+void FftPipeline::publish(uint64_t seq, std::vector<FftPtr> &ffts)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	Slot &slot = _slots[seq % _slots.size()];
+	slot.ffts.swap(ffts);
+	slot.ready = true;
+
+	_slotReady.notify_all();
+}
+
+void FftPipeline::workerLoop(Worker *worker)
+{
+	/* FFTW plans and FFTs are per worker, only the ring is shared */
+	FftBatch batch(_fft_size, _batchCount);
+	std::vector<FftPtr> ffts;
+	size_t span = (_batchCount - 1) * _hop + _fft_size;
+	uint64_t seq, pos;
+
+	ffts.reserve(_batchCount);
+
+	while (claim(&seq, &pos)) {
+		/* wait for the samples here, to be able to notice a stop request */
+		bool available;
+		do {
+			available = _ringBuffer.waitForAvailable(pos, span, 100000000);
+		} while (!available && !_stop);
+
+		uint64_t start = monotonicNs();
+		uint64_t fromPos = pos;
+		if (available &&
+		    Fft::fromRingBatch(batch, worker->pool, *_win, _ringBuffer, fromPos,
+				       _overlap, ffts)) {
+			worker->fftCount.fetch_add(ffts.size(), std::memory_order_relaxed);
+			worker->retuneDrops.fetch_add(_batchCount - ffts.size(),
+						      std::memory_order_relaxed);
+		} else {
+			ffts.clear();
+			worker->lostBatches.fetch_add(1, std::memory_order_relaxed);
+		}
+		worker->busyNs.fetch_add(monotonicNs() - start, std::memory_order_relaxed);
+
+		/* get the slot's old, empty, vector in exchange */
+		publish(seq, ffts);
+	}
+}
+
+bool FftPipeline::next(std::vector<FftPtr> &ffts, uint64_t timeoutNs)
+{
+	/* release the previous batch outside of the lock */
+	ffts.clear();
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	Slot *slot = &_slots[_deliverSeq % _slots.size()];
+	bool forever = timeoutNs == UINT64_MAX;
+	boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() +
+		boost::chrono::nanoseconds(forever ? 0 : timeoutNs);
+	while (!_stop && !(slot->ready && slot->seq == _deliverSeq)) {
+		if (forever)
+			_slotReady.wait(lock);
+		else if (_slotReady.wait_until(lock, deadline) == boost::cv_status::timeout &&
+			 !(slot->ready && slot->seq == _deliverSeq))
+			return false;
+	}
+	if (_stop)
+		return false;
+
+	ffts.swap(slot->ffts);
+	slot->ready = false;
+	_deliverSeq++;
+
+	_slotFreed.notify_all();
+
+	return true;
+}
+
+void FftPipeline::stop()
+{
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		if (_stop)
+			return;
+		_stop = true;
+		_slotFreed.notify_all();
+		_slotReady.notify_all();
+	}
+
+	for (size_t i = 0; i < _workers.size(); i++)
+		_workers[i]->thread.join();
+
+	/* give the claimed but unconsumed batches back to the ring */
+	boost::mutex::scoped_lock lock(_mutex);
+	if (_deliverSeq < _nextSeq)
+		_cursor.setPosition(_slots[_deliverSeq % _slots.size()].pos);
+	for (size_t i = 0; i < _slots.size(); i++)
+		_slots[i].ffts.clear();
+}
+
+std::vector<FftPipeline::WorkerStatistics> FftPipeline::workersStatistics() const
+{
+	std::vector<WorkerStatistics> stats(_workers.size());
+
+	for (size_t i = 0; i < _workers.size(); i++) {
+		stats[i].fftCount = _workers[i]->fftCount.load(std::memory_order_relaxed);
+		stats[i].busyNs = _workers[i]->busyNs.load(std::memory_order_relaxed);
+		stats[i].lostBatches = _workers[i]->lostBatches.load(std::memory_order_relaxed);
+		stats[i].retuneDrops = _workers[i]->retuneDrops.load(std::memory_order_relaxed);
+	}
+
+	return stats;
+}
@@ -0,0 +1,154 @@
+/**
+ * \file      fftpipeline.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef FFTPIPELINE_H
+#define FFTPIPELINE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "fft.h"
+#include "fftwindow.h"
+#include "samplesringbuffer.h"
+
+/**
+ * \class     FftPipeline
+ * \brief     Computes FFTs from a ring buffer on several threads.
+ *
+ * \details   Every worker thread claims the next batch of frames from the
+ *            ring, computes it with its own FftBatch and FftPool then
+ *            publishes it into a reorder buffer. #next hands the batches
+ *            out strictly in time order, whatever the order in which the
+ *            workers completed them, so as a stateful consumer (the
+ *            detection) sees the same stream as with a single thread.
+ *
+ *            The reorder buffer holds 2 batches per worker. When the
+ *            consumer is late, the workers stop claiming new batches and
+ *            the samples accumulate in the ring, the overruns being
+ *            accounted for by \a cursor.
+ *
+ *            **Thread-safety:** #next should be called from a single
+ *            thread. The other methods are thread safe.
+ */
+class FftPipeline
+{
+public:
+	/// The activity of a worker since the creation of the pipeline
+	struct WorkerStatistics
+	{
+		uint64_t fftCount; ///< The number of FFTs computed
+		uint64_t busyNs; ///< The time spent reading and transforming samples
+		uint64_t lostBatches; ///< The batches overridden while being read
+		uint64_t retuneDrops; ///< The frames dropped as they straddled a retune or had no marker
+	};
+
+private:
+	struct Slot
+	{
+		uint64_t seq; ///< The sequence number of the batch
+		uint64_t pos; ///< The position of the first sample of the batch
+		bool ready; ///< Has the batch been published?
+		std::vector<FftPtr> ffts; ///< The FFTs, empty if the batch got lost
+	};
+
+	struct Worker
+	{
+		boost::thread thread;
+		FftPool pool; ///< Outlives the thread, the consumer may still hold FFTs
+		std::atomic<uint64_t> fftCount;
+		std::atomic<uint64_t> busyNs;
+		std::atomic<uint64_t> lostBatches;
+		std::atomic<uint64_t> retuneDrops;
+
+		Worker(uint16_t fftSize, size_t capacity) : pool(fftSize, capacity),
+			fftCount(0), busyNs(0), lostBatches(0), retuneDrops(0) {}
+	};
+
+	SamplesRingBuffer &_ringBuffer; ///< The samples' source
+	SamplesRingBuffer::Cursor &_cursor; ///< The next position to be claimed
+	boost::shared_ptr<const FftWindow> _win; ///< The window, immutable
+	uint16_t _fft_size; ///< The size of the FFTs
+	size_t _batchCount; ///< The number of FFTs per batch
+	float _overlap; ///< The overlap between two frames
+	size_t _hop; ///< The number of samples between two frames
+
+	boost::mutex _mutex; ///< Protects the fields below
+	boost::condition_variable _slotFreed; ///< Signaled when a batch got consumed
+	boost::condition_variable _slotReady; ///< Signaled when a batch got published
+	std::vector<Slot> _slots; ///< The reorder buffer, indexed by seq % size
+	uint64_t _nextSeq; ///< The sequence number of the next batch to be claimed
+	uint64_t _deliverSeq; ///< The sequence number of the next batch to be consumed
+	std::atomic<bool> _stop; ///< Should the workers stop?
+
+	std::vector< boost::shared_ptr<Worker> > _workers;
+
+	FftPipeline(const FftPipeline &);
+	FftPipeline &operator=(const FftPipeline &);
+
+	bool claim(uint64_t *seq, uint64_t *pos);
+	void publish(uint64_t seq, std::vector<FftPtr> &ffts);
+	void workerLoop(Worker *worker);
+
+public:
+	/**
+	 * \brief    Start \a workers threads computing FFTs from \a ringBuffer.
+	 *
+	 * \param  ringBuffer        The samples' source
+	 * \param  cursor            The consumer's cursor, registered on
+	 *                           \a ringBuffer. The FFTs start at its position.
+	 * \param  win               The window to apply on the samples
+	 * \param  batchCount        The number of FFTs computed at once by a worker
+	 * \param  overlap           The overlap between two frames, from 0 to 0.75
+	 * \param  workers           The number of worker threads
+	 * \return Nothing.
+	 */
+	FftPipeline(SamplesRingBuffer &ringBuffer, SamplesRingBuffer::Cursor &cursor,
+		    boost::shared_ptr<const FftWindow> win, size_t batchCount, float overlap,
+		    size_t workers);
+	~FftPipeline();
+
+	uint16_t fftSize() const { return _fft_size; }
+	const FftWindow &window() const { return *_win; }
+	size_t batchCount() const { return _batchCount; }
+	float overlap() const { return _overlap; }
+	size_t hopSize() const { return _hop; }
+	size_t workerCount() const { return _workers.size(); }
+
+	/**
+	 * \brief    Get the next batch of FFTs, in time order.
+	 *
+	 * \details  Blocks until the batch is ready, at most \a timeoutNs. The
+	 *           FFTs previously stored in \a ffts are released.
+	 *
+	 * \param  ffts       Stores the FFTs. Empty if the batch got overridden
+	 *                    in the ring before being read.
+	 * \param  timeoutNs  The maximum time to wait, forever by default.
+	 * \return False if the pipeline has been stopped or the timeout
+	 *         expired, true otherwise.
+	 */
+	bool next(std::vector<FftPtr> &ffts, uint64_t timeoutNs = UINT64_MAX);
+
+	/**
+	 * \brief    Stop and join the workers.
+	 *
+	 * \details  The cursor is moved back to the first batch that has not
+	 *           been consumed yet, so as a new pipeline can take over
+	 *           without losing samples.
+	 *
+	 * \return Nothing.
+	 */
+	void stop();
+
+	/// Returns the statistics of every worker
+	std::vector<WorkerStatistics> workersStatistics() const;
+};
+
+#endif // FFTPIPELINE_H
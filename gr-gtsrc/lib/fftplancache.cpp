@@ -0,0 +1,123 @@
+#include "fftplancache.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <boost/make_shared.hpp>
+#include <gnuradio/fft/fft.h>
+
+FftPlanCache::FftPlanCache() : _wisdomImported(false), _plannerFlags(FFTW_MEASURE)
+{
+}
+
+/* never destroyed, the plans may be used until the very end of the process */
+FftPlanCache &FftPlanCache::instance()
+{
+	static FftPlanCache *cache = new FftPlanCache();
+	return *cache;
+}
+
+boost::shared_ptr<const FftWindow> FftPlanCache::window(uint16_t fftSize,
+							gr::filter::firdes::win_type window_type)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	boost::shared_ptr<const FftWindow> &win = _windows[WindowKey(fftSize, window_type)];
+	if (!win)
+		win = boost::make_shared<FftWindow>(fftSize, window_type);
+
+	return win;
+}
+
+fftwf_plan FftPlanCache::plan(uint16_t fftSize, size_t count)
+{
+	/* FFTW's planner is not thread safe, share GNU Radio's lock */
+	gr::fft::planner::scoped_lock lock(gr::fft::planner::mutex());
+
+	PlanKey key(fftSize, count);
+	std::map<PlanKey, fftwf_plan>::iterator it = _plans.find(key);
+	if (it != _plans.end())
+		return it->second;
+
+	/* a missing file is not an error, it is written by the first plan */
+	if (!_wisdomImported && !_wisdomPath.empty() &&
+	    access(_wisdomPath.c_str(), R_OK) == 0 &&
+	    !fftwf_import_wisdom_from_filename(_wisdomPath.c_str()))
+		fprintf(stderr, "FftPlanCache: cannot import the wisdom of '%s'\n",
+			_wisdomPath.c_str());
+	_wisdomImported = true;
+
+	/* planning may overwrite the arrays, plan on arrays of our own */
+	int n = fftSize;
+	fftwf_complex *in = (fftwf_complex *) fftwf_malloc(sizeof(fftwf_complex) * fftSize * count);
+	fftwf_complex *out = (fftwf_complex *) fftwf_malloc(sizeof(fftwf_complex) * fftSize * count);
+	fftwf_plan plan = NULL;
+	if (in && out)
+		plan = fftwf_plan_many_dft(1, &n, count,
+					   in, NULL, 1, fftSize,
+					   out, NULL, 1, fftSize,
+					   FFTW_FORWARD, _plannerFlags);
+	fftwf_free(in);
+	fftwf_free(out);
+
+	if (!plan)
+		return NULL;
+
+	_plans[key] = plan;
+	exportWisdom();
+
+	return plan;
+}
+
+/* called with the planner lock held */
+void FftPlanCache::exportWisdom()
+{
+	if (_wisdomPath.empty())
+		return;
+
+	/* written next to the file then renamed, another process never reads a partial file */
+	std::string tmppath = _wisdomPath + ".tmp";
+	if (!fftwf_export_wisdom_to_filename(tmppath.c_str()) ||
+	    rename(tmppath.c_str(), _wisdomPath.c_str()) < 0) {
+		fprintf(stderr, "FftPlanCache: cannot write the wisdom to '%s'\n",
+			_wisdomPath.c_str());
+		unlink(tmppath.c_str());
+	}
+}
+
+void FftPlanCache::setWisdomPath(const std::string &path)
+{
+	gr::fft::planner::scoped_lock lock(gr::fft::planner::mutex());
+	_wisdomPath = path;
+	_wisdomImported = false;
+}
+
+std::string FftPlanCache::wisdomPath() const
+{
+	gr::fft::planner::scoped_lock lock(gr::fft::planner::mutex());
+	return _wisdomPath;
+}
+
+void FftPlanCache::setPlannerFlags(unsigned flags)
+{
+	gr::fft::planner::scoped_lock lock(gr::fft::planner::mutex());
+	_plannerFlags = flags;
+}
+
+unsigned FftPlanCache::plannerFlags() const
+{
+	gr::fft::planner::scoped_lock lock(gr::fft::planner::mutex());
+	return _plannerFlags;
+}
+
+size_t FftPlanCache::windowCount() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _windows.size();
+}
+
+size_t FftPlanCache::planCount() const
+{
+	gr::fft::planner::scoped_lock lock(gr::fft::planner::mutex());
+	return _plans.size();
+}
@@ -0,0 +1,106 @@
+/**
+ * \file      fftplancache.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef FFTPLANCACHE_H
+#define FFTPLANCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <fftw3.h>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "fftwindow.h"
+
+/**
+ * \class     FftPlanCache
+ * \brief     The FFT windows and the FFTW plans of the process, made once.
+ *
+ * \details   The windows are keyed by size and type, the plans by size
+ *            and number of FFTs per call, see FftBatch. They are made on
+ *            first use then kept for the life of the process: switching
+ *            back to a former FFT size costs nothing, and a caller can
+ *            make them ahead of time so as a consumer swapping to them
+ *            does not wait for FFTW.
+ *
+ *            A plan is executed on the arrays of its users with FFTW's
+ *            new-array execute function, the arrays must be allocated by
+ *            fftwf_malloc.
+ *
+ *            The FFTW wisdom is imported from #wisdomPath before the first
+ *            plan is made, and exported after every new plan, so as
+ *            planning with FFTW_MEASURE or FFTW_PATIENT is paid once per
+ *            machine.
+ *
+ *            **Thread-safety:** Thread safe. The plans are made under
+ *            GNU Radio's FFTW planner lock.
+ */
+class FftPlanCache
+{
+private:
+	typedef std::pair<uint16_t, int> WindowKey; ///< Size and type
+	typedef std::pair<uint16_t, size_t> PlanKey; ///< Size and count
+
+	mutable boost::mutex _mutex; ///< Protects the windows
+	std::map<WindowKey, boost::shared_ptr<const FftWindow> > _windows;
+
+	/* protected by the planner lock */
+	std::map<PlanKey, fftwf_plan> _plans;
+	std::string _wisdomPath;
+	bool _wisdomImported;
+	unsigned _plannerFlags;
+
+	FftPlanCache();
+	FftPlanCache(const FftPlanCache &);
+	FftPlanCache &operator=(const FftPlanCache &);
+
+	void exportWisdom();
+
+public:
+	/// Returns the cache of the process
+	static FftPlanCache &instance();
+
+	/**
+	 * \brief    Get the window of a size and type, made on first use.
+	 *
+	 * \param    fftSize      The size of the FFT
+	 * \param    window_type  The type of window, see FftWindow
+	 * \return   The window, shared by all the callers.
+	 */
+	boost::shared_ptr<const FftWindow> window(uint16_t fftSize,
+						  gr::filter::firdes::win_type window_type);
+
+	/**
+	 * \brief    Get the plan of \a count forward FFTs of \a fftSize samples.
+	 *
+	 * \details  The input and the output are two matrices of \a count
+	 *           contiguous rows, out of place. Made on first use, which
+	 *           may take long depending on #plannerFlags.
+	 *
+	 * \param    fftSize   The size of every FFT
+	 * \param    count     The number of FFTs computed at once
+	 * \return   The plan, owned by the cache, NULL if FFTW failed.
+	 */
+	fftwf_plan plan(uint16_t fftSize, size_t count);
+
+	/// Where the wisdom is kept, empty for nowhere (default). Set it before the first plan.
+	void setWisdomPath(const std::string &path);
+	std::string wisdomPath() const;
+
+	/// The FFTW planner flags of the next plans, FFTW_MEASURE by default
+	void setPlannerFlags(unsigned flags);
+	unsigned plannerFlags() const;
+
+	size_t windowCount() const;
+	size_t planCount() const;
+};
+
+#endif // FFTPLANCACHE_H
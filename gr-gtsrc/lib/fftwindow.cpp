@@ -1,6 +1,7 @@
 #include "fftwindow.h"
 
-FftWindow::FftWindow()
+FftWindow::FftWindow() : _fft_size(0), _window_type(gr::filter::firdes::WIN_RECTANGULAR),
+	_window_power(0)
 {
 
 }
@@ -12,6 +13,8 @@ FftWindow::FftWindow(uint16_t fftSize, gr::filter::firdes::win_type window_type)
 
 void FftWindow::reset(uint16_t fftSize, gr::filter::firdes::win_type window_type)
 {
+	_fft_size = fftSize;
+	_window_type = window_type;
 	win = gr::filter::firdes::window(window_type, fftSize, 6.76); // 6.76 is cargo-culted
 
 	_window_power = 0;
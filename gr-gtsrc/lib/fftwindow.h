@@ -54,6 +54,9 @@ public:
 	gr::filter::firdes::win_type windowType() const { return _window_type; }
 	float windowPower() const { return _window_power; }
 
+	/// Returns the \a fftSize coefficients of the window, for the vectorized kernels
+	const float *data() const { return &win[0]; }
+
 	/**
 	 * \brief    Get the power at bin \a i
 	 *
@@ -26,17 +26,28 @@
 #include <gnuradio/fft/fft.h>
 
 #include "hachoir_c_impl.h"
-#include "fftaverage.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <set>
+
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include "comsdetect.h"
+#include "fftpipeline.h"
 #include "radioeventtable.h"
 #include "../common/message_utils.h"
 
 void ringBufferTest();
 
+/* calcThermalNoise gives up after this many seconds without samples */
+#define CALIBRATION_MAX_TIMEOUTS 5
+
 namespace gr {
 namespace gtsrc {
 
@@ -52,6 +63,57 @@ namespace gtsrc {
 			return hachoir_c::sptr();
 		}
 	}
+	/* the transmissions end after the same delay as the RET's entries */
+	static TransmissionExtractor::Config
+	extractorConfig(const ComsDetect &detect)
+	{
+		TransmissionExtractor::Config config;
+		config.endOfTransmissionDelayNs = detect.comEndOfTransmissionDelay();
+		return config;
+	}
+
+	/* store 100 ms worth of samples */
+	boost::shared_ptr<SamplesRingBuffer>
+	hachoir_c_impl::makeRingBuffer(uint64_t samplerate)
+	{
+		return boost::make_shared<SamplesRingBuffer>(samplerate / 10,
+			boost::make_shared<RingBufferAllocator>(4096, true, true));
+	}
+
+	/* the instances alive, the lowest free number goes to the next block */
+	static boost::mutex instancesMutex;
+	static std::set<unsigned> instances;
+
+	hachoir_c_impl::Instance::Instance()
+	{
+		boost::mutex::scoped_lock lock(instancesMutex);
+		number = 0;
+		while (instances.count(number))
+			number++;
+		instances.insert(number);
+	}
+
+	hachoir_c_impl::Instance::~Instance()
+	{
+		boost::mutex::scoped_lock lock(instancesMutex);
+		instances.erase(number);
+	}
+
+	/* the first block publishes under SPECTRUM_SHM_DEFAULT_NAME, the next
+	 * ones under spectrumShmName() of their instance. The slots hold the
+	 * largest FFT, set_FFT_size may ask for it at any time: 64 of them
+	 * make 16 MB.
+	 */
+	SpectrumShmWriter::Config
+	hachoir_c_impl::shmConfig(unsigned instance)
+	{
+		SpectrumShmWriter::Config config;
+		config.name = spectrumShmName(instance);
+		config.slotCount = 64;
+		config.maxBins = UINT16_MAX;
+		return config;
+	}
+
 	/*
 	* The private constructor
 	*/
@@ -60,21 +122,89 @@ namespace gtsrc {
 			gr::io_signature::make(1, 1, sizeof (gr_complex)),
 			gr::io_signature::make(0, 0, sizeof (gr_complex))),
 			_freq(freq), _samplerate(samplerate),
-			_server(21333), _ringBuf(samplerate / 10), /* store 100 ms worth of samples */
-			_ret(1000, comsDetect().comEndOfTransmissionDelay(), comsDetect().comMinDurationNs())
+			_fft_size(0), _fft_batch_count(8), _fft_overlap(0.0), _fft_workers(1),
+			_server(SENSING_SERVER_DEFAULT_PORT + _instance.number), _shm(shmConfig(_instance.number)),
+			_ringBuf(makeRingBuffer(samplerate)), _ringSampleRate(samplerate),
+			_ret(1000, _comsDetect.comEndOfTransmissionDelay(), _comsDetect.comMinDurationNs()),
+			_extractor(_ret, extractorConfig(_comsDetect)), _stop(false)
 	{
-		comsDetect().setFftSize(fft_size);
-
-		update_fft_params(fft_size, (gr::filter::firdes::win_type) window_type);
+		_comsDetect.setFftSize(fft_size);
+
+		/* plan once per machine, at the effort asked for. The wisdom is
+		 * only kept on disk when GTSRC_FFTW_WISDOM names the file. */
+		FftPlanCache &plans = FftPlanCache::instance();
+		const char *wisdom = getenv("GTSRC_FFTW_WISDOM");
+		if (wisdom)
+			plans.setWisdomPath(wisdom);
+
+		const char *planner = getenv("GTSRC_FFTW_PLANNER");
+		if (planner && strcmp(planner, "estimate") == 0)
+			plans.setPlannerFlags(FFTW_ESTIMATE);
+		else if (planner && strcmp(planner, "patient") == 0)
+			plans.setPlannerFlags(FFTW_PATIENT);
+
+		set_fft_workers(0);
+
+		if (!update_fft_params(fft_size, (gr::filter::firdes::win_type) window_type))
+			throw std::invalid_argument("hachoir_c: invalid FFT parameters");
+
+		/* skip the warm-up of the detection */
+		const char *calibration = getenv("GTSRC_CALIBRATION_FILE");
+		if (calibration)
+			loadCalibration(calibration);
+
+		/* or better, from the models learnt by the last run at this tuning */
+		const char *store = getenv("GTSRC_CALIBRATION_STORE");
+		if (store) {
+			_calibrationStore = boost::make_shared<CalibrationStore>(store);
+			if (_calibrationStore->isOpen())
+				_comsDetect.setCalibrationStore(_calibrationStore,
+								CalibrationStore::Key(central_freq(), sample_rate()));
+			else
+				_calibrationStore.reset();
+		}
 
 		fftThread = boost::thread(&hachoir_c_impl::calc_fft, this);
 	}
 
+	/* 0 or less: leave a core to the detection and one to the sample
+	 * acquisition. The pipeline does not scale beyond 8 workers.
+	 */
+	void hachoir_c_impl::set_fft_workers(int workers)
+	{
+		unsigned cores = boost::thread::hardware_concurrency();
+		if (workers > 0)
+			_fft_workers = std::min(workers, 8);
+		else
+			_fft_workers = cores > 2 ? std::min(cores - 2, 8U) : 1;
+	}
+
 	/*
 	* Our virtual destructor.
 	*/
 	hachoir_c_impl::~hachoir_c_impl()
 	{
+		/* the FFT thread and its workers use all the members */
+		_stop = true;
+		fftThread.join();
+	}
+
+	/* the samples are tagged with the new rate by the markers of general_work,
+	 * the flowgraph keeps running. A new ring replaces the current one when
+	 * it cannot hold 100 ms anymore, or holds more than twice that.
+	 */
+	void hachoir_c_impl::set_sample_rate(int samplerate)
+	{
+		boost::mutex::scoped_lock lock(_ringMutex);
+
+		_samplerate = samplerate;
+
+		uint64_t needed = (uint64_t)samplerate / 10;
+		if (needed <= _ringBuf->ringLength() && (uint64_t)samplerate >= _ringSampleRate / 2)
+			return;
+
+		boost::atomic_store(&_ringBuf, makeRingBuffer(samplerate));
+		_ringSampleRate = samplerate;
 	}
 
 	void
@@ -110,12 +240,13 @@ namespace gtsrc {
 		}
 		sampleCount += noutput_items;
 
-		uint64_t pos = _ringBuf.addSamples(in, noutput_items);
+		boost::shared_ptr<SamplesRingBuffer> ring = boost::atomic_load(&_ringBuf);
+		uint64_t pos = ring->addSamples(in, noutput_items);
 
 		RBMarker m = { central_freq(), sample_rate(), curTime };
-		_ringBuf.addMarker(m, pos);
+		ring->addMarker(m, pos);
 
-		_ringBuf.validateWrite();
+		ring->validateWrite();
 
 		consume_each (noutput_items);
 
@@ -123,15 +254,31 @@ namespace gtsrc {
 		return noutput_items;
 	}
 
-	void
+	bool
 	hachoir_c_impl::update_fft_params(int fft_size, gr::filter::firdes::win_type window_type)
 	{
-		/* reconstruct the window when the fft_size of the window type changes */
-		if (fft_size != _fft_size || window_type != _window_type)
-			win.reset(fft_size, window_type);
+		if (fft_size < 1 || fft_size > UINT16_MAX) {
+			fprintf(stderr, "hachoir_c: invalid FFT size %d, kept %u\n",
+				fft_size, this->fft_size());
+			return false;
+		}
+
+		/* make the plan before publishing the window, the FFT thread then
+		 * swaps to the new size without waiting for FFTW
+		 */
+		FftPlanCache &plans = FftPlanCache::instance();
+		boost::shared_ptr<const FftWindow> win = plans.window(fft_size, window_type);
+		if (!win || !plans.plan(fft_size, _fft_batch_count)) {
+			fprintf(stderr, "hachoir_c: cannot plan FFTs of size %d, kept %u\n",
+				fft_size, this->fft_size());
+			return false;
+		}
+		boost::atomic_store(&_win, win);
 
 		_fft_size = fft_size;
-		_window_type = _window_type;
+		_window_type = window_type;
+
+		return true;
 	}
 
 	uint64_t
@@ -142,58 +289,25 @@ namespace gtsrc {
 		return (time.tv_sec * 1000000 + time.tv_usec) * 1000;
 	}
 
-	void hachoir_c_impl::sendFFT(const Fft *fft, const char *filteredFft)
-	{
-		uint8_t packet[4200];
-
-		union {
-			uint8_t  *u08;
-			char     *s08;
-			uint16_t *u16;
-			uint32_t *u32;
-			uint64_t *u64;
-			float *f;
-		} ptr;
-
-		ptr.u08 = packet;
-		*ptr.u08++ = (char) MSG_FFT;
-		*ptr.u32++ = 26 +  fft->fftSize();
-		*ptr.u16++ = fft->fftSize(); //steps
-		*ptr.u64++ = fft->startFrequency(); // start freq
-		*ptr.u64++ = fft->endFrequency(); // end freq
-		*ptr.u64++ = fft->time_ns();
-
-		for (int i = 0; i < fft->fftSize(); i++)
-			*ptr.u08++ = (char) filteredFft[i]; // (fft->operator [](i));
-
-		_server.sendToAll((char*)packet, ptr.u08 - packet);
-	}
-
 	void hachoir_c_impl::sendRetUpdate()
 	{
-		char msgHeader[5];
-		size_t offset = 0;
-
-		char * buf;
 		size_t len;
-		_ret.toString(&buf, &len);
 
-		/* generate the message Header */
-		write_and_update_offset(offset, msgHeader, (char) MSG_RET);
-		write_and_update_offset(offset, msgHeader, len);
-		_server.sendToAll(msgHeader, 5);
+		/* the new clients need all the active communications */
+		if (_server.hasNewClients())
+			_ret.requestKeyframe();
 
-		/* send the actual payload */
-		_server.sendToAll(buf, len);
+		if (_retUpdate.size() < _ret.maxUpdateSize())
+			_retUpdate.resize(_ret.maxUpdateSize());
+		if (!_ret.encodeUpdate(_retUpdate.data(), _retUpdate.size(), &len))
+			return;
 
-		//fprintf(stderr, "len = %u\n", len);
+		_server.sendToAll(MSG_RET_UPDATE, _retUpdate.data(), len);
 	}
 
 	void
 	hachoir_c_impl::calc_fft()
 	{
-		char filteredFFT[4096];
-
 		/* for statistics */
 		uint64_t lastUpdate = getTimeNs();
 		uint64_t lastFFtTime = 0, FFtTimeAverage = 0;
@@ -201,209 +315,265 @@ namespace gtsrc {
 
 		/* parameters for the detection */
 		int id = 0;
-		size_t comMinWidth = 4;
 
-		/* the fft calculator */
-		gr::fft::fft_complex fft(fft_size());
+		/* the FFT workers are the most demanding consumers, keep the samples close */
+		boost::shared_ptr<SamplesRingBuffer> ring = boost::atomic_load(&_ringBuf);
+		ring->bindToCurrentNode();
 
-		FILE *f = fopen("/tmp/bin_pwr.csv", "w");
-		fprintf(f, "pwr, floor, maxNoise\n");
+		SamplesRingBuffer::Cursor *cursor = ring->registerCursor("fft");
+		cursor->setPosition(ring->tail());
 
-		uint64_t start_pos = _ringBuf.tail();
-		while (1)
+		/* the FFTs are computed by the workers and handed out in time order */
+		boost::scoped_ptr<FftPipeline> pipeline;
+		std::vector<FftPipeline::WorkerStatistics> lastWorkersStats;
+		std::vector<FftPtr> ffts;
+		ffts.reserve(_fft_batch_count);
+		bool shmRefused = false;
+		while (!_stop)
 		{
-		/* calculating the FFT */
-			boost::shared_ptr<Fft> new_fft(new Fft(fft_size(),
-							       central_freq(),
-							       sample_rate(),
-							       &fft,
-							       win, _ringBuf,
-							       start_pos));
-			start_pos = new_fft->ringBufferStartPos() + fft_size();
-
-			float pwr = new_fft->operator [](500);
-			float floor = comsDetect().noiseFloor(500);
-			float maxNoise = comsDetect().noiseMax(500);
-			fprintf(f, "%f, %f, %f\n", pwr, floor, maxNoise);
-			fflush(f);
-			fsync(fileno(f));
-
-		/* detecting transmissions */
-			comsDetect().addFFT(new_fft);
-
-			for (int i = 0; i < fft_size(); i++) {
-				float pwr = comsDetect().avgPowerAtBin(i);
-				filteredFFT[i] = pwr;
+			/* follow the ring to its replacement, see set_sample_rate. The
+			 * samples left in the former one belong to the former tuning,
+			 * they are dropped.
+			 */
+			if (boost::atomic_load(&_ringBuf) != ring) {
+				ffts.clear();
+				pipeline.reset();
+				ring->unregisterCursor(cursor);
+
+				ring = boost::atomic_load(&_ringBuf);
+				ring->bindToCurrentNode();
+				cursor = ring->registerCursor("fft");
+				cursor->setPosition(ring->tail());
 			}
 
-#if 0
-			_ret.startAddingCommunications(new_fft->time_ns());
-
-			/* try to match the detected transmissions to the
-			 * currently-ongoing ones
+			/* (re)start the pipeline when its parameters changed. The
+			 * samples of the batches not consumed yet are transformed
+			 * again by the new pipeline, none is lost.
 			 */
-			auto it = _ret.activeCommunications().begin();
-			for (; it != _ret.activeCommunications().end() ; it++) {
-				RetEntry *entry = (*it).get();
-				uint16_t start = new_fft->binAtFreq(entry->frequencyStart());
-				uint16_t end = new_fft->binAtFreq(entry->frequencyEnd());
-
-				if (start >= 2)
-					start -= 2;
-				if (end < fft_size() - 2)
-					end += 2;
-
-				int32_t realStart = -1, realEnd = -1;
-				for (int i = start; i < end; i++) {
-					bool active = comsDetect().isBinActive(i);
-					if (active)
-						realStart = i;
-					if (realStart > -1 && !active) {
-						/* we found a new sub-band */
-						realEnd = i;
-
-						if (abs(start - realStart) < 2 &&
-						    abs(end - realEnd) < 2) {
-							for (int e = realStart; e < realEnd; e++)
-								filteredFFT[i] = comsDetect().noiseFloor(e);
-						}
-					}
-				}
+			boost::shared_ptr<const FftWindow> win = boost::atomic_load(&_win);
+			if (!pipeline || pipeline->workerCount() != fft_workers() ||
+			    pipeline->overlap() != fft_overlap() ||
+			    pipeline->fftSize() != win->fftSize() ||
+			    pipeline->window().windowType() != win->windowType()) {
+				ffts.clear();
+				pipeline.reset();
+				pipeline.reset(new FftPipeline(*ring, *cursor, win,
+							       _fft_batch_count, fft_overlap(),
+							       fft_workers()));
+				lastWorkersStats = pipeline->workersStatistics();
 			}
 
-			uint16_t comWidth = 0;
-			int32_t sumPwr = 0;
-			for (int i = 0; i < fft_size(); i++) {
-				float noiseFloor = comsDetect().noiseFloor(i);
-				if (filteredFFT[i] > noiseFloor) {
-					sumPwr += filteredFFT[i];
-					comWidth++;
-				} else {
-					if (comWidth < comMinWidth) {
-						for (int e = i - comWidth; e < i; e++)
-							filteredFFT[e] = noiseFloor;
-					} else {
-						int8_t avgPwr = (int8_t)(sumPwr / comWidth);
-
-						/* add the communication to the radio event table */
-						_ret.addCommunication(new_fft->freqAtBin(i - comWidth)/1000,
-								      new_fft->freqAtBin(i - 1)/1000,
-								      avgPwr);
+		/* getting the next FFTs, no sample comes to a replaced ring */
+			if (!pipeline->next(ffts, 100000000))
+				continue;
+
+			for (size_t b = 0; b < ffts.size(); b++) {
+				FftPtr new_fft = ffts[b];
+
+				/* every tuning has its own noise models, switched with the samples */
+				const CalibrationStore::Key &key = _comsDetect.calibrationKey();
+				if (_calibrationStore && (key.centralFrequency != new_fft->centralFrequency() ||
+							  key.sampleRate != new_fft->sampleRate()))
+					_comsDetect.setCalibrationStore(_calibrationStore,
+									CalibrationStore::Key(new_fft->centralFrequency(),
+											      new_fft->sampleRate()));
+
+			/* detecting transmissions, start over when the FFT size changed */
+				if (new_fft->fftSize() != _comsDetect.fftSize())
+					_comsDetect.setFftSize(new_fft->fftSize());
+				_comsDetect.addFFT(new_fft);
+
+			/* grouping the active bins into transmissions, fed to the RET */
+				_extractor.addFrame(_comsDetect, *new_fft);
+
+			/* the local consumers get all the spectra, the clients reduced ones */
+				if (new_fft->bins()) {
+					if (!_shm.publishSpectrum(new_fft->time_ns(), new_fft->startFrequency(),
+								  new_fft->endFrequency(), new_fft->bins(),
+								  new_fft->fftSize()) &&
+					    _shm.isOpen() && !shmRefused) {
+						fprintf(stderr, "hachoir_c: %s refused a spectrum of %u bins\n",
+							_shm.config().name.c_str(), new_fft->fftSize());
+						shmRefused = true;
 					}
-
-					sumPwr = 0;
-					comWidth = 0;
+					_server.sendSpectrum(new_fft->time_ns(), new_fft->startFrequency(),
+							     new_fft->endFrequency(), new_fft->bins(),
+							     new_fft->fftSize());
 				}
-			}
-			_ret.stopAddingCommunications();
-#endif
-
-		/* some stats, sorry about this code */
-			if (lastFFtTime > 0)
-				FFtTimeAverage += (new_fft->time_ns() - lastFFtTime);
-			lastFFtTime = new_fft->time_ns();
 
-			uint64_t curTime = getTimeNs();
-			uint64_t time_diff = curTime - lastUpdate;
-			if (time_diff > 1000000000) {
-				float fftRate = fftCount / ((float)time_diff / 1000000000);
-				float fftCoverage = fftRate * fft_size() / sample_rate();
-				fprintf(stderr, "fftCoverage = %f, averageFftTime = %f: FFT rate = %f (fftCount = %llu, time_diff = %llu), detections = %llu/%llu\n",
-					fftCoverage, ((float)FFtTimeAverage) / fftCount, fftRate, fftCount, time_diff, _ret.trueDetection, _ret.totalDetections);
-				lastUpdate = curTime;
-				fftCount = 0;
-				FFtTimeAverage = 0;
-				_ret.trueDetection = 0;
-			} else
-				fftCount++;
-
-
-		/* send the Ffts to the clients! */
-			if ((id++ % 10) == 0) {
-				sendFFT(new_fft.get(), filteredFFT);
-				sendRetUpdate();
-				_server.matchActiveCommunications(_ret);
+			/* some stats, sorry about this code */
+				if (lastFFtTime > 0)
+					FFtTimeAverage += (new_fft->time_ns() - lastFFtTime);
+				lastFFtTime = new_fft->time_ns();
+
+				uint64_t curTime = getTimeNs();
+				uint64_t time_diff = curTime - lastUpdate;
+				if (time_diff > 1000000000) {
+					float fftRate = fftCount / ((float)time_diff / 1000000000);
+					float fftCoverage = fftRate * pipeline->hopSize() / sample_rate();
+					fprintf(stderr, "fftCoverage = %f, averageFftTime = %f: FFT rate = %f (fftCount = %llu, time_diff = %llu), detections = %llu/%llu\n",
+						fftCoverage, ((float)FFtTimeAverage) / fftCount, fftRate, fftCount, time_diff, _ret.trueDetection, _ret.totalDetections);
+
+					std::vector<FftPipeline::WorkerStatistics> workersStats;
+					workersStats = pipeline->workersStatistics();
+					for (size_t w = 0; w < workersStats.size(); w++) {
+						uint64_t workerFfts = workersStats[w].fftCount - lastWorkersStats[w].fftCount;
+						uint64_t busy = workersStats[w].busyNs - lastWorkersStats[w].busyNs;
+						uint64_t lost = workersStats[w].lostBatches - lastWorkersStats[w].lostBatches;
+						uint64_t retuneDrops = workersStats[w].retuneDrops - lastWorkersStats[w].retuneDrops;
+						fprintf(stderr, "	fft worker %zu: fftCoverage = %f, load = %f, lost batches = %llu, retune drops = %llu\n",
+							w, workerFfts * pipeline->hopSize() / (sample_rate() * ((float)time_diff / 1000000000)),
+							(float)busy / time_diff, lost, retuneDrops);
+					}
+					lastWorkersStats = workersStats;
+
+					std::vector<SamplesRingBuffer::CursorStatistics> stats;
+					stats = ring->cursorsStatistics();
+					for (size_t i = 0; i < stats.size(); i++)
+						fprintf(stderr, "	consumer '%s': lag = %llu, overruns = %llu, dropped = %llu\n",
+							stats[i].name.c_str(), stats[i].lag,
+							stats[i].overrunCount, stats[i].droppedCount);
+
+					SensingServer::Statistics serverStats = _server.statistics();
+					fprintf(stderr, "	server: clients = %zu, queued = %zu bytes, dropped FFTs = %llu, disconnected = %llu\n",
+						serverStats.clients, serverStats.queuedBytes,
+						serverStats.droppedFfts, serverStats.disconnected);
+					lastUpdate = curTime;
+					fftCount = 0;
+					FFtTimeAverage = 0;
+					_ret.trueDetection = 0;
+				} else
+					fftCount++;
+
+
+			/* send the RET to the clients! */
+				if ((id++ % 10) == 0) {
+					sendRetUpdate();
+					_shm.publishRet(new_fft->time_ns(), _ret);
+					_server.matchActiveCommunications(_ret);
+				}
 			}
-
 		}
+
+		ffts.clear();
+		pipeline.reset();
+		ring->unregisterCursor(cursor);
 	}
 
-	void hachoir_c_impl::calcThermalNoise(const char *outputFile)
+	bool hachoir_c_impl::calcThermalNoise(const char *outputFile, uint64_t durationNs)
 	{
-		gr::fft::fft_complex fft(fft_size());
-		FftAverage avr(fft_size(), central_freq(), sample_rate(), 500000); //500000
-		size_t profile[2000];
-		size_t profile_length = 2000;
-		float profile_steps = 0.1;
-
-		/* init the profile */
-		for (size_t i = 0; i < profile_length; i++)
-			profile[i] = 0;
-
-		/* calculate the FFTs and add this into the average FFT */
-		uint64_t pos = _ringBuf.tail();
-		size_t length;
-		do {
-			gr_complex *samples = nullptr;
-			length = fft_size();
-
-			_ringBuf.requestRead(pos, &length, &samples);
-			if (length == fft_size()) {
-				boost::shared_ptr<Fft> new_fft(new Fft(fft_size(),
-								       central_freq(),
-								       sample_rate(),
-								       &fft, win,
-								       samples, length, 0));
-				avr.addFft(new_fft);
-				pos += length; //length; //go for precision and not for computation time;
+		/* record the samples first, transforming them takes longer */
+		std::vector<gr_complex> samples(sample_rate() * durationNs / 1000000000);
+		boost::shared_ptr<SamplesRingBuffer> ring = boost::atomic_load(&_ringBuf);
+		SamplesRingBuffer::Cursor *cursor = ring->registerCursor("calibration");
+		RBMarker tuning = RBMarker(); /* the tuning of the first sample recorded */
+		size_t recorded = 0;
+		int timeouts = 0;
+		while (recorded < samples.size()) {
+			/* the samples of two sample rates do not make a calibration */
+			if (boost::atomic_load(&_ringBuf) != ring) {
+				fprintf(stderr, "calcThermalNoise: the sample rate changed, aborted\n");
+				ring->unregisterCursor(cursor);
+				return false;
 			}
 
-		} while (length == fft_size() && avr.currentAverageCount() < avr.averageCount());
+			/* the frames must not span the samples lost, start over */
+			if (cursor->recover()) {
+				fprintf(stderr, "calcThermalNoise: samples were lost, restarted\n");
+				recorded = 0;
+			}
 
-		/* calculate the variance at each bin and add data to the profile */
-		float bin_variance_average = 0;
-		float* variance = new float[fft_size()];
-		for (size_t i = 0; i < fft_size(); i++) {
-			float bin_avr;
-			variance[i] = avr.varianceAt(i, &bin_avr, profile, profile_length, profile_steps);
+			gr_complex *src;
+			size_t length = std::min(samples.size() - recorded, (size_t)65536);
+			if (!ring->waitForAvailable(cursor->position(), length, 1000000000) ||
+			    !ring->requestRead(cursor->position(), &length, &src)) {
+				/* the stream stopped */
+				if (++timeouts >= CALIBRATION_MAX_TIMEOUTS) {
+					fprintf(stderr, "calcThermalNoise: no samples for %d s, aborted\n",
+						timeouts);
+					ring->unregisterCursor(cursor);
+					return false;
+				}
+				continue;
+			}
+			timeouts = 0;
 
-			bin_variance_average += variance[i];
+			/* the samples are labelled with the tuning they were received at,
+			 * the ones of two tunings do not make a calibration
+			 */
+			uint64_t pos = cursor->position();
+			RBMarker marker;
+			uint64_t markerPos, changePos;
+			if (!ring->findMarker(pos, &marker, &markerPos)) {
+				/* of an unknown tuning, start over after them */
+				recorded = 0;
+				cursor->advance(length);
+				continue;
+			}
+			if (recorded == 0)
+				tuning = marker;
+			if (!SamplesRingBuffer::sameTuning(tuning, marker) ||
+			    ring->findTuningChange(pos, length, tuning, &changePos)) {
+				fprintf(stderr, "calcThermalNoise: the tuning changed, aborted\n");
+				ring->unregisterCursor(cursor);
+				return false;
+			}
 
-			/*fprintf(stderr, "bin %i: [%f, %f, %f]\n",
-				i, bin_avr, variance[i], sqrtf(variance[i]));*/
+			memcpy(&samples[recorded], src, length * sizeof(gr_complex));
+			cursor->advance(length);
+			recorded += length;
 		}
+		ring->unregisterCursor(cursor);
 
-		/* sum the number of occurences found at each point of the profile */
-		uint64_t profileCountSum = 0;
-		for (size_t i = 0; i < profile_length; i++)
-			profileCountSum += profile[i];
-
-		/* get the probability distribution of the noise */
-		fprintf(stderr, "Profile:\n");
-		double probaSum;
-		for (size_t i = 0; i < profile_length; i++) {
-			float offset = ((float)i - (profile_length / 2)) * profile_steps;
-			probaSum += ((double)profile[i]) / profileCountSum;
-
-			/*if (probaSum > 0 && probaSum < 1)
-				fprintf(stdout, "%.3f, %.20f\n", offset, probaSum);*/
-			fprintf(stdout, "%.1f, %u\n", offset, profile[i]);
-		}
+		ThermalCalibration calibration;
+		ThermalCalibration::Result result;
+		uint64_t start = getTimeNs();
+		if (!calibration.run(*boost::atomic_load(&_win), tuning.freq, tuning.sampleRate,
+				     samples.data(), samples.size(), result))
+			return false;
+		uint64_t duration = getTimeNs() - start;
 
-		float bin_variance_variance = 0;
-		bin_variance_average /= fft_size();
+		/* how much the noise variance differs between the bins */
+		float bin_variance_average = 0;
+		for (size_t i = 0; i < result.fftSize; i++)
+			bin_variance_average += result.variance[i];
+		bin_variance_average /= result.fftSize;
 
-		for (size_t i = 0; i < fft_size(); i++) {
-			float diff = variance[i] - bin_variance_average;
+		float bin_variance_variance = 0;
+		for (size_t i = 0; i < result.fftSize; i++) {
+			float diff = result.variance[i] - bin_variance_average;
 			bin_variance_variance += diff * diff;
 		}
-		bin_variance_variance /= fft_size();
+		bin_variance_variance /= result.fftSize;
 
+		fprintf(stderr, "Thermal noise: %llu FFTs in %llu ms\n",
+			result.ffts, duration / 1000000);
 		fprintf(stderr, "Variance of the noise variance: [%f, %f, %f]\n",
 			bin_variance_average, bin_variance_variance,
 			sqrtf(bin_variance_variance));
 
-		fprintf(stderr, "Time span = %llu ns\n", avr.span_ns());
+		return !outputFile || result.save(outputFile);
+	}
+
+	bool hachoir_c_impl::loadCalibration(const char *filepath)
+	{
+		ThermalCalibration::Result result;
+		if (!result.load(filepath))
+			return false;
+
+		if (result.centralFrequency != central_freq() ||
+		    result.sampleRate != sample_rate() ||
+		    !_comsDetect.loadCalibration(result)) {
+			fprintf(stderr, "hachoir_c: '%s' is the calibration of %llu Hz, "
+				"%llu S/s, FFT %u, ignored\n", filepath,
+				result.centralFrequency, result.sampleRate, result.fftSize);
+			return false;
+		}
+
+		fprintf(stderr, "hachoir_c: noise calibration loaded from '%s' (%llu FFTs)\n",
+			filepath, result.ffts);
+
+		return true;
 	}
 
 } /* namespace gtsrc */
@@ -25,14 +25,22 @@
 #include <gnuradio/filter/firdes.h>
 
 #include <stdint.h>
+#include <atomic>
 #include <memory>
+#include <vector>
 
 #include <boost/array.hpp>
 #include <boost/thread.hpp>
 
+#include "calibrationstore.h"
+#include "comsdetect.h"
+#include "fftplancache.h"
 #include "radioeventtable.h"
 #include "samplesringbuffer.h"
 #include "sensingserver.h"
+#include "spectrumshm.h"
+#include "thermalcalibration.h"
+#include "transmissionextractor.h"
 #include "fftwindow.h"
 #include "fft.h"
 
@@ -42,31 +50,68 @@ namespace gtsrc {
 	class hachoir_c_impl : public hachoir_c
 	{
 	private:
-		/* parameters */
-		uint64_t _freq;
-		uint64_t _samplerate;
-		uint16_t _fft_size;
-		gr::filter::firdes::win_type _window_type;
-
-		/* server */
+		/* parameters, set by other threads but the batch count */
+		std::atomic<uint64_t> _freq;
+		std::atomic<uint64_t> _samplerate;
+		std::atomic<uint16_t> _fft_size;
+		std::atomic<gr::filter::firdes::win_type> _window_type;
+		size_t _fft_batch_count;
+		std::atomic<float> _fft_overlap;
+		std::atomic<size_t> _fft_workers;
+
+		/* the number of the block among the ones of the process, names
+		 * _server's port and _shm. Given back once they are destroyed.
+		 */
+		struct Instance
+		{
+			unsigned number;
+			Instance();
+			~Instance();
+		} _instance;
+
+		/* server, on SENSING_SERVER_DEFAULT_PORT + the instance number */
 		SensingServer _server;
 
-		/* time-domain ring buffer */
-		SamplesRingBuffer _ringBuf;
+		/* every spectrum, for the consumers on this host */
+		SpectrumShmWriter _shm;
+
+		/* time-domain ring buffer, 100 ms of samples. Swapped atomically by
+		 * set_sample_rate when it gets too small or too large.
+		 */
+		boost::shared_ptr<SamplesRingBuffer> _ringBuf;
+		uint64_t _ringSampleRate; ///< The rate _ringBuf is sized for
+		boost::mutex _ringMutex; ///< Serializes the swaps of _ringBuf
+
+		/* the detection of the transmissions, used by fftThread only */
+		ComsDetect _comsDetect;
+
+		/* the noise models of every tuning, kept across restarts */
+		boost::shared_ptr<CalibrationStore> _calibrationStore;
 
 		/* Radio Event Table */
 		RadioEventTable _ret;
 
+		/* the transmissions found by _comsDetect, fed to _ret */
+		TransmissionExtractor _extractor;
+
+		/* the RET updates sent to the clients, grows as needed */
+		std::vector<char> _retUpdate;
+
 		/* internals */
 		boost::thread fftThread;
-		FftWindow win;
+		std::atomic<bool> _stop; ///< Asks fftThread to return, see the destructor
+
+		/* swapped atomically by update_fft_params, picked up by calc_fft
+		 * between two batches
+		 */
+		boost::shared_ptr<const FftWindow> _win;
 
-		void sendFFT(const Fft *fft, const char *filteredFft);
 		void sendRetUpdate();
 		void calc_fft();
-		void calcThermalNoise(const char *outputFile = NULL);
 
-		void update_fft_params(int fft_size, gr::filter::firdes::win_type window_type);
+		bool update_fft_params(int fft_size, gr::filter::firdes::win_type window_type);
+		static boost::shared_ptr<SamplesRingBuffer> makeRingBuffer(uint64_t samplerate);
+		static SpectrumShmWriter::Config shmConfig(unsigned instance);
 		uint64_t getTimeNs();
 
 	public:
@@ -75,21 +120,48 @@ namespace gtsrc {
 
 		void forecast (int noutput_items, gr_vector_int &ninput_items_required);
 
+		/**
+		 * \brief    Learn the thermal noise, the antenna being disconnected.
+		 *
+		 * \details  \a durationNs of samples are recorded from the stream,
+		 *           then transformed by a ThermalCalibration on all the
+		 *           cores. Blocks until done.
+		 *
+		 * \param    outputFile   The calibration file to write, NULL for none
+		 * \param    durationNs   The duration of the recording
+		 * \return   True on success, false otherwise.
+		 */
+		bool calcThermalNoise(const char *outputFile = NULL, uint64_t durationNs = 1000000000);
+		bool calc_thermal_noise(const std::string &output_file, double duration)
+		{
+			return calcThermalNoise(output_file.empty() ? NULL : output_file.c_str(),
+						duration * 1e9);
+		}
+
+		/// Start the detection from a calibration file, see #calcThermalNoise
+		bool loadCalibration(const char *filepath);
+
 		// Where all the action really happens
 		int general_work(int noutput_items,
 				gr_vector_int &ninput_items,
 				gr_vector_const_void_star &input_items,
 				gr_vector_void_star &output_items);
 
+		uint16_t server_port() const { return _server.port(); }
 		uint64_t central_freq() const { return _freq;}
 		uint64_t sample_rate() const { return _samplerate;}
 		uint16_t  fft_size() const { return _fft_size;}
-		gr::filter::firdes::win_type window_type() const { return _window_type;}
+		int window_type() const { return _window_type;}
+		size_t fft_batch_count() const { return _fft_batch_count;}
+		float fft_overlap() const { return _fft_overlap;}
+		size_t fft_workers() const { return _fft_workers;}
 
 		void set_central_freq(double freq) { _freq = freq;}
-		void set_sample_rate(int samplerate) { _samplerate = samplerate;}
-		void set_FFT_size(int fft_size) { update_fft_params(fft_size, window_type()); }
+		void set_sample_rate(int samplerate);
+		void set_FFT_size(int fft_size) { update_fft_params(fft_size, _window_type); }
 		void set_window_type(int win_type) { update_fft_params(fft_size(), (gr::filter::firdes::win_type) win_type); }
+		void set_fft_overlap(float overlap) { _fft_overlap = overlap; }
+		void set_fft_workers(int workers);
 	};
 
 } // namespace gtsrc
@@ -0,0 +1,300 @@
+#include "noisecalibration.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+#include "sw_radio_params.h"
+
+/* the threshold above the model mean, as with the former histograms */
+#define MODEL_MAX_OFFSET 14.0
+
+/* Under the noise model, the power p relative to the model mean follows
+ * P(p < x) = 1 - exp(-exp((x - NOISE_MU) / NOISE_SIGMA)). Its quantile q
+ * is NOISE_MU + NOISE_SIGMA * ln(-ln(1 - q)) and its density there is
+ * -ln(1 - q) * (1 - q) / NOISE_SIGMA.
+ */
+static float modelQuantile(float q)
+{
+	return NOISE_MU + NOISE_SIGMA * logf(-logf(1 - q));
+}
+
+/* the mean of the model, NOISE_MU - gamma * NOISE_SIGMA */
+static const float MODEL_MEAN = NOISE_MU - 0.5772157 * NOISE_SIGMA;
+
+/* the step giving the fastest convergence to a quantile, 1 / density */
+static float quantileGain(float q)
+{
+	return NOISE_SIGMA / (-logf(1 - q) * (1 - q));
+}
+
+/* the largest step of the quantiles. The gain of a high quantile is large,
+ * a rare power above it would otherwise throw it away during the warm-up.
+ */
+static const float MAX_QUANTILE_STEP = NOISE_SIGMA / 8;
+
+NoiseCalibration::NoiseCalibration(size_t groupSize, float forgetting,
+				   float quantile, uint32_t minSampleCount,
+				   size_t maxGroups) :
+	_bins(0), _groupSize(groupSize > 0 ? groupSize : 1),
+	_maxGroups(maxGroups > 0 ? maxGroups : 1), _forgetting(forgetting),
+	_quantile(std::min(std::max(quantile, 0.5f), 0.9999f)),
+	_minSampleCount(minSampleCount), _updates(0)
+{
+}
+
+void NoiseCalibration::reset(size_t bins)
+{
+	_bins = bins;
+
+	/* respect the memory budget */
+	size_t groupSize = _groupSize;
+	while ((bins + groupSize - 1) / groupSize > _maxGroups)
+		groupSize *= 2;
+	if (groupSize != _groupSize) {
+		fprintf(stderr, "NoiseCalibration: %zu bins do not fit in %zu groups, "
+			"grouping them by %zu\n", bins, _maxGroups, groupSize);
+		_groupSize = groupSize;
+	}
+
+	size_t groups = (bins + _groupSize - 1) / _groupSize;
+	_mean.assign(groups, 0.0);
+	_median.assign(groups, 0.0);
+	_high.assign(groups, 0.0);
+	_threshold.assign(bins, std::numeric_limits<float>::infinity());
+	_updates = 0;
+}
+
+void NoiseCalibration::setParams(size_t groupSize, float forgetting)
+{
+	_groupSize = groupSize > 0 ? groupSize : 1;
+	_forgetting = forgetting;
+	reset(_bins);
+}
+
+/* start from the first spectrum and the noise model */
+void NoiseCalibration::init(const float *pwr)
+{
+	float highOffset = modelQuantile(_quantile) - modelQuantile(0.5);
+
+	for (size_t g = 0; g < _mean.size(); g++) {
+		float x = pwr[g * _groupSize];
+		if (x != x)
+			x = -150.0;
+		_mean[g] = x;
+		_median[g] = x;
+		_high[g] = x + highOffset;
+	}
+}
+
+/* A single power is a poor start for the quantiles, the noise has a long
+ * tail towards the low powers. At the end of the warm-up, the mean is the
+ * exact average of the first powers, start the quantiles from it.
+ */
+void NoiseCalibration::reseed()
+{
+	float medianOffset = modelQuantile(0.5) - MODEL_MEAN;
+	float highOffset = modelQuantile(_quantile) - MODEL_MEAN;
+
+	for (size_t g = 0; g < _mean.size(); g++) {
+		_median[g] = _mean[g] + medianOffset;
+		_high[g] = _mean[g] + highOffset;
+	}
+}
+
+bool NoiseCalibration::update(const float *pwr, size_t length)
+{
+	if (length != _bins || length == 0)
+		return false;
+
+	if (_updates == 0)
+		init(pwr);
+
+	float p = _quantile;
+	const float medianGain = quantileGain(0.5);
+	const float highGain = quantileGain(p);
+	float *mean = _mean.data();
+	float *median = _median.data();
+	float *high = _high.data();
+
+	if (_groupSize == 1) {
+		/* every group sees its n-th power, a single weight for all */
+		float a = std::max(_forgetting, 1.0f / (_updates + 1));
+		float medianStep = std::min(a * medianGain, MAX_QUANTILE_STEP);
+		float highStep = std::min(a * highGain, MAX_QUANTILE_STEP);
+
+		/* branch-free, vectorized by the compiler. NaNs are ignored. */
+		for (size_t i = 0; i < length; i++) {
+			float x = pwr[i];
+			bool valid = x == x;
+			float m = mean[i], q = median[i], h = high[i];
+
+			mean[i] = valid ? m + a * (x - m) : m;
+			median[i] = valid ? q + medianStep * (0.5f - (float)(x <= q)) : q;
+			high[i] = valid ? h + highStep * (p - (float)(x <= h)) : h;
+		}
+	} else {
+		for (size_t g = 0; g < _mean.size(); g++) {
+			size_t begin = g * _groupSize;
+			size_t end = std::min(begin + _groupSize, length);
+			uint64_t n = _updates * _groupSize;
+
+			for (size_t i = begin; i < end; i++) {
+				float x = pwr[i];
+				if (x != x)
+					continue;
+
+				float a = std::max(_forgetting, 1.0f / ++n);
+				mean[g] += a * (x - mean[g]);
+				float medianStep = std::min(a * medianGain, MAX_QUANTILE_STEP);
+				float highStep = std::min(a * highGain, MAX_QUANTILE_STEP);
+				median[g] += medianStep * (0.5f - (float)(x <= median[g]));
+				high[g] += highStep * (p - (float)(x <= high[g]));
+			}
+		}
+	}
+
+	_updates++;
+	if (_updates * _groupSize >= _minSampleCount &&
+	    (_updates - 1) * _groupSize < _minSampleCount)
+		reseed();
+	updateThresholds();
+
+	return true;
+}
+
+bool NoiseCalibration::seed(const float *mean, const float *median,
+			    const float *high, float quantile, size_t length,
+			    uint64_t updates)
+{
+	if (length != _bins || length == 0)
+		return false;
+
+	float highOffset = modelQuantile(_quantile) - modelQuantile(0.5);
+	bool sameQuantile = fabsf(quantile - _quantile) < 1e-6;
+
+	for (size_t g = 0; g < _mean.size(); g++) {
+		size_t begin = g * _groupSize;
+		size_t end = std::min(begin + _groupSize, length);
+		float m = 0, q = 0, h = 0;
+
+		for (size_t i = begin; i < end; i++) {
+			m += mean[i];
+			q += median[i];
+			h += sameQuantile ? high[i] : median[i] + highOffset;
+		}
+		_mean[g] = m / (end - begin);
+		_median[g] = q / (end - begin);
+		_high[g] = h / (end - begin);
+	}
+
+	/* past the warm-up, the next powers get the weight of a long history */
+	uint64_t warmup = (_minSampleCount + _groupSize - 1) / _groupSize;
+	_updates = std::max(updates, warmup);
+	updateThresholds();
+
+	return true;
+}
+
+bool NoiseCalibration::restore(const Snapshot &snapshot)
+{
+	size_t groups = _mean.size();
+	if (snapshot.bins != _bins || _bins == 0 || snapshot.groupSize != _groupSize ||
+	    snapshot.mean.size() != groups || snapshot.mode.size() != groups ||
+	    snapshot.highQuantile.size() != groups)
+		return false;
+
+	/* the inverse of #mode */
+	float medianOffset = modelQuantile(0.5) - NOISE_MU;
+	float highOffset = modelQuantile(_quantile) - modelQuantile(0.5);
+	bool sameQuantile = fabsf(snapshot.quantile - _quantile) < 1e-6;
+
+	for (size_t g = 0; g < groups; g++) {
+		_mean[g] = snapshot.mean[g];
+		_median[g] = snapshot.mode[g] + medianOffset;
+		_high[g] = sameQuantile ? snapshot.highQuantile[g] : _median[g] + highOffset;
+	}
+
+	_updates = snapshot.updates;
+	std::fill(_threshold.begin(), _threshold.end(), std::numeric_limits<float>::infinity());
+	updateThresholds();
+
+	return true;
+}
+
+void NoiseCalibration::updateThresholds()
+{
+	if (!isReady())
+		return;
+
+	/* see #modelMean */
+	float offset = MODEL_MAX_OFFSET - modelQuantile(0.5);
+	const float *median = _median.data();
+	float *threshold = _threshold.data();
+
+	if (_groupSize == 1) {
+		for (size_t i = 0; i < _bins; i++)
+			threshold[i] = median[i] + offset;
+	} else {
+		for (size_t g = 0; g < _mean.size(); g++) {
+			size_t end = std::min((g + 1) * _groupSize, _bins);
+			for (size_t i = g * _groupSize; i < end; i++)
+				threshold[i] = median[g] + offset;
+		}
+	}
+}
+
+/* the mode is at NOISE_MU above the model mean, the median at modelQuantile(0.5) */
+float NoiseCalibration::mode(size_t bin) const
+{
+	return _median[bin / _groupSize] - modelQuantile(0.5) + NOISE_MU;
+}
+
+float NoiseCalibration::modelMean(size_t bin) const
+{
+	return mode(bin) - NOISE_MU;
+}
+
+void NoiseCalibration::snapshot(Snapshot &snapshot) const
+{
+	size_t groups = groupCount();
+
+	snapshot.bins = _bins;
+	snapshot.groupSize = _groupSize;
+	snapshot.updates = _updates;
+	snapshot.quantile = _quantile;
+	snapshot.ready = isReady();
+
+	snapshot.mean.assign(_mean.begin(), _mean.end());
+	snapshot.highQuantile.assign(_high.begin(), _high.end());
+	snapshot.mode.resize(groups);
+	snapshot.threshold.resize(groups);
+	for (size_t g = 0; g < groups; g++) {
+		snapshot.mode[g] = mode(g * _groupSize);
+		snapshot.threshold[g] = _threshold[g * _groupSize];
+	}
+}
+
+bool NoiseCalibration::dumpToCsvFile(const Snapshot &snapshot,
+				     const std::string &filepath)
+{
+	std::ofstream myfile;
+
+	myfile.open(filepath.c_str());
+	if (!myfile.is_open()) {
+		fprintf(stderr, "NoiseCalibration: cannot open '%s'\n", filepath.c_str());
+		return false;
+	}
+
+	myfile << "first bin, mean, mode, high quantile, threshold" << std::endl;
+	for (size_t g = 0; g < snapshot.mean.size(); g++)
+		myfile << g * snapshot.groupSize << ", " << snapshot.mean[g] << ", "
+		       << snapshot.mode[g] << ", " << snapshot.highQuantile[g] << ", "
+		       << snapshot.threshold[g] << std::endl;
+
+	myfile.close();
+
+	return !myfile.fail();
+}
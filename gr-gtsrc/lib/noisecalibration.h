@@ -0,0 +1,176 @@
+/**
+ * \file      noisecalibration.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef NOISECALIBRATION_H
+#define NOISECALIBRATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "alignedallocator.h"
+
+/**
+ * \class     NoiseCalibration
+ * \brief     Learns the noise of every bin, or group of bins, of a spectrum.
+ *
+ * \details   Every group of \a groupSize consecutive bins has its own
+ *            model, updated in O(1) by every power added:
+ *             - the mean, an exponential moving average;
+ *             - the median, tracked by stochastic approximation, which is
+ *               robust to the transmissions. The mode and the model mean
+ *               are derived from it using the noise model of
+ *               sw_radio_params.h (NOISE_MU, NOISE_SIGMA);
+ *             - a high quantile, tracked the same way.
+ *
+ *            The weight of a new power is max(\a forgetting, 1 / n), n
+ *            being the number of powers seen by the group. The first
+ *            powers are thus averaged evenly, then the model slowly
+ *            forgets the past to follow a drifting noise.
+ *
+ *            The detection threshold of a bin is its model mean plus 14
+ *            dB, as with the former histograms, or +inf until the group
+ *            has seen \a minSampleCount powers.
+ *
+ *            At most \a maxGroups groups are kept (64k by default, 16 bytes
+ *            each plus 4 bytes per bin), \a groupSize grows if needed.
+ *
+ *            **Thread-safety:** Not thread safe. #snapshot should be
+ *            called by the thread calling #update.
+ */
+class NoiseCalibration
+{
+public:
+	/// A copy of the models, see #snapshot
+	struct Snapshot
+	{
+		size_t bins; ///< The number of bins
+		size_t groupSize; ///< The number of bins per group
+		uint64_t updates; ///< The number of spectra learnt
+		float quantile; ///< The probability of #highQuantile
+		bool ready; ///< Are the thresholds valid?
+
+		std::vector<float> mean; ///< The mean power of every group
+		std::vector<float> mode; ///< The most probable power of every group
+		std::vector<float> highQuantile; ///< The high quantile of every group
+		std::vector<float> threshold; ///< The detection threshold of every group
+	};
+
+private:
+	typedef std::vector<float, AlignedAllocator<float> > FloatArray;
+
+	size_t _bins; ///< The number of bins of the spectra
+	size_t _groupSize; ///< The number of bins sharing a model
+	size_t _maxGroups; ///< The memory budget, in groups
+	float _forgetting; ///< The minimum weight of a new power
+	float _quantile; ///< The probability of the high quantile
+	uint32_t _minSampleCount; ///< The powers needed before detecting
+
+	uint64_t _updates; ///< The number of spectra learnt
+
+	FloatArray _mean; ///< Per group
+	FloatArray _median; ///< Per group
+	FloatArray _high; ///< Per group
+	FloatArray _threshold; ///< Per bin, +inf until ready
+
+	void init(const float *pwr);
+	void reseed();
+	void updateThresholds();
+
+public:
+	/**
+	 * \brief    Create a calibration, see the class's description.
+	 *
+	 * \param    groupSize       The number of bins sharing a model
+	 * \param    forgetting      The minimum weight of a new power, 0 to 1
+	 * \param    quantile        The probability of the high quantile
+	 * \param    minSampleCount  The number of powers a group needs to see
+	 *                           before its threshold is valid
+	 * \param    maxGroups       The maximum number of groups
+	 * \return   Nothing.
+	 */
+	NoiseCalibration(size_t groupSize = 1, float forgetting = 1.0 / 8192,
+			 float quantile = 0.99, uint32_t minSampleCount = 100,
+			 size_t maxGroups = 65536);
+
+	/// Forget everything and get ready for spectra of \a bins bins
+	void reset(size_t bins);
+
+	/// Change the grouping and forgetting, resets the models
+	void setParams(size_t groupSize, float forgetting);
+
+	/**
+	 * \brief    Learn a spectrum.
+	 *
+	 * \param    pwr      The powers, in dB
+	 * \param    length   The number of bins, must be the one given to #reset
+	 * \return   False if \a length is wrong, true otherwise.
+	 */
+	bool update(const float *pwr, size_t length);
+
+	/**
+	 * \brief    Start from a thermal noise calibration, skipping the warm-up.
+	 *
+	 * \details  The models of a group start from the average of its bins.
+	 *           The high quantile is derived from the median when the
+	 *           calibration's is of another probability. The calibration
+	 *           counts as \a updates spectra learnt.
+	 *
+	 * \param    mean      The mean power of every bin, in dB
+	 * \param    median    The median power of every bin, in dB
+	 * \param    high      The high quantile of every bin, in dB
+	 * \param    quantile  The probability of \a high
+	 * \param    length    The number of bins, must be the one given to #reset
+	 * \param    updates   The number of spectra the calibration was learnt from
+	 * \return   False if \a length is wrong, true otherwise.
+	 */
+	bool seed(const float *mean, const float *median, const float *high,
+		  float quantile, size_t length, uint64_t updates);
+
+	/**
+	 * \brief    Restore the models saved by #snapshot, O(groups).
+	 *
+	 * \details  The high quantile is derived from the median when the
+	 *           snapshot's is of another probability.
+	 *
+	 * \param    snapshot   The models, of the same bins and groupSize
+	 * \return   False if the snapshot does not match, true otherwise.
+	 */
+	bool restore(const Snapshot &snapshot);
+
+	size_t bins() const { return _bins; }
+	size_t groupSize() const { return _groupSize; }
+	size_t groupCount() const { return _mean.size(); }
+	float forgetting() const { return _forgetting; }
+	float quantile() const { return _quantile; }
+	uint64_t updates() const { return _updates; }
+	bool isReady() const { return _updates * _groupSize >= _minSampleCount; }
+
+	float mean(size_t bin) const { return _mean[bin / _groupSize]; }
+	float mode(size_t bin) const;
+	float modelMean(size_t bin) const;
+	float highQuantile(size_t bin) const { return _high[bin / _groupSize]; }
+	float threshold(size_t bin) const { return _threshold[bin]; }
+
+	/// The detection thresholds of all the bins
+	const float *thresholds() const { return _threshold.data(); }
+
+	/// Copy the models into \a snapshot, O(groups)
+	void snapshot(Snapshot &snapshot) const;
+
+	/**
+	 * \brief    Write a snapshot as CSV, one line per group.
+	 *
+	 * \param    snapshot   The snapshot to be written
+	 * \param    filepath   The path of the CSV file
+	 * \return   True on success, false otherwise.
+	 */
+	static bool dumpToCsvFile(const Snapshot &snapshot, const std::string &filepath);
+};
+
+#endif // NOISECALIBRATION_H
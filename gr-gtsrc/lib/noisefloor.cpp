@@ -0,0 +1,172 @@
+#include "noisefloor.h"
+
+#include <algorithm>
+#include <limits>
+
+/* the band around the cut-offs, in dB */
+static const float MARGIN_MIN = 0.0625;
+static const float MARGIN_START = 1.0;
+static const float MARGIN_MAX = 64.0;
+
+NoiseFloorEstimator::NoiseFloorEstimator(float low, float high) :
+	_low(std::min(std::max(low, 0.0f), 1.0f)),
+	_high(std::min(std::max(high, _low), 1.0f)),
+	_primed(false), _lowCut(0), _highCut(0), _margin(MARGIN_START),
+	_estimations(0), _fallbacks(0)
+{
+}
+
+NoiseFloorEstimator NoiseFloorEstimator::lowestMean(float fraction)
+{
+	return NoiseFloorEstimator(0.0, fraction);
+}
+
+NoiseFloorEstimator NoiseFloorEstimator::percentile(float percentile)
+{
+	return NoiseFloorEstimator(percentile, percentile);
+}
+
+NoiseFloorEstimator NoiseFloorEstimator::trimmedMean(float low, float high)
+{
+	return NoiseFloorEstimator(low, 1.0 - high);
+}
+
+/* average the bins of ranks [l, h) of _scratch[0, n), or return the bin of
+ * rank l when h == l + 1. Updates the cut-offs.
+ */
+static float selectRanks(std::vector<float> &scratch, size_t n, size_t l,
+			 size_t h, float *lowCut, float *highCut)
+{
+	std::vector<float>::iterator begin = scratch.begin();
+
+	if (l > 0 || h == l + 1)
+		std::nth_element(begin, begin + l, begin + n);
+	*lowCut = scratch[l];
+
+	if (h == l + 1) {
+		*highCut = *lowCut;
+		return *lowCut;
+	}
+
+	/* the bins of ranks [l, n) are now in [l, n) */
+	std::nth_element(begin + l, begin + h - 1, begin + n);
+	*highCut = scratch[h - 1];
+
+	float sum = 0;
+	for (size_t i = l; i < h; i++)
+		sum += scratch[i];
+	return sum / (h - l);
+}
+
+float NoiseFloorEstimator::fullSelection(const float *pwr, size_t length,
+					 size_t lowRank, size_t highRank)
+{
+	_scratch.assign(pwr, pwr + length);
+	_primed = true;
+	_fallbacks++;
+
+	return selectRanks(_scratch, length, lowRank, highRank, &_lowCut, &_highCut);
+}
+
+float NoiseFloorEstimator::estimate(const float *pwr, size_t length)
+{
+	if (length == 0)
+		return 0.0;
+
+	/* the ranks to average, at least one bin */
+	size_t lowRank = std::min((size_t)(_low * length), length - 1);
+	size_t highRank = std::max((size_t)(_high * length), lowRank + 1);
+	highRank = std::min(highRank, length);
+
+	_estimations++;
+	if (!_primed)
+		return fullSelection(pwr, length, lowRank, highRank);
+
+	if (_scratch.size() < 2 * length)
+		_scratch.resize(2 * length);
+
+	if (_highCut - _lowCut > 4 * _margin)
+		return twoBands(pwr, length, lowRank, highRank);
+
+	/* keep the bins around the previous cut-offs, only count the others */
+	float a = _lowCut - _margin;
+	float b = _highCut + _margin;
+	if (lowRank == 0)
+		a = -std::numeric_limits<float>::infinity();
+
+	float *band = _scratch.data();
+	size_t below = 0, n = 0;
+	for (size_t i = 0; i < length; i++) {
+		float v = pwr[i];
+		band[n] = v;
+		n += (v >= a) & (v <= b);
+		below += (v < a);
+	}
+
+	/* the cut-offs moved out of the band */
+	if (below > lowRank || below + n < highRank) {
+		_margin = std::min(_margin * 2, MARGIN_MAX);
+		return fullSelection(pwr, length, lowRank, highRank);
+	}
+
+	/* too many bins in the band, tighten it */
+	if (n - (highRank - lowRank) > length / 8)
+		_margin = std::max(_margin / 2, MARGIN_MIN);
+
+	return selectRanks(_scratch, n, lowRank - below, highRank - below,
+			   &_lowCut, &_highCut);
+}
+
+float NoiseFloorEstimator::twoBands(const float *pwr, size_t length,
+				    size_t lowRank, size_t highRank)
+{
+	/* a band around each cut-off, the bins in between are simply summed */
+	float a0 = _lowCut - _margin, a1 = _lowCut + _margin;
+	float b0 = _highCut - _margin, b1 = _highCut + _margin;
+	if (lowRank == 0)
+		a0 = -std::numeric_limits<float>::infinity();
+
+	float *bandA = _scratch.data();
+	float *bandB = _scratch.data() + length;
+	size_t below = 0, nA = 0, nB = 0, mid = 0;
+	float midSum = 0;
+	for (size_t i = 0; i < length; i++) {
+		float v = pwr[i];
+		bool inMid = (v > a1) & (v < b0);
+
+		bandA[nA] = v;
+		nA += (v >= a0) & (v <= a1);
+		bandB[nB] = v;
+		nB += (v >= b0) & (v <= b1);
+		below += (v < a0);
+		midSum += inMid ? v : 0.0f;
+		mid += inMid;
+	}
+
+	/* the rank low must fall in the band A, the rank high - 1 in the band B */
+	size_t base = below + nA + mid;
+	if (below > lowRank || lowRank >= below + nA ||
+	    highRank <= base || highRank > base + nB) {
+		_margin = std::min(_margin * 2, MARGIN_MAX);
+		return fullSelection(pwr, length, lowRank, highRank);
+	}
+
+	size_t l = lowRank - below, h = highRank - base;
+	float sum = midSum;
+
+	std::nth_element(bandA, bandA + l, bandA + nA);
+	_lowCut = bandA[l];
+	for (size_t i = l; i < nA; i++)
+		sum += bandA[i];
+
+	std::nth_element(bandB, bandB + h - 1, bandB + nB);
+	_highCut = bandB[h - 1];
+	for (size_t i = 0; i < h; i++)
+		sum += bandB[i];
+
+	/* too many bins in the bands, tighten them */
+	if (nA + nB > length / 4)
+		_margin = std::max(_margin / 2, MARGIN_MIN);
+
+	return sum / (highRank - lowRank);
+}
@@ -0,0 +1,99 @@
+/**
+ * \file      noisefloor.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef NOISEFLOOR_H
+#define NOISEFLOOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * \class     NoiseFloorEstimator
+ * \brief     Estimates the noise floor of consecutive power spectra.
+ *
+ * \details   The noise floor is the mean of the bins whose rank, once the
+ *            bins sorted by power, lies between the \a low and \a high
+ *            fractions of the spectrum. A percentile is the special case
+ *            where \a low == \a high, the historical "mean of the lowest
+ *            10%" the case where \a low = 0 and \a high = 0.1.
+ *
+ *            The result is exact but the estimator is incremental: the
+ *            noise floor barely moves from one FFT to the next, so only
+ *            the bins close to the previous cut-off powers get selected,
+ *            the others only get counted or summed. When the cut-offs
+ *            moved out of their bands, the estimator falls back to a
+ *            selection on the whole spectrum and widens the bands.
+ *
+ *            **Thread-safety:** Not thread safe, use one estimator per
+ *            thread and per stream of FFTs.
+ */
+class NoiseFloorEstimator
+{
+private:
+	float _low; ///< The fraction of the bins discarded at the bottom
+	float _high; ///< The fraction of the bins below the upper cut-off
+
+	bool _primed; ///< Are _lowCut and _highCut valid?
+	float _lowCut; ///< The power of the bin at rank low, last time
+	float _highCut; ///< The power of the bin at rank high, last time
+	float _margin; ///< The half-width, in dB, of the bands around the cut-offs
+
+	uint64_t _estimations; ///< The number of estimations done
+	uint64_t _fallbacks; ///< The number of full selections done
+
+	std::vector<float> _scratch; ///< The bins being selected, 2 bands, reused
+
+	float fullSelection(const float *pwr, size_t length,
+			    size_t lowRank, size_t highRank);
+	float twoBands(const float *pwr, size_t length,
+		       size_t lowRank, size_t highRank);
+
+public:
+	/**
+	 * \brief    Create an estimator averaging the bins ranked between
+	 *           \a low and \a high.
+	 *
+	 * \param    low    The fraction of the lowest bins to discard, 0 to 1
+	 * \param    high   The fraction of the bins below the upper cut-off,
+	 *                  \a low to 1
+	 * \return   Nothing.
+	 */
+	NoiseFloorEstimator(float low = 0.0, float high = 0.1);
+
+	/// The mean of the lowest \a fraction of the bins
+	static NoiseFloorEstimator lowestMean(float fraction);
+
+	/// The power below which lies \a percentile (0 to 1) of the bins
+	static NoiseFloorEstimator percentile(float percentile);
+
+	/// The mean of the bins once the lowest \a low and highest \a high discarded
+	static NoiseFloorEstimator trimmedMean(float low, float high);
+
+	float low() const { return _low; }
+	float high() const { return _high; }
+
+	/**
+	 * \brief    Estimate the noise floor of a power spectrum.
+	 *
+	 * \param    pwr      The power of the bins, in dB
+	 * \param    length   The number of bins
+	 * \return   The noise floor, in the unit of \a pwr.
+	 */
+	float estimate(const float *pwr, size_t length);
+
+	/// Forget the previous spectra, the next estimation will be a full one
+	void reset() { _primed = false; }
+
+	/// Returns how many estimations could not use the previous cut-offs
+	uint64_t fallbacks() const { return _fallbacks; }
+
+	/// Returns the number of estimations done so far
+	uint64_t estimations() const { return _estimations; }
+};
+
+#endif // NOISEFLOOR_H
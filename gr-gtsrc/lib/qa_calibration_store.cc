@@ -0,0 +1,241 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_calibration_store.h"
+#include "calibrationstore.h"
+#include "comsdetect.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+
+namespace gr {
+namespace gtsrc {
+
+	/* the power of complex gaussian noise, around level dBm */
+	static void
+	noise(std::vector<float> &pwr, float level)
+	{
+		for (size_t i = 0; i < pwr.size(); i++) {
+			float u = (rand() + 1.0) / (RAND_MAX + 2.0);
+			pwr[i] = level + 10 * log10f(-logf(u));
+		}
+	}
+
+	static void
+	learn(NoiseCalibration &calibration, size_t spectra, float level)
+	{
+		std::vector<float> pwr(calibration.bins());
+		for (size_t s = 0; s < spectra; s++) {
+			noise(pwr, level);
+			calibration.update(pwr.data(), pwr.size());
+		}
+	}
+
+	static std::string
+	tempPath()
+	{
+		char path[] = "/tmp/qa_calibration_store_XXXXXX";
+		int fd = mkstemp(path);
+		CPPUNIT_ASSERT(fd >= 0);
+		close(fd);
+		unlink(path);
+		return path;
+	}
+
+	/* the models of many tunings survive a restart, a torn snapshot is ignored */
+	void
+	qa_calibration_store::t1()
+	{
+		const size_t bins = 64;
+		std::string path = tempPath();
+		CalibrationStore::Config config;
+		config.maxKeys = 100;
+		config.dataSize = 1 << 20;
+
+		srand(3);
+		std::vector<NoiseCalibration::Snapshot> snapshots(50);
+		{
+			CalibrationStore store(path, config);
+			CPPUNIT_ASSERT(store.isOpen());
+
+			for (size_t k = 0; k < snapshots.size(); k++) {
+				NoiseCalibration calibration(4);
+				calibration.reset(bins);
+				learn(calibration, 50 + k, -100.0 + k);
+				calibration.snapshot(snapshots[k]);
+
+				CalibrationStore::Key key(800000000 + k * 1000000, 2000000, 20.0, bins);
+				CPPUNIT_ASSERT(store.save(key, snapshots[k]));
+			}
+			CPPUNIT_ASSERT_EQUAL((size_t)50, store.keyCount());
+		}
+
+		CalibrationStore store(path, config);
+		CPPUNIT_ASSERT(store.isOpen());
+		CPPUNIT_ASSERT_EQUAL((size_t)50, store.keyCount());
+
+		for (size_t k = 0; k < snapshots.size(); k++) {
+			NoiseCalibration::Snapshot loaded;
+			CalibrationStore::Key key(800000000 + k * 1000000, 2000000, 20.0, bins);
+			CPPUNIT_ASSERT(store.load(key, loaded));
+			CPPUNIT_ASSERT_EQUAL(snapshots[k].updates, loaded.updates);
+			CPPUNIT_ASSERT(snapshots[k].mean == loaded.mean);
+			CPPUNIT_ASSERT(snapshots[k].mode == loaded.mode);
+			CPPUNIT_ASSERT(snapshots[k].highQuantile == loaded.highQuantile);
+
+			/* the restored models detect as the saved ones */
+			NoiseCalibration restored(4);
+			restored.reset(bins);
+			CPPUNIT_ASSERT(restored.restore(loaded));
+			CPPUNIT_ASSERT(restored.isReady());
+			for (size_t g = 0; g < loaded.mean.size(); g++)
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(snapshots[k].threshold[g],
+							     restored.threshold(g * 4), 1e-4);
+
+			NoiseCalibration other(8);
+			other.reset(bins);
+			CPPUNIT_ASSERT(!other.restore(loaded));
+		}
+
+		NoiseCalibration::Snapshot loaded;
+		CPPUNIT_ASSERT(!store.load(CalibrationStore::Key(800000000, 2000000, 10.0, bins), loaded));
+		CPPUNIT_ASSERT(!store.load(CalibrationStore::Key(800000000, 2000000, 20.0, 128), loaded));
+
+		/* the newest snapshot is torn, the other one is used */
+		CalibrationStore::Key key(800000000, 2000000, 20.0, bins);
+		NoiseCalibration::Snapshot newer = snapshots[0];
+		newer.updates += 1000;
+		CPPUNIT_ASSERT(store.save(key, newer));
+		CPPUNIT_ASSERT(store.load(key, loaded));
+		CPPUNIT_ASSERT_EQUAL(newer.updates, loaded.updates);
+
+		NoiseCalibration::Snapshot newest = snapshots[0];
+		newest.updates += 2000;
+		CPPUNIT_ASSERT(store.save(key, newest));
+
+		/* the index of 128 keys ends before 12 kB, where the first snapshot
+		 * of the first key is, the newest one now. Its floats are after 40 bytes.
+		 */
+		int fd = open(path.c_str(), O_WRONLY);
+		CPPUNIT_ASSERT(fd >= 0);
+		float garbage = 42.0;
+		CPPUNIT_ASSERT_EQUAL((ssize_t)sizeof(garbage),
+				     pwrite(fd, &garbage, sizeof(garbage), 12288 + 40));
+		close(fd);
+		CPPUNIT_ASSERT(store.load(key, loaded));
+		CPPUNIT_ASSERT_EQUAL(newer.updates, loaded.updates);
+
+		/* the index is full */
+		CalibrationStore::Config small;
+		small.maxKeys = 2;
+		CalibrationStore full(path + ".small", small);
+		CPPUNIT_ASSERT(full.save(CalibrationStore::Key(1), snapshots[0]));
+		CPPUNIT_ASSERT(full.save(CalibrationStore::Key(2), snapshots[0]));
+		CPPUNIT_ASSERT(!full.save(CalibrationStore::Key(3), snapshots[0]));
+		CPPUNIT_ASSERT(full.save(CalibrationStore::Key(1), snapshots[0]));
+
+		/* a damaged header starts the store over */
+		fd = open(path.c_str(), O_WRONLY);
+		CPPUNIT_ASSERT(fd >= 0);
+		CPPUNIT_ASSERT_EQUAL((ssize_t)1, pwrite(fd, "X", 1, 0));
+		close(fd);
+		CalibrationStore over(path, config);
+		CPPUNIT_ASSERT(over.isOpen());
+		CPPUNIT_ASSERT_EQUAL((size_t)0, over.keyCount());
+		CPPUNIT_ASSERT(!over.load(key, loaded));
+
+		unlink(path.c_str());
+		unlink((path + ".small").c_str());
+	}
+
+	/* a detector restarted at the same tuning is ready at once */
+	void
+	qa_calibration_store::t2()
+	{
+		const size_t fftSize = 64;
+		std::string path = tempPath();
+		boost::shared_ptr<CalibrationStore> store = boost::make_shared<CalibrationStore>(path);
+		CalibrationStore::Key band1(900000000, 2000000, 30.0);
+		CalibrationStore::Key band2(2400000000ULL, 2000000, 30.0);
+		std::vector<float> pwr(fftSize);
+
+		ComsDetect::Config config;
+		config.fftSize = fftSize;
+		config.calibrationSaveInterval = 100;
+		ComsDetect detect(config);
+		CPPUNIT_ASSERT(!detect.setCalibrationStore(store, band1));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)fftSize, detect.calibrationKey().fftSize);
+
+		srand(5);
+		for (size_t s = 0; s < 250; s++) {
+			noise(pwr, -90.0);
+			detect.addSpectrum(pwr.data(), fftSize);
+		}
+		CPPUNIT_ASSERT(detect.calibration().isReady());
+		CPPUNIT_ASSERT_EQUAL((size_t)1, store->keyCount());
+
+		/* restored from the save of the 200th spectrum */
+		ComsDetect restarted(config);
+		CPPUNIT_ASSERT(restarted.setCalibrationStore(store, band1));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)200, restarted.calibration().updates());
+
+		/* hopping to another band starts over, and back */
+		CPPUNIT_ASSERT(!restarted.setCalibrationStore(store, band2));
+		CPPUNIT_ASSERT(!restarted.calibration().isReady());
+		for (size_t s = 0; s < 150; s++) {
+			noise(pwr, -70.0);
+			restarted.addSpectrum(pwr.data(), fftSize);
+		}
+		CPPUNIT_ASSERT(restarted.setCalibrationStore(store, band1));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)200, restarted.calibration().updates());
+		CPPUNIT_ASSERT_EQUAL((size_t)2, store->keyCount());
+
+		CPPUNIT_ASSERT(restarted.setCalibrationStore(store, band2));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)150, restarted.calibration().updates());
+		CPPUNIT_ASSERT(restarted.noiseMax(10) > detect.noiseMax(10) + 15);
+
+		/* the models learnt since the last save survive a change of FFT size */
+		for (size_t s = 0; s < 30; s++) {
+			noise(pwr, -70.0);
+			restarted.addSpectrum(pwr.data(), fftSize);
+		}
+		restarted.setFftSize(2 * fftSize);
+		CPPUNIT_ASSERT(!restarted.calibration().isReady());
+		restarted.setFftSize(fftSize);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)180, restarted.calibration().updates());
+
+		/* the slices have their own models */
+		ComsDetect::Config sliceConfig = config;
+		sliceConfig.firstBin = 32;
+		ComsDetect slice(sliceConfig);
+		CPPUNIT_ASSERT(!slice.setCalibrationStore(store, band1));
+
+		unlink(path.c_str());
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
@@ -0,0 +1,297 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_coms_detect.h"
+#include "comsdetect.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread.hpp>
+
+namespace gr {
+namespace gtsrc {
+
+	/* ComsDetect::addFFT's state machine, one bin at a time */
+	struct ReferenceDetect
+	{
+		struct Bin
+		{
+			uint32_t inactiveCnt;
+			uint32_t avgCnt;
+			float avg;
+			float avgSquared;
+			bool active;
+		};
+
+		NoiseCalibration calibration;
+		std::vector<Bin> bins;
+		uint32_t maxTimeout;
+
+		ReferenceDetect(size_t fftSize, uint32_t timeout) :
+			bins(fftSize), maxTimeout(timeout)
+		{
+			memset(&bins[0], 0, fftSize * sizeof(Bin));
+			calibration.reset(fftSize);
+		}
+
+		void addSpectrum(const float *pwr)
+		{
+			calibration.update(pwr, bins.size());
+			if (!calibration.isReady())
+				return;
+
+			for (size_t i = 0; i < bins.size(); i++) {
+				Bin *lt = &bins[i];
+				float threshold = calibration.threshold(i);
+
+				if (pwr[i] > threshold) {
+					lt->inactiveCnt = 0;
+					lt->active = true;
+				}
+
+				if (lt->active) {
+					lt->avg += pwr[i];
+					lt->avgSquared += pwr[i] * pwr[i];
+					lt->avgCnt++;
+					if (lt->avgCnt > 1000) {
+						lt->avgCnt /= 2;
+						lt->avg /= 2;
+					}
+
+					if (pwr[i] < threshold) {
+						lt->inactiveCnt++;
+						if (lt->inactiveCnt >= maxTimeout) {
+							lt->avg = 0;
+							lt->avgCnt = 0;
+							lt->active = false;
+						}
+					}
+				}
+			}
+		}
+	};
+
+	/* gumbel-like noise around -100 dB, plus bursts of various lengths
+	 * and powers switching on and off as the frames go.
+	 */
+	static void
+	noisySpectrum(std::vector<float> &pwr, size_t f)
+	{
+		for (size_t i = 0; i < pwr.size(); i++) {
+			float u = (rand() + 1.0) / (RAND_MAX + 2.0);
+			pwr[i] = -100.0 - 2.0 * logf(-logf(u));
+		}
+
+		for (size_t b = 0; b < 8; b++) {
+			size_t start = (100 + b * 110) * pwr.size() / 1024;
+			if ((f / (20 + b * 13)) % 3 == 0)
+				for (size_t i = start; i < start + 10 + b * 5; i++)
+					pwr[i] += 10.0 + 5 * b;
+		}
+	}
+
+	/* runs a detector over frames, in its own thread */
+	struct DetectRun
+	{
+		ComsDetect *detect;
+		const std::vector< std::vector<float> > *frames;
+
+		void operator()()
+		{
+			for (size_t f = 0; f < frames->size(); f++)
+				detect->addSpectrum((*frames)[f].data(), (*frames)[f].size());
+		}
+	};
+
+	static bool
+	sameFloat(float a, float b)
+	{
+		return memcmp(&a, &b, sizeof(float)) == 0;
+	}
+
+	/* noise plus transmissions switching on and off on a few bands, the
+	 * vectorized detection must match the per-bin reference bit for bit.
+	 */
+	void
+	qa_coms_detect::t1()
+	{
+		const uint16_t fftSize = 1024;
+
+		ComsDetect::Config config;
+		config.fftSize = fftSize;
+		ComsDetect detect(config);
+
+		/* find the timeout used by the detection, it is private */
+		uint32_t timeout = 0;
+		{
+			std::vector<float> pwr(fftSize, -200.0);
+			std::vector<float> loud(fftSize, 0.0);
+
+			for (size_t f = 0; f < 200; f++)
+				detect.addSpectrum(pwr.data(), fftSize);
+			detect.addSpectrum(loud.data(), fftSize);
+			while (detect.isBinActive(0) && timeout < 100000) {
+				detect.addSpectrum(pwr.data(), fftSize);
+				timeout++;
+			}
+			detect.setFftSize(fftSize);
+		}
+
+		ReferenceDetect ref(fftSize, timeout);
+		std::vector<float> pwr(fftSize);
+
+		srand(1);
+		for (size_t f = 0; f < 3000; f++) {
+			noisySpectrum(pwr, f);
+
+			/* exact threshold values and non-numbers */
+			if (f % 100 == 50) {
+				pwr[7] = detect.noiseMax(7);
+				pwr[900] = NAN;
+			}
+
+			detect.addSpectrum(pwr.data(), fftSize);
+			ref.addSpectrum(pwr.data());
+
+			for (size_t i = 0; i < fftSize; i++) {
+				const ReferenceDetect::Bin &b = ref.bins[i];
+				float modelMean = ref.calibration.modelMean(i);
+				CPPUNIT_ASSERT_EQUAL(b.active, detect.isBinActive(i));
+				CPPUNIT_ASSERT(sameFloat(ref.calibration.threshold(i), detect.noiseMax(i)));
+
+				float avg = b.avgCnt > 0 ? b.avg / b.avgCnt : modelMean;
+				if (avg < modelMean)
+					avg = modelMean;
+				CPPUNIT_ASSERT(sameFloat(avg, detect.avgPowerAtBin(i)));
+
+				float variance = (b.avgSquared - (b.avg * b.avg)) / b.avgCnt;
+				CPPUNIT_ASSERT(sameFloat(variance, detect.varianceAtBin(i)));
+			}
+		}
+	}
+
+	/* the same bins of two detectors are in the same state */
+	static void
+	assertSameBins(const ComsDetect &a, const ComsDetect &b,
+		       size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++) {
+			CPPUNIT_ASSERT_EQUAL(a.isBinActive(i), b.isBinActive(i));
+			CPPUNIT_ASSERT(sameFloat(a.noiseMax(i), b.noiseMax(i)));
+			CPPUNIT_ASSERT(sameFloat(a.avgPowerAtBin(i), b.avgPowerAtBin(i)));
+		}
+	}
+
+	/* four independent detectors, with their own parameters, run
+	 * concurrently as they would in four hachoir_c blocks.
+	 */
+	void
+	qa_coms_detect::t2()
+	{
+		const uint16_t fftSizes[4] = { 512, 1024, 2048, 1000 };
+		std::vector< std::vector< std::vector<float> > > frames(4);
+		std::vector<ComsDetect::Config> configs(4);
+		boost::ptr_vector<ComsDetect> detects;
+
+		srand(2);
+		for (size_t d = 0; d < 4; d++) {
+			frames[d].resize(600, std::vector<float>(fftSizes[d]));
+			for (size_t f = 0; f < frames[d].size(); f++)
+				noisySpectrum(frames[d][f], f);
+
+			configs[d].fftSize = fftSizes[d];
+			configs[d].comMinSNR = 3 * d;
+			detects.push_back(new ComsDetect(configs[d]));
+		}
+
+		boost::thread_group threads;
+		for (size_t d = 0; d < 4; d++) {
+			DetectRun run = { &detects[d], &frames[d] };
+			threads.create_thread(run);
+		}
+		threads.join_all();
+
+		for (size_t d = 0; d < 4; d++) {
+			ComsDetect alone(configs[d]);
+			DetectRun run = { &alone, &frames[d] };
+			run();
+
+			CPPUNIT_ASSERT_EQUAL(fftSizes[d], detects[d].fftSize());
+			assertSameBins(alone, detects[d], 0, fftSizes[d]);
+		}
+	}
+
+	/* a spectrum split in four slices detected by four threads gives the
+	 * same result as a single detector.
+	 */
+	void
+	qa_coms_detect::t3()
+	{
+		ComsDetect::Config config;
+		config.fftSize = 4096;
+
+		std::vector<ComsDetect::Config> slices = ComsDetect::partition(config, 4);
+		CPPUNIT_ASSERT_EQUAL((size_t)4, slices.size());
+
+		size_t end = 0;
+		for (size_t s = 0; s < slices.size(); s++) {
+			CPPUNIT_ASSERT_EQUAL(end, (size_t)slices[s].firstBin);
+			end += slices[s].binCount;
+		}
+		CPPUNIT_ASSERT_EQUAL((size_t)config.fftSize, end);
+
+		std::vector< std::vector<float> > frames(600, std::vector<float>(config.fftSize));
+		srand(3);
+		for (size_t f = 0; f < frames.size(); f++)
+			noisySpectrum(frames[f], f);
+
+		boost::ptr_vector<ComsDetect> detects;
+		boost::thread_group threads;
+		for (size_t s = 0; s < slices.size(); s++) {
+			detects.push_back(new ComsDetect(slices[s]));
+			DetectRun run = { &detects[s], &frames };
+			threads.create_thread(run);
+		}
+		threads.join_all();
+
+		ComsDetect whole(config);
+		DetectRun run = { &whole, &frames };
+		run();
+
+		size_t active = 0;
+		for (size_t s = 0; s < slices.size(); s++) {
+			const ComsDetect &d = detects[s];
+			CPPUNIT_ASSERT(d.hasBin(slices[s].firstBin));
+			CPPUNIT_ASSERT(!d.hasBin(d.endBin()));
+			assertSameBins(whole, d, d.firstBin(), d.endBin());
+			for (size_t i = d.firstBin(); i < d.endBin(); i++)
+				active += d.isBinActive(i);
+		}
+		CPPUNIT_ASSERT(active > 0);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
@@ -0,0 +1,171 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_fft_average.h"
+#include "fftaverage.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <stdlib.h>
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	/* noise around floor dB */
+	static void
+	spectrum(std::vector<float> &pwr, float floor)
+	{
+		for (size_t i = 0; i < pwr.size(); i++)
+			pwr[i] = floor + i * 0.5 + 6.0 * rand() / RAND_MAX;
+	}
+
+	/* the mean and the variance of bin i over frames [begin, end) */
+	static void
+	reference(const std::vector< std::vector<float> > &frames, size_t begin,
+		  size_t end, size_t i, double &mean, double &variance)
+	{
+		mean = 0;
+		for (size_t f = begin; f < end; f++)
+			mean += frames[f][i];
+		mean /= end - begin;
+
+		variance = 0;
+		for (size_t f = begin; f < end; f++)
+			variance += (frames[f][i] - mean) * (frames[f][i] - mean);
+		variance /= end - begin;
+	}
+
+	/* a sliding window fitting in the budget is exact */
+	void
+	qa_fft_average::t1()
+	{
+		const size_t bins = 16;
+		std::vector< std::vector<float> > frames(200, std::vector<float>(bins));
+		FftAverage avr(bins, 940000000, 8000000, 25);
+
+		CPPUNIT_ASSERT_EQUAL((size_t)1, avr.blockSize());
+
+		srand(42);
+		for (size_t f = 0; f < frames.size(); f++) {
+			spectrum(frames[f], -100.0 + 0.1 * f);
+			avr.addFft(frames[f].data(), 1000 * f);
+
+			size_t begin = f + 1 > 25 ? f + 1 - 25 : 0;
+			CPPUNIT_ASSERT_EQUAL(f + 1 - begin, avr.currentAverageCount());
+			CPPUNIT_ASSERT_EQUAL((uint64_t)(1000 * begin), avr.time_ns());
+			CPPUNIT_ASSERT_EQUAL((uint64_t)(1000 * (f - begin)), avr.span_ns());
+
+			for (size_t i = 0; i < bins; i++) {
+				double mean, variance;
+				reference(frames, begin, f + 1, i, mean, variance);
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(mean, avr[i], 1e-3);
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(mean, avr.meanAt(i), 1e-3);
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(variance, avr.varianceAt(i), 1e-2);
+			}
+			CPPUNIT_ASSERT_EQUAL(avr.bins()[3], avr[3]);
+		}
+
+		avr.reset();
+		CPPUNIT_ASSERT_EQUAL((size_t)0, avr.currentAverageCount());
+		CPPUNIT_ASSERT_EQUAL(0.0f, avr[0]);
+		CPPUNIT_ASSERT_EQUAL(0.0f, avr.varianceAt(0));
+	}
+
+	/* past the budget, the window slides by blocks of FFTs */
+	void
+	qa_fft_average::t2()
+	{
+		const size_t bins = 64;
+		std::vector< std::vector<float> > frames(500, std::vector<float>(bins));
+
+		FftAverage::Config config;
+		config.average = 100;
+		config.memoryBudget = 10 * 2 * bins * sizeof(float);
+		FftAverage avr(bins, 940000000, 8000000, config);
+
+		CPPUNIT_ASSERT_EQUAL((size_t)10, avr.blockSize());
+		CPPUNIT_ASSERT(avr.memoryUsage() <= config.memoryBudget + bins * 32 + 10 * 8);
+
+		srand(7);
+		for (size_t f = 0; f < frames.size(); f++) {
+			spectrum(frames[f], -100.0 + 0.05 * f);
+			avr.addFft(frames[f].data(), 1000 * f);
+
+			size_t count = avr.currentAverageCount();
+			CPPUNIT_ASSERT(count <= 100 && count <= f + 1);
+			CPPUNIT_ASSERT(count >= 91 || count == f + 1);
+			CPPUNIT_ASSERT_EQUAL((uint64_t)(1000 * (f + 1 - count)), avr.time_ns());
+
+			for (size_t i = 0; i < bins; i += 7) {
+				double mean, variance;
+				reference(frames, f + 1 - count, f + 1, i, mean, variance);
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(mean, avr[i], 1e-3);
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(variance, avr.varianceAt(i), 1e-2);
+			}
+		}
+
+		/* the thermal noise calibration window, 8192 bins x 500k FFTs */
+		config.average = 500000;
+		config.memoryBudget = 64 << 20;
+		FftAverage calibration(8192, 940000000, 8000000, config);
+		CPPUNIT_ASSERT(calibration.blockSize() > 1);
+		CPPUNIT_ASSERT(calibration.memoryUsage() < config.memoryBudget + (1 << 20));
+	}
+
+	/* exponential averaging: exact until the window is full, then forgets */
+	void
+	qa_fft_average::t3()
+	{
+		const size_t bins = 8;
+		std::vector< std::vector<float> > frames(600, std::vector<float>(bins));
+
+		FftAverage::Config config;
+		config.mode = FftAverage::EXPONENTIAL;
+		config.average = 50;
+		FftAverage avr(bins, 940000000, 8000000, config);
+
+		srand(3);
+		for (size_t f = 0; f < 50; f++) {
+			spectrum(frames[f], -100.0);
+			avr.addFft(frames[f].data(), 1000 * f);
+
+			for (size_t i = 0; i < bins; i++) {
+				double mean, variance;
+				reference(frames, 0, f + 1, i, mean, variance);
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(mean, avr[i], 1e-3);
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(variance, avr.varianceAt(i), 1e-2);
+			}
+		}
+
+		/* a step of 20 dB is followed with a time constant of 50 FFTs */
+		for (size_t f = 50; f < frames.size(); f++) {
+			spectrum(frames[f], -80.0);
+			avr.addFft(frames[f].data(), 1000 * f);
+		}
+		CPPUNIT_ASSERT_EQUAL((size_t)50, avr.currentAverageCount());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)0, avr.time_ns());
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(-80.0 + 3.0, avr[0], 0.5);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(3.0, avr.varianceAt(0), 1.5);
+		CPPUNIT_ASSERT(avr.memoryUsage() < 1024);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
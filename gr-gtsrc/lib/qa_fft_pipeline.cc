@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_fft_pipeline.h"
+#include "fftpipeline.h"
+
+#include <cppunit/TestAssert.h>
+#include <boost/make_shared.hpp>
+
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	/* the batches must come out in time order and, once the pipeline is
+	 * stopped, the cursor must point right after the last consumed frame.
+	 */
+	void
+	qa_fft_pipeline::t1()
+	{
+		const uint16_t fftSize = 256;
+		const size_t batchCount = 4;
+		const float overlap = 0.5;
+
+		SamplesRingBuffer ring(1 << 18);
+		boost::shared_ptr<const FftWindow> win = boost::make_shared<FftWindow>(fftSize, gr::filter::firdes::WIN_HANN);
+		std::vector<gr_complex> chunk(4096, gr_complex(0.5, -0.5));
+
+		while (ring.head() + chunk.size() < ring.ringLength()) {
+			uint64_t pos = ring.addSamples(chunk.data(), chunk.size());
+			RBMarker m = { 940000000, 8000000, pos * 125 };
+			ring.addMarker(m, pos);
+			ring.validateWrite();
+		}
+
+		SamplesRingBuffer::Cursor *cursor = ring.registerCursor("qa");
+		cursor->setPosition(ring.tail());
+
+		size_t hop = Fft::hopSize(fftSize, overlap);
+		uint64_t expected = ring.tail();
+		std::vector<FftPtr> ffts;
+
+		FftPipeline pipeline(ring, *cursor, win, batchCount, overlap, 4);
+		CPPUNIT_ASSERT_EQUAL(hop, pipeline.hopSize());
+
+		for (size_t b = 0; b < 100; b++) {
+			CPPUNIT_ASSERT(pipeline.next(ffts));
+			CPPUNIT_ASSERT_EQUAL(batchCount, ffts.size());
+
+			for (size_t i = 0; i < ffts.size(); i++) {
+				CPPUNIT_ASSERT_EQUAL(expected, ffts[i]->ringBufferStartPos());
+				expected += hop;
+			}
+		}
+
+		pipeline.stop();
+		CPPUNIT_ASSERT(!pipeline.next(ffts));
+		CPPUNIT_ASSERT_EQUAL(expected, cursor->position());
+
+		uint64_t total = 0;
+		std::vector<FftPipeline::WorkerStatistics> stats = pipeline.workersStatistics();
+		CPPUNIT_ASSERT_EQUAL((size_t)4, stats.size());
+		for (size_t i = 0; i < stats.size(); i++)
+			total += stats[i].fftCount;
+		CPPUNIT_ASSERT(total >= 100 * batchCount);
+
+		ring.unregisterCursor(cursor);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
@@ -0,0 +1,122 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_fft_plan_cache.h"
+#include "fftplancache.h"
+#include "fftbatch.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <complex>
+
+namespace gr {
+namespace gtsrc {
+
+	/* the bin of the highest power of the first FFT of the batch */
+	static size_t
+	peak(const FftBatch &batch)
+	{
+		size_t best = 0;
+		for (size_t i = 1; i < batch.fftSize(); i++)
+			if (std::norm(batch.outbuf()[i]) > std::norm(batch.outbuf()[best]))
+				best = i;
+		return best;
+	}
+
+	static void
+	tone(FftBatch &batch, size_t bin)
+	{
+		for (size_t i = 0; i < batch.fftSize(); i++) {
+			float phase = 2 * M_PI * bin * i / batch.fftSize();
+			batch.inbuf()[i] = gr_complex(cosf(phase), sinf(phase));
+		}
+	}
+
+	/* the windows and the plans are made once, the batches share them */
+	void
+	qa_fft_plan_cache::t1()
+	{
+		FftPlanCache &cache = FftPlanCache::instance();
+		size_t windows = cache.windowCount();
+
+		boost::shared_ptr<const FftWindow> a = cache.window(64, gr::filter::firdes::WIN_HANN);
+		boost::shared_ptr<const FftWindow> b = cache.window(64, gr::filter::firdes::WIN_HANN);
+		boost::shared_ptr<const FftWindow> c = cache.window(64, gr::filter::firdes::WIN_BLACKMAN_hARRIS);
+		boost::shared_ptr<const FftWindow> d = cache.window(128, gr::filter::firdes::WIN_HANN);
+		CPPUNIT_ASSERT(a == b);
+		CPPUNIT_ASSERT(a != c && a != d);
+		CPPUNIT_ASSERT_EQUAL(windows + 3, cache.windowCount());
+
+		FftWindow fresh(64, gr::filter::firdes::WIN_HANN);
+		CPPUNIT_ASSERT_EQUAL(fresh.windowPower(), a->windowPower());
+		CPPUNIT_ASSERT_EQUAL((uint16_t)64, a->fftSize());
+		CPPUNIT_ASSERT_EQUAL(gr::filter::firdes::WIN_HANN, a->windowType());
+
+		size_t plans = cache.planCount();
+		fftwf_plan plan = cache.plan(32, 4);
+		CPPUNIT_ASSERT(plan != NULL);
+		CPPUNIT_ASSERT(plan == cache.plan(32, 4));
+		CPPUNIT_ASSERT(plan != cache.plan(32, 2));
+		CPPUNIT_ASSERT_EQUAL(plans + 2, cache.planCount());
+
+		/* the batches of the same size transform their own arrays */
+		FftBatch first(32, 4), second(32, 4);
+		CPPUNIT_ASSERT_EQUAL(plans + 2, cache.planCount());
+		tone(first, 3);
+		tone(second, 5);
+		second.execute();
+		first.execute();
+		CPPUNIT_ASSERT_EQUAL((size_t)3, peak(first));
+		CPPUNIT_ASSERT_EQUAL((size_t)5, peak(second));
+	}
+
+	/* the wisdom is written by every new plan */
+	void
+	qa_fft_plan_cache::t2()
+	{
+		FftPlanCache &cache = FftPlanCache::instance();
+		char path[] = "/tmp/qa_fft_plan_cache_XXXXXX";
+		int fd = mkstemp(path);
+		CPPUNIT_ASSERT(fd >= 0);
+		close(fd);
+		unlink(path);
+
+		cache.setWisdomPath(path);
+		CPPUNIT_ASSERT(cache.wisdomPath() == path);
+		CPPUNIT_ASSERT(cache.plan(48, 1) != NULL);
+		CPPUNIT_ASSERT_EQUAL(0, access(path, R_OK));
+
+		/* no new plan, no new wisdom */
+		unlink(path);
+		CPPUNIT_ASSERT(cache.plan(48, 1) != NULL);
+		CPPUNIT_ASSERT(access(path, R_OK) != 0);
+
+		CPPUNIT_ASSERT(cache.plan(96, 1) != NULL);
+		CPPUNIT_ASSERT_EQUAL(0, access(path, R_OK));
+
+		cache.setWisdomPath("");
+		unlink(path);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
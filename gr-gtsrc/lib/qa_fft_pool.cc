@@ -0,0 +1,127 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "qa_fft_pool.h"
+#include "fft.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	/* FFTs go back to the pool when their last reference is dropped */
+	void
+	qa_fft_pool::t1()
+	{
+		FftPool pool(256, 2);
+		CPPUNIT_ASSERT_EQUAL((size_t)2, pool.capacity());
+		CPPUNIT_ASSERT_EQUAL((size_t)2, pool.available());
+
+		{
+			FftPtr a = pool.get(940000000, 8000000);
+			FftPtr b = pool.get(940000000, 8000000);
+			FftPtr c = a;
+			CPPUNIT_ASSERT_EQUAL((size_t)0, pool.available());
+			CPPUNIT_ASSERT_EQUAL((uint16_t)256, a->fftSize());
+			CPPUNIT_ASSERT_EQUAL((uint64_t)940000000, b->centralFrequency());
+
+			a.reset();
+			CPPUNIT_ASSERT_EQUAL((size_t)0, pool.available());
+			c.reset();
+			CPPUNIT_ASSERT_EQUAL((size_t)1, pool.available());
+
+			/* the pool grows when it runs dry */
+			FftPtr d = pool.get(940000000, 8000000);
+			FftPtr e = pool.get(940000000, 8000000);
+			CPPUNIT_ASSERT(pool.capacity() > 2);
+		}
+		CPPUNIT_ASSERT_EQUAL(pool.capacity(), pool.available());
+
+		/* FFTs outliving their pool are deleted on their last release */
+		FftPtr orphan;
+		{
+			FftPool shortLived(256, 1);
+			orphan = shortLived.get(940000000, 8000000);
+		}
+		orphan.reset();
+	}
+
+	/* the frames take their tuning from the markers, those crossing a retune are dropped */
+	void
+	qa_fft_pool::t2()
+	{
+		const uint16_t fftSize = 256;
+		const size_t count = 8;
+		const size_t packet = 300;
+		const uint64_t t0 = 1000000000, t1 = 2000000000;
+
+		SamplesRingBuffer ring(1 << 16);
+		std::vector<gr_complex> samples(packet, gr_complex(1, 0));
+
+		/* 3 packets at 940 MHz, 8 MS/s, then a retune to 950 MHz, 4 MS/s at 900 */
+		for (size_t p = 0; p < 9; p++) {
+			uint64_t pos = ring.addSamples(samples.data(), samples.size());
+			RBMarker a = { 940000000, 8000000, t0 + pos * 125 };
+			RBMarker b = { 950000000, 4000000, t1 + (pos - 900) * 250 };
+			ring.addMarker(p < 3 ? a : b, pos);
+			ring.validateWrite();
+		}
+
+		uint64_t changePos;
+		RBMarker marker;
+		uint64_t markerPos;
+		CPPUNIT_ASSERT(ring.findNextMarker(300, &marker, &markerPos));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)600, markerPos);
+		CPPUNIT_ASSERT(ring.findMarker(512, &marker, &markerPos));
+		CPPUNIT_ASSERT(!ring.findTuningChange(512, fftSize, marker, &changePos));
+		CPPUNIT_ASSERT(ring.findTuningChange(768, fftSize, marker, &changePos));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)900, changePos);
+
+		FftWindow win(fftSize, gr::filter::firdes::WIN_BLACKMAN_HARRIS);
+		FftBatch batch(fftSize, count);
+		FftPool pool(fftSize, count);
+		std::vector<FftPtr> ffts;
+		uint64_t pos = ring.tail();
+		CPPUNIT_ASSERT(Fft::fromRingBatch(batch, pool, win, ring, pos,
+						  0.0, ffts));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)(count * fftSize), pos);
+
+		/* the frame at 768 crosses the retune */
+		CPPUNIT_ASSERT_EQUAL(count - 1, ffts.size());
+		for (size_t k = 0; k < ffts.size(); k++) {
+			uint64_t start = ffts[k]->ringBufferStartPos();
+			CPPUNIT_ASSERT(start != 768);
+			if (start < 900) {
+				CPPUNIT_ASSERT_EQUAL((uint64_t)940000000, ffts[k]->centralFrequency());
+				CPPUNIT_ASSERT_EQUAL((uint64_t)8000000, ffts[k]->sampleRate());
+				CPPUNIT_ASSERT_EQUAL(t0 + start * 125, ffts[k]->time_ns());
+			} else {
+				CPPUNIT_ASSERT_EQUAL((uint64_t)950000000, ffts[k]->centralFrequency());
+				CPPUNIT_ASSERT_EQUAL((uint64_t)4000000, ffts[k]->sampleRate());
+				CPPUNIT_ASSERT_EQUAL(t1 + (start - 900) * 250, ffts[k]->time_ns());
+			}
+		}
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
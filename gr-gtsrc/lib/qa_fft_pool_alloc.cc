@@ -0,0 +1,124 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_fft_pool_alloc.h"
+#include "fft.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include <vector>
+
+/* counting allocator: every allocation of this test binary goes through it,
+ * which is why it is kept apart from test-gtsrc.
+ * Not inlined, gcc would otherwise pair the malloc with a delete.
+ */
+static std::atomic<size_t> allocationCount(0);
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+__attribute__((noinline)) void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void *ptr) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+namespace gr {
+namespace gtsrc {
+
+	/* steady-state FFT computation does not touch the heap */
+	void
+	qa_fft_pool_alloc::t1()
+	{
+		const uint16_t fftSize = 1024;
+		const size_t count = 8;
+		const size_t iterations = 100;
+
+		SamplesRingBuffer ring(1 << 21);
+		std::vector<gr_complex> samples(4096);
+		for (size_t i = 0; i < samples.size(); i++)
+			samples[i] = gr_complex(cosf(i * 0.1), sinf(i * 0.1));
+		while (ring.head() <= (iterations + 2) * count * fftSize) {
+			uint64_t pos = ring.addSamples(samples.data(), samples.size());
+			RBMarker m = { 940000000, 8000000, pos * 125 };
+			ring.addMarker(m, pos);
+			ring.validateWrite();
+		}
+
+		FftWindow win(fftSize, gr::filter::firdes::WIN_BLACKMAN_HARRIS);
+		FftBatch batch(fftSize, count);
+		FftPool pool(fftSize, 2 * count);
+		std::vector<FftPtr> ffts;
+		ffts.reserve(count);
+		uint64_t pos = ring.tail();
+		float noiseFloor = 0;
+
+		/* warm up: the per-thread scratch buffers get allocated */
+		for (size_t i = 0; i < 2; i++) {
+			CPPUNIT_ASSERT(Fft::fromRingBatch(batch, pool, win, ring, pos,
+							  0.0, ffts));
+			noiseFloor += ffts[0]->noiseFloor();
+		}
+
+		size_t before = allocationCount.load();
+		for (size_t i = 0; i < iterations; i++) {
+			CPPUNIT_ASSERT(Fft::fromRingBatch(batch, pool, win, ring, pos,
+							  0.0, ffts));
+			for (size_t k = 0; k < ffts.size(); k++)
+				noiseFloor += ffts[k]->noiseFloor();
+		}
+		size_t after = allocationCount.load();
+
+		CPPUNIT_ASSERT_EQUAL((size_t)0, after - before);
+		CPPUNIT_ASSERT_EQUAL(2 * count, pool.capacity());
+		CPPUNIT_ASSERT(noiseFloor != 0);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
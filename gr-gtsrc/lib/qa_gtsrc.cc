@@ -27,12 +27,44 @@
 
 #include "qa_gtsrc.h"
 #include "qa_hachoir_c.h"
+#include "qa_fft_pool.h"
+#include "qa_fft_pipeline.h"
+#include "qa_noise_floor.h"
+#include "qa_coms_detect.h"
+#include "qa_noise_calibration.h"
+#include "qa_transmission_extractor.h"
+#include "qa_radio_event_table.h"
+#include "qa_sensing_server.h"
+#include "qa_spectrum_shm.h"
+#include "qa_spectrum_decimator.h"
+#include "qa_fft_average.h"
+#include "qa_thermal_calibration.h"
+#include "qa_calibration_store.h"
+#include "qa_fft_plan_cache.h"
+#include "qa_ring_buffer.h"
+#include "qa_spectrum_kernels.h"
 
 CppUnit::TestSuite *
 qa_gtsrc::suite()
 {
   CppUnit::TestSuite *s = new CppUnit::TestSuite("gtsrc");
   s->addTest(gr::gtsrc::qa_hachoir_c::suite());
+  s->addTest(gr::gtsrc::qa_fft_pool::suite());
+  s->addTest(gr::gtsrc::qa_fft_pipeline::suite());
+  s->addTest(gr::gtsrc::qa_noise_floor::suite());
+  s->addTest(gr::gtsrc::qa_coms_detect::suite());
+  s->addTest(gr::gtsrc::qa_noise_calibration::suite());
+  s->addTest(gr::gtsrc::qa_transmission_extractor::suite());
+  s->addTest(gr::gtsrc::qa_radio_event_table::suite());
+  s->addTest(gr::gtsrc::qa_sensing_server::suite());
+  s->addTest(gr::gtsrc::qa_spectrum_shm::suite());
+  s->addTest(gr::gtsrc::qa_spectrum_decimator::suite());
+  s->addTest(gr::gtsrc::qa_fft_average::suite());
+  s->addTest(gr::gtsrc::qa_thermal_calibration::suite());
+  s->addTest(gr::gtsrc::qa_calibration_store::suite());
+  s->addTest(gr::gtsrc::qa_fft_plan_cache::suite());
+  s->addTest(gr::gtsrc::qa_ring_buffer::suite());
+  s->addTest(gr::gtsrc::qa_spectrum_kernels::suite());
 
   return s;
 }
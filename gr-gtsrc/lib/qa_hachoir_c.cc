@@ -54,6 +54,24 @@ namespace gtsrc {
 		topblock->run();
 	}
 
+	/* two blocks in one flowgraph get their own port and shared memory */
+	void
+	qa_hachoir_c::t2()
+	{
+		hachoir_c::sptr first = hachoir_c::make(940000000, 8000000, 1024, 1);
+		hachoir_c::sptr second = hachoir_c::make(945000000, 8000000, 1024, 1);
+		CPPUNIT_ASSERT(first);
+		CPPUNIT_ASSERT(second);
+		CPPUNIT_ASSERT(first->server_port() != second->server_port());
+
+		/* the number of a destroyed block goes to the next one */
+		uint16_t port = second->server_port();
+		second.reset();
+		second = hachoir_c::make(950000000, 8000000, 1024, 1);
+		CPPUNIT_ASSERT(second);
+		CPPUNIT_ASSERT_EQUAL(port, second->server_port());
+	}
+
 } /* namespace gtsrc */
 } /* namespace gr */
 
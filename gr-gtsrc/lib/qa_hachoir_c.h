@@ -32,11 +32,13 @@ namespace gr {
     {
     public:
       CPPUNIT_TEST_SUITE(qa_hachoir_c);
+      CPPUNIT_TEST(t2); // before t1, which streams its file forever
       CPPUNIT_TEST(t1);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void t1();
+      void t2();
     };
 
   } /* namespace gtsrc */
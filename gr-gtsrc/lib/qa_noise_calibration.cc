@@ -0,0 +1,125 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "qa_noise_calibration.h"
+#include "noisecalibration.h"
+#include "sw_radio_params.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	/* noise following the model of sw_radio_params.h, its model mean at floor */
+	static void
+	modelNoise(std::vector<float> &pwr, float floor)
+	{
+		for (size_t i = 0; i < pwr.size(); i++) {
+			float u = (rand() + 1.0) / (RAND_MAX + 2.0);
+			pwr[i] = floor + NOISE_MU + NOISE_SIGMA * logf(-logf(u));
+		}
+	}
+
+	/* every bin learns its own floor, despite the transmissions */
+	void
+	qa_noise_calibration::t1()
+	{
+		const size_t bins = 256;
+		NoiseCalibration calibration;
+		std::vector<float> pwr(bins);
+
+		calibration.reset(bins);
+		CPPUNIT_ASSERT(!calibration.update(pwr.data(), bins - 1));
+
+		srand(1);
+		for (size_t f = 0; f < 5000; f++) {
+			CPPUNIT_ASSERT_EQUAL(f >= 100, calibration.isReady());
+
+			modelNoise(pwr, -100.0);
+			for (size_t i = 0; i < bins; i++)
+				pwr[i] += i / 16;
+
+			/* a transmission 30 dB above the noise, 10% of the time */
+			if (f % 10 == 0)
+				for (size_t i = 100; i < 120; i++)
+					pwr[i] += 30.0;
+
+			CPPUNIT_ASSERT(calibration.update(pwr.data(), bins));
+		}
+
+		float highQuantile = NOISE_MU + NOISE_SIGMA * logf(-logf(1 - 0.99));
+		for (size_t i = 0; i < bins; i++) {
+			float floor = -100.0 + i / 16;
+			CPPUNIT_ASSERT_DOUBLES_EQUAL(floor, calibration.modelMean(i), 1.0);
+			CPPUNIT_ASSERT_DOUBLES_EQUAL(floor + NOISE_MU, calibration.mode(i), 1.0);
+			CPPUNIT_ASSERT_DOUBLES_EQUAL(calibration.modelMean(i) + 14.0,
+						     calibration.threshold(i), 1e-3);
+			if (i < 100 || i >= 120)
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(floor + highQuantile,
+							     calibration.highQuantile(i), 2.0);
+		}
+	}
+
+	/* the memory budget, the forgetting and the snapshots */
+	void
+	qa_noise_calibration::t2()
+	{
+		const size_t bins = 1000;
+		NoiseCalibration calibration(1, 1.0 / 256, 0.99, 100, 16);
+		std::vector<float> pwr(bins);
+
+		calibration.reset(bins);
+		CPPUNIT_ASSERT_EQUAL((size_t)64, calibration.groupSize());
+		CPPUNIT_ASSERT_EQUAL((size_t)16, calibration.groupCount());
+
+		/* the noise rises by 10 dB, the model must follow it */
+		srand(2);
+		for (size_t f = 0; f < 3000; f++) {
+			modelNoise(pwr, f < 1000 ? -100.0 : -90.0);
+			calibration.update(pwr.data(), bins);
+		}
+		for (size_t i = 0; i < bins; i++)
+			CPPUNIT_ASSERT_DOUBLES_EQUAL(-90.0, calibration.modelMean(i), 1.0);
+
+		NoiseCalibration::Snapshot snapshot;
+		calibration.snapshot(snapshot);
+		CPPUNIT_ASSERT(snapshot.ready);
+		CPPUNIT_ASSERT_EQUAL(bins, snapshot.bins);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)3000, snapshot.updates);
+		CPPUNIT_ASSERT_EQUAL((size_t)16, snapshot.threshold.size());
+		for (size_t g = 0; g < snapshot.threshold.size(); g++) {
+			CPPUNIT_ASSERT_EQUAL(calibration.threshold(g * 64), snapshot.threshold[g]);
+			CPPUNIT_ASSERT_EQUAL(calibration.mode(g * 64), snapshot.mode[g]);
+		}
+
+		/* changing the parameters starts over */
+		calibration.setParams(128, 1.0 / 1024);
+		CPPUNIT_ASSERT_EQUAL((size_t)8, calibration.groupCount());
+		CPPUNIT_ASSERT(!calibration.isReady());
+		CPPUNIT_ASSERT(isinf(calibration.threshold(0)));
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
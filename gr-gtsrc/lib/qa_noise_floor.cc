@@ -0,0 +1,117 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_noise_floor.h"
+#include "noisefloor.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	/* the mean of the bins of ranks [low * n, high * n), sorting everything */
+	static float
+	reference(const std::vector<float> &pwr, float low, float high)
+	{
+		std::vector<float> sorted(pwr);
+		std::sort(sorted.begin(), sorted.end());
+
+		size_t l = std::min((size_t)(low * sorted.size()), sorted.size() - 1);
+		size_t h = std::min(std::max((size_t)(high * sorted.size()), l + 1),
+				    sorted.size());
+
+		float sum = 0;
+		for (size_t i = l; i < h; i++)
+			sum += sorted[i];
+		return sum / (h - l);
+	}
+
+	/* a noise floor around floor dB plus a few transmissions */
+	static void
+	spectrum(std::vector<float> &pwr, float floor)
+	{
+		for (size_t i = 0; i < pwr.size(); i++)
+			pwr[i] = floor + 6.0 * rand() / RAND_MAX;
+		for (size_t i = pwr.size() / 3; i < pwr.size() / 3 + 200; i++)
+			pwr[i] += 30;
+	}
+
+	/* every variant must give the same result as sorting all the bins */
+	void
+	qa_noise_floor::t1()
+	{
+		NoiseFloorEstimator estimators[] = {
+			NoiseFloorEstimator(),
+			NoiseFloorEstimator::lowestMean(0.25),
+			NoiseFloorEstimator::percentile(0.5),
+			NoiseFloorEstimator::percentile(0.0),
+			NoiseFloorEstimator::trimmedMean(0.1, 0.2),
+		};
+		const size_t count = sizeof(estimators) / sizeof(estimators[0]);
+		std::vector<float> pwr(8192);
+
+		srand(42);
+		for (size_t f = 0; f < 200; f++) {
+			/* drift slowly, then jump to exercise the fallback */
+			float floor = -100.0 + f * 0.05 + (f % 50 == 49 ? 20.0 : 0.0);
+			spectrum(pwr, floor);
+
+			for (size_t e = 0; e < count; e++) {
+				float expected = reference(pwr, estimators[e].low(), estimators[e].high());
+				float nf = estimators[e].estimate(pwr.data(), pwr.size());
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, nf, 1e-3);
+			}
+		}
+
+		/* small spectra, down to a single bin */
+		for (size_t n = 1; n < 20; n++) {
+			pwr.resize(n);
+			spectrum(pwr, -90.0);
+			for (size_t e = 0; e < count; e++) {
+				float expected = reference(pwr, estimators[e].low(), estimators[e].high());
+				float nf = estimators[e].estimate(pwr.data(), pwr.size());
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, nf, 1e-3);
+			}
+		}
+	}
+
+	/* a slowly moving noise floor should not need full selections */
+	void
+	qa_noise_floor::t2()
+	{
+		NoiseFloorEstimator estimator;
+		std::vector<float> pwr(8192);
+
+		srand(7);
+		for (size_t f = 0; f < 1000; f++) {
+			spectrum(pwr, -100.0 + 0.01 * f);
+			estimator.estimate(pwr.data(), pwr.size());
+		}
+
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1000, estimator.estimations());
+		CPPUNIT_ASSERT(estimator.fallbacks() < 10);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
@@ -0,0 +1,305 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "qa_radio_event_table.h"
+#include "radioeventtable.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	static uint32_t
+	centralFreq(const RetEntry *e)
+	{
+		return e->frequencyStart() + (e->frequencyEnd() - e->frequencyStart()) / 2;
+	}
+
+	static bool
+	isSorted(const RadioEventTable &ret)
+	{
+		const RadioEventTable::ActiveComs &coms = ret.activeCommunications();
+		for (size_t i = 0; i < coms.size(); i++) {
+			if (coms[i].centralFreq != centralFreq(coms[i].entry.get()))
+				return false;
+			if (i > 0 && coms[i - 1].centralFreq > coms[i].centralFreq)
+				return false;
+		}
+		return true;
+	}
+
+	/* the communications within 10% of the width, scanning them all */
+	static size_t
+	referenceMatches(const RadioEventTable &ret, uint32_t start, uint32_t end)
+	{
+		uint32_t width = end - start;
+		int32_t central = start + width / 2;
+		int32_t maxError = width * 10 / 100;
+		size_t matches = 0;
+
+		const RadioEventTable::ActiveComs &coms = ret.activeCommunications();
+		for (size_t i = 0; i < coms.size(); i++) {
+			int32_t diff = (int32_t)centralFreq(coms[i].entry.get()) - central;
+			matches += diff < maxError && -diff < maxError;
+		}
+		return matches;
+	}
+
+	/* the index finds what a scan finds, and stays sorted */
+	void
+	qa_radio_event_table::t1()
+	{
+		RadioEventTable ret(1000, 1000, 0);
+
+		srand(1);
+		for (size_t frame = 1; frame <= 200; frame++) {
+			ret.startAddingCommunications(frame * 100);
+			for (size_t c = 0; c < 20; c++) {
+				uint32_t start = 868000 + rand() % 2000;
+				uint32_t end = start + 20 + rand() % 200;
+
+				size_t matches = referenceMatches(ret, start, end);
+				RetEntry *entry = ret.findMatchInActiveCommunications(start, end, 0);
+				CPPUNIT_ASSERT_EQUAL(matches > 0, entry != NULL);
+
+				if (entry) {
+					/* the closest one */
+					int32_t central = start + (end - start) / 2;
+					int32_t best = abs((int32_t)centralFreq(entry) - central);
+					CPPUNIT_ASSERT(best < (int32_t)((end - start) * 10 / 100));
+
+					const RadioEventTable::ActiveComs &coms = ret.activeCommunications();
+					for (size_t i = 0; i < coms.size(); i++)
+						CPPUNIT_ASSERT(abs((int32_t)coms[i].centralFreq - central) >= best);
+				}
+
+				/* grows the matching communication, moving its center */
+				ret.addCommunication(start, end, -50);
+				if (rand() % 4 == 0) {
+					std::shared_ptr<RetEntry> e = ret.addTransmission(start, end, -60);
+					ret.updateTransmission(e.get(), start + 100, end + 300, -55);
+				}
+			}
+			ret.stopAddingCommunications();
+			CPPUNIT_ASSERT(isSorted(ret));
+		}
+	}
+
+	/* the communications not seen for longer than the delay end */
+	void
+	qa_radio_event_table::t2()
+	{
+		RadioEventTable ret(1000, 1000, 2000);
+
+		ret.startAddingCommunications(10000);
+		ret.addCommunication(100000, 100100, -50);
+		ret.addCommunication(200000, 200100, -50);
+		ret.addCommunication(300000, 300100, -50);
+		ret.stopAddingCommunications();
+
+		/* the first two go on, the second one long enough to be kept */
+		for (uint64_t t = 10500; t <= 12500; t += 500) {
+			ret.startAddingCommunications(t);
+			ret.addCommunication(100000, 100100, -50);
+			if (t <= 12000)
+				ret.addCommunication(200000, 200100, -50);
+			ret.stopAddingCommunications();
+		}
+
+		/* the third one ended, too short, the second one ends after 13000 */
+		CPPUNIT_ASSERT_EQUAL((size_t)2, ret.activeCommunications().size());
+		ret.startAddingCommunications(13001);
+		ret.stopAddingCommunications();
+		CPPUNIT_ASSERT_EQUAL((size_t)1, ret.activeCommunications().size());
+
+		std::vector<RetEntry> entries;
+		CPPUNIT_ASSERT_EQUAL((size_t)2, ret.fetchEntries(0, ~0ULL, entries));
+		CPPUNIT_ASSERT_EQUAL((size_t)2, entries.size());
+		CPPUNIT_ASSERT_EQUAL((uint32_t)100000, entries[0].frequencyStart());
+		CPPUNIT_ASSERT_EQUAL((uint32_t)200000, entries[1].frequencyStart());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)12000, entries[1].timeEnd());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)2, ret.totalDetections);
+
+		/* the finished one is only found around its lifetime */
+		entries.clear();
+		CPPUNIT_ASSERT_EQUAL((size_t)1, ret.fetchEntries(12000, 20000, entries));
+		entries.clear();
+		CPPUNIT_ASSERT_EQUAL((size_t)2, ret.fetchEntries(9000, 10001, entries));
+	}
+
+	/* the ids of the entries of history overlapping ]start, end[, scanning them all */
+	static std::vector<uint64_t>
+	referenceFetch(const RetHistory &history, uint64_t start, uint64_t end)
+	{
+		std::vector<uint64_t> ids;
+		for (uint64_t i = history.tail(); i < history.head(); i++) {
+			const RetEntry *e = history.at(i);
+			if (e->timeEnd() > start && e->timeStart() < end)
+				ids.push_back(e->id());
+		}
+		return ids;
+	}
+
+	/* the time index finds what a scan finds: short and long-running
+	 * entries, entries pushed late, once the oldest ones overwritten.
+	 */
+	void
+	qa_radio_event_table::t3()
+	{
+		RetHistory history(5000);
+		uint64_t now = 10000000;
+
+		srand(3);
+		for (uint64_t id = 0; id < 20000; id++) {
+			uint64_t duration = 1 + rand() % 1000;
+			if (rand() % 100 == 0)
+				duration = 1 + rand() % 1000000;
+			else if (rand() % 100 == 0)
+				duration = 0;
+
+			uint64_t end = now;
+			if (rand() % 50 == 0)
+				end -= rand() % 5000;
+			now += rand() % 100;
+
+			history.push_back(RetEntry(id, end - duration, end, 0, 0, -50,
+						   RetEntry::UNKNOWN, 0));
+			CPPUNIT_ASSERT(history.size() <= 5000);
+
+			if (id % 500 != 499)
+				continue;
+
+			for (int q = 0; q < 20; q++) {
+				uint64_t start = now - rand() % 600000;
+				uint64_t stop = start + rand() % (q < 10 ? 2000 : 200000);
+
+				std::vector<RetEntry> entries;
+				size_t found = history.fetch(start, stop, entries);
+				CPPUNIT_ASSERT_EQUAL(entries.size(), found);
+
+				std::vector<uint64_t> ids;
+				for (size_t i = 0; i < entries.size(); i++)
+					ids.push_back(entries[i].id());
+				std::sort(ids.begin(), ids.end());
+				CPPUNIT_ASSERT(ids == referenceFetch(history, start, stop));
+			}
+		}
+		CPPUNIT_ASSERT_EQUAL((size_t)5000, history.size());
+	}
+
+	static bool
+	sameEntry(const RetEntry &a, const RetEntry &b)
+	{
+		return a.id() == b.id() && a.timeStart() == b.timeStart() &&
+		       a.timeEnd() == b.timeEnd() &&
+		       a.frequencyStart() == b.frequencyStart() &&
+		       a.frequencyEnd() == b.frequencyEnd() && a.pwr() == b.pwr() &&
+		       a.psu() == b.psu() && a.address() == b.address();
+	}
+
+	/* the receiver knows the active communications seen more than once */
+	static bool
+	sameActive(const RadioEventTable &sender, const RadioEventTable &receiver)
+	{
+		const RadioEventTable::ActiveComs &s = sender.activeCommunications();
+		const RadioEventTable::ActiveComs &r = receiver.activeCommunications();
+		size_t n = 0;
+
+		for (size_t i = 0; i < s.size(); i++) {
+			const RetEntry *e = s[i].entry.get();
+			if (e->timeEnd() == e->timeStart())
+				continue;
+
+			bool found = false;
+			for (size_t j = 0; j < r.size() && !found; j++)
+				found = sameEntry(*e, *r[j].entry);
+			if (!found)
+				return false;
+			n++;
+		}
+		return n == r.size() && isSorted(receiver);
+	}
+
+	/* the delta updates rebuild the sender's table, recover from a lost
+	 * update with the next keyframe and from a buffer too short.
+	 */
+	void
+	qa_radio_event_table::t4()
+	{
+		RadioEventTable sender(1000, 1000, 1500), receiver(1000);
+		std::vector<char> buf;
+		size_t len, lost = 0;
+
+		sender.setKeyframeInterval(16);
+		srand(4);
+		for (uint64_t frame = 1; frame <= 2000; frame++) {
+			sender.startAddingCommunications(frame * 500);
+			for (size_t c = 0; c < 10; c++) {
+				uint32_t start = 100000 + (rand() % 40) * 1000 + rand() % 20;
+				sender.addCommunication(start, start + 500 + rand() % 20, -40 - rand() % 50);
+			}
+			sender.stopAddingCommunications();
+
+			/* too short, nothing is sent but the next one is a keyframe */
+			if (frame % 97 == 0) {
+				buf.resize(8);
+				CPPUNIT_ASSERT(!sender.encodeUpdate(buf.data(), buf.size(), &len));
+			}
+
+			buf.resize(sender.maxUpdateSize());
+			CPPUNIT_ASSERT(sender.encodeUpdate(buf.data(), buf.size(), &len));
+			CPPUNIT_ASSERT(len <= buf.size());
+			CPPUNIT_ASSERT_EQUAL(frame, sender.updateSequence());
+
+			/* lose one, the receiver waits for the next keyframe */
+			if (frame % 200 == 0) {
+				lost++;
+				continue;
+			}
+			bool applied = receiver.applyUpdate(buf.data(), len);
+			CPPUNIT_ASSERT_EQUAL(applied, receiver.isUpdateSynced());
+			if (applied)
+				CPPUNIT_ASSERT(sameActive(sender, receiver));
+			else
+				CPPUNIT_ASSERT(frame % 200 < 16);
+		}
+		CPPUNIT_ASSERT(lost > 0);
+		CPPUNIT_ASSERT(receiver.isUpdateSynced());
+
+		/* the finished ones received after the last loss are the sender's */
+		const RetHistory &sent = sender.finishedCommunications();
+		const RetHistory &received = receiver.finishedCommunications();
+		CPPUNIT_ASSERT(received.size() > 0);
+		for (uint64_t i = received.head() - 10; i < received.head(); i++) {
+			const RetEntry *r = received.at(i);
+			bool found = false;
+			for (uint64_t j = sent.tail(); j < sent.head() && !found; j++)
+				found = sameEntry(*r, *sent.at(j));
+			CPPUNIT_ASSERT(found);
+		}
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
@@ -0,0 +1,446 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_ring_buffer.h"
+#include "ringbuffer.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace gr {
+namespace gtsrc {
+
+	typedef RingBuffer<uint32_t, uint64_t> TestRing;
+
+	/* writes \a length elements valued by their position, with a marker
+	 * valued by its position at the first one
+	 */
+	static uint64_t
+	writeChunk(TestRing &ring, size_t length)
+	{
+		std::vector<uint32_t> chunk(length);
+		uint64_t pos = ring.head();
+		for (size_t i = 0; i < length; i++)
+			chunk[i] = pos + i;
+
+		ring.addSamples(chunk.data(), length);
+		ring.addMarker(pos, pos);
+		ring.validateWrite();
+
+		return pos;
+	}
+
+	static uint64_t
+	monotonicNs()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+
+	/* the storage is aligned, mapped as described, readable and writable */
+	static void
+	checkAllocation(const RingBufferAllocation &a, size_t elementSize,
+			size_t length, size_t alignment)
+	{
+		size_t page = sysconf(_SC_PAGESIZE);
+
+		CPPUNIT_ASSERT(a.ptr != NULL);
+		CPPUNIT_ASSERT_EQUAL((uintptr_t)0, (uintptr_t)a.ptr % alignment);
+		CPPUNIT_ASSERT(a.length >= length);
+		CPPUNIT_ASSERT_EQUAL(a.length * elementSize, a.bytes);
+		if (a.hugePages)
+			CPPUNIT_ASSERT_EQUAL((uintptr_t)0, (uintptr_t)a.ptr % (2 * 1024 * 1024));
+		if (a.mappedBytes > 0)
+			CPPUNIT_ASSERT_EQUAL((size_t)0, a.mappedBytes % page);
+		if (a.mirrored)
+			CPPUNIT_ASSERT_EQUAL(2 * a.bytes, a.mappedBytes);
+
+		uint8_t *bytes = (uint8_t *)a.ptr;
+		for (size_t i = 0; i < a.bytes; i++)
+			bytes[i] = i * 7;
+		for (size_t i = 0; i < a.bytes; i++)
+			CPPUNIT_ASSERT_EQUAL((uint8_t)(i * 7), bytes[i]);
+	}
+
+	/* reads \a length elements from \a pos, in as many chunks as needed.
+	 * Returns the number of chunks, 0 if the elements got overridden.
+	 */
+	static size_t
+	readAll(TestRing &ring, uint64_t pos, size_t length, std::vector<uint32_t> &out)
+	{
+		size_t chunks = 0;
+
+		out.clear();
+		while (out.size() < length) {
+			uint32_t *src;
+			size_t n = length - out.size();
+			if (!ring.requestRead(pos + out.size(), &n, &src) || n == 0)
+				return 0;
+			out.insert(out.end(), src, src + n);
+			chunks++;
+		}
+
+		return ring.isPositionValid(pos) ? chunks : 0;
+	}
+
+	/* every valid element keeps the marker of its chunk, whether the markers
+	 * are dropped by the tail or by the capacity of their ring
+	 */
+	void
+	qa_ring_buffer::t1()
+	{
+		const size_t chunk = 100;
+
+		/* the tail drops the markers, but the one it falls in */
+		TestRing ring(4096);
+		CPPUNIT_ASSERT(ring.markersCapacity() >= 4096);
+		for (size_t i = 0; i < 1000; i++)
+			writeChunk(ring, chunk);
+
+		CPPUNIT_ASSERT(ring.tail() % chunk != 0);
+		for (uint64_t pos = ring.tail(); pos < ring.head(); pos++) {
+			uint64_t marker, markerPos;
+			CPPUNIT_ASSERT(ring.findMarker(pos, &marker, &markerPos));
+			CPPUNIT_ASSERT_EQUAL(pos - pos % chunk, markerPos);
+			CPPUNIT_ASSERT_EQUAL(markerPos, marker);
+		}
+
+		uint64_t marker, markerPos;
+		CPPUNIT_ASSERT(!ring.findMarker(ring.tail() - 1, &marker, &markerPos));
+		CPPUNIT_ASSERT(ring.findNextMarker(ring.tail(), &marker, &markerPos));
+		CPPUNIT_ASSERT_EQUAL(ring.tail() - ring.tail() % chunk + chunk, markerPos);
+
+		/* 8 markers annotate less than the ring, the elements go with them */
+		TestRing small(4096, boost::shared_ptr<RingBufferAllocator>(new RingBufferAllocator()), 8);
+		CPPUNIT_ASSERT_EQUAL((size_t)8, small.markersCapacity());
+		for (size_t i = 0; i < 1000; i++)
+			writeChunk(small, chunk);
+
+		CPPUNIT_ASSERT_EQUAL((uint64_t)0, small.tail() % chunk);
+		CPPUNIT_ASSERT_EQUAL((size_t)(8 * chunk), small.size());
+		for (uint64_t pos = small.tail(); pos < small.head(); pos++) {
+			CPPUNIT_ASSERT(small.findMarker(pos, &marker, &markerPos));
+			CPPUNIT_ASSERT_EQUAL(pos - pos % chunk, marker);
+		}
+
+		/* the position of the marker is rewound with the ring */
+		small.clear();
+		CPPUNIT_ASSERT(!small.findMarker(0, &marker, &markerPos));
+		writeChunk(small, chunk);
+		CPPUNIT_ASSERT(small.findMarker(chunk - 1, &marker, &markerPos));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)0, markerPos);
+	}
+
+	/* the lookups never return a marker recycled while they were reading it */
+	void
+	qa_ring_buffer::t2()
+	{
+		const size_t chunk = 16;
+		TestRing ring(1024, boost::shared_ptr<RingBufferAllocator>(new RingBufferAllocator()), 16);
+		std::atomic<bool> stop(false);
+
+		writeChunk(ring, chunk);
+		boost::thread producer([&ring, &stop]() {
+			while (!stop.load())
+				writeChunk(ring, chunk);
+		});
+
+		size_t checked = 0;
+		for (size_t i = 0; i < 200000; i++) {
+			uint64_t pos = ring.head() - 1 - i % (8 * chunk);
+			uint64_t marker, markerPos;
+
+			if (!ring.findMarker(pos, &marker, &markerPos))
+				continue;
+
+			/* a torn marker would not match its own position */
+			CPPUNIT_ASSERT_EQUAL(markerPos, marker);
+			CPPUNIT_ASSERT(markerPos <= pos);
+			if (ring.isPositionValid(pos)) {
+				CPPUNIT_ASSERT_EQUAL(pos - pos % chunk, markerPos);
+				checked++;
+			}
+		}
+
+		stop.store(true);
+		producer.join();
+
+		CPPUNIT_ASSERT(checked > 0);
+	}
+
+	/* on a mirrored ring, the accesses straddling the end are contiguous */
+	void
+	qa_ring_buffer::t3()
+	{
+		TestRing ring(1000, boost::shared_ptr<RingBufferAllocator>(new RingBufferAllocator(64, false, true)));
+		CPPUNIT_ASSERT(ring.isMirrored());
+
+		/* rounded up to the page size */
+		size_t length = ring.ringLength();
+		CPPUNIT_ASSERT(length >= 1000);
+		CPPUNIT_ASSERT_EQUAL((size_t)0, length * sizeof(uint32_t) % sysconf(_SC_PAGESIZE));
+
+		writeChunk(ring, length - 50);
+
+		uint32_t *dst;
+		CPPUNIT_ASSERT_EQUAL((size_t)100, ring.requestWrite(100, &dst));
+		for (size_t i = 0; i < 100; i++)
+			dst[i] = length - 50 + i;
+		ring.validateWrite();
+
+		std::vector<uint32_t> out;
+		CPPUNIT_ASSERT_EQUAL((size_t)1, readAll(ring, length - 50, 100, out));
+		for (size_t i = 0; i < out.size(); i++)
+			CPPUNIT_ASSERT_EQUAL(length - 50 + i, (size_t)out[i]);
+
+		/* the element after the last one is the first one, seen twice */
+		uint32_t *first, *wrapped;
+		size_t n = 1;
+		CPPUNIT_ASSERT(ring.requestRead(length, &n, &wrapped));
+		n = 1;
+		CPPUNIT_ASSERT(ring.requestRead(length - 50, &n, &first));
+		CPPUNIT_ASSERT(wrapped != first + 50);
+		first[50] = 12345;
+		CPPUNIT_ASSERT_EQUAL((uint32_t)12345, wrapped[0]);
+		first[50] = length;
+
+		uint64_t startPos, restartPos;
+		uint32_t *last;
+		CPPUNIT_ASSERT_EQUAL((size_t)100, ring.requestReadLastN(100, &startPos, &restartPos, &last));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)(length - 50), startPos);
+		CPPUNIT_ASSERT_EQUAL((uint32_t)(length + 49), last[99]);
+	}
+
+	/* without mirroring, the accesses straddling the end are split */
+	void
+	qa_ring_buffer::t4()
+	{
+		TestRing ring(1000);
+		CPPUNIT_ASSERT(!ring.isMirrored());
+		CPPUNIT_ASSERT_EQUAL((size_t)1000, ring.ringLength());
+
+		writeChunk(ring, 950);
+
+		uint32_t *dst;
+		CPPUNIT_ASSERT_EQUAL((size_t)50, ring.requestWrite(100, &dst));
+		for (size_t i = 0; i < 50; i++)
+			dst[i] = 950 + i;
+		CPPUNIT_ASSERT_EQUAL((size_t)50, ring.requestWrite(50, &dst));
+		for (size_t i = 0; i < 50; i++)
+			dst[i] = 1000 + i;
+		ring.validateWrite();
+
+		std::vector<uint32_t> out;
+		CPPUNIT_ASSERT_EQUAL((size_t)2, readAll(ring, 950, 100, out));
+		for (size_t i = 0; i < out.size(); i++)
+			CPPUNIT_ASSERT_EQUAL((uint32_t)(950 + i), out[i]);
+
+		uint64_t startPos, restartPos;
+		uint32_t *last;
+		CPPUNIT_ASSERT_EQUAL((size_t)50, ring.requestReadLastN(100, &startPos, &restartPos, &last));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)950, startPos);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1000, restartPos);
+		CPPUNIT_ASSERT_EQUAL((uint32_t)950, last[0]);
+
+		/* a long write wraps around more than once, the last elements stay */
+		std::vector<uint32_t> chunk(2500);
+		for (size_t i = 0; i < chunk.size(); i++)
+			chunk[i] = 1050 + i;
+		ring.addSamples(chunk.data(), chunk.size());
+		ring.validateWrite();
+
+		CPPUNIT_ASSERT(readAll(ring, ring.tail(), ring.size(), out) > 0);
+		for (size_t i = 0; i < out.size(); i++)
+			CPPUNIT_ASSERT_EQUAL((uint32_t)(ring.tail() + i), out[i]);
+	}
+
+	/* a consumer sleeps until the timeout, or until the producer wrote enough */
+	void
+	qa_ring_buffer::t5()
+	{
+		TestRing ring(4096);
+
+		uint64_t start = monotonicNs();
+		CPPUNIT_ASSERT(!ring.waitForAvailable(0, 100, 50000000));
+		uint64_t elapsed = monotonicNs() - start;
+		CPPUNIT_ASSERT(elapsed >= 50000000);
+		CPPUNIT_ASSERT(elapsed < 1000000000);
+
+		/* not enough yet, the consumer goes back to sleep */
+		for (uint32_t spin = 0; spin <= 1000; spin += 1000) {
+			ring.clear();
+			ring.setWaitSpinCount(spin);
+
+			boost::thread producer([&ring]() {
+				boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+				writeChunk(ring, 50);
+				boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+				writeChunk(ring, 100);
+			});
+
+			start = monotonicNs();
+			CPPUNIT_ASSERT(ring.waitForAvailable(0, 100, 5000000000ULL));
+			elapsed = monotonicNs() - start;
+			producer.join();
+
+			CPPUNIT_ASSERT(ring.hasNAvailableFrom(0, 100));
+			CPPUNIT_ASSERT(elapsed >= 80000000);
+			CPPUNIT_ASSERT(elapsed < 2000000000);
+		}
+
+		/* the data already there is not waited for */
+		start = monotonicNs();
+		CPPUNIT_ASSERT(ring.waitForAvailable(0, 100, 5000000000ULL));
+		CPPUNIT_ASSERT(monotonicNs() - start < 1000000000);
+	}
+
+	/* an overrun cursor moves according to its policy and accounts for it */
+	void
+	qa_ring_buffer::t6()
+	{
+		TestRing ring(1000);
+		writeChunk(ring, 200);
+
+		TestRing::Cursor *fresh = ring.registerCursor("fresh");
+		TestRing::Cursor *oldest = ring.registerCursor("oldest", TestRing::SKIP_TO_OLDEST_VALID);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)200, fresh->position());
+		CPPUNIT_ASSERT(oldest->policy() == TestRing::SKIP_TO_OLDEST_VALID);
+
+		writeChunk(ring, 300);
+		oldest->advance(100);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)300, fresh->lag());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)200, oldest->lag());
+		CPPUNIT_ASSERT(!fresh->recover());
+		CPPUNIT_ASSERT(!oldest->recover());
+
+		/* head = 2000, tail = 1000 */
+		writeChunk(ring, 1500);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1000, ring.tail());
+
+		CPPUNIT_ASSERT(fresh->recover());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)2000, fresh->position());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)0, fresh->lag());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1, fresh->overrunCount());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1800, fresh->droppedCount());
+
+		CPPUNIT_ASSERT(oldest->recover());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1000, oldest->position());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1000, oldest->lag());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1, oldest->overrunCount());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)700, oldest->droppedCount());
+
+		/* recovered, nothing more to account for */
+		CPPUNIT_ASSERT(!fresh->recover());
+		CPPUNIT_ASSERT(!oldest->recover());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1, oldest->overrunCount());
+
+		/* a second overrun adds up */
+		writeChunk(ring, 1200);
+		CPPUNIT_ASSERT(oldest->recover());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)2200, oldest->position());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)2, oldest->overrunCount());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1900, oldest->droppedCount());
+
+		std::vector<TestRing::CursorStatistics> stats = ring.cursorsStatistics();
+		CPPUNIT_ASSERT_EQUAL((size_t)2, stats.size());
+		CPPUNIT_ASSERT(stats[0].name == "fresh");
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1200, stats[0].lag);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1, stats[0].overrunCount);
+		CPPUNIT_ASSERT(stats[1].name == "oldest");
+		CPPUNIT_ASSERT_EQUAL((uint64_t)2200, stats[1].position);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1900, stats[1].droppedCount);
+
+		ring.unregisterCursor(fresh);
+		stats = ring.cursorsStatistics();
+		CPPUNIT_ASSERT_EQUAL((size_t)1, stats.size());
+		CPPUNIT_ASSERT(stats[0].name == "oldest");
+		ring.unregisterCursor(oldest);
+		CPPUNIT_ASSERT(ring.cursorsStatistics().empty());
+	}
+
+	/* whatever the machine provides, the allocator returns usable storage.
+	 * Without reserved huge pages, MAP_HUGETLB fails and the allocator
+	 * falls back to normal pages.
+	 */
+	void
+	qa_ring_buffer::t7()
+	{
+		const size_t elementSize = 8, length = 300000;
+		size_t page = sysconf(_SC_PAGESIZE);
+		RingBufferAllocation a;
+
+		/* on the heap */
+		RingBufferAllocator heap(256, false, false);
+		CPPUNIT_ASSERT(heap.allocate(elementSize, length, &a));
+		CPPUNIT_ASSERT_EQUAL((size_t)0, a.mappedBytes);
+		CPPUNIT_ASSERT_EQUAL(length, a.length);
+		checkAllocation(a, elementSize, length, 256);
+		heap.release(a);
+
+		/* huge pages, or normal ones with a transparent huge pages hint */
+		RingBufferAllocator huge(64, true, false);
+		CPPUNIT_ASSERT(huge.allocate(elementSize, length, &a));
+		CPPUNIT_ASSERT(!a.mirrored);
+		CPPUNIT_ASSERT_EQUAL(length, a.length);
+		checkAllocation(a, elementSize, length, page);
+
+		/* the binding may be refused, the storage is left untouched */
+		CPPUNIT_ASSERT(!huge.bindToNode(a, 8 * sizeof(unsigned long)));
+		huge.bindToNode(a, -1);
+		for (size_t i = 0; i < a.bytes; i++)
+			CPPUNIT_ASSERT_EQUAL((uint8_t)(i * 7), ((uint8_t *)a.ptr)[i]);
+		huge.release(a);
+
+		/* mirrored, on huge pages or not, rounded up to the page */
+		RingBufferAllocator mirrored(64, true, true);
+		CPPUNIT_ASSERT(mirrored.allocate(elementSize, length, &a));
+		checkAllocation(a, elementSize, length, page);
+		if (a.mirrored) {
+			uint8_t *bytes = (uint8_t *)a.ptr;
+			CPPUNIT_ASSERT_EQUAL(bytes[0], bytes[a.bytes]);
+			CPPUNIT_ASSERT_EQUAL(bytes[a.bytes - 1], bytes[2 * a.bytes - 1]);
+		}
+		mirrored.release(a);
+
+		/* too small for a whole page, nothing to bind */
+		CPPUNIT_ASSERT(heap.allocate(elementSize, 16, &a));
+		CPPUNIT_ASSERT(!heap.bindToNode(a, 0));
+		heap.release(a);
+
+		/* a ring on the fallback storage works like any other */
+		TestRing ring(length, boost::shared_ptr<RingBufferAllocator>(new RingBufferAllocator(64, true, true)));
+		writeChunk(ring, ring.ringLength() - 10);
+		writeChunk(ring, 20);
+		std::vector<uint32_t> out;
+		CPPUNIT_ASSERT(readAll(ring, ring.ringLength() - 10, 20, out) > 0);
+		for (size_t i = 0; i < out.size(); i++)
+			CPPUNIT_ASSERT_EQUAL((uint32_t)(ring.ringLength() - 10 + i), out[i]);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
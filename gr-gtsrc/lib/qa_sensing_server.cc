@@ -0,0 +1,244 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "qa_sensing_server.h"
+#include "sensingserver.h"
+#include "message_utils.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <string.h>
+#include <time.h>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	static const size_t FFT_PAYLOAD = 26 + 4096;
+	static const size_t MESSAGES = 20000;
+
+	static uint64_t
+	nowNs()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+
+	/* a full-sensing client, sending its requests */
+	static void
+	connectClient(boost::asio::ip::tcp::socket &socket, SensingServer &server,
+		      const char *requests, size_t len)
+	{
+		size_t clients = server.statistics().clients;
+
+		socket.connect(boost::asio::ip::tcp::endpoint(
+		  boost::asio::ip::address_v4::loopback(), server.port()));
+		boost::asio::write(socket, boost::asio::buffer(requests, len));
+
+		for (int i = 0; i < 5000 && server.statistics().clients == clients; i++)
+			boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+		CPPUNIT_ASSERT_EQUAL(clients + 1, server.statistics().clients);
+	}
+
+	/* a full-sensing client which never reads, with a tiny socket buffer */
+	static void
+	connectStalled(boost::asio::ip::tcp::socket &socket, SensingServer &server)
+	{
+		const char requests[] = { 0x1, 0x0 };
+
+		socket.open(boost::asio::ip::tcp::v4());
+		socket.set_option(boost::asio::socket_base::receive_buffer_size(4096));
+		connectClient(socket, server, requests, sizeof(requests));
+	}
+
+	/* returns the type of the message */
+	static char
+	readMessage(boost::asio::ip::tcp::socket &socket, std::vector<char> &payload)
+	{
+		char header[5];
+		uint32_t len;
+
+		boost::asio::read(socket, boost::asio::buffer(header, 5));
+		memcpy(&len, header + 1, sizeof(len));
+		payload.resize(len);
+		boost::asio::read(socket, boost::asio::buffer(payload));
+
+		return header[0];
+	}
+
+	/* what the FFT thread does: 9 FFT frames, then a RET update carrying
+	 * its number. Returns the time spent, in ns.
+	 */
+	static uint64_t
+	sendMessages(SensingServer &server, size_t retSize)
+	{
+		std::vector<char> fft(FFT_PAYLOAD, 42);
+		std::vector<char> ret(retSize, 0);
+		uint32_t retCount = 0;
+
+		uint64_t start = nowNs();
+		for (size_t i = 0; i < MESSAGES; i++) {
+			if (i % 10 == 9) {
+				memcpy(ret.data(), &retCount, sizeof(retCount));
+				server.sendToAll(MSG_RET_UPDATE, ret.data(), ret.size());
+				retCount++;
+			} else
+			  server.sendToAll(MSG_FFT, fft.data(), fft.size());
+		}
+		return nowNs() - start;
+	}
+
+	/* a stalled client neither slows down the sender nor misses a RET update */
+	void
+	qa_sensing_server::t1()
+	{
+		SensingClient::QueueConfig config;
+		config.maxFfts = 4;
+		SensingServer server(0, config);
+
+		/* without any client */
+		uint64_t alone = sendMessages(server, 64);
+
+		boost::asio::io_service ios;
+		boost::asio::ip::tcp::socket socket(ios);
+		connectStalled(socket, server);
+
+		uint64_t stalled = sendMessages(server, 64);
+		CPPUNIT_ASSERT(stalled < 4 * alone + 200000000);
+
+		/* the queue is bounded, the RET updates never dropped */
+		SensingServer::Statistics stats = server.statistics();
+		CPPUNIT_ASSERT_EQUAL((size_t) 1, stats.clients);
+		CPPUNIT_ASSERT(stats.droppedFfts > 0);
+		CPPUNIT_ASSERT(stats.queuedBytes <= (config.maxFfts + 16) * (5 + FFT_PAYLOAD)
+									 + MESSAGES / 10 * (5 + 64));
+
+		/* the client wakes up, it gets every RET update in order */
+		size_t ffts = 0;
+		uint32_t expected = 0;
+		std::vector<char> payload;
+		while (expected < MESSAGES / 10) {
+			char type = readMessage(socket, payload);
+			if (type == MSG_FFT) {
+				CPPUNIT_ASSERT_EQUAL(FFT_PAYLOAD, payload.size());
+				ffts++;
+			} else {
+				CPPUNIT_ASSERT_EQUAL((int) MSG_RET_UPDATE, (int) type);
+				uint32_t count;
+				memcpy(&count, payload.data(), sizeof(count));
+				CPPUNIT_ASSERT_EQUAL(expected, count);
+				expected++;
+			}
+		}
+		CPPUNIT_ASSERT(ffts < MESSAGES * 9 / 10);
+		CPPUNIT_ASSERT_EQUAL(stats.droppedFfts, MESSAGES * 9 / 10 - ffts);
+	}
+
+	/* a client lagging on the RET updates is disconnected */
+	void
+	qa_sensing_server::t2()
+	{
+		SensingClient::QueueConfig config;
+		config.maxBytes = 1024 * 1024;
+		SensingServer server(0, config);
+
+		boost::asio::io_service ios;
+		boost::asio::ip::tcp::socket socket(ios);
+		connectStalled(socket, server);
+
+		sendMessages(server, 8192);
+
+		SensingServer::Statistics stats = server.statistics();
+		CPPUNIT_ASSERT_EQUAL((size_t) 0, stats.clients);
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 1, stats.disconnected);
+	}
+
+	/* reads the spectra sent to a client until a RET update */
+	static void
+	readSpectra(boost::asio::ip::tcp::socket &socket, std::vector<uint16_t> &bins,
+		    std::vector<char> &last)
+	{
+		std::vector<char> payload;
+		while (readMessage(socket, payload) == MSG_FFT) {
+			uint16_t count;
+			memcpy(&count, payload.data(), sizeof(count));
+			CPPUNIT_ASSERT_EQUAL((size_t) 26 + count, payload.size());
+			bins.push_back(count);
+			last.assign(payload.begin() + 26, payload.end());
+		}
+	}
+
+	/* every client gets the spectra at the resolution it asked for */
+	void
+	qa_sensing_server::t3()
+	{
+		SensingServer server(0);
+		boost::asio::io_service ios;
+
+		/* the max-hold of 4 spectra, up to 1024 bins */
+		boost::asio::ip::tcp::socket waterfall(ios);
+		char requests[8];
+		size_t offset = 0;
+		write_and_update_offset(offset, requests, (char) 0x1);
+		write_and_update_offset(offset, requests, (char) 0x3);
+		write_and_update_offset(offset, requests, (uint16_t) 1024);
+		write_and_update_offset(offset, requests, (uint16_t) 4);
+		write_and_update_offset(offset, requests, (uint8_t) 1);
+		write_and_update_offset(offset, requests, (char) 0x0);
+		connectClient(waterfall, server, requests, offset);
+
+		/* the default resolution */
+		boost::asio::ip::tcp::socket full(ios);
+		const char fullRequests[] = { 0x1, 0x0 };
+		connectClient(full, server, fullRequests, sizeof(fullRequests));
+
+		/* 20 spectra of 8192 bins, spectrum f peaking at bin f */
+		std::vector<float> spectrum(8192);
+		for (int f = 0; f < 20; f++) {
+			spectrum.assign(8192, -100.0);
+			spectrum[f] = -10.0;
+			server.sendSpectrum(f, 860000000, 870000000, spectrum.data(), spectrum.size());
+		}
+		server.sendToAll(MSG_RET_UPDATE, requests, 1);
+
+		std::vector<uint16_t> bins;
+		std::vector<char> last;
+		readSpectra(waterfall, bins, last);
+		CPPUNIT_ASSERT_EQUAL((size_t) 5, bins.size());
+		CPPUNIT_ASSERT_EQUAL((uint16_t) 1024, bins[0]);
+		/* bins 16 to 19 peaked in the last 4 spectra, pooled by 8 */
+		CPPUNIT_ASSERT_EQUAL((int) -10, (int) last[2]);
+		CPPUNIT_ASSERT_EQUAL((int) -100, (int) last[1]);
+
+		bins.clear();
+		readSpectra(full, bins, last);
+		CPPUNIT_ASSERT_EQUAL((size_t) 2, bins.size());
+		CPPUNIT_ASSERT_EQUAL((uint16_t) 8192, bins[1]);
+		for (int f = 10; f < 20; f++)
+			CPPUNIT_ASSERT_EQUAL((int) -10, (int) last[f]);
+		CPPUNIT_ASSERT_EQUAL((int) -100, (int) last[9]);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
@@ -0,0 +1,119 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "qa_spectrum_decimator.h"
+#include "spectrumdecimator.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	/* max-hold and average over the frames, full resolution */
+	void
+	qa_spectrum_decimator::t1()
+	{
+		SpectrumDecimator maxHold(SpectrumDecimator::Resolution(0, 3, SpectrumDecimator::MAX_HOLD));
+		SpectrumDecimator average(SpectrumDecimator::Resolution(0, 3, SpectrumDecimator::AVERAGE));
+		std::vector<float> bins(4);
+
+		for (int f = 0; f < 3; f++) {
+			for (size_t i = 0; i < bins.size(); i++)
+				bins[i] = -100.0 + 10 * ((f + i) % 3);
+
+			bool ready = f == 2;
+			CPPUNIT_ASSERT_EQUAL(ready, maxHold.add(1000 + f, 100, 400, bins.data(), bins.size()));
+			CPPUNIT_ASSERT_EQUAL(ready, average.add(1000 + f, 100, 400, bins.data(), bins.size()));
+		}
+
+		CPPUNIT_ASSERT_EQUAL((size_t) 4, maxHold.bins().size());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 1000, maxHold.time_ns());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 100, maxHold.startFrequency());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 400, maxHold.endFrequency());
+		for (size_t i = 0; i < 4; i++) {
+			CPPUNIT_ASSERT_DOUBLES_EQUAL(-80.0, maxHold.bins()[i], 1e-4);
+			CPPUNIT_ASSERT_DOUBLES_EQUAL(-90.0, average.bins()[i], 1e-4);
+		}
+
+		/* the next reduction starts from scratch */
+		bins.assign(4, -120.0);
+		for (int f = 0; f < 3; f++)
+			maxHold.add(2000 + f, 100, 400, bins.data(), bins.size());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 2000, maxHold.time_ns());
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(-120.0, maxHold.bins()[0], 1e-4);
+	}
+
+	/* the bins are pooled by groups, the last one maybe smaller */
+	void
+	qa_spectrum_decimator::t2()
+	{
+		SpectrumDecimator maxPool(SpectrumDecimator::Resolution(4, 1, SpectrumDecimator::MAX_HOLD));
+		SpectrumDecimator avgPool(SpectrumDecimator::Resolution(4, 1, SpectrumDecimator::AVERAGE));
+
+		/* 10 bins, 1 Hz apart: groups of 3, 3, 3 and 1 */
+		std::vector<float> bins(10);
+		for (size_t i = 0; i < bins.size(); i++)
+			bins[i] = -100.0 + i;
+
+		CPPUNIT_ASSERT(maxPool.add(0, 1000, 1009, bins.data(), bins.size()));
+		CPPUNIT_ASSERT(avgPool.add(0, 1000, 1009, bins.data(), bins.size()));
+
+		CPPUNIT_ASSERT_EQUAL((size_t) 4, maxPool.bins().size());
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(-98.0, maxPool.bins()[0], 1e-4);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(-92.0, maxPool.bins()[2], 1e-4);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(-91.0, maxPool.bins()[3], 1e-4);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(-99.0, avgPool.bins()[0], 1e-4);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(-93.0, avgPool.bins()[2], 1e-4);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(-91.0, avgPool.bins()[3], 1e-4);
+
+		/* the centers of the first and last groups */
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 1001, maxPool.startFrequency());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 1009, maxPool.endFrequency());
+
+		/* a new size starts over */
+		bins.resize(8192, -50.0);
+		SpectrumDecimator waterfall(SpectrumDecimator::Resolution(1024, 2, SpectrumDecimator::MAX_HOLD));
+		CPPUNIT_ASSERT(!waterfall.add(0, 0, 8191, bins.data(), 10));
+		CPPUNIT_ASSERT(!waterfall.add(0, 0, 8191, bins.data(), bins.size()));
+		CPPUNIT_ASSERT(waterfall.add(0, 0, 8191, bins.data(), bins.size()));
+		CPPUNIT_ASSERT_EQUAL((size_t) 1024, waterfall.bins().size());
+	}
+
+	/* the largest FFTs fit in the 16 bits bin count of the messages */
+	void
+	qa_spectrum_decimator::t3()
+	{
+		std::vector<float> bins(65536, -90.0);
+		SpectrumDecimator full;
+
+		bool ready = false;
+		for (int f = 0; f < 10; f++)
+			ready = full.add(f, 0, 65535, bins.data(), bins.size());
+
+		CPPUNIT_ASSERT(ready);
+		CPPUNIT_ASSERT_EQUAL((size_t) 32768, full.bins().size());
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(-90.0, full.bins()[32767], 1e-4);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
@@ -0,0 +1,152 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_spectrum_kernels.h"
+#include "spectrumkernels.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	/* none of them a multiple of the width of the vectors but the powers of two */
+	static const size_t lengths[] = { 1, 3, 7, 8, 15, 16, 17, 31, 33, 64, 100, 1023, 1025 };
+	static const size_t lengthCount = sizeof(lengths) / sizeof(lengths[0]);
+
+	static std::vector<gr_complex>
+	randomSamples(size_t length)
+	{
+		std::vector<gr_complex> samples(length);
+		for (size_t i = 0; i < length; i++)
+			samples[i] = gr_complex(rand() / (float)RAND_MAX - 0.5,
+						rand() / (float)RAND_MAX - 0.5);
+		return samples;
+	}
+
+	/* every supported window kernel gives the scalar output, in place or not */
+	void
+	qa_spectrum_kernels::t1()
+	{
+		CPPUNIT_ASSERT(SpectrumKernels::isSupported(SpectrumKernels::SCALAR));
+		CPPUNIT_ASSERT(SpectrumKernels::isSupported(SpectrumKernels::selected()));
+		SpectrumKernels::ApplyWindowFn scalar = SpectrumKernels::applyWindowFor(SpectrumKernels::SCALAR);
+
+		for (int isa = 0; isa < SpectrumKernels::ISA_COUNT; isa++) {
+			SpectrumKernels::ApplyWindowFn kernel = SpectrumKernels::applyWindowFor((SpectrumKernels::Isa)isa);
+			CPPUNIT_ASSERT((kernel != NULL) == SpectrumKernels::isSupported((SpectrumKernels::Isa)isa));
+			if (!kernel)
+				continue;
+
+			for (size_t l = 0; l < lengthCount; l++) {
+				size_t length = lengths[l];
+				std::vector<gr_complex> src = randomSamples(length);
+				std::vector<float> win(length);
+				for (size_t i = 0; i < length; i++)
+					win[i] = rand() / (float)RAND_MAX;
+
+				/* one more sample, which must be left alone */
+				std::vector<gr_complex> expected(length), dst(length + 1, gr_complex(42, 42));
+				scalar(expected.data(), src.data(), win.data(), length);
+				kernel(dst.data(), src.data(), win.data(), length);
+				for (size_t i = 0; i < length; i++)
+					CPPUNIT_ASSERT(dst[i] == expected[i]);
+				CPPUNIT_ASSERT(dst[length] == gr_complex(42, 42));
+
+				kernel(src.data(), src.data(), win.data(), length);
+				for (size_t i = 0; i < length; i++)
+					CPPUNIT_ASSERT(src[i] == expected[i]);
+			}
+		}
+	}
+
+	/* every supported power kernel is within 0.001 dB of the scalar one and
+	 * of 10*log10, a null power being clamped to FLT_MIN
+	 */
+	void
+	qa_spectrum_kernels::t2()
+	{
+		const float offset = -12.5;
+		SpectrumKernels::PowerDbFn scalar = SpectrumKernels::powerDbFor(SpectrumKernels::SCALAR);
+
+		for (int isa = 0; isa < SpectrumKernels::ISA_COUNT; isa++) {
+			SpectrumKernels::PowerDbFn kernel = SpectrumKernels::powerDbFor((SpectrumKernels::Isa)isa);
+			CPPUNIT_ASSERT((kernel != NULL) == SpectrumKernels::isSupported((SpectrumKernels::Isa)isa));
+			if (!kernel)
+				continue;
+
+			for (size_t l = 0; l < lengthCount; l++) {
+				size_t length = lengths[l];
+				std::vector<gr_complex> src = randomSamples(length);
+
+				/* null, denormal and large powers */
+				src[0] = gr_complex(0, 0);
+				if (length > 2) {
+					src[1] = gr_complex(1e-25f, 0);
+					src[2] = gr_complex(1e6f, -1e6f);
+				}
+
+				std::vector<float> expected(length), dst(length + 1, 42);
+				scalar(expected.data(), src.data(), length, offset);
+				kernel(dst.data(), src.data(), length, offset);
+				CPPUNIT_ASSERT_EQUAL(42.0f, dst[length]);
+
+				for (size_t i = 0; i < length; i++) {
+					float pwr = std::norm(src[i]);
+					float exact = 10 * log10(pwr >= FLT_MIN ? pwr : FLT_MIN) + offset;
+
+					CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], dst[i], 0.001);
+					CPPUNIT_ASSERT_DOUBLES_EQUAL(exact, dst[i], 0.001);
+				}
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(-379.3 + offset, dst[0], 0.1);
+			}
+		}
+	}
+
+	/* the fused fftshift puts the negative frequencies first, for odd sizes too */
+	void
+	qa_spectrum_kernels::t3()
+	{
+		const float offset = 3;
+		SpectrumKernels::PowerDbFn scalar = SpectrumKernels::powerDbFor(SpectrumKernels::SCALAR);
+
+		for (size_t l = 0; l < lengthCount; l++) {
+			size_t fftSize = lengths[l];
+			std::vector<gr_complex> src = randomSamples(fftSize);
+
+			std::vector<gr_complex> shifted(fftSize);
+			for (size_t i = 0; i < fftSize; i++)
+				shifted[i] = src[(i + fftSize / 2) % fftSize];
+
+			std::vector<float> expected(fftSize), dst(fftSize);
+			scalar(expected.data(), shifted.data(), fftSize, offset);
+			SpectrumKernels::powerDbShifted(dst.data(), src.data(), fftSize, offset);
+
+			for (size_t i = 0; i < fftSize; i++)
+				CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], dst[i], 0.001);
+		}
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
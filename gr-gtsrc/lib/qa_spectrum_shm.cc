@@ -0,0 +1,263 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "qa_spectrum_shm.h"
+#include "spectrumshm.h"
+#include "radioeventtable.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/thread.hpp>
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	static SpectrumShmWriter::Config
+	testConfig(uint32_t slotCount, uint32_t maxBins)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "/gtsrc-qa-%d", (int) getpid());
+
+		SpectrumShmWriter::Config config;
+		config.name = name;
+		config.slotCount = slotCount;
+		config.maxBins = maxBins;
+		config.maxRetEntries = 4;
+		return config;
+	}
+
+	/* frame n has its n in all its bins */
+	static void
+	publish(SpectrumShmWriter &writer, uint64_t n, uint32_t bins)
+	{
+		std::vector<float> pwr(bins, (float) n);
+		writer.publishSpectrum(n, 868000000, 869000000, pwr.data(), bins);
+	}
+
+	/* the frames are read in order, the ones overwritten are counted */
+	void
+	qa_spectrum_shm::t1()
+	{
+		SpectrumShmWriter writer(testConfig(6, 64));
+		CPPUNIT_ASSERT(writer.isOpen());
+		CPPUNIT_ASSERT_EQUAL((uint32_t) 8, writer.config().slotCount);
+
+		SpectrumShmReader reader(writer.config().name.c_str());
+		CPPUNIT_ASSERT(reader.isOpen());
+
+		SpectrumShmReader::Frame frame;
+		std::vector<float> bins;
+		CPPUNIT_ASSERT(!reader.readFrame(frame, bins));
+
+		for (uint64_t n = 0; n < 5; n++)
+			publish(writer, n, 64);
+		for (uint64_t n = 0; n < 5; n++) {
+			CPPUNIT_ASSERT(reader.readFrame(frame, bins));
+			CPPUNIT_ASSERT_EQUAL(n, frame.sequence);
+			CPPUNIT_ASSERT_EQUAL(n, frame.time_ns);
+			CPPUNIT_ASSERT_EQUAL((uint64_t) 868000000, frame.startFrequency);
+			CPPUNIT_ASSERT_EQUAL((uint64_t) 869000000, frame.endFrequency);
+			CPPUNIT_ASSERT_EQUAL((size_t) 64, bins.size());
+			CPPUNIT_ASSERT_EQUAL((float) n, bins[63]);
+		}
+		CPPUNIT_ASSERT(!reader.readFrame(frame, bins));
+
+		/* the reader lags by more than the ring */
+		for (uint64_t n = 5; n < 25; n++)
+			publish(writer, n, 32);
+		for (uint64_t n = 17; n < 25; n++) {
+			CPPUNIT_ASSERT(reader.readFrame(frame, bins));
+			CPPUNIT_ASSERT_EQUAL(n, frame.sequence);
+			CPPUNIT_ASSERT_EQUAL((size_t) 32, bins.size());
+			CPPUNIT_ASSERT_EQUAL((float) n, bins[0]);
+		}
+		CPPUNIT_ASSERT(!reader.readFrame(frame, bins));
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 12, reader.lostFrames());
+
+		/* too large for the slots */
+		std::vector<float> large(65);
+		CPPUNIT_ASSERT(!writer.publishSpectrum(0, 0, 0, large.data(), large.size()));
+
+		/* a reader opened later starts with the next frame */
+		SpectrumShmReader late(writer.config().name.c_str());
+		CPPUNIT_ASSERT(!late.readFrame(frame, bins));
+		publish(writer, 25, 32);
+		CPPUNIT_ASSERT(late.readFrame(frame, bins));
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 25, frame.sequence);
+	}
+
+	/* the RET snapshots hold the active communications */
+	void
+	qa_spectrum_shm::t2()
+	{
+		SpectrumShmWriter writer(testConfig(8, 64));
+		SpectrumShmReader reader(writer.config().name.c_str());
+		RadioEventTable ret(100);
+
+		ret.startAddingCommunications(1000);
+		ret.addCommunication(868000, 868100, -40);
+		ret.addCommunication(869000, 869200, -60);
+		ret.stopAddingCommunications();
+
+		uint64_t timeNs;
+		std::vector<SpectrumShmRetEntry> entries;
+		CPPUNIT_ASSERT(!reader.readRet(timeNs, entries));
+
+		CPPUNIT_ASSERT(writer.publishRet(1000, ret));
+		CPPUNIT_ASSERT(reader.readRet(timeNs, entries));
+		CPPUNIT_ASSERT(!reader.readRet(timeNs, entries));
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 1000, timeNs);
+		CPPUNIT_ASSERT_EQUAL((size_t) 2, entries.size());
+
+		const RadioEventTable::ActiveComs &coms = ret.activeCommunications();
+		for (size_t i = 0; i < coms.size(); i++) {
+			CPPUNIT_ASSERT_EQUAL(coms[i].entry->id(), entries[i].id);
+			CPPUNIT_ASSERT_EQUAL(coms[i].entry->frequencyStart(), entries[i].frequencyStart);
+			CPPUNIT_ASSERT_EQUAL(coms[i].entry->frequencyEnd(), entries[i].frequencyEnd);
+			CPPUNIT_ASSERT_EQUAL(coms[i].entry->pwr(), entries[i].pwr);
+		}
+
+		/* only the last snapshot is read, truncated to maxRetEntries */
+		ret.startAddingCommunications(2000);
+		for (uint32_t i = 0; i < 6; i++)
+			ret.addCommunication(870000 + i * 1000, 870100 + i * 1000, -50);
+		ret.stopAddingCommunications();
+		writer.publishRet(1500, ret);
+		CPPUNIT_ASSERT(!writer.publishRet(2000, ret));
+
+		CPPUNIT_ASSERT(reader.readRet(timeNs, entries));
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 2000, timeNs);
+		CPPUNIT_ASSERT_EQUAL((size_t) 4, entries.size());
+	}
+
+	/* a reader racing the writer never gets a torn frame */
+	void
+	qa_spectrum_shm::t3()
+	{
+		const uint64_t frames = 200000;
+		SpectrumShmWriter writer(testConfig(4, 1024));
+		SpectrumShmReader reader(writer.config().name.c_str());
+
+		boost::thread thread([&writer, frames]() {
+			for (uint64_t n = 0; n < frames; n++)
+				publish(writer, n, 1024);
+		});
+
+		SpectrumShmReader::Frame frame;
+		std::vector<float> bins;
+		uint64_t read = 0, last = 0;
+		bool torn = false;
+		while (true) {
+			bool done = reader.framesPublished() == frames;
+			if (!reader.readFrame(frame, bins)) {
+				if (done)
+					break;
+				continue;
+			}
+			if (read > 0 && frame.sequence <= last)
+				torn = true;
+			for (size_t i = 0; i < bins.size(); i++)
+				if (bins[i] != (float) frame.time_ns)
+					torn = true;
+			last = frame.sequence;
+			read++;
+		}
+		thread.join();
+
+		CPPUNIT_ASSERT(!torn);
+		CPPUNIT_ASSERT(read > 0);
+		CPPUNIT_ASSERT_EQUAL(frames, read + reader.lostFrames());
+	}
+
+	/* a live writer's memory is never replaced, a dead one's is */
+	void
+	qa_spectrum_shm::t4()
+	{
+		CPPUNIT_ASSERT(spectrumShmName(0) == SPECTRUM_SHM_DEFAULT_NAME);
+		CPPUNIT_ASSERT(spectrumShmName(2) == SPECTRUM_SHM_DEFAULT_NAME "-2");
+
+		SpectrumShmWriter::Config config = testConfig(4, 64);
+		{
+			SpectrumShmWriter writer(config);
+			CPPUNIT_ASSERT(writer.isOpen());
+			publish(writer, 1, 64);
+
+			/* the second writer fails and leaves the name to the first */
+			{
+				SpectrumShmWriter twin(config);
+				CPPUNIT_ASSERT(!twin.isOpen());
+			}
+			SpectrumShmReader reader(config.name.c_str());
+			CPPUNIT_ASSERT(reader.isOpen());
+			CPPUNIT_ASSERT_EQUAL((uint64_t) 1, reader.framesPublished());
+		}
+		CPPUNIT_ASSERT(!SpectrumShmReader(config.name.c_str()).isOpen());
+
+		/* a memory which was never initialized is replaced */
+		int fd = shm_open(config.name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+		CPPUNIT_ASSERT(fd >= 0);
+		close(fd);
+		{
+			SpectrumShmWriter writer(config);
+			CPPUNIT_ASSERT(writer.isOpen());
+		}
+
+		/* another process keeps its memory while running, and loses it
+		 * when it dies without removing it
+		 */
+		int opened[2], quit[2];
+		CPPUNIT_ASSERT(pipe(opened) == 0 && pipe(quit) == 0);
+		pid_t child = fork();
+		if (child == 0) {
+			char c = new SpectrumShmWriter(config) != NULL;
+			if (write(opened[1], &c, 1) != 1 || read(quit[0], &c, 1) != 1)
+				_exit(1);
+			_exit(0);
+		}
+		CPPUNIT_ASSERT(child > 0);
+		char c;
+		CPPUNIT_ASSERT_EQUAL((ssize_t) 1, read(opened[0], &c, 1));
+		{
+			SpectrumShmWriter twin(config);
+			CPPUNIT_ASSERT(!twin.isOpen());
+		}
+		CPPUNIT_ASSERT_EQUAL((ssize_t) 1, write(quit[1], &c, 1));
+		int status;
+		CPPUNIT_ASSERT_EQUAL(child, waitpid(child, &status, 0));
+		close(opened[0]);
+		close(opened[1]);
+		close(quit[0]);
+		close(quit[1]);
+		CPPUNIT_ASSERT(SpectrumShmReader(config.name.c_str()).isOpen());
+
+		SpectrumShmWriter writer(config);
+		CPPUNIT_ASSERT(writer.isOpen());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 0, SpectrumShmReader(config.name.c_str()).framesPublished());
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
@@ -0,0 +1,178 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qa_thermal_calibration.h"
+#include "thermalcalibration.h"
+#include "comsdetect.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	/* complex gaussian noise, plus a tone at the center of bin tone. The
+	 * spectra are shifted, DC is at fftSize / 2.
+	 */
+	static void
+	noise(std::vector<gr_complex> &samples, size_t fftSize, size_t tone)
+	{
+		for (size_t i = 0; i < samples.size(); i++) {
+			float u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+			float u2 = (float)rand() / RAND_MAX;
+			float r = 0.01 * sqrtf(-2 * logf(u1));
+			float phase = 2 * M_PI * (tone + fftSize / 2) * (i % fftSize) / fftSize;
+			samples[i] = gr_complex(r * cosf(2 * M_PI * u2), r * sinf(2 * M_PI * u2)) +
+				     gr_complex(cosf(phase), sinf(phase));
+		}
+	}
+
+	/* the slices of the threads add up to the whole recording */
+	void
+	qa_thermal_calibration::t1()
+	{
+		const size_t fftSize = 64;
+		std::vector<gr_complex> samples(fftSize * 3000 + 10);
+		FftWindow win(fftSize, gr::filter::firdes::WIN_BLACKMAN_hARRIS);
+
+		srand(42);
+		noise(samples, fftSize, 10);
+
+		ThermalCalibration::Config config;
+		config.threads = 1;
+		ThermalCalibration::Result single;
+		CPPUNIT_ASSERT(ThermalCalibration(config).run(win, 940000000, 8000000,
+							      samples.data(), samples.size(),
+							      single));
+
+		config.threads = 4;
+		config.batchCount = 7;
+		ThermalCalibration::Result parallel;
+		CPPUNIT_ASSERT(ThermalCalibration(config).run(win, 940000000, 8000000,
+							      samples.data(), samples.size(),
+							      parallel));
+
+		CPPUNIT_ASSERT_EQUAL((uint16_t)fftSize, parallel.fftSize);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)3000, parallel.ffts);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)940000000, parallel.centralFrequency);
+
+		float variance = 0, median = 0, high = 0;
+		size_t noiseBins = 0;
+		for (size_t i = 0; i < fftSize; i++) {
+			CPPUNIT_ASSERT_DOUBLES_EQUAL(single.mean[i], parallel.mean[i], 1e-3);
+			CPPUNIT_ASSERT_DOUBLES_EQUAL(single.variance[i], parallel.variance[i], 1e-2);
+			CPPUNIT_ASSERT_EQUAL(single.median[i], parallel.median[i]);
+			CPPUNIT_ASSERT_EQUAL(single.highQuantile[i], parallel.highQuantile[i]);
+
+			/* the main lobe of the window around the tone */
+			if (i >= 5 && i <= 15)
+				continue;
+
+			variance += parallel.variance[i];
+			median += parallel.median[i] - parallel.mean[i];
+			high += parallel.highQuantile[i] - parallel.median[i];
+			noiseBins++;
+		}
+
+		/* the power of a noise bin follows an exponential distribution */
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(31.0, variance / noiseBins, 1.0);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(0.92, median / noiseBins, 0.1);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(8.2, high / noiseBins, 0.3);
+
+		/* the tone is steady, far above the noise */
+		CPPUNIT_ASSERT(parallel.mean[10] > parallel.highQuantile[30] + 20);
+		CPPUNIT_ASSERT(parallel.variance[10] < 1.0);
+
+		/* not even a frame */
+		CPPUNIT_ASSERT(!ThermalCalibration(config).run(win, 940000000, 8000000,
+							       samples.data(), fftSize - 1,
+							       parallel));
+	}
+
+	/* the calibration file is loaded back and skips the warm-up */
+	void
+	qa_thermal_calibration::t2()
+	{
+		const size_t fftSize = 64;
+		std::vector<gr_complex> samples(fftSize * 500);
+		FftWindow win(fftSize, gr::filter::firdes::WIN_BLACKMAN_hARRIS);
+		char path[] = "/tmp/qa_thermal_calibration_XXXXXX";
+		int fd = mkstemp(path);
+		CPPUNIT_ASSERT(fd >= 0);
+		close(fd);
+
+		srand(7);
+		noise(samples, fftSize, 10);
+
+		ThermalCalibration::Config config;
+		config.threads = 2;
+		ThermalCalibration::Result result, loaded;
+		CPPUNIT_ASSERT(ThermalCalibration(config).run(win, 940000000, 8000000,
+							      samples.data(), samples.size(),
+							      result));
+		CPPUNIT_ASSERT(result.save(path));
+		CPPUNIT_ASSERT(loaded.load(path));
+
+		CPPUNIT_ASSERT_EQUAL(result.fftSize, loaded.fftSize);
+		CPPUNIT_ASSERT_EQUAL(result.sampleRate, loaded.sampleRate);
+		CPPUNIT_ASSERT_EQUAL(result.ffts, loaded.ffts);
+		CPPUNIT_ASSERT(result.mean == loaded.mean);
+		CPPUNIT_ASSERT(result.variance == loaded.variance);
+		CPPUNIT_ASSERT(result.median == loaded.median);
+		CPPUNIT_ASSERT(result.highQuantile == loaded.highQuantile);
+
+		/* the detection is ready at once, the slices read their own bins */
+		ComsDetect::Config detectConfig;
+		detectConfig.fftSize = fftSize;
+		ComsDetect detect(detectConfig);
+		CPPUNIT_ASSERT(!detect.calibration().isReady());
+		CPPUNIT_ASSERT(detect.loadCalibration(loaded));
+		CPPUNIT_ASSERT(detect.calibration().isReady());
+		CPPUNIT_ASSERT(detect.noiseMax(10) > detect.noiseMax(30) + 20);
+		for (size_t i = 0; i < fftSize; i++)
+			CPPUNIT_ASSERT_DOUBLES_EQUAL(14.0, detect.noiseMax(i) - detect.noiseFloor(i), 1e-3);
+
+		ComsDetect::Config sliceConfig = detectConfig;
+		sliceConfig.firstBin = 16;
+		sliceConfig.binCount = 16;
+		ComsDetect slice(sliceConfig);
+		CPPUNIT_ASSERT(slice.loadCalibration(loaded));
+		CPPUNIT_ASSERT_EQUAL(detect.noiseMax(20), slice.noiseMax(20));
+
+		detectConfig.fftSize = 128;
+		ComsDetect other(detectConfig);
+		CPPUNIT_ASSERT(!other.loadCalibration(loaded));
+		CPPUNIT_ASSERT(!other.calibration().isReady());
+
+		/* a truncated file is rejected, leaving the result untouched */
+		CPPUNIT_ASSERT_EQUAL(0, truncate(path, 100));
+		CPPUNIT_ASSERT(!loaded.load(path));
+		CPPUNIT_ASSERT(result.mean == loaded.mean);
+
+		unlink(path);
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
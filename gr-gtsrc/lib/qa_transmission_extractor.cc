@@ -0,0 +1,248 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 <+YOU OR YOUR COMPANY+>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "qa_transmission_extractor.h"
+#include "transmissionextractor.h"
+
+#include <cppunit/TestAssert.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace gr {
+namespace gtsrc {
+
+	static const uint16_t FFT_SIZE = 1024;
+	static const uint64_t CENTRAL_FREQ = 868000000;
+	static const uint64_t SAMPLE_RATE = 10240000;
+	static const uint64_t FRAME_NS = 100000; /* FFT_SIZE / SAMPLE_RATE */
+
+	/* the noise calibration learns fast at first, it would learn the
+	 * transmissions too.
+	 */
+	static const size_t WARMUP = 3000;
+
+	/* a signal of snr dB over bins [begin, end) */
+	struct Signal
+	{
+		uint16_t begin;
+		uint16_t end;
+		float snr;
+	};
+
+	/* the power of |noise + signal|², noise at -100 dB */
+	static void
+	makeFrame(std::vector<float> &pwr, const std::vector<Signal> &signals)
+	{
+		std::vector<float> lin(pwr.size(), 0.0);
+		for (size_t s = 0; s < signals.size(); s++)
+			for (size_t i = signals[s].begin; i < signals[s].end; i++)
+				lin[i] += powf(10.0, signals[s].snr / 10);
+
+		for (size_t i = 0; i < pwr.size(); i++) {
+			float u = (rand() + 1.0) / (RAND_MAX + 2.0);
+			pwr[i] = -100.0 + 10 * log10f(-logf(u) + lin[i]);
+		}
+	}
+
+	/* runs the detection and the extraction from frame to frame + count */
+	struct Chain
+	{
+		ComsDetect detect;
+		RadioEventTable ret;
+		TransmissionExtractor extractor;
+		std::vector<float> pwr;
+		uint64_t frame;
+
+		Chain() :
+			detect(config()), ret(1000, 1000000, 10000000), extractor(ret),
+			pwr(FFT_SIZE), frame(0)
+		{
+		}
+
+		static ComsDetect::Config config()
+		{
+			ComsDetect::Config config;
+			config.fftSize = FFT_SIZE;
+			return config;
+		}
+
+		void run(size_t count, const std::vector<Signal> &signals,
+			 uint64_t centralFreq = CENTRAL_FREQ)
+		{
+			for (size_t f = 0; f < count; f++, frame++) {
+				makeFrame(pwr, signals);
+				detect.addSpectrum(pwr.data(), FFT_SIZE);
+				extractor.addFrame(detect, frame * FRAME_NS, centralFreq, SAMPLE_RATE);
+			}
+		}
+
+		std::vector<RetEntry> entries()
+		{
+			std::vector<RetEntry> entries;
+			ret.fetchEntries(0, ~0ULL, entries);
+			return entries;
+		}
+	};
+
+	static uint32_t
+	kHzAtBin(uint16_t i)
+	{
+		return (CENTRAL_FREQ - SAMPLE_RATE / 2 + i * SAMPLE_RATE / FFT_SIZE) / 1000;
+	}
+
+	/* two transmissions, apart in time and frequency */
+	void
+	qa_transmission_extractor::t1()
+	{
+		Chain chain;
+		std::vector<Signal> none, a(1), ab(2), b(1);
+		Signal sa = { 200, 220, 20.0 }, sb = { 600, 630, 15.0 };
+		a[0] = sa;
+		ab[0] = sa;
+		ab[1] = sb;
+		b[0] = sb;
+
+		srand(1);
+		chain.run(WARMUP, none);
+		chain.run(100, a);
+		chain.run(200, ab);
+		chain.run(300, b);
+		chain.run(300, none);
+
+		std::vector<RetEntry> entries = chain.entries();
+		CPPUNIT_ASSERT_EQUAL((size_t)2, entries.size());
+		CPPUNIT_ASSERT_EQUAL((size_t)0, chain.extractor.ongoingTransmissions());
+
+		const RetEntry *ea = &entries[0], *eb = &entries[1];
+		if (ea->frequencyStart() > eb->frequencyStart())
+			std::swap(ea, eb);
+
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(200), ea->frequencyStart());
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(219), ea->frequencyEnd());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)WARMUP * FRAME_NS, ea->timeStart());
+		CPPUNIT_ASSERT(ea->timeEnd() >= (WARMUP + 299) * FRAME_NS);
+		CPPUNIT_ASSERT(ea->timeEnd() < (WARMUP + 350) * FRAME_NS);
+		CPPUNIT_ASSERT(ea->pwr() > -90 && ea->pwr() < -75);
+
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(600), eb->frequencyStart());
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(629), eb->frequencyEnd());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)(WARMUP + 100) * FRAME_NS, eb->timeStart());
+		CPPUNIT_ASSERT(eb->timeEnd() >= (WARMUP + 599) * FRAME_NS);
+		CPPUNIT_ASSERT(eb->timeEnd() < (WARMUP + 650) * FRAME_NS);
+	}
+
+	/* two tones joined by a wider signal are a single transmission */
+	void
+	qa_transmission_extractor::t2()
+	{
+		Chain chain;
+		std::vector<Signal> none, tones(2), joined(1);
+		Signal low = { 300, 306, 20.0 }, high = { 330, 336, 20.0 };
+		Signal wide = { 300, 336, 20.0 };
+		tones[0] = low;
+		tones[1] = high;
+		joined[0] = wide;
+
+		srand(2);
+		chain.run(WARMUP, none);
+		chain.run(200, tones);
+		CPPUNIT_ASSERT_EQUAL((size_t)2, chain.extractor.ongoingTransmissions());
+
+		chain.run(50, joined);
+		CPPUNIT_ASSERT_EQUAL((size_t)1, chain.extractor.ongoingTransmissions());
+		chain.run(200, tones);
+		chain.run(300, none);
+
+		std::vector<RetEntry> entries = chain.entries();
+		CPPUNIT_ASSERT_EQUAL((size_t)1, entries.size());
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(300), entries[0].frequencyStart());
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(335), entries[0].frequencyEnd());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)WARMUP * FRAME_NS, entries[0].timeStart());
+		CPPUNIT_ASSERT(entries[0].timeEnd() >= (WARMUP + 449) * FRAME_NS);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1, chain.extractor.statistics().merges);
+	}
+
+	/* on-off keyed bursts, Manchester coded, 20 dB over the noise */
+	void
+	qa_transmission_extractor::t3()
+	{
+		Chain chain;
+		std::vector<Signal> none, on(1);
+		Signal burst = { 500, 508, 20.0 };
+		on[0] = burst;
+
+		srand(3);
+		chain.run(WARMUP, none);
+		for (size_t b = 0; b < 10; b++) {
+			for (size_t bit = 0; bit < 30; bit++) {
+				bool one = rand() & 1;
+				chain.run(5, one ? on : none);
+				chain.run(5, one ? none : on);
+			}
+			chain.run(200, none);
+		}
+
+		std::vector<RetEntry> entries = chain.entries();
+		CPPUNIT_ASSERT_EQUAL((size_t)10, entries.size());
+		for (size_t e = 0; e < entries.size(); e++) {
+			uint64_t start = (WARMUP + e * 500) * FRAME_NS;
+			CPPUNIT_ASSERT(entries[e].timeStart() >= start);
+			CPPUNIT_ASSERT(entries[e].timeStart() <= start + 10 * FRAME_NS);
+			CPPUNIT_ASSERT(entries[e].frequencyStart() <= kHzAtBin(501));
+			CPPUNIT_ASSERT(entries[e].frequencyEnd() >= kHzAtBin(506));
+		}
+	}
+
+	/* a retune ends the transmissions, the same bins are other frequencies */
+	void
+	qa_transmission_extractor::t4()
+	{
+		Chain chain;
+		std::vector<Signal> none, a(1);
+		Signal sa = { 200, 220, 20.0 };
+		a[0] = sa;
+
+		srand(4);
+		chain.run(WARMUP, none);
+		chain.run(200, a);
+		CPPUNIT_ASSERT_EQUAL((size_t)1, chain.extractor.ongoingTransmissions());
+		chain.run(200, a, CENTRAL_FREQ + 2000000);
+		chain.run(300, none, CENTRAL_FREQ + 2000000);
+
+		std::vector<RetEntry> entries = chain.entries();
+		CPPUNIT_ASSERT_EQUAL((size_t)2, entries.size());
+		const RetEntry *before = &entries[0], *after = &entries[1];
+		if (before->timeStart() > after->timeStart())
+			std::swap(before, after);
+
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(200), before->frequencyStart());
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(219), before->frequencyEnd());
+		CPPUNIT_ASSERT(before->timeEnd() < (WARMUP + 200) * FRAME_NS);
+
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(200) + 2000, after->frequencyStart());
+		CPPUNIT_ASSERT_EQUAL(kHzAtBin(219) + 2000, after->frequencyEnd());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)(WARMUP + 200) * FRAME_NS, after->timeStart());
+	}
+
+} /* namespace gtsrc */
+} /* namespace gr */
@@ -8,6 +8,8 @@
 #ifndef SAMPLESRINGBUFFER_H
 #define SAMPLESRINGBUFFER_H
 
+#include <gnuradio/gr_complex.h>
+
 #include "ringbuffer.h"
 
 /// The #SamplesRingBuffer's markers that annotate the samples stream
@@ -32,11 +34,18 @@ public:
 	/**
 	 * \brief    Construct a new Sample ring buffer
 	 *
-	 * \param    size   The maximum number of elements to be stored in the
-	 *                  ring buffer.
+	 * \param    size            The maximum number of elements to be
+	 *                           stored in the ring buffer.
+	 * \param    allocator       The allocator of the ring's storage (see
+	 *                           #RingBufferAllocator).
+	 * \param    markersCapacity The maximum number of markers to be stored,
+	 *                           0 for one per 64 samples (at least 4096).
 	 * \return   Nothing.
 	 */
-	SamplesRingBuffer(size_t size) : RingBuffer(size)
+	SamplesRingBuffer(size_t size, boost::shared_ptr<RingBufferAllocator> allocator =
+				boost::shared_ptr<RingBufferAllocator>(new RingBufferAllocator()),
+			  size_t markersCapacity = 0)
+		: RingBuffer(size, allocator, markersCapacity)
 	{
 
 	}
@@ -104,6 +113,48 @@ public:
 		else
 			return 0;
 	}
+
+	/// Returns true if \a a and \a b have the same frequency and sample rate
+	static bool sameTuning(const RBMarker &a, const RBMarker &b)
+	{
+		return a.freq == b.freq && a.sampleRate == b.sampleRate;
+	}
+
+	/**
+	 * \brief    Find where the tuning changes in a window of samples
+	 *
+	 * \details  A marker is added with every packet, most of them do not
+	 *           change the tuning. Every marker of the window is checked,
+	 *           so as a retune and back within the window is noticed.
+	 *
+	 * \param[in]  pos         The position of the first sample of the window.
+	 * \param[in]  length      The number of samples of the window.
+	 * \param[in]  marker      The marker covering \a pos, see #findMarker.
+	 * \param[out] changePos   Stores the position of the first marker with
+	 *                         another tuning than \a marker.
+	 *
+	 * \return   True if the tuning changes before \a pos + \a length,
+	 *           false otherwise.
+	 *
+	 * \sa #sameTuning
+	 */
+	bool findTuningChange(uint64_t pos, size_t length, const RBMarker &marker,
+			      uint64_t *changePos) const
+	{
+		RBMarker next;
+		uint64_t nextPos;
+
+		while (findNextMarker(pos, &next, &nextPos) && nextPos < pos + length) {
+			if (!sameTuning(marker, next)) {
+				*changePos = nextPos;
+				return true;
+			}
+			length -= nextPos - pos;
+			pos = nextPos;
+		}
+
+		return false;
+	}
 };
 
 #endif // SAMPLESRINGBUFFER_H
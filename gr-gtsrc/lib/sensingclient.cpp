@@ -2,81 +2,250 @@
 
 #include <stdint.h>
 #include <stdio.h>
-#include <iostream>
+#include <string.h>
+#include <boost/bind.hpp>
 
-SensingClient::SensingClient(boost::asio::io_service &ios) : _socket(ios)
+#include "message_utils.h"
+
+SensingClient::QueueConfig::QueueConfig() :
+	maxFfts(8), fftDropPolicy(DROP_OLDEST), maxBytes(32 * 1024 * 1024)
 {
 }
 
-bool SensingClient::readNBytes(char *buf, size_t size)
+SensingClient::SensingClient(boost::asio::io_service &ios, const QueueConfig &config) :
+	_ios(ios), _socket(ios), _fullSensing(false), _config(config), _inFlight(0),
+	_waitingFfts(0), _writing(false), _connected(true)
 {
-	size_t len = 0;
+	memset(&_stats, 0, sizeof(_stats));
+}
 
-	while (len < size) {
-		size_t subLen = _socket.read_some(boost::asio::buffer(buf+size, size - len));
-		if (subLen == 0)
-			return false;
-		len += subLen;
-	}
+void SensingClient::socketIsConnected(const ReadyHandler &onReady)
+{
+	_onReady = onReady;
+	readRequest();
+}
 
-	return true;
+void SensingClient::readRequest()
+{
+	boost::asio::async_read(_socket, boost::asio::buffer(_request, 1),
+		boost::bind(&SensingClient::requestRead, shared_from_this(),
+			    boost::asio::placeholders::error));
 }
 
-#include "message_utils.h"
-void SensingClient::socketIsConnected()
+void SensingClient::requestRead(const boost::system::error_code &error)
 {
-	try {
-		uint8_t msgType = 0;
-		do {
-			size_t len = _socket.read_some(boost::asio::buffer(&msgType, 1));
-			if (len != 1)
-				return;
-
-			switch (msgType)
-			{
-			case 0x0:
-				/* End, nothing to do */
-				break;
-			case 0x1:
-				_fullSensing = true;
-				break;
-			case 0x2:
-				freqInterest f;
-
-				_socket.read_some(boost::asio::buffer(&f.centralFreq, 8));
-				_socket.read_some(boost::asio::buffer(&f.bandwidth, 4));
-				_socket.read_some(boost::asio::buffer(&f.error, 1));
-
-				_frequencies.push_back(f);
-
-				fprintf(stderr, "cf = %llu, bandwidth = %u, error = %u\n",
-					f.centralFreq, f.bandwidth, f.error);
-				break;
-			default:
-				fprintf(stderr, "Unknown message type %u\n", msgType);
-				break;
-			}
-		} while (msgType > 0);
+	if (error) {
+		fprintf(stderr, "SensingClient: %s\n", error.message().c_str());
+		return;
 	}
-	catch (std::exception& e)
+
+	uint8_t msgType = _request[0];
+	switch (msgType)
 	{
-		std::cerr << e.what() << std::endl;
+	case 0x0:
+		/* End, the client is ready */
+		_onReady(shared_from_this());
+		return;
+	case 0x1:
+		_fullSensing = true;
+		break;
+	case 0x2:
+		boost::asio::async_read(_socket, boost::asio::buffer(_request, 13),
+			boost::bind(&SensingClient::frequencyRead, shared_from_this(),
+				    boost::asio::placeholders::error));
+		return;
+	case 0x3:
+		boost::asio::async_read(_socket, boost::asio::buffer(_request, 5),
+			boost::bind(&SensingClient::resolutionRead, shared_from_this(),
+				    boost::asio::placeholders::error));
+		return;
+	default:
+		fprintf(stderr, "Unknown message type %u\n", msgType);
+		break;
+	}
+
+	readRequest();
+}
+
+void SensingClient::frequencyRead(const boost::system::error_code &error)
+{
+	if (error) {
+		fprintf(stderr, "SensingClient: %s\n", error.message().c_str());
+		return;
+	}
+
+	freqInterest f;
+	size_t offset = 0;
+	read_and_update_offset(offset, _request, f.centralFreq);
+	read_and_update_offset(offset, _request, f.bandwidth);
+	read_and_update_offset(offset, _request, f.error);
+
+	_frequencies.push_back(f);
+
+	fprintf(stderr, "cf = %llu, bandwidth = %u, error = %u\n",
+		f.centralFreq, f.bandwidth, f.error);
+
+	readRequest();
+}
+
+/* the most bins, the spectra reduced into one and the mode (0: average,
+ * 1: max-hold) of the spectra wanted
+ */
+void SensingClient::resolutionRead(const boost::system::error_code &error)
+{
+	if (error) {
+		fprintf(stderr, "SensingClient: %s\n", error.message().c_str());
+		return;
 	}
+
+	uint16_t maxBins, frames;
+	uint8_t mode;
+	size_t offset = 0;
+	read_and_update_offset(offset, _request, maxBins);
+	read_and_update_offset(offset, _request, frames);
+	read_and_update_offset(offset, _request, mode);
+
+	_resolution = SpectrumDecimator::Resolution(maxBins, frames,
+		mode ? SpectrumDecimator::MAX_HOLD : SpectrumDecimator::AVERAGE);
+
+	fprintf(stderr, "max bins = %u, frames = %u, mode = %u\n",
+		maxBins, frames, mode);
+
+	readRequest();
 }
 
-bool SensingClient::send(const char *buf, size_t len)
+bool SensingClient::dropOldestFft()
 {
-	try {
-		size_t sentLen = _socket.send(boost::asio::buffer(buf, len));
-		if (sentLen != len) {
-			fprintf(stderr, "SensingClient::send: sentLen != len\n");
-			return false;
-		} else
+	std::deque<MessagePtr>::iterator it;
+	for (it = _queue.begin() + _inFlight; it != _queue.end(); ++it) {
+		if ((*it)->droppable) {
+			_stats.queuedBytes -= (*it)->size();
+			_queue.erase(it);
+			_waitingFfts--;
 			return true;
+		}
 	}
-	catch (std::exception& e)
-	{
-		std::cerr << e.what() << std::endl;
+
+	return false;
+}
+
+bool SensingClient::queue(const MessagePtr &msg)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	if (!_connected)
+		return false;
+
+	if (msg->droppable && _waitingFfts >= _config.maxFfts) {
+		_stats.droppedFfts++;
+		if (_config.fftDropPolicy == DROP_NEWEST || !dropOldestFft())
+			return true;
+	}
+
+	_queue.push_back(msg);
+	_stats.queuedBytes += msg->size();
+	if (msg->droppable)
+		_waitingFfts++;
+
+	if (_stats.queuedBytes > _config.maxBytes) {
+		fprintf(stderr, "SensingClient: %zu bytes queued, disconnecting\n",
+			_stats.queuedBytes);
+		disconnect();
 		return false;
 	}
+
+	if (!_writing) {
+		_writing = true;
+		_ios.post(boost::bind(&SensingClient::write, shared_from_this()));
+	}
+
+	return true;
+}
+
+bool SensingClient::isConnected()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _connected;
+}
+
+SensingClient::Statistics SensingClient::statistics()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	return _stats;
+}
+
+/* with _mutex held. The messages in flight are kept until written() */
+void SensingClient::disconnect()
+{
+	_connected = false;
+	while (_queue.size() > _inFlight) {
+		_stats.queuedBytes -= _queue.back()->size();
+		_queue.pop_back();
+	}
+	_waitingFfts = 0;
+
+	_ios.post(boost::bind(&SensingClient::close, shared_from_this()));
+}
+
+void SensingClient::close()
+{
+	boost::system::error_code error;
+	_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+	_socket.close(error);
+}
+
+void SensingClient::write()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	if (!_connected || _queue.empty()) {
+		_writing = false;
+		return;
+	}
+
+	/* gather the first messages, a header and a payload buffer each */
+	_inFlight = _queue.size();
+	if (_inFlight > MAX_GATHERED_MESSAGES)
+		_inFlight = MAX_GATHERED_MESSAGES;
+	_buffers.clear();
+	for (size_t i = 0; i < _inFlight; i++) {
+		const Message &msg = *_queue[i];
+		if (msg.headerSize > 0)
+			_buffers.push_back(boost::asio::buffer(msg.header, msg.headerSize));
+		if (msg.payload.size() > 0)
+			_buffers.push_back(boost::asio::buffer(msg.payload));
+		if (msg.droppable)
+			_waitingFfts--;
+	}
+
+	boost::asio::async_write(_socket, _buffers,
+		boost::bind(&SensingClient::written, shared_from_this(),
+			    boost::asio::placeholders::error));
+}
+
+void SensingClient::written(const boost::system::error_code &error)
+{
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		size_t count = _inFlight;
+		for (size_t i = 0; i < count; i++) {
+			_stats.queuedBytes -= _queue.front()->size();
+			_queue.pop_front();
+		}
+		_inFlight = 0;
+
+		if (error) {
+			if (_connected) {
+				fprintf(stderr, "SensingClient: %s\n", error.message().c_str());
+				disconnect();
+			}
+			_writing = false;
+			return;
+		}
+
+		_stats.sentMessages += count;
+	}
+
+	write();
 }
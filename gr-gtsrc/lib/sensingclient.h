@@ -2,9 +2,37 @@
 #define SENSINGCLIENT_H
 
 #include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <stdint.h>
+#include <deque>
 #include <list>
+#include <vector>
 
-class SensingClient
+#include "spectrumdecimator.h"
+
+/**
+ * \class     SensingClient
+ * \brief     A viewer connected to the SensingServer.
+ *
+ * \details   The requests of the client are read asynchronously, then the
+ *            messages are queued by #queue, which never blocks, and written
+ *            by the io_service's thread. Several queued messages are
+ *            written by a single async_write, each as a header and a
+ *            payload buffer.
+ *
+ *            The queue is bounded. When more than \a maxFfts FFT frames
+ *            wait, one is dropped according to the \a fftDropPolicy. The
+ *            other messages, the RET updates for instance, are never
+ *            dropped: a client having more than \a maxBytes queued is
+ *            disconnected instead.
+ *
+ *            **Thread-safety:** #queue and #statistics may be called from
+ *            any thread, the other methods from the io_service's thread.
+ */
+class SensingClient : public boost::enable_shared_from_this<SensingClient>
 {
 public:
 	struct freqInterest
@@ -14,23 +42,99 @@ public:
 		uint8_t error;
 	};
 
-	SensingClient(boost::asio::io_service &ios);
+	/// What to do with an FFT frame when too many of them are queued
+	enum DropPolicy
+	{
+		DROP_OLDEST, ///< Drop the oldest FFT frame not being written
+		DROP_NEWEST, ///< Drop the frame being queued
+	};
+
+	/// The bounds of the outgoing queue
+	struct QueueConfig
+	{
+		size_t maxFfts; ///< The FFT frames waiting before dropping one
+		DropPolicy fftDropPolicy; ///< The frame dropped
+		size_t maxBytes; ///< The bytes queued before disconnecting
+
+		/// 8 FFT frames, the oldest dropped, disconnected past 32 MB
+		QueueConfig();
+	};
+
+	/// A message, shared by the queues of all the clients
+	struct Message
+	{
+		char header[5]; ///< The type and the length of the payload
+		size_t headerSize; ///< 5, or 0 for the messages without header
+		std::vector<char> payload;
+		bool droppable; ///< An FFT frame, see DropPolicy
+
+		size_t size() const { return headerSize + payload.size(); }
+	};
+	typedef boost::shared_ptr<const Message> MessagePtr;
+
+	/// Counters since the connection
+	struct Statistics
+	{
+		uint64_t sentMessages; ///< The messages written
+		uint64_t droppedFfts; ///< The FFT frames dropped
+		size_t queuedBytes; ///< The bytes currently queued
+	};
+
+	typedef boost::function<void (const boost::shared_ptr<SensingClient> &)> ReadyHandler;
+
+	SensingClient(boost::asio::io_service &ios,
+		      const QueueConfig &config = QueueConfig());
 
 	boost::asio::ip::tcp::socket &socket() { return _socket; }
 	bool wantsFullSensing() const { return _fullSensing; }
+	const SpectrumDecimator::Resolution &resolution() const { return _resolution; }
 	std::list<freqInterest> &frequencies() { return _frequencies; }
 
-	void socketIsConnected();
+	/// Read the requests of the client, then call \a onReady
+	void socketIsConnected(const ReadyHandler &onReady);
 
-	bool send(const char *buf, size_t len);
+	/// Queue \a msg without blocking, false once disconnected
+	bool queue(const MessagePtr &msg);
+
+	bool isConnected();
+	Statistics statistics();
 
 private:
+	/* the messages written by one async_write */
+	static const size_t MAX_GATHERED_MESSAGES = 16;
+
+	boost::asio::io_service &_ios;
 	boost::asio::ip::tcp::socket _socket;
 	bool _fullSensing;
+	SpectrumDecimator::Resolution _resolution; /* of the spectra sent */
 
 	std::list<freqInterest> _frequencies;
 
-	bool readNBytes(char *buf, size_t size);
+	/* the requests being read */
+	ReadyHandler _onReady;
+	char _request[13];
+
+	/* the outgoing queue, its first _inFlight messages being written */
+	QueueConfig _config;
+	boost::mutex _mutex;
+	std::deque<MessagePtr> _queue;
+	size_t _inFlight;
+	size_t _waitingFfts; /* the FFT frames not in flight */
+	bool _writing; /* a write is posted or in flight */
+	bool _connected;
+	Statistics _stats;
+	std::vector<boost::asio::const_buffer> _buffers;
+
+	void readRequest();
+	void requestRead(const boost::system::error_code &error);
+	void frequencyRead(const boost::system::error_code &error);
+	void resolutionRead(const boost::system::error_code &error);
+
+	bool dropOldestFft();
+	void disconnect();
+	void close();
+	void write();
+	void written(const boost::system::error_code &error);
 };
 
 #endif // SENSINGCLIENT_H
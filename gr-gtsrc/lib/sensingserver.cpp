@@ -1,35 +1,55 @@
 #include "sensingserver.h"
 #include "message_utils.h"
 
+#include <string.h>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
 void SensingServer::io_service()
 {
 	startListening();
 	_ios.run();
 }
 
-void SensingServer::incomingConnection(SensingClient *client,
+void SensingServer::incomingConnection(const ClientPtr &client,
 				       const boost::system::error_code& error)
 {
+	if (error == boost::asio::error::operation_aborted)
+		return;
+
 	startListening();
 
-	if (!error) {
-		client->socketIsConnected();
+	/* the client is added once its requests are read */
+	if (!error)
+		client->socketIsConnected(boost::bind(&SensingServer::clientReady, this, _1));
+}
 
-		_clientsMutex.lock();
-		_clients.push_back(client);
-		_clientsMutex.unlock();
-	}
+void SensingServer::clientReady(const ClientPtr &client)
+{
+	_clientsMutex.lock();
+	_clients.push_back(client);
+	_newClients = true;
+	_clientsMutex.unlock();
 }
 
-SensingServer::SensingServer(uint16_t port) : _port(port),
-	_endpoint(boost::asio::ip::tcp::v4(), _port), _acceptor(_ios, _endpoint)
+SensingServer::SensingServer(uint16_t port, const SensingClient::QueueConfig &queueConfig) :
+	_port(port), _queueConfig(queueConfig), _work(_ios),
+	_endpoint(boost::asio::ip::tcp::v4(), _port), _acceptor(_ios, _endpoint),
+	_newClients(false), _droppedFfts(0), _disconnected(0)
 {
+	_port = _acceptor.local_endpoint().port();
 	_io_thread = boost::thread(&SensingServer::io_service, this);
 }
 
+SensingServer::~SensingServer()
+{
+	_ios.stop();
+	_io_thread.join();
+}
+
 void SensingServer::startListening()
 {
-	SensingClient *client = new SensingClient(_ios);
+	ClientPtr client(new SensingClient(_ios, _queueConfig));
 
 	_acceptor.async_accept(client->socket(),
 		boost::bind(&SensingServer::incomingConnection, this,
@@ -41,47 +61,182 @@ void SensingServer::stopListening()
 	_acceptor.cancel();
 }
 
-void SensingServer::sendToAll(const char *buf, size_t len)
+std::list<SensingServer::ClientPtr>::iterator
+SensingServer::removeClient(std::list<ClientPtr>::iterator client)
 {
+	_droppedFfts += (*client)->statistics().droppedFfts;
+	_disconnected++;
+	return _clients.erase(client);
+}
+
+boost::shared_ptr<SensingClient::Message>
+SensingServer::newMessage(MessageType type, size_t len)
+{
+	boost::shared_ptr<SensingClient::Message> msg;
+	msg = boost::make_shared<SensingClient::Message>();
+
+	size_t offset = 0;
+	write_and_update_offset(offset, msg->header, (char) type);
+	write_and_update_offset(offset, msg->header, (uint32_t) len);
+	msg->headerSize = offset;
+	msg->payload.resize(len);
+	msg->droppable = type == MSG_FFT;
+
+	return msg;
+}
+
+void SensingServer::sendToAll(MessageType type, const char *payload, size_t len)
+{
+	/* one copy, shared by all the clients */
+	boost::shared_ptr<SensingClient::Message> msg = newMessage(type, len);
+	memcpy(msg->payload.data(), payload, len);
+
 	_clientsMutex.lock();
 
-	std::list<SensingClient *>::iterator it;
+	std::list<ClientPtr>::iterator it = _clients.begin();
+	while (it != _clients.end()) {
+		if ((*it)->wantsFullSensing() && !(*it)->queue(msg))
+			it = removeClient(it);
+		else
+			++it;
+	}
+
+	_clientsMutex.unlock();
+}
+
+/* with _clientsMutex held, a reduction per resolution wanted */
+void SensingServer::updateDecimators()
+{
+	std::list<ClientPtr>::iterator it;
+
+	Decimators::iterator d = _decimators.begin();
+	while (d != _decimators.end()) {
+		for (it = _clients.begin(); it != _clients.end(); ++it) {
+			if ((*it)->wantsFullSensing() && (*it)->resolution() == d->first)
+				break;
+		}
+		if (it == _clients.end())
+			_decimators.erase(d++);
+		else
+			++d;
+	}
+
 	for (it = _clients.begin(); it != _clients.end(); ++it) {
-		if ((*it)->wantsFullSensing()) {
-			if (!(*it)->send(buf, len)) {
-				delete (*it);
-				it = _clients.erase(it);
-			}
+		const SpectrumDecimator::Resolution &resolution = (*it)->resolution();
+		if ((*it)->wantsFullSensing() && _decimators.find(resolution) == _decimators.end())
+			_decimators.insert(std::make_pair(resolution, SpectrumDecimator(resolution)));
+	}
+}
+
+void SensingServer::sendSpectrum(uint64_t time_ns, uint64_t startFrequency,
+				 uint64_t endFrequency, const float *bins, uint32_t fftSize)
+{
+	_clientsMutex.lock();
+
+	updateDecimators();
+
+	Decimators::iterator d;
+	for (d = _decimators.begin(); d != _decimators.end(); ++d) {
+		SpectrumDecimator &decimator = d->second;
+		if (!decimator.add(time_ns, startFrequency, endFrequency, bins, fftSize))
+			continue;
+
+		/* a byte per bin, in dBm */
+		const std::vector<float> &pwr = decimator.bins();
+		uint16_t count = pwr.size();
+		boost::shared_ptr<SensingClient::Message> msg = newMessage(MSG_FFT, 26 + count);
+
+		char *payload = msg->payload.data();
+		size_t offset = 0;
+		write_and_update_offset(offset, payload, count);
+		write_and_update_offset(offset, payload, decimator.startFrequency());
+		write_and_update_offset(offset, payload, decimator.endFrequency());
+		write_and_update_offset(offset, payload, decimator.time_ns());
+		for (uint16_t i = 0; i < count; i++) {
+			float p = pwr[i] < -128 ? -128 : (pwr[i] > 127 ? 127 : pwr[i]);
+			payload[offset + i] = (char) p;
+		}
+
+		std::list<ClientPtr>::iterator it = _clients.begin();
+		while (it != _clients.end()) {
+			if ((*it)->wantsFullSensing() && (*it)->resolution() == d->first &&
+			    !(*it)->queue(msg))
+				it = removeClient(it);
+			else
+				++it;
 		}
 	}
 
 	_clientsMutex.unlock();
 }
 
-void SensingServer::sendDetection(std::list<SensingClient *>::iterator &client, const SensingClient::freqInterest &f)
+bool SensingServer::hasNewClients()
 {
-	char buffer[20];
-	size_t offset = 0;
+	_clientsMutex.lock();
+	bool ret = _newClients;
+	_newClients = false;
+	_clientsMutex.unlock();
 
-	write_and_update_offset(offset, buffer, (char)2);
-	write_and_update_offset(offset, buffer, f.centralFreq);
-	write_and_update_offset(offset, buffer, f.bandwidth);
-	write_and_update_offset(offset, buffer, f.error);
+	return ret;
+}
+
+SensingServer::Statistics SensingServer::statistics()
+{
+	Statistics stats;
 
-	if (!(*client)->send(buffer, offset)) {
-		/*delete (*client);
-		client = _clients.erase(client);*/
+	_clientsMutex.lock();
+
+	stats.clients = _clients.size();
+	stats.queuedBytes = 0;
+	stats.droppedFfts = _droppedFfts;
+	stats.disconnected = _disconnected;
+
+	std::list<ClientPtr>::iterator it;
+	for (it = _clients.begin(); it != _clients.end(); ++it) {
+		SensingClient::Statistics client = (*it)->statistics();
+		stats.queuedBytes += client.queuedBytes;
+		stats.droppedFfts += client.droppedFfts;
 	}
+
+	_clientsMutex.unlock();
+
+	return stats;
+}
+
+void SensingServer::sendDetection(const ClientPtr &client, const SensingClient::freqInterest &f)
+{
+	boost::shared_ptr<SensingClient::Message> msg;
+	msg = boost::make_shared<SensingClient::Message>();
+
+	/* the detections have no header */
+	msg->headerSize = 0;
+	msg->payload.resize(14);
+	msg->droppable = false;
+
+	size_t offset = 0;
+	write_and_update_offset(offset, msg->payload.data(), (char)2);
+	write_and_update_offset(offset, msg->payload.data(), f.centralFreq);
+	write_and_update_offset(offset, msg->payload.data(), f.bandwidth);
+	write_and_update_offset(offset, msg->payload.data(), f.error);
+
+	client->queue(msg);
 }
 
 void SensingServer::matchActiveCommunications(RadioEventTable &ret)
 {
+	_clientsMutex.lock();
 
 	/* for all clients */
-	std::list<SensingClient *>::iterator itClient;
-	for (itClient = _clients.begin(); itClient != _clients.end(); ++itClient) {
-		if ((*itClient)->wantsFullSensing())
+	std::list<ClientPtr>::iterator itClient = _clients.begin();
+	while (itClient != _clients.end()) {
+		if ((*itClient)->wantsFullSensing()) {
+			++itClient;
+			continue;
+		}
+		if (!(*itClient)->isConnected()) {
+			itClient = removeClient(itClient);
 			continue;
+		}
 
 		/* for all wanted communications */
 		std::list< SensingClient::freqInterest >::iterator itWanted;
@@ -95,8 +250,12 @@ void SensingServer::matchActiveCommunications(RadioEventTable &ret)
 			if (entry) {
 				fprintf(stderr, "Found a matching communication: fc = %llu kHz\n",
 					f.centralFreq);
-				sendDetection(itClient, f);
+				sendDetection(*itClient, f);
 			}
 		}
+
+		++itClient;
 	}
+
+	_clientsMutex.unlock();
 }
@@ -2,42 +2,126 @@
 #define SENSINGSERVER_H
 
 #include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
-#include <boost/asio.hpp>
 
+#include <list>
+#include <map>
 #include <memory>
 
 #include "sensingclient.h"
+#include "spectrumdecimator.h"
 #include "ret_entry.h"
 #include "radioeventtable.h"
 
-enum MessageType { MSG_FFT = 1, MSG_RET = 2 };
+enum MessageType { MSG_FFT = 1, MSG_RET = 2, MSG_RET_UPDATE = 3 };
+
+/// The port of the first hachoir_c block, the next ones take the following ports
+#define SENSING_SERVER_DEFAULT_PORT 21333
 
+/**
+ * \class     SensingServer
+ * \brief     Sends the spectrum and the RET to the connected clients.
+ *
+ * \details   The sockets are handled by the io_service's thread only. The
+ *            messages are built once, shared by the outgoing queues of the
+ *            clients and written asynchronously, see SensingClient: a slow
+ *            client lags, losing FFT frames, but never blocks the caller.
+ *
+ *            Every client gets the spectra at the resolution it asked for,
+ *            see SpectrumDecimator. The clients asking for the same
+ *            resolution share the reduction and the messages.
+ *
+ *            **Thread-safety:** Thread safe.
+ */
 class SensingServer
 {
+public:
+	/// Counters of all the clients
+	struct Statistics
+	{
+		size_t clients; ///< The clients connected
+		size_t queuedBytes; ///< The bytes queued for them
+		uint64_t droppedFfts; ///< The FFT frames they lost
+		uint64_t disconnected; ///< The clients gone since the start
+	};
+
 private:
+	typedef boost::shared_ptr<SensingClient> ClientPtr;
+
 	uint16_t _port;
+	SensingClient::QueueConfig _queueConfig;
 
 	boost::asio::io_service _ios;
+	boost::asio::io_service::work _work; /* run() even without client */
 	boost::asio::ip::tcp::endpoint _endpoint;
 	boost::asio::ip::tcp::acceptor _acceptor;
 	boost::thread _io_thread;
 
 	boost::mutex _clientsMutex;
-	std::list<SensingClient*> _clients;
+	std::list<ClientPtr> _clients;
+	bool _newClients; /* connected since the last hasNewClients() */
+	uint64_t _droppedFfts; /* by the clients gone */
+	uint64_t _disconnected;
+
+	/* the reduction of the spectra, by resolution wanted */
+	typedef std::map<SpectrumDecimator::Resolution, SpectrumDecimator> Decimators;
+	Decimators _decimators;
 
 	void io_service();
-	void incomingConnection(SensingClient *client,
+	void incomingConnection(const ClientPtr &client,
 				const boost::system::error_code &error);
+	void clientReady(const ClientPtr &client);
+
+	/* with _clientsMutex held, forget the clients disconnected */
+	std::list<ClientPtr>::iterator removeClient(std::list<ClientPtr>::iterator client);
 
-	void sendDetection(std::list<SensingClient *>::iterator &client, const SensingClient::freqInterest &f);
+	boost::shared_ptr<SensingClient::Message> newMessage(MessageType type, size_t len);
+	void updateDecimators();
+
+	void sendDetection(const ClientPtr &client, const SensingClient::freqInterest &f);
 public:
-	SensingServer(uint16_t port);
+	/**
+	 * \brief    Listen on \a port, 0 for any free port.
+	 *
+	 * \param    port          The TCP port
+	 * \param    queueConfig   The bounds of the queue of every client
+	 * \return   Nothing.
+	 */
+	SensingServer(uint16_t port,
+		      const SensingClient::QueueConfig &queueConfig = SensingClient::QueueConfig());
+	~SensingServer();
+
+	uint16_t port() const { return _port; }
 
 	void startListening();
 	void stopListening();
 
-	void sendToAll(const char *buf, size_t len);
+	/// Queue the message to the full-sensing clients, never blocks
+	void sendToAll(MessageType type, const char *payload, size_t len);
+
+	/**
+	 * \brief    Queue a spectrum to the full-sensing clients, never blocks.
+	 *
+	 * \details  The spectrum is reduced for every resolution asked for by
+	 *           the clients, the MSG_FFT messages are sent when a reduction
+	 *           is complete. Any FFT size is supported.
+	 *
+	 * \param    time_ns          The time of the first sample of the FFT
+	 * \param    startFrequency   The frequency of the first bin, in Hz
+	 * \param    endFrequency     The frequency of the last bin, in Hz
+	 * \param    bins             The power of the bins, in dBm
+	 * \param    fftSize          The number of bins
+	 * \return   Nothing.
+	 */
+	void sendSpectrum(uint64_t time_ns, uint64_t startFrequency,
+			  uint64_t endFrequency, const float *bins, uint32_t fftSize);
+
+	/* did clients connect since the last call? */
+	bool hasNewClients();
+
+	Statistics statistics();
+
 	void matchActiveCommunications(RadioEventTable &ret);
 };
 
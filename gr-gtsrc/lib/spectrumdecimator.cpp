@@ -0,0 +1,105 @@
+#include "spectrumdecimator.h"
+
+#include <string.h>
+
+SpectrumDecimator::Resolution::Resolution() :
+	maxBins(0), frames(10), mode(MAX_HOLD)
+{
+}
+
+SpectrumDecimator::Resolution::Resolution(uint16_t maxBins, uint16_t frames, Mode mode) :
+	maxBins(maxBins), frames(frames > 0 ? frames : 1), mode(mode)
+{
+}
+
+bool SpectrumDecimator::Resolution::operator<(const Resolution &other) const
+{
+	if (maxBins != other.maxBins)
+		return maxBins < other.maxBins;
+	if (frames != other.frames)
+		return frames < other.frames;
+	return mode < other.mode;
+}
+
+bool SpectrumDecimator::Resolution::operator==(const Resolution &other) const
+{
+	return maxBins == other.maxBins && frames == other.frames && mode == other.mode;
+}
+
+SpectrumDecimator::SpectrumDecimator(const Resolution &resolution) :
+	_resolution(resolution), _fftSize(0), _count(0), _time_ns(0),
+	_startFrequency(0), _endFrequency(0), _outStartFrequency(0), _outEndFrequency(0)
+{
+	if (_resolution.frames == 0)
+		_resolution.frames = 1;
+}
+
+bool SpectrumDecimator::add(uint64_t time_ns, uint64_t startFrequency,
+			    uint64_t endFrequency, const float *bins, uint32_t fftSize)
+{
+	if (fftSize == 0)
+		return false;
+
+	/* start over on a new spectrum size or frequency */
+	if (fftSize != _fftSize || startFrequency != _startFrequency ||
+	    endFrequency != _endFrequency) {
+		_acc.resize(fftSize);
+		_fftSize = fftSize;
+		_startFrequency = startFrequency;
+		_endFrequency = endFrequency;
+		_count = 0;
+	}
+
+	float *acc = _acc.data();
+	if (_count == 0) {
+		memcpy(acc, bins, fftSize * sizeof(float));
+		_time_ns = time_ns;
+	} else if (_resolution.mode == MAX_HOLD) {
+		for (uint32_t i = 0; i < fftSize; i++)
+			acc[i] = bins[i] > acc[i] ? bins[i] : acc[i];
+	} else {
+		for (uint32_t i = 0; i < fftSize; i++)
+			acc[i] += bins[i];
+	}
+
+	if (++_count < _resolution.frames)
+		return false;
+
+	reduceBins();
+	_count = 0;
+
+	return true;
+}
+
+void SpectrumDecimator::reduceBins()
+{
+	uint32_t maxBins = _resolution.maxBins > 0 ? _resolution.maxBins : 0xFFFF;
+	uint32_t group = (_fftSize + maxBins - 1) / maxBins;
+	uint32_t count = (_fftSize + group - 1) / group;
+
+	_bins.resize(count);
+	const float *acc = _acc.data();
+	float scale = 1.0 / _count;
+
+	for (uint32_t g = 0; g < count; g++) {
+		uint32_t begin = g * group;
+		uint32_t end = begin + group < _fftSize ? begin + group : _fftSize;
+
+		float v = acc[begin];
+		if (_resolution.mode == MAX_HOLD) {
+			for (uint32_t i = begin + 1; i < end; i++)
+				v = acc[i] > v ? acc[i] : v;
+		} else {
+			for (uint32_t i = begin + 1; i < end; i++)
+				v += acc[i];
+			v *= scale / (end - begin);
+		}
+		_bins[g] = v;
+	}
+
+	/* the frequencies of the centers of the first and last groups */
+	double step = _fftSize > 1 ? (double)(_endFrequency - _startFrequency) / (_fftSize - 1) : 0;
+	uint32_t lastBegin = (count - 1) * group;
+	_outStartFrequency = _startFrequency + step * (group - 1) / 2;
+	_outEndFrequency = _startFrequency + step * (lastBegin + _fftSize - 1) / 2;
+}
@@ -0,0 +1,106 @@
+/**
+ * \file      spectrumdecimator.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef SPECTRUMDECIMATOR_H
+#define SPECTRUMDECIMATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * \class     SpectrumDecimator
+ * \brief     Reduces the spectra to the resolution wanted by a client.
+ *
+ * \details   In time, \a frames consecutive spectra are reduced to one,
+ *            bin by bin, keeping either the highest power (max-hold) or
+ *            the average power. In frequency, groups of adjacent bins are
+ *            then reduced the same way, so as at most \a maxBins bins are
+ *            left. The powers are averaged in dBm.
+ *
+ *            A spectrum costs a pass over its bins, the reduction in
+ *            frequency is done once per output spectrum.
+ *
+ *            The reduction starts over when the size of the spectra
+ *            changes.
+ *
+ *            **Thread-safety:** Not thread safe.
+ */
+class SpectrumDecimator
+{
+public:
+	/// How the powers are reduced
+	enum Mode
+	{
+		AVERAGE = 0, ///< The average power, in dBm
+		MAX_HOLD = 1, ///< The highest power
+	};
+
+	/// The resolution wanted by a client
+	struct Resolution
+	{
+		uint16_t maxBins; ///< The most bins of a spectrum, 0 for all of them (up to 65535)
+		uint16_t frames; ///< The spectra reduced into one, at least 1
+		Mode mode; ///< How the spectra and the bins are reduced
+
+		/// All the bins, the max-hold of 10 spectra
+		Resolution();
+		Resolution(uint16_t maxBins, uint16_t frames, Mode mode);
+
+		bool operator<(const Resolution &other) const;
+		bool operator==(const Resolution &other) const;
+	};
+
+private:
+	Resolution _resolution;
+
+	std::vector<float> _acc; ///< The spectra reduced so far, full resolution
+	uint32_t _fftSize;
+	uint16_t _count; ///< The spectra in _acc
+	uint64_t _time_ns; ///< The time of the first spectrum in _acc
+	uint64_t _startFrequency;
+	uint64_t _endFrequency;
+
+	std::vector<float> _bins; ///< The last output spectrum
+	uint64_t _outStartFrequency;
+	uint64_t _outEndFrequency;
+
+	void reduceBins();
+
+public:
+	SpectrumDecimator(const Resolution &resolution = Resolution());
+
+	const Resolution &resolution() const { return _resolution; }
+
+	/**
+	 * \brief    Add a spectrum.
+	 *
+	 * \param    time_ns          The time of the first sample of the FFT
+	 * \param    startFrequency   The frequency of the first bin, in Hz
+	 * \param    endFrequency     The frequency of the last bin, in Hz
+	 * \param    bins             The power of the bins, in dBm
+	 * \param    fftSize          The number of bins
+	 * \return   True when \a frames spectra were reduced into a new output
+	 *           spectrum, see #bins.
+	 */
+	bool add(uint64_t time_ns, uint64_t startFrequency, uint64_t endFrequency,
+		 const float *bins, uint32_t fftSize);
+
+	/// The last output spectrum, in dBm
+	const std::vector<float> &bins() const { return _bins; }
+
+	/// The time of the first spectrum reduced into the output
+	uint64_t time_ns() const { return _time_ns; }
+
+	/// The central frequency of the first output bin, in Hz
+	uint64_t startFrequency() const { return _outStartFrequency; }
+
+	/// The central frequency of the last output bin, in Hz
+	uint64_t endFrequency() const { return _outEndFrequency; }
+};
+
+#endif // SPECTRUMDECIMATOR_H
@@ -0,0 +1,456 @@
+#include "spectrumkernels.h"
+
+#include <float.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SPECTRUMKERNELS_X86 1
+#include <immintrin.h>
+
+/* the AVX-512 intrinsics use self-initialized "undefined" vectors */
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#if defined(__aarch64__) || (defined(__ARM_NEON) && defined(__ARM_FEATURE_FMA))
+#define SPECTRUMKERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* 10 * log10(2), converts a log2 into dB */
+#define DB_PER_LOG2 3.010299957f
+
+/* Minimax polynomial of log2(1 + x) on [0, 1), max error 1.26e-5 */
+#define LOG2_C0 1.253874416e-05f
+#define LOG2_C1 1.441684604e+00f
+#define LOG2_C2 -7.079926729e-01f
+#define LOG2_C3 4.136301279e-01f
+#define LOG2_C4 -1.921956390e-01f
+#define LOG2_C5 4.487361014e-02f
+
+static inline float fast_log2(float x)
+{
+	uint32_t bits;
+	float e, m;
+
+	if (!(x >= FLT_MIN))
+		x = FLT_MIN;
+
+	memcpy(&bits, &x, sizeof(bits));
+	e = (float)((int32_t)(bits >> 23) - 127);
+	bits = (bits & 0x007FFFFF) | 0x3F800000;
+	memcpy(&m, &bits, sizeof(m));
+	m -= 1.0f;
+
+	float p = LOG2_C5;
+	p = p * m + LOG2_C4;
+	p = p * m + LOG2_C3;
+	p = p * m + LOG2_C2;
+	p = p * m + LOG2_C1;
+	p = p * m + LOG2_C0;
+
+	return e + p;
+}
+
+static void applyWindowScalar(gr_complex *dst, const gr_complex *src,
+			      const float *win, size_t length)
+{
+	const float *s = (const float *)src;
+	float *d = (float *)dst;
+
+	for (size_t i = 0; i < length; i++) {
+		d[2 * i] = s[2 * i] * win[i];
+		d[2 * i + 1] = s[2 * i + 1] * win[i];
+	}
+}
+
+static void powerDbScalar(float *dst, const gr_complex *src, size_t length,
+			  float offset)
+{
+	const float *s = (const float *)src;
+
+	for (size_t i = 0; i < length; i++) {
+		float re = s[2 * i], im = s[2 * i + 1];
+		dst[i] = fast_log2(re * re + im * im) * DB_PER_LOG2 + offset;
+	}
+}
+
+#ifdef SPECTRUMKERNELS_X86
+__attribute__((target("avx2,fma")))
+static inline __m256 fast_log2_avx2(__m256 x)
+{
+	x = _mm256_max_ps(x, _mm256_set1_ps(FLT_MIN));
+
+	__m256i bits = _mm256_castps_si256(x);
+	__m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+						       _mm256_set1_epi32(127)));
+	bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+			       _mm256_set1_epi32(0x3F800000));
+	__m256 m = _mm256_sub_ps(_mm256_castsi256_ps(bits), _mm256_set1_ps(1.0f));
+
+	__m256 p = _mm256_set1_ps(LOG2_C5);
+	p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG2_C4));
+	p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG2_C3));
+	p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG2_C2));
+	p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG2_C1));
+	p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG2_C0));
+
+	return _mm256_add_ps(e, p);
+}
+
+__attribute__((target("avx2,fma")))
+static void applyWindowAvx2(gr_complex *dst, const gr_complex *src,
+			    const float *win, size_t length)
+{
+	const float *s = (const float *)src;
+	float *d = (float *)dst;
+	size_t i = 0;
+
+	/* 4 complex samples per register, each coefficient is used twice */
+	for (; i + 8 <= length; i += 8) {
+		__m128 w0 = _mm_loadu_ps(win + i);
+		__m128 w1 = _mm_loadu_ps(win + i + 4);
+		__m256 ww0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(w0, w0)),
+						  _mm_unpackhi_ps(w0, w0), 1);
+		__m256 ww1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(w1, w1)),
+						  _mm_unpackhi_ps(w1, w1), 1);
+
+		_mm256_storeu_ps(d + 2 * i, _mm256_mul_ps(_mm256_loadu_ps(s + 2 * i), ww0));
+		_mm256_storeu_ps(d + 2 * i + 8, _mm256_mul_ps(_mm256_loadu_ps(s + 2 * i + 8), ww1));
+	}
+
+	/* avoid the AVX to SSE transition penalty in the scalar code,
+	 * gcc does not always insert it before a tail call.
+	 */
+	_mm256_zeroupper();
+	applyWindowScalar(dst + i, src + i, win + i, length - i);
+}
+
+__attribute__((target("avx2,fma")))
+static void powerDbAvx2(float *dst, const gr_complex *src, size_t length,
+			float offset)
+{
+	const float *s = (const float *)src;
+	__m256 scale = _mm256_set1_ps(DB_PER_LOG2);
+	__m256 off = _mm256_set1_ps(offset);
+	size_t i = 0;
+
+	for (; i + 8 <= length; i += 8) {
+		__m256 a = _mm256_loadu_ps(s + 2 * i);
+		__m256 b = _mm256_loadu_ps(s + 2 * i + 8);
+
+		/* hadd interleaves the lanes: p0 p1 p4 p5 p2 p3 p6 p7 */
+		__m256 p = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+		p = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), 0xD8));
+
+		_mm256_storeu_ps(dst + i, _mm256_fmadd_ps(fast_log2_avx2(p), scale, off));
+	}
+
+	_mm256_zeroupper();
+	powerDbScalar(dst + i, src + i, length - i, offset);
+}
+
+/* vzeroupper does not clean zmm16-31: once used, they keep the upper state
+ * dirty and every SSE instruction executed afterwards (libm, FFTW, ...)
+ * gets much slower. Zeroing them explicitly cleans the state.
+ */
+__attribute__((target("avx512f")))
+static inline void avx512_cleanup()
+{
+#ifdef __x86_64__
+	__asm__ volatile(
+		"vpxord %%xmm16, %%xmm16, %%xmm16\n\t"
+		"vpxord %%xmm17, %%xmm17, %%xmm17\n\t"
+		"vpxord %%xmm18, %%xmm18, %%xmm18\n\t"
+		"vpxord %%xmm19, %%xmm19, %%xmm19\n\t"
+		"vpxord %%xmm20, %%xmm20, %%xmm20\n\t"
+		"vpxord %%xmm21, %%xmm21, %%xmm21\n\t"
+		"vpxord %%xmm22, %%xmm22, %%xmm22\n\t"
+		"vpxord %%xmm23, %%xmm23, %%xmm23\n\t"
+		"vpxord %%xmm24, %%xmm24, %%xmm24\n\t"
+		"vpxord %%xmm25, %%xmm25, %%xmm25\n\t"
+		"vpxord %%xmm26, %%xmm26, %%xmm26\n\t"
+		"vpxord %%xmm27, %%xmm27, %%xmm27\n\t"
+		"vpxord %%xmm28, %%xmm28, %%xmm28\n\t"
+		"vpxord %%xmm29, %%xmm29, %%xmm29\n\t"
+		"vpxord %%xmm30, %%xmm30, %%xmm30\n\t"
+		"vpxord %%xmm31, %%xmm31, %%xmm31"
+		::: "xmm16", "xmm17", "xmm18", "xmm19", "xmm20", "xmm21",
+		    "xmm22", "xmm23", "xmm24", "xmm25", "xmm26", "xmm27",
+		    "xmm28", "xmm29", "xmm30", "xmm31");
+#endif
+	_mm256_zeroupper();
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 fast_log2_avx512(__m512 x)
+{
+	x = _mm512_max_ps(x, _mm512_set1_ps(FLT_MIN));
+
+	__m512i bits = _mm512_castps_si512(x);
+	__m512 e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23),
+						       _mm512_set1_epi32(127)));
+	bits = _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007FFFFF)),
+			       _mm512_set1_epi32(0x3F800000));
+	__m512 m = _mm512_sub_ps(_mm512_castsi512_ps(bits), _mm512_set1_ps(1.0f));
+
+	__m512 p = _mm512_set1_ps(LOG2_C5);
+	p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG2_C4));
+	p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG2_C3));
+	p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG2_C2));
+	p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG2_C1));
+	p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG2_C0));
+
+	return _mm512_add_ps(e, p);
+}
+
+__attribute__((target("avx512f")))
+static void applyWindowAvx512(gr_complex *dst, const gr_complex *src,
+			      const float *win, size_t length)
+{
+	const float *s = (const float *)src;
+	float *d = (float *)dst;
+	const __m512i dup = _mm512_set_epi32(7, 7, 6, 6, 5, 5, 4, 4,
+					     3, 3, 2, 2, 1, 1, 0, 0);
+	size_t i = 0;
+
+	/* 8 complex samples per register, each coefficient is used twice */
+	for (; i + 8 <= length; i += 8) {
+		__m512 w = _mm512_castps256_ps512(_mm256_loadu_ps(win + i));
+		__m512 ww = _mm512_permutexvar_ps(dup, w);
+
+		_mm512_storeu_ps(d + 2 * i, _mm512_mul_ps(_mm512_loadu_ps(s + 2 * i), ww));
+	}
+
+	avx512_cleanup();
+	applyWindowScalar(dst + i, src + i, win + i, length - i);
+}
+
+__attribute__((target("avx512f")))
+static void powerDbAvx512(float *dst, const gr_complex *src, size_t length,
+			  float offset)
+{
+	const float *s = (const float *)src;
+	const __m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16,
+					      14, 12, 10, 8, 6, 4, 2, 0);
+	const __m512i odd = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17,
+					     15, 13, 11, 9, 7, 5, 3, 1);
+	__m512 scale = _mm512_set1_ps(DB_PER_LOG2);
+	__m512 off = _mm512_set1_ps(offset);
+	size_t i = 0;
+
+	for (; i + 16 <= length; i += 16) {
+		__m512 a = _mm512_loadu_ps(s + 2 * i);
+		__m512 b = _mm512_loadu_ps(s + 2 * i + 16);
+		__m512 re = _mm512_permutex2var_ps(a, even, b);
+		__m512 im = _mm512_permutex2var_ps(a, odd, b);
+		__m512 p = _mm512_fmadd_ps(re, re, _mm512_mul_ps(im, im));
+
+		_mm512_storeu_ps(dst + i, _mm512_fmadd_ps(fast_log2_avx512(p), scale, off));
+	}
+
+	avx512_cleanup();
+	powerDbScalar(dst + i, src + i, length - i, offset);
+}
+#endif
+
+#ifdef SPECTRUMKERNELS_NEON
+static inline float32x4_t fast_log2_neon(float32x4_t x)
+{
+	x = vmaxq_f32(x, vdupq_n_f32(FLT_MIN));
+
+	uint32x4_t bits = vreinterpretq_u32_f32(x);
+	float32x4_t e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)),
+						vdupq_n_s32(127)));
+	bits = vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x007FFFFF)),
+			 vdupq_n_u32(0x3F800000));
+	float32x4_t m = vsubq_f32(vreinterpretq_f32_u32(bits), vdupq_n_f32(1.0f));
+
+	float32x4_t p = vdupq_n_f32(LOG2_C5);
+	p = vfmaq_f32(vdupq_n_f32(LOG2_C4), p, m);
+	p = vfmaq_f32(vdupq_n_f32(LOG2_C3), p, m);
+	p = vfmaq_f32(vdupq_n_f32(LOG2_C2), p, m);
+	p = vfmaq_f32(vdupq_n_f32(LOG2_C1), p, m);
+	p = vfmaq_f32(vdupq_n_f32(LOG2_C0), p, m);
+
+	return vaddq_f32(e, p);
+}
+
+static void applyWindowNeon(gr_complex *dst, const gr_complex *src,
+			    const float *win, size_t length)
+{
+	const float *s = (const float *)src;
+	float *d = (float *)dst;
+	size_t i = 0;
+
+	for (; i + 4 <= length; i += 4) {
+		float32x4x2_t v = vld2q_f32(s + 2 * i);
+		float32x4_t w = vld1q_f32(win + i);
+
+		v.val[0] = vmulq_f32(v.val[0], w);
+		v.val[1] = vmulq_f32(v.val[1], w);
+		vst2q_f32(d + 2 * i, v);
+	}
+
+	applyWindowScalar(dst + i, src + i, win + i, length - i);
+}
+
+static void powerDbNeon(float *dst, const gr_complex *src, size_t length,
+			float offset)
+{
+	const float *s = (const float *)src;
+	float32x4_t scale = vdupq_n_f32(DB_PER_LOG2);
+	float32x4_t off = vdupq_n_f32(offset);
+	size_t i = 0;
+
+	for (; i + 4 <= length; i += 4) {
+		float32x4x2_t v = vld2q_f32(s + 2 * i);
+		float32x4_t p = vfmaq_f32(vmulq_f32(v.val[1], v.val[1]),
+					  v.val[0], v.val[0]);
+
+		vst1q_f32(dst + i, vfmaq_f32(off, fast_log2_neon(p), scale));
+	}
+
+	powerDbScalar(dst + i, src + i, length - i, offset);
+}
+#endif
+
+bool SpectrumKernels::isSupported(Isa isa)
+{
+	switch (isa) {
+	case SCALAR:
+		return true;
+#ifdef SPECTRUMKERNELS_X86
+	case AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	case AVX512:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef SPECTRUMKERNELS_NEON
+	case NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+const char *SpectrumKernels::name(Isa isa)
+{
+	switch (isa) {
+	case SCALAR:
+		return "scalar";
+	case AVX2:
+		return "avx2";
+	case AVX512:
+		return "avx512";
+	case NEON:
+		return "neon";
+	default:
+		return "unknown";
+	}
+}
+
+SpectrumKernels::ApplyWindowFn SpectrumKernels::applyWindowFor(Isa isa)
+{
+	if (!isSupported(isa))
+		return NULL;
+
+	switch (isa) {
+#ifdef SPECTRUMKERNELS_X86
+	case AVX2:
+		return applyWindowAvx2;
+	case AVX512:
+		return applyWindowAvx512;
+#endif
+#ifdef SPECTRUMKERNELS_NEON
+	case NEON:
+		return applyWindowNeon;
+#endif
+	default:
+		return applyWindowScalar;
+	}
+}
+
+SpectrumKernels::PowerDbFn SpectrumKernels::powerDbFor(Isa isa)
+{
+	if (!isSupported(isa))
+		return NULL;
+
+	switch (isa) {
+#ifdef SPECTRUMKERNELS_X86
+	case AVX2:
+		return powerDbAvx2;
+	case AVX512:
+		return powerDbAvx512;
+#endif
+#ifdef SPECTRUMKERNELS_NEON
+	case NEON:
+		return powerDbNeon;
+#endif
+	default:
+		return powerDbScalar;
+	}
+}
+
+namespace {
+	struct Dispatch
+	{
+		SpectrumKernels::Isa isa;
+		SpectrumKernels::ApplyWindowFn applyWindow;
+		SpectrumKernels::PowerDbFn powerDb;
+
+		Dispatch()
+		{
+			static const SpectrumKernels::Isa preferred[] = {
+				SpectrumKernels::AVX512, SpectrumKernels::AVX2,
+				SpectrumKernels::NEON, SpectrumKernels::SCALAR
+			};
+
+			for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+				if (SpectrumKernels::isSupported(preferred[i])) {
+					isa = preferred[i];
+					break;
+				}
+			}
+			applyWindow = SpectrumKernels::applyWindowFor(isa);
+			powerDb = SpectrumKernels::powerDbFor(isa);
+		}
+	};
+
+	const Dispatch &dispatch()
+	{
+		static const Dispatch d;
+		return d;
+	}
+}
+
+SpectrumKernels::Isa SpectrumKernels::selected()
+{
+	return dispatch().isa;
+}
+
+void SpectrumKernels::applyWindow(gr_complex *dst, const gr_complex *src,
+				  const float *win, size_t length)
+{
+	dispatch().applyWindow(dst, src, win, length);
+}
+
+void SpectrumKernels::powerDb(float *dst, const gr_complex *src, size_t length,
+			      float offset)
+{
+	dispatch().powerDb(dst, src, length, offset);
+}
+
+void SpectrumKernels::powerDbShifted(float *dst, const gr_complex *src,
+				     size_t fftSize, float offset)
+{
+	size_t half = fftSize / 2;
+	PowerDbFn powerDb = dispatch().powerDb;
+
+	/* dst[i] = power(src[(i + fftSize/2) % fftSize]) */
+	powerDb(dst, src + half, fftSize - half, offset);
+	powerDb(dst + fftSize - half, src, half, offset);
+}
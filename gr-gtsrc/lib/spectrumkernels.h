@@ -0,0 +1,100 @@
+/**
+ * \file      spectrumkernels.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef SPECTRUMKERNELS_H
+#define SPECTRUMKERNELS_H
+
+#include <gnuradio/gr_complex.h>
+#include <stddef.h>
+
+/**
+ * \class     SpectrumKernels
+ * \brief     Vectorized kernels used to turn samples into a power spectrum.
+ *
+ * \details   Every kernel comes in a scalar version and, when the
+ *            architecture has them, AVX2, AVX-512 and NEON versions. The
+ *            best implementation supported by the CPU is selected at
+ *            runtime, the first time a kernel is called.
+ *
+ *            The power is computed as 10*log10(re² + im²), without any
+ *            square root, using a polynomial approximation of log2 whose
+ *            error is lower than 0.0001 dB. The scalar version uses the
+ *            same approximation so as the output does not depend on the CPU.
+ *            A null power is clamped to FLT_MIN (about -379 dB).
+ *
+ *            **Thread-safety:** All the kernels are thread safe.
+ */
+class SpectrumKernels
+{
+public:
+	enum Isa {
+		SCALAR = 0,
+		AVX2 = 1,
+		AVX512 = 2,
+		NEON = 3,
+		ISA_COUNT
+	};
+
+	typedef void (*ApplyWindowFn)(gr_complex *dst, const gr_complex *src,
+				      const float *win, size_t length);
+	typedef void (*PowerDbFn)(float *dst, const gr_complex *src,
+				  size_t length, float offset);
+
+	/// Returns true if the current CPU can run the kernels of \a isa
+	static bool isSupported(Isa isa);
+
+	/// Returns the name of \a isa
+	static const char *name(Isa isa);
+
+	/// Returns the instruction set used by #applyWindow and #powerDb
+	static Isa selected();
+
+	/// Returns the window kernel for \a isa, NULL if it is not supported
+	static ApplyWindowFn applyWindowFor(Isa isa);
+
+	/// Returns the power kernel for \a isa, NULL if it is not supported
+	static PowerDbFn powerDbFor(Isa isa);
+
+	/**
+	 * \brief    Apply a window on samples: dst[i] = src[i] * win[i]
+	 *
+	 * \param    dst     The output buffer, \a length samples
+	 * \param    src     The input samples, may be equal to \a dst
+	 * \param    win     The window, \a length coefficients
+	 * \param    length  The number of samples
+	 * \return   Nothing.
+	 */
+	static void applyWindow(gr_complex *dst, const gr_complex *src,
+				const float *win, size_t length);
+
+	/**
+	 * \brief    Compute the power: dst[i] = 10*log10(|src[i]|²) + offset
+	 *
+	 * \param    dst     The output buffer, \a length values
+	 * \param    src     The input bins
+	 * \param    length  The number of bins
+	 * \param    offset  The value to add to every power, in dB
+	 * \return   Nothing.
+	 */
+	static void powerDb(float *dst, const gr_complex *src, size_t length,
+			    float offset);
+
+	/**
+	 * \brief    Same as #powerDb but also swaps the two halves of the
+	 *           spectrum (fftshift) so as bin 0 is the lowest frequency.
+	 *
+	 * \param    dst      The output buffer, \a fftSize values
+	 * \param    src      The output of an FFT
+	 * \param    fftSize  The size of the FFT
+	 * \param    offset   The value to add to every power, in dB
+	 * \return   Nothing.
+	 */
+	static void powerDbShifted(float *dst, const gr_complex *src,
+				   size_t fftSize, float offset);
+};
+
+#endif // SPECTRUMKERNELS_H
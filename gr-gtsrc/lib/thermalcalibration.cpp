@@ -0,0 +1,316 @@
+#include "thermalcalibration.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "alignedallocator.h"
+#include "fftaverage.h"
+#include "fftbatch.h"
+#include "spectrumkernels.h"
+
+#define CALIBRATION_FILE_MAGIC "GTSRCCAL"
+#define CALIBRATION_FILE_VERSION 1
+
+/* the header of a calibration file, followed by the mean, the variance, the
+ * median and the high quantile of every bin, fftSize floats each
+ */
+struct CalibrationFileHeader
+{
+	char magic[8]; ///< CALIBRATION_FILE_MAGIC
+	uint32_t version; ///< CALIBRATION_FILE_VERSION
+	uint32_t fftSize;
+	uint64_t centralFrequency;
+	uint64_t sampleRate;
+	uint64_t ffts;
+	float quantile;
+	uint32_t reserved;
+};
+
+/* the moments and the histograms of the slice of a thread */
+struct ThermalCalibration::Worker
+{
+	boost::thread thread;
+	FftAverage moments; ///< Welford's mean and variance, over all the FFTs
+	std::vector<uint32_t> histogram; ///< histogramBins steps per bin
+
+	static FftAverage::Config momentsConfig()
+	{
+		FftAverage::Config config;
+		config.mode = FftAverage::EXPONENTIAL;
+		config.average = (size_t)-1;
+		return config;
+	}
+
+	Worker(uint16_t fftSize, size_t histogramBins) :
+		moments(fftSize, 0, 0, momentsConfig()),
+		histogram(fftSize * histogramBins, 0)
+	{
+	}
+};
+
+ThermalCalibration::Config::Config() :
+	threads(0), batchCount(8), histogramMin(-180.0), histogramStep(0.5),
+	histogramBins(400), quantile(0.99)
+{
+}
+
+ThermalCalibration::Result::Result() :
+	fftSize(0), centralFrequency(0), sampleRate(0), ffts(0), quantile(0)
+{
+}
+
+ThermalCalibration::ThermalCalibration(const Config &config) : _config(config)
+{
+	if (_config.batchCount == 0)
+		_config.batchCount = 1;
+	if (_config.histogramBins == 0)
+		_config.histogramBins = 1;
+}
+
+void ThermalCalibration::transform(const Config &config, const FftWindow &win,
+				   const gr_complex *samples, size_t first,
+				   size_t count, Worker *worker)
+{
+	uint16_t fftSize = win.fftSize();
+	FftBatch batch(fftSize, config.batchCount);
+	std::vector<float, AlignedAllocator<float> > pwr(fftSize);
+	size_t steps = config.histogramBins;
+	float scale = 1.0 / config.histogramStep;
+
+	/* see Fft::computePower */
+	float offset = -20 * log10f(fftSize)
+		- 10 * log10f(win.windowPower()/fftSize)
+		+ 3;
+
+	for (size_t f = 0; f < count; f += batch.count()) {
+		size_t frames = std::min(batch.count(), count - f);
+
+		for (size_t k = 0; k < frames; k++)
+			SpectrumKernels::applyWindow(batch.inbuf() + k * fftSize,
+						     samples + (first + f + k) * fftSize,
+						     win.data(), fftSize);
+		batch.execute();
+
+		for (size_t k = 0; k < frames; k++) {
+			SpectrumKernels::powerDbShifted(pwr.data(), batch.outbuf() + k * fftSize,
+							fftSize, offset);
+			worker->moments.addFft(pwr.data(), 0);
+
+			uint32_t *histogram = worker->histogram.data();
+			for (size_t i = 0; i < fftSize; i++) {
+				float x = (pwr[i] - config.histogramMin) * scale;
+				size_t step = x > 0 ? (x < steps ? (size_t)x : steps - 1) : 0;
+				histogram[i * steps + step]++;
+			}
+		}
+	}
+}
+
+/* the power under which a fraction q of the powers are, interpolated in the step */
+static float histogramQuantile(const uint32_t *histogram, size_t steps,
+			       uint64_t total, float q, float min, float step)
+{
+	double target = q * total;
+	uint64_t below = 0;
+
+	for (size_t s = 0; s < steps; s++) {
+		if (histogram[s] > 0 && below + histogram[s] >= target)
+			return min + (s + (target - below) / histogram[s]) * step;
+		below += histogram[s];
+	}
+
+	return min + steps * step;
+}
+
+bool ThermalCalibration::run(const FftWindow &win, uint64_t centralFrequency,
+			     uint64_t sampleRate, const gr_complex *samples,
+			     size_t count, Result &result) const
+{
+	uint16_t fftSize = win.fftSize();
+	if (fftSize == 0 || count < fftSize)
+		return false;
+
+	size_t frames = count / fftSize;
+	size_t threads = _config.threads;
+	if (threads == 0)
+		threads = boost::thread::hardware_concurrency();
+	threads = std::max(std::min(threads, frames), (size_t)1);
+
+	/* a slice of consecutive frames per thread */
+	size_t steps = _config.histogramBins;
+	std::vector< boost::shared_ptr<Worker> > workers;
+	for (size_t w = 0; w < threads; w++) {
+		size_t first = frames * w / threads;
+		size_t end = frames * (w + 1) / threads;
+
+		workers.push_back(boost::make_shared<Worker>(fftSize, steps));
+		workers[w]->thread = boost::thread(&ThermalCalibration::transform,
+						   boost::cref(_config), boost::cref(win),
+						   samples, first, end - first,
+						   workers[w].get());
+	}
+	for (size_t w = 0; w < threads; w++)
+		workers[w]->thread.join();
+
+	/* merge the histograms in the first one */
+	uint32_t *histogram = workers[0]->histogram.data();
+	for (size_t w = 1; w < threads; w++) {
+		const uint32_t *other = workers[w]->histogram.data();
+		for (size_t i = 0; i < workers[w]->histogram.size(); i++)
+			histogram[i] += other[i];
+	}
+
+	result.fftSize = fftSize;
+	result.centralFrequency = centralFrequency;
+	result.sampleRate = sampleRate;
+	result.ffts = frames;
+	result.quantile = _config.quantile;
+	result.mean.resize(fftSize);
+	result.variance.resize(fftSize);
+	result.median.resize(fftSize);
+	result.highQuantile.resize(fftSize);
+
+	for (size_t i = 0; i < fftSize; i++) {
+		/* Chan's merge of the means and the sums of squared differences */
+		double n = 0, mean = 0, m2 = 0;
+		for (size_t w = 0; w < threads; w++) {
+			const FftAverage &moments = workers[w]->moments;
+			double nw = moments.currentAverageCount();
+			if (nw == 0)
+				continue;
+
+			double delta = moments.meanAt(i) - mean;
+			double total = n + nw;
+			mean += delta * nw / total;
+			m2 += moments.varianceAt(i) * nw + delta * delta * n * nw / total;
+			n = total;
+		}
+
+		result.mean[i] = mean;
+		result.variance[i] = m2 / n;
+		result.median[i] = histogramQuantile(histogram + i * steps, steps, frames, 0.5,
+						     _config.histogramMin, _config.histogramStep);
+		result.highQuantile[i] = histogramQuantile(histogram + i * steps, steps, frames,
+							   _config.quantile, _config.histogramMin,
+							   _config.histogramStep);
+	}
+
+	return true;
+}
+
+bool ThermalCalibration::runFile(const FftWindow &win, uint64_t centralFrequency,
+				 uint64_t sampleRate, const std::string &filepath,
+				 Result &result) const
+{
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		perror("ThermalCalibration: open");
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(gr_complex)) {
+		fprintf(stderr, "ThermalCalibration: '%s' holds no samples\n", filepath.c_str());
+		close(fd);
+		return false;
+	}
+
+	void *samples = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (samples == MAP_FAILED) {
+		perror("ThermalCalibration: mmap");
+		return false;
+	}
+
+	bool ret = run(win, centralFrequency, sampleRate, (const gr_complex *)samples,
+		       st.st_size / sizeof(gr_complex), result);
+
+	munmap(samples, st.st_size);
+
+	return ret;
+}
+
+bool ThermalCalibration::Result::save(const std::string &filepath) const
+{
+	std::string tmppath = filepath + ".tmp";
+	FILE *f = fopen(tmppath.c_str(), "wb");
+	if (!f) {
+		fprintf(stderr, "ThermalCalibration: cannot open '%s'\n", tmppath.c_str());
+		return false;
+	}
+
+	CalibrationFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CALIBRATION_FILE_MAGIC, sizeof(header.magic));
+	header.version = CALIBRATION_FILE_VERSION;
+	header.fftSize = fftSize;
+	header.centralFrequency = centralFrequency;
+	header.sampleRate = sampleRate;
+	header.ffts = ffts;
+	header.quantile = quantile;
+
+	const std::vector<float> *arrays[] = { &mean, &variance, &median, &highQuantile };
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for (size_t a = 0; a < 4 && ok; a++)
+		ok = arrays[a]->size() == fftSize &&
+		     fwrite(arrays[a]->data(), sizeof(float), fftSize, f) == fftSize;
+	ok = fclose(f) == 0 && ok;
+
+	if (!ok || rename(tmppath.c_str(), filepath.c_str()) < 0) {
+		fprintf(stderr, "ThermalCalibration: cannot write '%s'\n", filepath.c_str());
+		unlink(tmppath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool ThermalCalibration::Result::load(const std::string &filepath)
+{
+	FILE *f = fopen(filepath.c_str(), "rb");
+	if (!f) {
+		fprintf(stderr, "ThermalCalibration: cannot open '%s'\n", filepath.c_str());
+		return false;
+	}
+
+	CalibrationFileHeader header;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+		  memcmp(header.magic, CALIBRATION_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+		  header.version == CALIBRATION_FILE_VERSION &&
+		  header.fftSize > 0 && header.fftSize <= 0xFFFF;
+
+	/* left untouched unless the whole file is valid */
+	Result loaded;
+	std::vector<float> *arrays[] = { &loaded.mean, &loaded.variance,
+					 &loaded.median, &loaded.highQuantile };
+	for (size_t a = 0; a < 4 && ok; a++) {
+		arrays[a]->resize(header.fftSize);
+		ok = fread(arrays[a]->data(), sizeof(float), header.fftSize, f) == header.fftSize;
+	}
+	fclose(f);
+
+	if (!ok) {
+		fprintf(stderr, "ThermalCalibration: '%s' is not a valid calibration file\n",
+			filepath.c_str());
+		return false;
+	}
+
+	loaded.fftSize = header.fftSize;
+	loaded.centralFrequency = header.centralFrequency;
+	loaded.sampleRate = header.sampleRate;
+	loaded.ffts = header.ffts;
+	loaded.quantile = header.quantile;
+	*this = loaded;
+
+	return true;
+}
@@ -0,0 +1,147 @@
+/**
+ * \file      thermalcalibration.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef THERMALCALIBRATION_H
+#define THERMALCALIBRATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <gnuradio/gr_complex.h>
+
+#include "fftwindow.h"
+
+/**
+ * \class     ThermalCalibration
+ * \brief     Learns the thermal noise of every bin from recorded samples.
+ *
+ * \details   The samples, recorded with no transmission around, are split
+ *            in as many slices as there are threads. Every thread
+ *            transforms its slice, \a batchCount FFTs per FFTW call, and
+ *            reduces the powers of every bin into moments (Welford's mean
+ *            and variance) and a histogram of \a histogramBins steps of
+ *            \a histogramStep dB. The slices are then merged, the
+ *            moments using Chan's formula, and the median and the high
+ *            quantile of every bin are read from the histograms.
+ *
+ *            The #Result can be saved to a binary calibration file and
+ *            loaded back at startup, see ComsDetect::loadCalibration, so as
+ *            the detection does not need to warm up.
+ *
+ *            A histogram takes 4 * \a histogramBins bytes per bin and per
+ *            thread, 13 MB for 8192 bins by default.
+ *
+ *            **Thread-safety:** Not thread safe, #run starts and joins its
+ *            own threads.
+ */
+class ThermalCalibration
+{
+public:
+	/// The parameters of the calibration
+	struct Config
+	{
+		size_t threads; ///< The threads transforming the samples, 0 for one per core
+		size_t batchCount; ///< The FFTs computed per FFTW call
+		float histogramMin; ///< The lowest power of the histograms, in dBm
+		float histogramStep; ///< The width of a step of the histograms, in dB
+		size_t histogramBins; ///< The steps of the histograms
+		float quantile; ///< The probability of the high quantile
+
+		/// One thread per core, from -180 to +20 dBm by 0.5 dB, quantile 0.99
+		Config();
+	};
+
+	/// The noise of every bin, as stored in a calibration file
+	struct Result
+	{
+		uint16_t fftSize; ///< The number of bins
+		uint64_t centralFrequency; ///< The central frequency of the samples
+		uint64_t sampleRate; ///< The samples' sampling rate
+		uint64_t ffts; ///< The FFTs the noise was learnt from
+		float quantile; ///< The probability of #highQuantile
+
+		std::vector<float> mean; ///< The mean power of every bin, in dBm
+		std::vector<float> variance; ///< The variance of the power of every bin, in dB²
+		std::vector<float> median; ///< The median power of every bin, in dBm
+		std::vector<float> highQuantile; ///< The quantile #quantile of every bin, in dBm
+
+		Result();
+
+		/**
+		 * \brief    Write the result to a binary calibration file.
+		 *
+		 * \details  The file is written next to \a filepath then renamed,
+		 *           a reader never sees a partial file.
+		 *
+		 * \param    filepath   The path of the calibration file
+		 * \return   True on success, false otherwise.
+		 */
+		bool save(const std::string &filepath) const;
+
+		/**
+		 * \brief    Read a binary calibration file.
+		 *
+		 * \param    filepath   The path of the calibration file
+		 * \return   True on success, false if the file cannot be read or
+		 *           is not a calibration file of this version.
+		 */
+		bool load(const std::string &filepath);
+	};
+
+private:
+	struct Worker;
+
+	Config _config;
+
+	static void transform(const Config &config, const FftWindow &win,
+			      const gr_complex *samples, size_t first,
+			      size_t count, Worker *worker);
+
+public:
+	ThermalCalibration(const Config &config = Config());
+
+	const Config &config() const { return _config; }
+
+	/**
+	 * \brief    Learn the noise of the samples.
+	 *
+	 * \details  The samples are split in consecutive frames of
+	 *           win.fftSize() samples, without overlap.
+	 *
+	 * \param    win               The window to apply on the samples
+	 * \param    centralFrequency  The central frequency at which the samples were taken
+	 * \param    sampleRate        The samples' sampling rate
+	 * \param    samples           The recorded samples
+	 * \param    count             The number of samples
+	 * \param    result            Receives the noise of every bin
+	 * \return   False if there are fewer samples than a frame, true otherwise.
+	 */
+	bool run(const FftWindow &win, uint64_t centralFrequency,
+		 uint64_t sampleRate, const gr_complex *samples, size_t count,
+		 Result &result) const;
+
+	/**
+	 * \brief    Learn the noise of samples recorded in a file.
+	 *
+	 * \details  The file holds raw gr_complex samples, as written by a
+	 *           GNU Radio file sink. It is mapped in memory, not read.
+	 *
+	 * \param    win               The window to apply on the samples
+	 * \param    centralFrequency  The central frequency at which the samples were taken
+	 * \param    sampleRate        The samples' sampling rate
+	 * \param    filepath          The path of the samples
+	 * \param    result            Receives the noise of every bin
+	 * \return   True on success, false otherwise.
+	 */
+	bool runFile(const FftWindow &win, uint64_t centralFrequency,
+		     uint64_t sampleRate, const std::string &filepath,
+		     Result &result) const;
+};
+
+#endif // THERMALCALIBRATION_H
@@ -0,0 +1,289 @@
+#include "transmissionextractor.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+
+TransmissionExtractor::Config::Config() :
+	minWidthBins(4), maxGapBins(2), endOfTransmissionDelayNs(1000000)
+{
+}
+
+TransmissionExtractor::TransmissionExtractor(RadioEventTable &ret,
+					     const Config &config) :
+	_ret(ret), _config(config), _frame(0), _fftSize(0),
+	_centralFrequency(0), _sampleRate(0), _live(0)
+{
+	memset(&_stats, 0, sizeof(_stats));
+	if (_config.minWidthBins == 0)
+		_config.minWidthBins = 1;
+}
+
+void TransmissionExtractor::reset()
+{
+	for (size_t c = 0; c < _components.size(); c++)
+		_components[c].entry.reset();
+
+	_runs.clear();
+	_tracks.clear();
+	_components.clear();
+	_freeComponents.clear();
+	_released.clear();
+	_live = 0;
+}
+
+uint32_t TransmissionExtractor::newComponent(uint64_t timeNs)
+{
+	uint32_t c;
+
+	if (!_freeComponents.empty()) {
+		c = _freeComponents.back();
+		_freeComponents.pop_back();
+	} else {
+		c = _components.size();
+		_components.push_back(Component());
+	}
+
+	Component &comp = _components[c];
+	comp.parent = c;
+	comp.begin = std::numeric_limits<uint16_t>::max();
+	comp.end = 0;
+	comp.pwr = -std::numeric_limits<float>::infinity();
+	comp.timeStart = comp.timeEnd = timeNs;
+	comp.frame = 0;
+	comp.live = true;
+	comp.entry.reset();
+
+	_stats.transmissions++;
+	_live++;
+
+	return c;
+}
+
+uint32_t TransmissionExtractor::find(uint32_t c)
+{
+	/* path halving */
+	while (_components[c].parent != c) {
+		_components[c].parent = _components[_components[c].parent].parent;
+		c = _components[c].parent;
+	}
+	return c;
+}
+
+/* the oldest transmission absorbs the other one, and its entry */
+uint32_t TransmissionExtractor::unite(uint32_t a, uint32_t b)
+{
+	a = find(a);
+	b = find(b);
+	if (a == b)
+		return a;
+
+	if (_components[b].timeStart < _components[a].timeStart ||
+	    (_components[b].timeStart == _components[a].timeStart && b < a))
+		std::swap(a, b);
+
+	Component &into = _components[a];
+	Component &from = _components[b];
+	into.begin = std::min(into.begin, from.begin);
+	into.end = std::max(into.end, from.end);
+	into.pwr = std::max(into.pwr, from.pwr);
+	into.timeEnd = std::max(into.timeEnd, from.timeEnd);
+
+	if (into.entry && from.entry)
+		_ret.mergeTransmissions(into.entry.get(), from.entry.get());
+	else if (from.entry)
+		into.entry = from.entry;
+
+	from.parent = a;
+	from.live = false;
+	from.entry.reset();
+	_released.push_back(b);
+	_stats.merges++;
+	_live--;
+
+	return a;
+}
+
+void TransmissionExtractor::end(uint32_t c)
+{
+	/* the RadioEventTable ends the entry after the same delay */
+	_components[c].live = false;
+	_components[c].entry.reset();
+	_released.push_back(c);
+	_stats.ended++;
+	_live--;
+}
+
+void TransmissionExtractor::findRuns(const ComsDetect &detect)
+{
+	const uint32_t *active = detect.activeBins();
+	size_t first = detect.firstBin();
+	size_t n = detect.endBin() - first;
+	size_t maxGap = _config.maxGapBins;
+	size_t i = 0;
+
+	_runs.clear();
+	while (i < n) {
+		/* skip the inactive bins, 8 at a time */
+		while (i + 8 <= n && (active[i] | active[i + 1] | active[i + 2] |
+				      active[i + 3] | active[i + 4] | active[i + 5] |
+				      active[i + 6] | active[i + 7]) == 0)
+			i += 8;
+		while (i < n && !active[i])
+			i++;
+		if (i == n)
+			break;
+
+		/* extend the run as long as the gaps are small enough */
+		size_t begin = i, end = i;
+		float sum = 0;
+		size_t count = 0;
+		while (i < n && i - end <= maxGap) {
+			if (active[i]) {
+				sum += detect.avgPowerAtBin(first + i);
+				count++;
+				end = i + 1;
+			}
+			i++;
+		}
+		i = end;
+
+		if (end - begin < _config.minWidthBins)
+			continue;
+
+		Run run = { (uint16_t)(first + begin), (uint16_t)(first + end), NONE,
+			    sum / count };
+		_runs.push_back(run);
+	}
+
+	_stats.runs += _runs.size();
+}
+
+/* both the runs and the tracks are sorted and do not overlap */
+void TransmissionExtractor::matchRuns(uint64_t timeNs)
+{
+	size_t j = 0;
+
+	for (size_t r = 0; r < _runs.size(); r++) {
+		Run &run = _runs[r];
+		uint32_t c = NONE;
+
+		while (j < _tracks.size() && _tracks[j].end <= run.begin)
+			j++;
+
+		/* the last track may overlap the next run too, j stays */
+		for (size_t k = j; k < _tracks.size() && _tracks[k].begin < run.end; k++)
+			c = c == NONE ? find(_tracks[k].component) : unite(c, _tracks[k].component);
+
+		if (c == NONE)
+			c = newComponent(timeNs);
+		run.component = c;
+	}
+
+	/* a run may have been merged by a following one */
+	_seen.clear();
+	for (size_t r = 0; r < _runs.size(); r++) {
+		Run &run = _runs[r];
+		run.component = find(run.component);
+
+		Component &comp = _components[run.component];
+		comp.begin = std::min(comp.begin, run.begin);
+		comp.end = std::max(comp.end, run.end);
+		comp.pwr = std::max(comp.pwr, run.pwr);
+		comp.timeEnd = timeNs;
+		if (comp.frame != _frame) {
+			comp.frame = _frame;
+			_seen.push_back(run.component);
+		}
+	}
+}
+
+/* the next tracks are the runs, and the last runs of the transmissions
+ * not seen in this frame. Those do not overlap the runs, or they would
+ * have been seen.
+ */
+void TransmissionExtractor::updateTracks(uint64_t timeNs)
+{
+	size_t r = 0;
+
+	_nextTracks.clear();
+	for (size_t t = 0; t < _tracks.size(); t++) {
+		Run track = _tracks[t];
+		track.component = find(track.component);
+
+		Component &comp = _components[track.component];
+		if (!comp.live || comp.frame == _frame)
+			continue;
+		if (timeNs - comp.timeEnd > _config.endOfTransmissionDelayNs) {
+			end(track.component);
+			continue;
+		}
+
+		while (r < _runs.size() && _runs[r].begin < track.begin)
+			_nextTracks.push_back(_runs[r++]);
+		_nextTracks.push_back(track);
+	}
+	while (r < _runs.size())
+		_nextTracks.push_back(_runs[r++]);
+
+	_tracks.swap(_nextTracks);
+}
+
+static uint64_t freqAtBin(uint64_t centralFrequency, uint64_t sampleRate,
+			  uint16_t fftSize, uint16_t i)
+{
+	return centralFrequency - (sampleRate / 2) + i * sampleRate / fftSize;
+}
+
+void TransmissionExtractor::feedRet(uint64_t centralFrequency,
+				    uint64_t sampleRate, uint16_t fftSize)
+{
+	for (size_t s = 0; s < _seen.size(); s++) {
+		Component &comp = _components[_seen[s]];
+
+		/* in kHz, as the former detection code */
+		uint64_t start = freqAtBin(centralFrequency, sampleRate, fftSize, comp.begin) / 1000;
+		uint64_t end = freqAtBin(centralFrequency, sampleRate, fftSize, comp.end - 1) / 1000;
+		float pwr = std::min(std::max(roundf(comp.pwr), -128.0f), 127.0f);
+
+		if (!comp.entry)
+			comp.entry = _ret.addTransmission(start, end, (int8_t)pwr);
+		else
+			_ret.updateTransmission(comp.entry.get(), start, end, (int8_t)pwr);
+	}
+}
+
+void TransmissionExtractor::addFrame(const ComsDetect &detect, uint64_t timeNs,
+				     uint64_t centralFrequency, uint64_t sampleRate)
+{
+	/* the tracks are meaningless with another FFT size or tuning */
+	if (detect.fftSize() != _fftSize || centralFrequency != _centralFrequency ||
+	    sampleRate != _sampleRate) {
+		reset();
+		_fftSize = detect.fftSize();
+		_centralFrequency = centralFrequency;
+		_sampleRate = sampleRate;
+	}
+
+	_frame++;
+	_stats.frames++;
+
+	_ret.startAddingCommunications(timeNs);
+
+	findRuns(detect);
+	matchRuns(timeNs);
+	updateTracks(timeNs);
+	feedRet(centralFrequency, sampleRate, detect.fftSize());
+
+	_ret.stopAddingCommunications();
+
+	/* nothing refers to the merged and ended transmissions anymore */
+	_freeComponents.insert(_freeComponents.end(), _released.begin(), _released.end());
+	_released.clear();
+}
+
+void TransmissionExtractor::addFrame(const ComsDetect &detect, const Fft &fft)
+{
+	addFrame(detect, fft.time_ns(), fft.centralFrequency(), fft.sampleRate());
+}
@@ -0,0 +1,154 @@
+/**
+ * \file      transmissionextractor.h
+ * \author    MuPuF (Martin Peres <martin.peres@labri.fr>)
+ * \version   1.0
+ * \date      18 Octobre 2026
+ */
+
+#ifndef TRANSMISSIONEXTRACTOR_H
+#define TRANSMISSIONEXTRACTOR_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "comsdetect.h"
+#include "radioeventtable.h"
+
+/**
+ * \class     TransmissionExtractor
+ * \brief     Groups the active bins of ComsDetect into transmissions and
+ *            feeds them to a RadioEventTable.
+ *
+ * \details   Every frame, the active bins are cut in runs of consecutive
+ *            bins, allowing gaps of \a maxGapBins inactive bins. The runs
+ *            narrower than \a minWidthBins are ignored.
+ *
+ *            A transmission is a connected component of the time-frequency
+ *            plane: a run belongs to the transmissions whose last runs it
+ *            overlaps in frequency, the transmissions it connects are
+ *            merged (union-find). A transmission not seen for more than
+ *            \a endOfTransmissionDelayNs ends.
+ *
+ *            The runs and the last runs of the ongoing transmissions are
+ *            sorted by frequency, a frame costs O(active bins + ongoing
+ *            transmissions) on top of the scan of the activity mask.
+ *
+ *            Every transmission owns a RetEntry, created, updated, merged
+ *            and ended through the RadioEventTable's API, which ends its
+ *            entries after the same delay.
+ *
+ *            **Thread-safety:** Not thread safe, to be used by the thread
+ *            running the ComsDetect.
+ */
+class TransmissionExtractor
+{
+public:
+	/// The parameters of the extraction
+	struct Config
+	{
+		uint16_t minWidthBins; ///< The narrowest run, in bins
+		uint16_t maxGapBins; ///< The widest gap inside a run, in bins
+		uint64_t endOfTransmissionDelayNs; ///< The silence ending a transmission
+
+		/// The parameters of the former detection code, 4 bins and 2 bins
+		Config();
+	};
+
+	/// Counters since the creation of the extractor
+	struct Statistics
+	{
+		uint64_t frames; ///< The frames added
+		uint64_t runs; ///< The runs found
+		uint64_t transmissions; ///< The transmissions started
+		uint64_t merges; ///< The transmissions merged into another one
+		uint64_t ended; ///< The transmissions ended
+	};
+
+private:
+	static const uint32_t NONE = ~0U;
+
+	/* consecutive active bins of a frame, [begin, end) */
+	struct Run
+	{
+		uint16_t begin;
+		uint16_t end;
+		uint32_t component;
+		float pwr;
+	};
+
+	struct Component
+	{
+		uint32_t parent; ///< Union-find, itself for a root
+		uint16_t begin; ///< The lowest bin ever covered
+		uint16_t end; ///< The bin above the highest bin ever covered
+		float pwr; ///< The highest power of a run, in dB
+		uint64_t timeStart;
+		uint64_t timeEnd; ///< The last frame it has been seen in
+		uint64_t frame; ///< The last frame it has been updated in
+		bool live;
+		std::shared_ptr<RetEntry> entry;
+	};
+
+	RadioEventTable &_ret;
+	Config _config;
+	Statistics _stats;
+	uint64_t _frame;
+	uint16_t _fftSize; ///< The size of the frames the tracks come from
+	uint64_t _centralFrequency; ///< The tuning of the frames the tracks come from
+	uint64_t _sampleRate;
+	size_t _live; ///< The number of ongoing transmissions
+
+	std::vector<Run> _runs; ///< The runs of the current frame
+	std::vector<Run> _tracks; ///< The last runs of the ongoing transmissions
+	std::vector<Run> _nextTracks;
+	std::vector<Component> _components;
+	std::vector<uint32_t> _freeComponents;
+	std::vector<uint32_t> _released; ///< Freed at the end of the frame
+	std::vector<uint32_t> _seen; ///< The roots seen in the current frame
+
+	void findRuns(const ComsDetect &detect);
+	void matchRuns(uint64_t timeNs);
+	void updateTracks(uint64_t timeNs);
+	void feedRet(uint64_t centralFrequency, uint64_t sampleRate,
+		     uint16_t fftSize);
+
+	uint32_t newComponent(uint64_t timeNs);
+	uint32_t find(uint32_t c);
+	uint32_t unite(uint32_t a, uint32_t b);
+	void end(uint32_t c);
+
+public:
+	TransmissionExtractor(RadioEventTable &ret, const Config &config = Config());
+
+	/**
+	 * \brief    Extract the transmissions of a frame, once added to \a detect.
+	 *
+	 * \details  The ongoing transmissions end when the FFT size, the
+	 *           central frequency or the sample rate differs from the
+	 *           previous frame's: their bins do not cover the same
+	 *           frequencies anymore.
+	 *
+	 * \param    detect             The detection, after its addFFT()
+	 * \param    timeNs             The time of the frame
+	 * \param    centralFrequency   The central frequency of the frame, in Hz
+	 * \param    sampleRate         The sample rate of the frame
+	 * \return   Nothing.
+	 */
+	void addFrame(const ComsDetect &detect, uint64_t timeNs,
+		      uint64_t centralFrequency, uint64_t sampleRate);
+
+	/// Extract the transmissions of \a fft, once added to \a detect
+	void addFrame(const ComsDetect &detect, const Fft &fft);
+
+	/// Forget the ongoing transmissions, their entries end normally
+	void reset();
+
+	const Config &config() const { return _config; }
+	const Statistics &statistics() const { return _stats; }
+
+	/// The number of transmissions being tracked
+	size_t ongoingTransmissions() const { return _live; }
+};
+
+#endif // TRANSMISSIONEXTRACTOR_H
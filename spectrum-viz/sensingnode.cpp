@@ -9,16 +9,31 @@
 
 #include "../common/message_utils.h"
 
+/* the finished communications kept for the views, 64 MB */
+#define RET_HISTORY_SIZE 1000000
+
+/* the spectra wanted: up to 2048 bins, the max-hold of 10 FFTs */
+#define SPECTRUM_MAX_BINS 2048
+#define SPECTRUM_FRAMES 10
+#define SPECTRUM_MAX_HOLD 1
+
 SensingNode::SensingNode(QTcpSocket *socket, int clientID, QObject *parent) :
 	QObject(parent), clientSocket(socket), clientID(clientID),
-	_ringbuffer(1000), _ret(10000), pwr_min(125), pwr_max(-125)
+	_ringbuffer(1000), _ret(RET_HISTORY_SIZE), pwr_min(125), pwr_max(-125)
 {
 	connect(clientSocket, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
 	connect(clientSocket, SIGNAL(disconnected()), clientSocket, SLOT(deleteLater()));
 	connect(clientSocket, SIGNAL(readyRead()), this, SLOT(dataReady()));
 
-	const char buffer[] = { 0x1, 0x0 };
-	clientSocket->write(buffer, sizeof(buffer));
+	char buffer[8];
+	size_t offset = 0;
+	write_and_update_offset(offset, buffer, (char)0x1);
+	write_and_update_offset(offset, buffer, (char)0x3);
+	write_and_update_offset(offset, buffer, (uint16_t)SPECTRUM_MAX_BINS);
+	write_and_update_offset(offset, buffer, (uint16_t)SPECTRUM_FRAMES);
+	write_and_update_offset(offset, buffer, (uint8_t)SPECTRUM_MAX_HOLD);
+	write_and_update_offset(offset, buffer, (char)0x0);
+	clientSocket->write(buffer, offset);
 	clientSocket->flush();
 }
 
@@ -86,9 +101,7 @@ int SensingNode::fetchCommunications(qreal timeStart, qreal timeEnd)
 	QMutexLocker locker(&_renderingMutex);
 	freeCommunications();
 
-	_coms = _ret.fetchEntries(timeStart, timeEnd);
-
-	return _coms.size();
+	return _ret.fetchEntries(timeStart, timeEnd, _coms);
 }
 
 QMap<QString, QVariant> SensingNode::selectCommunication(qreal pos)
@@ -96,7 +109,7 @@ QMap<QString, QVariant> SensingNode::selectCommunication(qreal pos)
 	QMap<QString, QVariant> map;
 
 	if (pos >= 0 && pos < _coms.size()) {
-		RetEntry *entry = _coms[pos].get();
+		const RetEntry *entry = &_coms[pos];
 		map["id"] = (float) entry->id();
 		map["timeStart"] = (double) entry->timeStart();
 		map["timeEnd"] = (double) entry->timeEnd();
@@ -161,6 +174,14 @@ void SensingNode::readRETMessage(const QByteArray &retMsg)
 	_ret.updateFromString(retMsg.data(), retMsg.length());
 }
 
+void SensingNode::readRETUpdateMessage(const QByteArray &updateMsg)
+{
+	QMutexLocker locker(&_renderingMutex);
+
+	/* a missed update is recovered by the next keyframe */
+	_ret.applyUpdate(updateMsg.data(), updateMsg.length());
+}
+
 void SensingNode::dataReady()
 {
 	while (clientSocket->bytesAvailable() > 5)
@@ -186,6 +207,9 @@ void SensingNode::dataReady()
 		case 0x2:
 			readRETMessage(msg);
 			break;
+		case 0x3:
+			readRETUpdateMessage(msg);
+			break;
 		default:
 			qDebug() << "SensingNode: Invalid message type";
 			break;
@@ -28,7 +28,7 @@ private:
 	/* qml's view */
 	std::vector< std::shared_ptr<PowerSpectrum> > _entries;
 	uint64_t _entries_start, _entries_end;
-	std::vector< std::shared_ptr<RetEntry> > _coms;
+	std::vector<RetEntry> _coms;
 
 	QAtomicInt updatesPaused;
 
@@ -39,6 +39,7 @@ private:
 	QByteArray readExactlyNBytes(QTcpSocket *socket, qint64 n);
 	void readPowerSpectrumMessage(const QByteArray &psMsg);
 	void readRETMessage(const QByteArray &retMsg);
+	void readRETUpdateMessage(const QByteArray &updateMsg);
 public:
 	explicit SensingNode(QTcpSocket *socket, int clientID, QObject *parent = 0);
 
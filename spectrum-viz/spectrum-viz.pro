@@ -22,6 +22,7 @@ SOURCES += main.cpp \
     sensingserver.cpp \
     powerspectrum.cpp \
     ../common/radioeventtable.cpp \
+    ../common/rethistory.cpp \
     ../common/ret_entry.cpp
 
 # Please do not modify the following two lines. Required for deployment.
@@ -34,4 +35,5 @@ HEADERS += \
     powerspectrum.h \
     ../common/absoluteringbuffer.h \
     ../common/radioeventtable.h \
+    ../common/rethistory.h \
     ../common/ret_entry.h